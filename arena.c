@@ -0,0 +1,254 @@
+/**
+ * @file arena.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Expression node arenas.
+ *
+ * An arena is a chain of node blocks. Nodes are taken from the current block in
+ * order, and a new block is chained on when the last one is full. Resetting goes
+ * back to the first block, and later blocks are reused as they are reached again.
+ */
+#include <stdlib.h> // malloc(), free()
+#include "errors.h"
+#include "expression.h"
+#include "arena.h"
+
+/// A block of nodes
+struct arena_block {
+	struct arena_block *next;    ///< Next block in the chain or NULL
+	size_t              size;    ///< Number of nodes in the block
+	struct expression   nodes[]; ///< The nodes
+};
+
+struct exp_arena {
+	struct arena_block *first;       ///< First block
+	struct arena_block *current;     ///< Block nodes are being taken from
+	size_t              used;        ///< Nodes taken from the current block
+	size_t              block_nodes; ///< Nodes in each new block
+	size_t              nodes;       ///< Nodes handed out since made or reset
+	size_t              blocks;      ///< Number of blocks in the chain
+};
+
+/* Add a block to the end of the chain */
+static struct arena_block *
+arena_block_new (struct exp_arena *arena) {
+	struct arena_block *block;
+
+	block = (struct arena_block *) malloc(sizeof(struct arena_block)
+	                                      + (arena->block_nodes * sizeof(struct expression)));
+	assert(block); // throw error - arena_block_new: malloc could not do allocation
+	block->next = NULL;
+	block->size = arena->block_nodes;
+	if (arena->current) {
+		arena->current->next = block;
+	} else {
+		arena->first = block;
+	}
+	arena->blocks++;
+	return block;
+}
+
+/** New empty arena.
+ * No blocks are allocated until the first node is taken.
+ * @param block_nodes Nodes in each block, or 0 for @ref EXP_ARENA_BLOCK_NODES
+ * @return The new arena. Free with @ref exp_arena_free.
+ */
+struct exp_arena *
+exp_arena_new (size_t block_nodes) {
+	struct exp_arena *arena = (struct exp_arena *) malloc(sizeof(struct exp_arena));
+	assert(arena); // throw error - exp_arena_new: malloc could not do allocation
+
+	arena->first       = NULL;
+	arena->current     = NULL;
+	arena->used        = 0;
+	arena->block_nodes = block_nodes ? block_nodes : EXP_ARENA_BLOCK_NODES;
+	arena->nodes       = 0;
+	arena->blocks      = 0;
+	return arena;
+}
+
+/** Free an arena and every node taken from it.
+ * Only the blocks are freed, the nodes are never visited.
+ * @param arena The arena to free
+ */
+void
+exp_arena_free (struct exp_arena *arena) {
+	struct arena_block *block, *next;
+
+	assert(arena);
+	for (block = arena->first; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
+
+/** Empty an arena, keeping its blocks.
+ * Every node taken from the arena is gone afterwards, and new nodes reuse the memory.
+ * @param arena The arena to empty
+ */
+void
+exp_arena_reset (struct exp_arena *arena) {
+	assert(arena);
+	arena->current = arena->first;
+	arena->used    = 0;
+	arena->nodes   = 0;
+}
+
+/** New blank node in an arena.
+ * The node is marked with @ref EXP_ARENA_REFS, so it is left alone by @ref expression_free.
+ * @param arena The arena to take the node from
+ * @return The node, which lives until the arena is reset or freed
+ */
+expression_t
+exp_arena_node (struct exp_arena *arena) {
+	expression_t exp;
+
+	assert(arena);
+	if (!arena->current || (arena->used == arena->current->size)) {
+		// move on to a block kept by a reset, or chain on a new one
+		arena->current = (arena->current && arena->current->next) ? arena->current->next
+		                                                          : arena_block_new(arena);
+		arena->used = 0;
+	}
+	exp = &arena->current->nodes[arena->used++];
+	exp->refs = EXP_ARENA_REFS;
+	arena->nodes++;
+	return exp;
+}
+
+/** Report the nodes and memory an arena holds.
+ * @param arena The arena
+ * @param[out] stats Filled in with the arena's usage
+ */
+void
+exp_arena_stats (struct exp_arena const *arena,
+                 struct exp_arena_stats *stats) {
+	struct arena_block const *block;
+
+	assert(arena);
+	assert(stats);
+	stats->nodes    = arena->nodes;
+	stats->capacity = 0;
+	stats->blocks   = arena->blocks;
+	stats->bytes    = sizeof(struct exp_arena);
+	for (block = arena->first; block; block = block->next) {
+		stats->capacity += block->size;
+		stats->bytes    += sizeof(struct arena_block) + (block->size * sizeof(struct expression));
+	}
+}
+
+#ifdef ARENA_TEST_MAIN
+/*
+ * Checks that arena expressions evaluate like malloced ones, and that a reset
+ * arena reuses its blocks instead of growing.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DARENA_TEST_MAIN -o arena arena.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c funcs.c -lm
+ */
+#include <stdio.h>
+#include <string.h> // strlen()
+
+/// Expressions built in each round
+static char const *const test_strs[] = {
+	"1+2*3",
+	"(4-1)*(2+5)/3",
+	"7/2.0 + 1",
+	"3 < 4 ? 10 : 20",
+	"1+2+3+4+5+6+7+8+9+10",
+};
+#define TEST_STR_COUNT (sizeof(test_strs) / sizeof(test_strs[0]))
+
+/// Rounds of building and resetting
+#define TEST_ROUNDS 20
+
+/// Nodes per block, small so the expressions need several
+#define TEST_BLOCK_NODES 8
+
+int
+main (void) {
+	struct exp_arena *arena = exp_arena_new(TEST_BLOCK_NODES);
+	struct exp_arena_stats stats, first;
+	struct exp_error err;
+	expression_t exp, heap, first_node = NULL;
+	value_t want, result;
+	size_t i, nodes = 0;
+	int round, bad = 0, cases = 0;
+
+	exp_arena_stats(arena, &stats);
+	cases++;
+	if ((stats.nodes != 0) || (stats.blocks != 0)) {
+		printf("FAIL new: %lu nodes in %lu blocks\n", (unsigned long) stats.nodes, (unsigned long) stats.blocks);
+		bad++;
+	}
+
+	for (round = 0; round < TEST_ROUNDS; round++) {
+		for (i = 0; i < TEST_STR_COUNT; i++) {
+			string_to_expression_arena_r(strlen(test_strs[i]), test_strs[i], arena, &exp, &err);
+			string_to_expression_r(strlen(test_strs[i]), (char *) test_strs[i], &heap, &err);
+			if (i == 0) {
+				// the first node of every round is in the same place
+				if (round == 0) first_node = exp;
+				cases++;
+				if (exp != first_node) {
+					printf("FAIL round %d: memory was not reused\n", round);
+					bad++;
+				}
+			}
+
+			/* Same value as malloced, and freeing or referencing does nothing */
+			want = expression_evaluate(heap);
+			expression_ref(exp);
+			expression_free(exp);
+			result = expression_evaluate(exp);
+			cases++;
+			if (!value_equal(result, want) || (exp->refs != EXP_ARENA_REFS)) {
+				printf("FAIL round %d, \"%s\": arena value differs or refs changed\n", round, test_strs[i]);
+				bad++;
+			}
+
+			/* A malloced tree may hold an arena node */
+			heap = expression_new_tree('+', heap, exp);
+			result = expression_evaluate(heap);
+			expression_free(heap);
+			expression_operate_r('+', want, want, &want, NULL);
+			cases++;
+			if (!value_equal(result, want)) {
+				printf("FAIL round %d, \"%s\": mixed tree\n", round, test_strs[i]);
+				bad++;
+			}
+		}
+
+		exp_arena_stats(arena, &stats);
+		if (round == 0) {
+			first = stats;
+			nodes = stats.nodes;
+		}
+		cases++;
+		if ((stats.nodes != nodes) || (stats.blocks != first.blocks) || (stats.bytes != first.bytes)
+		    || (stats.capacity < stats.nodes) || (stats.blocks < 2)) {
+			printf("FAIL round %d: %lu nodes in %lu blocks, %lu bytes, want %lu nodes in %lu blocks, %lu bytes\n", round,
+			       (unsigned long) stats.nodes, (unsigned long) stats.blocks, (unsigned long) stats.bytes,
+			       (unsigned long) nodes, (unsigned long) first.blocks, (unsigned long) first.bytes);
+			bad++;
+		}
+
+		exp_arena_reset(arena);
+		exp_arena_stats(arena, &stats);
+		cases++;
+		if ((stats.nodes != 0) || (stats.blocks != first.blocks) || (stats.capacity != first.capacity)) {
+			printf("FAIL round %d reset: %lu nodes in %lu blocks kept\n", round, (unsigned long) stats.nodes, (unsigned long) stats.blocks);
+			bad++;
+		}
+	}
+	exp_arena_free(arena);
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef ARENA_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,66 @@
+/**
+ * @file arena.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Arenas hand out expression nodes from large blocks, one after another,
+ * so an expression built in an arena sits in a few contiguous runs of memory.
+ *
+ * Nodes are never freed one at a time. The whole arena is released at once with
+ * @ref exp_arena_free, or emptied with @ref exp_arena_reset, which keeps its blocks
+ * to build the next expressions in, such as the scratch of each request.
+ *
+ * Any of the expression_new_*_in constructors, and @ref string_to_expression_arena_r,
+ * can build in an arena. Giving an arena node to @ref expression_free or
+ * @ref expression_ref does nothing, so arena nodes can be children of malloced nodes.
+ * @warning A malloced node that is only owned by arena nodes is not freed with the arena.
+ *
+ * An arena node's refs is always @ref EXP_ARENA_REFS, so code that asks whether a node
+ * has other owners must test for it rather than for refs > 1. Arena nodes are taken to
+ * hang from a single parent: @ref expression_simplify rewrites them in place, and
+ * @ref expression_evaluate_dag does not memoize them. Do not share an arena node between
+ * parents if the expression is to be rewritten.
+ */
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h> /* size_t */
+#include "expression_lite.h" // just need pointer expression_t
+
+/// Nodes in each block when an arena is made with a block size of 0
+#define EXP_ARENA_BLOCK_NODES 1024
+
+/// Reference count of arena nodes. They have no owners of their own, and count as having one parent.
+#define EXP_ARENA_REFS (~0U)
+
+/// Node usage of an arena
+struct exp_arena_stats {
+	size_t nodes;    ///< Nodes handed out since the arena was made or reset
+	size_t capacity; ///< Nodes that fit in the blocks held
+	size_t blocks;   ///< Number of blocks held
+	size_t bytes;    ///< Bytes held, including the arena itself
+};
+
+/// A node arena. Its fields are private to arena.c.
+struct exp_arena;
+
+struct exp_arena *
+exp_arena_new (size_t block_nodes);
+
+void
+exp_arena_free (struct exp_arena *arena);
+
+void
+exp_arena_reset (struct exp_arena *arena);
+
+expression_t
+exp_arena_node (struct exp_arena *arena);
+
+void
+exp_arena_stats (struct exp_arena const *arena,
+                 struct exp_arena_stats *stats);
+
+#endif /* _ARENA_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
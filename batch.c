@@ -0,0 +1,558 @@
+/**
+ * @file batch.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Evaluates one expression over many rows of variable values.
+ *
+ * The expression is compiled to bytecode, then each instruction is run over a
+ * block of @ref BATCH_BLOCK rows before moving to the next one. Stack entries are
+ * whole blocks, so the per-row cost of an operation is a few vector instructions.
+ * Variable loads point straight into the caller's columns instead of copying.
+ *
+ * Add, subtract and multiply have SSE2 and AVX2 kernels, picked at run time.
+ * Neither has a 64 bit multiply, so it is built from 32 bit partial products.
+ * Division has no vector form and always uses the scalar kernel.
+ * Comparisons have AVX2 kernels only, as SSE2 has no 64 bit compare.
+ * Define BATCH_FORCE_SCALAR to always use the scalar kernel.
+ *
+ * A select masks its two arms' blocks together, so no row ever takes a branch
+ * of its own, however its condition falls.
+ *
+ * Faults are kept like @ref bytecode_run keeps them, but for a block at a time.
+ * A stack entry has no fault block until one of its rows faults, so a block
+ * without faults costs only the divisor check of each division.
+ */
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memcpy(), memset()
+#include "errors.h"
+#include "types.h"
+#include "bytecode.h"
+#include "batch.h"
+
+/* The vector kernels treat sys_int_long as 64 bit lanes */
+#if !defined(BATCH_FORCE_SCALAR) && defined(__x86_64__) && defined(__LP64__)
+	#define BATCH_HAVE_SSE2
+	#include <emmintrin.h>
+	#if defined(__GNUC__)
+		#define BATCH_HAVE_AVX2
+		#include <immintrin.h>
+	#endif
+#endif
+
+/** Run a binary operation over n rows.
+ * dst[i] = a[i] op b[i], or a[i] op k when b is NULL.
+ * dst may be the same array as a or b.
+ */
+typedef void (*batch_op_fn)(enum bc_opcode op, size_t n, sys_int_long *dst, sys_int_long const *a, sys_int_long const *b, sys_int_long k);
+
+static void
+batch_op_scalar (enum bc_opcode op, size_t n, sys_int_long *dst, sys_int_long const *a, sys_int_long const *b, sys_int_long k) {
+	size_t i;
+	switch (op) {
+	case BC_ADD:
+		if (b) for (i = 0; i < n; i++) dst[i] = a[i] + b[i];
+		else   for (i = 0; i < n; i++) dst[i] = a[i] + k;
+		break;
+	case BC_SUB:
+		if (b) for (i = 0; i < n; i++) dst[i] = a[i] - b[i];
+		else   for (i = 0; i < n; i++) dst[i] = a[i] - k;
+		break;
+	case BC_MUL:
+		if (b) for (i = 0; i < n; i++) dst[i] = a[i] * b[i];
+		else   for (i = 0; i < n; i++) dst[i] = a[i] * k;
+		break;
+	case BC_DIV:
+		// rows that fault are found by batch_faults, and only must not trap here
+		if (b) for (i = 0; i < n; i++) dst[i] = SYS_INT_LONG_DIV(a[i], b[i]);
+		else   for (i = 0; i < n; i++) dst[i] = a[i] / k; // k is never 0 or -1
+		break;
+	/* Comparisons and logical operations have no _K forms */
+	case BC_LT: for (i = 0; i < n; i++) dst[i] = a[i] <  b[i]; break;
+	case BC_GT: for (i = 0; i < n; i++) dst[i] = a[i] >  b[i]; break;
+	case BC_LE: for (i = 0; i < n; i++) dst[i] = a[i] <= b[i]; break;
+	case BC_GE: for (i = 0; i < n; i++) dst[i] = a[i] >= b[i]; break;
+	case BC_EQ: for (i = 0; i < n; i++) dst[i] = a[i] == b[i]; break;
+	case BC_NE: for (i = 0; i < n; i++) dst[i] = a[i] != b[i]; break;
+	case BC_AND: for (i = 0; i < n; i++) dst[i] = (a[i] != 0) & (b[i] != 0); break;
+	case BC_OR:  for (i = 0; i < n; i++) dst[i] = (a[i] != 0) | (b[i] != 0); break;
+	default:
+		assert(0); // throw error - batch_op_scalar: not a binary operation
+	}
+}
+
+/** Run a select over n rows.
+ * dst[i] = c[i] ? t[i] : e[i], built from a mask so the compiler has no branch to make.
+ * dst may be the same array as c, t or e.
+ */
+static void
+batch_select (size_t n, sys_int_long *dst, sys_int_long const *c, sys_int_long const *t, sys_int_long const *e) {
+	size_t i;
+	for (i = 0; i < n; i++) {
+		sys_int_long mask = -(sys_int_long) (c[i] != 0);
+		dst[i] = (t[i] & mask) | (e[i] & ~mask);
+	}
+}
+
+/** Find the faults of a binary operation's rows, before it runs.
+ * A row keeps a fault of its left operand, then of its right, then gets the
+ * operation's own. && and || drop a fault on their right in rows their left decides.
+ * @param f Where to write the faults. May be the same array as lf.
+ * @param lf Faults of the left operand, or NULL if it has none
+ * @param rf Faults of the right operand, or NULL if it has none
+ * @return f, or NULL if no row faults
+ */
+static unsigned char *
+batch_faults (enum bc_opcode op, size_t n, unsigned char *f, sys_int_long const *a, sys_int_long const *b,
+              unsigned char const *lf, unsigned char const *rf) {
+	unsigned char any = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		unsigned char fault = lf ? lf[i] : 0;
+		if (!fault && rf && ((op != BC_AND) || (a[i] != 0)) && ((op != BC_OR) || (a[i] == 0))) fault = rf[i];
+		if (!fault && (op == BC_DIV)) fault = BC_DIV_FAULT(a[i], b[i]);
+		f[i] = fault;
+		any |= fault;
+	}
+	return any ? f : NULL;
+}
+
+/** Find the faults of a select's rows, before it runs.
+ * A row keeps a fault of its condition, or else of the arm it takes.
+ * @param f Where to write the faults. May be the same array as cf.
+ * @return f, or NULL if no row faults
+ */
+static unsigned char *
+batch_select_faults (size_t n, unsigned char *f, sys_int_long const *c,
+                     unsigned char const *cf, unsigned char const *tf, unsigned char const *ef) {
+	unsigned char any = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		unsigned char fault = cf ? cf[i] : 0;
+		if (!fault) fault = c[i] ? (tf ? tf[i] : 0) : (ef ? ef[i] : 0);
+		f[i] = fault;
+		any |= fault;
+	}
+	return any ? f : NULL;
+}
+
+/* Run OPFN over whole vectors of rows, leaving i at the first row not done */
+#define BATCH_VECTOR_LOOP(T, LANES, LOAD, STORE, SET1, OPFN) \
+	do { \
+		if (b) { \
+			for (; i + (LANES) <= n; i += (LANES)) \
+				STORE((T *) (dst + i), OPFN(LOAD((T const *) (a + i)), LOAD((T const *) (b + i)))); \
+		} else { \
+			T kv = SET1(k); \
+			for (; i + (LANES) <= n; i += (LANES)) \
+				STORE((T *) (dst + i), OPFN(LOAD((T const *) (a + i)), kv)); \
+		} \
+	} while (0)
+
+#ifdef BATCH_HAVE_SSE2
+/* Low 64 bits of x * y: lo*lo + ((hi*lo + lo*hi) << 32) */
+static __m128i
+sse2_mul_epi64 (__m128i x, __m128i y) {
+	__m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(x, 32), y),
+	                              _mm_mul_epu32(x, _mm_srli_epi64(y, 32)));
+	return _mm_add_epi64(_mm_mul_epu32(x, y), _mm_slli_epi64(cross, 32));
+}
+
+static void
+batch_op_sse2 (enum bc_opcode op, size_t n, sys_int_long *dst, sys_int_long const *a, sys_int_long const *b, sys_int_long k) {
+	size_t i = 0;
+	switch (op) {
+	case BC_ADD: BATCH_VECTOR_LOOP(__m128i, 2, _mm_loadu_si128, _mm_storeu_si128, _mm_set1_epi64x, _mm_add_epi64); break;
+	case BC_SUB: BATCH_VECTOR_LOOP(__m128i, 2, _mm_loadu_si128, _mm_storeu_si128, _mm_set1_epi64x, _mm_sub_epi64); break;
+	case BC_MUL: BATCH_VECTOR_LOOP(__m128i, 2, _mm_loadu_si128, _mm_storeu_si128, _mm_set1_epi64x, sse2_mul_epi64); break;
+	default: break; // no vector form
+	}
+	batch_op_scalar(op, n - i, dst + i, a + i, b ? b + i : NULL, k);
+}
+#endif /* BATCH_HAVE_SSE2 */
+
+#ifdef BATCH_HAVE_AVX2
+/* Low 64 bits of x * y: lo*lo + ((hi*lo + lo*hi) << 32) */
+__attribute__((target("avx2")))
+static __m256i
+avx2_mul_epi64 (__m256i x, __m256i y) {
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), y),
+	                                 _mm256_mul_epu32(x, _mm256_srli_epi64(y, 32)));
+	return _mm256_add_epi64(_mm256_mul_epu32(x, y), _mm256_slli_epi64(cross, 32));
+}
+
+/* The compares give all ones lanes for true, which the shift makes 1 */
+__attribute__((target("avx2")))
+static __m256i
+avx2_lt_epi64 (__m256i x, __m256i y) {
+	return _mm256_srli_epi64(_mm256_cmpgt_epi64(y, x), 63);
+}
+
+__attribute__((target("avx2")))
+static __m256i
+avx2_gt_epi64 (__m256i x, __m256i y) {
+	return _mm256_srli_epi64(_mm256_cmpgt_epi64(x, y), 63);
+}
+
+__attribute__((target("avx2")))
+static __m256i
+avx2_le_epi64 (__m256i x, __m256i y) {
+	return _mm256_xor_si256(avx2_gt_epi64(x, y), _mm256_set1_epi64x(1));
+}
+
+__attribute__((target("avx2")))
+static __m256i
+avx2_ge_epi64 (__m256i x, __m256i y) {
+	return _mm256_xor_si256(avx2_lt_epi64(x, y), _mm256_set1_epi64x(1));
+}
+
+__attribute__((target("avx2")))
+static __m256i
+avx2_eq_epi64 (__m256i x, __m256i y) {
+	return _mm256_srli_epi64(_mm256_cmpeq_epi64(x, y), 63);
+}
+
+__attribute__((target("avx2")))
+static __m256i
+avx2_ne_epi64 (__m256i x, __m256i y) {
+	return _mm256_xor_si256(avx2_eq_epi64(x, y), _mm256_set1_epi64x(1));
+}
+
+__attribute__((target("avx2")))
+static void
+batch_op_avx2 (enum bc_opcode op, size_t n, sys_int_long *dst, sys_int_long const *a, sys_int_long const *b, sys_int_long k) {
+	size_t i = 0;
+	switch (op) {
+	case BC_ADD: BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, _mm256_add_epi64); break;
+	case BC_SUB: BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, _mm256_sub_epi64); break;
+	case BC_MUL: BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, avx2_mul_epi64); break;
+	case BC_LT:  BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, avx2_lt_epi64); break;
+	case BC_GT:  BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, avx2_gt_epi64); break;
+	case BC_LE:  BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, avx2_le_epi64); break;
+	case BC_GE:  BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, avx2_ge_epi64); break;
+	case BC_EQ:  BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, avx2_eq_epi64); break;
+	case BC_NE:  BATCH_VECTOR_LOOP(__m256i, 4, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_set1_epi64x, avx2_ne_epi64); break;
+	default: break; // no vector form
+	}
+	batch_op_scalar(op, n - i, dst + i, a + i, b ? b + i : NULL, k);
+}
+#endif /* BATCH_HAVE_AVX2 */
+
+/** Pick the best operation kernel for this CPU.
+ * No state is kept, so this is safe to call from any thread.
+ */
+static batch_op_fn
+batch_kernel (void) {
+#ifdef BATCH_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2")) return batch_op_avx2;
+#endif
+#ifdef BATCH_HAVE_SSE2
+	return batch_op_sse2;
+#else
+	return batch_op_scalar;
+#endif
+}
+
+/** Name of the operation kernel that will be used.
+ * @return "avx2", "sse2", or "scalar"
+ */
+char const *
+batch_kernel_name (void) {
+	batch_op_fn fn = batch_kernel();
+	(void) fn; // nothing to compare with when only the scalar kernel is built
+#ifdef BATCH_HAVE_AVX2
+	if (fn == batch_op_avx2) return "avx2";
+#endif
+#ifdef BATCH_HAVE_SSE2
+	if (fn == batch_op_sse2) return "sse2";
+#endif
+	return "scalar";
+}
+
+/** Run a compiled program over many rows.
+ * Row i gives the same result as @ref bytecode_run with vars[v] = cols[v][i].
+ * A row whose result faulted has its fault in faults, and an unspecified value in out.
+ * @param prog The program to run. Must be a VAL_LINT program without double constants or function calls.
+ * @param cols One column of nrows values per variable the program reads.
+ * 		May be NULL if the program reads no variables.
+ * @param nrows Number of rows.
+ * @param[out] out Set to the nrows results. May be one of the columns.
+ * @param[out] faults Set to the nrows faults, BC_FAULT_ZERO or BC_FAULT_DIV, or 0 where the result is a number.
+ * 		May be NULL.
+ */
+void
+batch_run (struct bc_program const *prog,
+           sys_int_long const *const *cols,
+           size_t nrows,
+           sys_int_long *out,
+           unsigned char *faults) {
+	batch_op_fn fn = batch_kernel();
+	sys_int_long const **top;  // stack entries, each a block of rows
+	unsigned char **ftop;      // faults of each stack entry, or NULL if none of its rows faulted
+	sys_int_long *slots;       // a block of storage for each stack entry
+	unsigned char *fslots;     // a block of fault storage for each stack entry
+	size_t row;
+
+	assert(prog);
+	assert(prog->type == VAL_LINT); // throw error - batch_run: only long int programs can be batched
+	assert(prog->ncalls == 0); // throw error - batch_run: function calls cannot be batched
+	assert(prog->nconsts == 0); // throw error - batch_run: double operations cannot be batched
+	assert(cols || (prog->nvars == 0));
+	assert(out || (nrows == 0));
+
+	top = (sys_int_long const **) malloc(prog->depth * (sizeof(*top) + sizeof(*ftop) + (BATCH_BLOCK * (sizeof(*slots) + sizeof(*fslots)))));
+	assert(top); // throw error - batch_run: malloc could not do allocation
+	ftop   = (unsigned char **) (top + prog->depth);
+	slots  = (sys_int_long *) (ftop + prog->depth);
+	fslots = (unsigned char *) (slots + (prog->depth * BATCH_BLOCK));
+
+	for (row = 0; row < nrows; row += BATCH_BLOCK) {
+		size_t n = (nrows - row < BATCH_BLOCK) ? (nrows - row) : BATCH_BLOCK;
+		struct bc_insn const *ip;
+		size_t sp = 0; // number of stack entries
+		size_t i;
+
+		for (ip = prog->code; ip->op != BC_RET; ip++) {
+			sys_int_long *dst;
+			switch (ip->op) {
+			case BC_CONST:
+				dst = slots + (sp * BATCH_BLOCK);
+				for (i = 0; i < n; i++) dst[i] = ip->arg;
+				ftop[sp] = NULL;
+				top[sp++] = dst;
+				break;
+			case BC_LOAD:
+				ftop[sp] = NULL;
+				top[sp++] = cols[ip->arg] + row;
+				break;
+			case BC_ADD:
+			case BC_SUB:
+			case BC_MUL:
+			case BC_DIV:
+			case BC_LT:
+			case BC_GT:
+			case BC_LE:
+			case BC_GE:
+			case BC_EQ:
+			case BC_NE:
+			case BC_AND:
+			case BC_OR:
+				sp--;
+				dst = slots + ((sp - 1) * BATCH_BLOCK);
+				// before the operation, which may write over its left operand
+				if (ftop[sp - 1] || ftop[sp] || (ip->op == BC_DIV)) {
+					ftop[sp - 1] = batch_faults(ip->op, n, fslots + ((sp - 1) * BATCH_BLOCK), top[sp - 1], top[sp], ftop[sp - 1], ftop[sp]);
+				}
+				fn(ip->op, n, dst, top[sp - 1], top[sp], 0);
+				top[sp - 1] = dst;
+				break;
+			case BC_ADD_K:
+			case BC_SUB_K:
+			case BC_MUL_K:
+			case BC_DIV_K:
+				dst = slots + ((sp - 1) * BATCH_BLOCK);
+				// the _K opcodes are in the same order as their plain forms
+				fn((enum bc_opcode) (BC_ADD + (ip->op - BC_ADD_K)), n, dst, top[sp - 1], NULL, ip->arg);
+				top[sp - 1] = dst;
+				break;
+			case BC_SELECT:
+				sp -= 2;
+				dst = slots + ((sp - 1) * BATCH_BLOCK);
+				if (ftop[sp - 1] || ftop[sp] || ftop[sp + 1]) {
+					ftop[sp - 1] = batch_select_faults(n, fslots + ((sp - 1) * BATCH_BLOCK), top[sp - 1], ftop[sp - 1], ftop[sp], ftop[sp + 1]);
+				}
+				batch_select(n, dst, top[sp - 1], top[sp], top[sp + 1]);
+				top[sp - 1] = dst;
+				break;
+			default:
+				assert(0); // throw error - batch_run: invalid opcode
+			}
+		}
+
+		assert(sp == 1);
+		if (top[0] != out + row) {
+			memmove(out + row, top[0], n * sizeof(*out));
+		}
+		if (faults) {
+			if (ftop[0]) memcpy(faults + row, ftop[0], n);
+			else         memset(faults + row, 0, n);
+		}
+	}
+
+	free(top);
+}
+
+/** Evaluate an expression over many rows.
+ * Row i gives the same result as @ref expression_evaluate with syms[v] bound to cols[v][i].
+ * @param exp The expression to evaluate.
+ * @param nsyms Number of symbol names.
+ * @param syms Symbol names the expression may use. Symbol syms[v] reads column cols[v].
+ * @param cols One column of nrows values per symbol name.
+ * @param nrows Number of rows.
+ * @param[out] out Set to the nrows results.
+ * @param[out] faults Set to the nrows faults, as with @ref batch_run. May be NULL.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code from compiling exp
+ */
+int
+batch_evaluate (expression_t exp,
+                size_t nsyms,
+                char const *const *syms,
+                sys_int_long const *const *cols,
+                size_t nrows,
+                sys_int_long *out,
+                unsigned char *faults,
+                struct exp_error *err) {
+	struct bc_program *prog;
+	int ret;
+
+	if ((ret = bytecode_compile(exp, nsyms, syms, &prog, err)) != EXP_OK) {
+		return ret;
+	}
+	// a long int result may still come from comparing doubles
+	if ((prog->type != VAL_LINT) || (prog->nconsts != 0)) {
+		bytecode_free(prog);
+		return exp_error_set(err, EXP_EEVAL, 0, "Compile Error - Only long int expressions can be batched");
+	}
+	batch_run(prog, cols, nrows, out, faults);
+	bytecode_free(prog);
+	return EXP_OK;
+}
+
+#ifdef BATCH_TEST_MAIN
+/*
+ * Checks batch_run against bytecode_run row by row, on random expressions over
+ * more rows than one block, with divisors of 0 and -1 and LONG_MIN dividends.
+ * make tests also runs it built with BATCH_FORCE_SCALAR.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DBATCH_TEST_MAIN -o batch batch.c bytecode.c expression.c token.c symbolic.c reparse.c scan.c types.c workspace.c errors.c traverse.c funcs.c arena.c -pthread -lm
+ */
+#include <stdio.h>
+#include "expression.h"
+
+#define TEST_RUNS 300
+#define TEST_ROWS (3 * BATCH_BLOCK + 17)
+#define TEST_VARS 4
+
+static char const *const test_syms[TEST_VARS] = {"a", "b", "c", "m"};
+
+/* Expressions that divide LONG_MIN, in m, by -1 in some rows */
+static char const *const test_fixed[] = {
+	"m/b",
+	"b ? m/b : 0",
+	"(m/b) + (1/b)",
+	"(1/b) + (m/b)",
+	"b == 0 || m/b > 0",
+	"b && m/b",
+	"0 && m/b",
+	"b != 0-1 ? m/b : 7",
+};
+
+#define TEST_FIXED_COUNT (sizeof(test_fixed) / sizeof(test_fixed[0]))
+
+/* Random expression string over a, b and c with every operation batch_run takes */
+static size_t
+test_expression (char *buf, int depth) {
+	static char const *const ops[] = {"+", "-", "*", "/", "<", ">", "<=", ">=", "==", "!=", "&&", "||", "?"};
+	char const *op;
+	size_t n = 0;
+
+	if ((depth == 0) || (rand() % 4 == 0)) {
+		switch (rand() % 5) {
+		case 0:  return (size_t) sprintf(buf, "%d", rand() % 10);
+		case 1:  return (size_t) sprintf(buf, "(0-%d)", rand() % 3);
+		default: return (size_t) sprintf(buf, "%c", "abc"[rand() % 3]);
+		}
+	}
+	op = ops[rand() % (sizeof(ops) / sizeof(ops[0]))];
+	buf[n++] = '(';
+	n += test_expression(buf + n, depth - 1);
+	n += (size_t) sprintf(buf + n, " %s ", op);
+	n += test_expression(buf + n, depth - 1);
+	if (op[0] == '?') {
+		n += (size_t) sprintf(buf + n, " : ");
+		n += test_expression(buf + n, depth - 1);
+	}
+	buf[n++] = ')';
+	buf[n] = '\0';
+	return n;
+}
+
+/* Compare batch_run with bytecode_run on every row, returning the number of mismatched rows */
+static int
+test_rows (char const *str, sys_int_long *const *cols) {
+	static sys_int_long out[TEST_ROWS];
+	static unsigned char faults[TEST_ROWS];
+	sys_int_long col0[TEST_ROWS];
+	sys_int_long vars[TEST_VARS];
+	struct bc_program *prog;
+	struct exp_error err;
+	expression_t exp;
+	size_t row, v;
+	int bad = 0, pass;
+
+	if ((string_to_expression_r(strlen(str), str, &exp, &err) != EXP_OK)
+	    || (bytecode_compile(exp, TEST_VARS, test_syms, &prog, &err) != EXP_OK)) {
+		printf("FAIL compile %s: %s\n", str, err.msg);
+		return 1;
+	}
+
+	// once into out, and once into the first column, which it also reads
+	for (pass = 0; pass < 2; pass++) {
+		sys_int_long *dst = pass ? cols[0] : out;
+		memcpy(col0, cols[0], sizeof(col0));
+		batch_run(prog, (sys_int_long const *const *) cols, TEST_ROWS, dst, faults);
+		for (row = 0; row < TEST_ROWS; row++) {
+			value_t want;
+			for (v = 0; v < TEST_VARS; v++) vars[v] = v ? cols[v][row] : col0[row];
+			want = bytecode_run(prog, vars);
+			if (VAL_IS_NUMBER(want) ? (faults[row] || (dst[row] != want.data.lint))
+			                        : (!faults[row] || (BC_FAULT_TYPE(faults[row]) != want.type))) {
+				if (!bad) printf("FAIL %s row %lu: %s\n", pass ? "in place" : "batch", (unsigned long) row, str);
+				bad++;
+			}
+		}
+		memcpy(cols[0], col0, sizeof(col0));
+	}
+
+	bytecode_free(prog);
+	expression_free(exp);
+	return bad ? 1 : 0;
+}
+
+int
+main (void) {
+	static sys_int_long a[TEST_ROWS], b[TEST_ROWS], c[TEST_ROWS], m[TEST_ROWS];
+	sys_int_long *cols[TEST_VARS] = {a, b, c, m};
+	char buf[4096];
+	size_t row, i;
+	int run, bad = 0;
+
+	srand(1);
+	for (row = 0; row < TEST_ROWS; row++) {
+		a[row] = (rand() % 201) - 100;
+		b[row] = (rand() % 5) - 2; // divisors of 0 and -1 in many rows
+		c[row] = (rand() % 21) - 10;
+		m[row] = (rand() % 4) ? SYS_INT_LONG_T_MIN : (rand() % 100);
+	}
+
+	printf("selected kernel: %s\n", batch_kernel_name());
+	for (i = 0; i < TEST_FIXED_COUNT; i++) {
+		bad += test_rows(test_fixed[i], cols);
+	}
+	for (run = 0; run < TEST_RUNS; run++) {
+		test_expression(buf, 4);
+		bad += test_rows(buf, cols);
+	}
+
+	printf("%lu cases, %d failures\n", (unsigned long) (TEST_FIXED_COUNT + TEST_RUNS), bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef BATCH_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,47 @@
+/**
+ * @file batch.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Evaluates one expression over many rows of variable values.
+ * Variables are given as columns, one array per symbol, and the results are
+ * written to an output column. Rows are processed in blocks, running each
+ * bytecode operation over the whole block with AVX2 or SSE2 when available.
+ * A row whose result faulted, like a division by zero, is marked in a fault column.
+ */
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "expression_lite.h" // just need pointer expression_t
+#include "bytecode.h"
+
+/// Number of rows processed by each bytecode operation at once
+#define BATCH_BLOCK 256
+
+void
+batch_run (struct bc_program const *prog,
+           sys_int_long const *const *cols,
+           size_t nrows,
+           sys_int_long *out,
+           unsigned char *faults);
+
+int
+batch_evaluate (expression_t exp,
+                size_t nsyms,
+                char const *const *syms,
+                sys_int_long const *const *cols,
+                size_t nrows,
+                sys_int_long *out,
+                unsigned char *faults,
+                struct exp_error *err);
+
+char const *
+batch_kernel_name (void);
+
+#endif /* _BATCH_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,1084 @@
+/**
+ * @file bytecode.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Compiles expression trees to flat postfix bytecode and runs it on a small stack machine.
+ *
+ * The interpreter uses computed goto dispatch when built with GCC or Clang, which gives
+ * every operation its own indirect branch. Otherwise it falls back to a switch.
+ * Define BYTECODE_NO_COMPUTED_GOTO to always use the switch.
+ *
+ * A program is one allocation. The instructions are followed by the double constants,
+ * the function call sites, and then the argument types of every call site.
+ */
+#include <stdlib.h> // malloc(), realloc(), free()
+#include <string.h> // strcmp(), memset()
+#include "errors.h"
+#include "types.h"
+#include "expression.h"
+#include "funcs.h"
+#include "traverse.h"
+#include "bytecode.h"
+
+#if defined(__GNUC__) && !defined(BYTECODE_NO_COMPUTED_GOTO)
+	#define BYTECODE_COMPUTED_GOTO
+#endif
+
+/// Stack entries kept on the C stack while running. Deeper programs use malloc.
+#define BC_STACK_LOCAL 64
+
+/// Function arguments kept on the C stack while calling. Calls with more use malloc.
+#define BC_CALL_LOCAL 8
+
+/**
+ * A stack entry. Its type is known from the code, so it is not stored.
+ */
+union bc_slot {
+	sys_int_long lint; ///< Long int entry
+	double       dbl;  ///< Double entry
+};
+
+/**
+ * Compiler state.
+ */
+struct bc_compiler {
+	size_t              nsyms; ///< Number of symbol names
+	char const *const  *syms;  ///< Symbol names. A symbol's index is its variable index.
+	struct bc_insn     *code;  ///< Instructions emitted so far, or NULL when only counting
+	size_t              len;   ///< Number of instructions emitted
+	size_t              depth; ///< Current stack depth
+	size_t              max_depth; ///< Largest stack depth seen
+	size_t              nvars; ///< One past the largest variable index used
+	double             *consts; ///< Double constants added so far, or NULL when only counting
+	size_t              nconsts; ///< Number of double constants added
+	struct exp_funcs const *funcs; ///< Functions calls are resolved in, or NULL to refuse calls
+	struct bc_call     *calls; ///< Call sites added so far, or NULL when only counting
+	size_t              ncalls; ///< Number of call sites added
+	unsigned char      *doubles; ///< Argument types of the call sites, or NULL when only counting
+	size_t              nargs; ///< Number of arguments of all call sites
+	struct exp_error   *err;   ///< Where to report errors
+};
+
+/// Offset from a long int operation to its double form
+#define BC_DOUBLE_OFFSET (BC_FADD - BC_ADD)
+
+/// Offset from a long int comparison to its double form
+#define BC_COMPARE_DOUBLE_OFFSET (BC_FLT - BC_LT)
+
+/** Emit one instruction and track the stack depth.
+ * @param pops Number of stack entries the instruction pops.
+ * @param pushes Number of stack entries the instruction pushes.
+ */
+static void
+bc_emit (struct bc_compiler *c, enum bc_opcode op, sys_int_long arg, size_t pops, size_t pushes) {
+	if (c->code) {
+		c->code[c->len].op  = op;
+		c->code[c->len].arg = arg;
+	}
+	c->len++;
+	c->depth = c->depth - pops + pushes;
+	if (c->depth > c->max_depth) c->max_depth = c->depth;
+}
+
+/** Add a double constant to the program.
+ * @return The constant's index
+ */
+static sys_int_long
+bc_const (struct bc_compiler *c, double val) {
+	if (c->consts) c->consts[c->nconsts] = val;
+	return (sys_int_long) c->nconsts++;
+}
+
+/** Binary operation char to bytecode.
+ * @param k Non-zero for the form that takes a constant right operand.
+ * @return The opcode or BC_OPCODE_COUNT if op is not known.
+ */
+static enum bc_opcode
+bc_binary_op (char op, int k) {
+	switch (op) {
+	case '+': return k ? BC_ADD_K : BC_ADD;
+	case '-': return k ? BC_SUB_K : BC_SUB;
+	case '*': return k ? BC_MUL_K : BC_MUL;
+	case '/': return k ? BC_DIV_K : BC_DIV;
+	default:  return BC_OPCODE_COUNT;
+	}
+}
+
+/** Comparison or logical operation char to bytecode.
+ * @return The long int opcode or BC_OPCODE_COUNT if op is not one.
+ */
+static enum bc_opcode
+bc_test_op (char op) {
+	switch (op) {
+	case '<': return BC_LT;
+	case '>': return BC_GT;
+	case 'L': return BC_LE;
+	case 'G': return BC_GE;
+	case '=': return BC_EQ;
+	case '!': return BC_NE;
+	case '&': return BC_AND;
+	case '|': return BC_OR;
+	default:  return BC_OPCODE_COUNT;
+	}
+}
+
+/**
+ * A call whose arguments are being compiled.
+ */
+struct bc_pending_call {
+	struct exp_func const *func;    ///< The function called
+	size_t                 argc;    ///< Number of arguments
+	unsigned char         *doubles; ///< The call's argument types, or NULL when only counting
+};
+
+/**
+ * What the compiler's walk has yet to finish. Both stacks grow with malloc.
+ */
+struct bc_pending {
+	enum value_types       *types;  ///< Types of the values the code emitted so far leaves, bottom first
+	size_t                  ntypes; ///< Number of types
+	size_t                  types_size; ///< Number of types the stack can hold
+	struct bc_pending_call *calls;  ///< Calls being compiled, innermost last
+	size_t                  ncalls; ///< Number of calls
+	size_t                  calls_size; ///< Number of calls the stack can hold
+};
+
+/* Push the type of a value the code leaves on the stack */
+static void
+bc_push_type (struct bc_pending *p, enum value_types type) {
+	if (p->ntypes == p->types_size) {
+		p->types_size = p->types_size ? (p->types_size * 2) : EXP_WALK_LOCAL;
+		p->types = (enum value_types *) realloc(p->types, p->types_size * sizeof(enum value_types));
+		assert(p->types); // throw error - bc_push_type: realloc could not do allocation
+	}
+	p->types[p->ntypes++] = type;
+}
+
+/* True if the ',' tree the walk is on separates the arguments of a call,
+ * which it does when only ',' trees are between it and a symbol.
+ * @param above Number of frames on the walk's stack above the ',' tree. */
+static int
+bc_is_args (struct exp_walk const *w, size_t above) {
+	expression_t exp;
+
+	while (above--) {
+		exp = w->stack[above].exp;
+		if (exp->type == EXP_SYMBOLIC) return 1;
+		if ((exp->type != EXP_TREE) || (exp->data.tree.op != ',')) return 0;
+	}
+	return 0;
+}
+
+/* True if the ':' tree exp is the arms of the select parent */
+static int
+bc_is_arms (expression_t exp, expression_t parent) {
+	return parent && EXP_IS_SELECT(parent) && (parent->data.tree.right == exp) && (parent->data.tree.left != exp);
+}
+
+/* True if the tree exp is an operation whose constant right operand rides along in the instruction */
+static int
+bc_rides_along (expression_t exp) {
+	expression_t right = exp->data.tree.right;
+
+	if (bc_binary_op(exp->data.tree.op, 0) == BC_OPCODE_COUNT) return 0;
+	if (right->type != EXP_VALUE) return 0;
+	if (right->data.val.type == VAL_DOUBLE) return 1;
+	if (right->data.val.type != VAL_LINT) return 0;
+	// BC_DIV_K divides as is, so only a divisor that cannot trap rides along
+	return (exp->data.tree.op != '/') || ((right->data.val.data.lint != 0) && (right->data.val.data.lint != -1));
+}
+
+/* Number of arguments in a symbol's parameter, whose ',' trees separate them */
+static size_t
+bc_count_args (expression_t exp) {
+	struct exp_walk w;
+	enum exp_walk_event event;
+	expression_t node;
+	size_t argc = 0;
+
+	exp_walk_init(&w, exp);
+	while (exp_walk_next(&w, &node, &event)) {
+		if ((event != EXP_WALK_ENTER) || ((node->type == EXP_TREE) && (node->data.tree.op == ','))) continue;
+		argc++;
+		exp_walk_skip(&w);
+	}
+	exp_walk_free(&w);
+	return argc;
+}
+
+/** Start a call, checking it against its function.
+ * The call claims its argument types before any nested call claims its own.
+ */
+static int
+bc_enter_call (struct bc_compiler *c, struct bc_pending *p, expression_t exp) {
+	struct bc_pending_call *call;
+	struct exp_func const *func;
+	size_t argc;
+
+	if (!c->funcs) {
+		return exp_error_set(c->err, EXP_EEVAL, 0, "Compile Error - Cannot compile symbol parameter of \"%s\"", exp->data.sym.name);
+	}
+	if (!(func = exp_funcs_find(c->funcs, exp->data.sym.name))) {
+		return exp_error_set(c->err, EXP_EEVAL, 0, "Compile Error - Unknown function \"%s\"", exp->data.sym.name);
+	}
+	argc = bc_count_args(exp->data.sym.p);
+	if ((argc < func->min_args) || (argc > func->max_args)) {
+		return exp_error_set(c->err, EXP_EEVAL, 0, "Compile Error - Wrong number of arguments for \"%s\"", exp->data.sym.name);
+	}
+
+	if (p->ncalls == p->calls_size) {
+		p->calls_size = p->calls_size ? (p->calls_size * 2) : EXP_WALK_LOCAL;
+		p->calls = (struct bc_pending_call *) realloc(p->calls, p->calls_size * sizeof(struct bc_pending_call));
+		assert(p->calls); // throw error - bc_enter_call: realloc could not do allocation
+	}
+	call = &p->calls[p->ncalls++];
+	call->func    = func;
+	call->argc    = argc;
+	call->doubles = c->doubles ? &c->doubles[c->nargs] : NULL;
+	c->nargs += argc;
+	return EXP_OK;
+}
+
+/* Finish a call once its arguments are on the stack */
+static void
+bc_leave_call (struct bc_compiler *c, struct bc_pending *p) {
+	struct bc_pending_call *call = &p->calls[--p->ncalls];
+	enum value_types type;
+	size_t i;
+	int any = 0;
+
+	p->ntypes -= call->argc;
+	for (i = 0; i < call->argc; i++) {
+		if (call->doubles) call->doubles[i] = (p->types[p->ntypes + i] == VAL_DOUBLE);
+		if (p->types[p->ntypes + i] == VAL_DOUBLE) any = 1;
+	}
+	type = exp_func_type(call->func, any);
+	if (c->calls) {
+		c->calls[c->ncalls].func    = call->func;
+		c->calls[c->ncalls].argc    = call->argc;
+		c->calls[c->ncalls].doubles = call->doubles;
+		c->calls[c->ncalls].type    = type;
+	}
+	bc_emit(c, BC_CALL, (sys_int_long) c->ncalls++, call->argc, 1);
+	bc_push_type(p, type);
+}
+
+/* Emit code for a value or a variable */
+static int
+bc_compile_leaf (struct bc_compiler *c, struct bc_pending *p, expression_t exp) {
+	size_t i;
+
+	if (exp->type == EXP_VALUE) {
+		if (exp->data.val.type == VAL_LINT) {
+			bc_emit(c, BC_CONST, exp->data.val.data.lint, 0, 1);
+		} else if (exp->data.val.type == VAL_DOUBLE) {
+			bc_emit(c, BC_FCONST, bc_const(c, exp->data.val.data.dbl), 0, 1);
+		} else {
+			return exp_error_set(c->err, EXP_EEVAL, 0, "Compile Error - Only long int and double values can be compiled");
+		}
+		bc_push_type(p, exp->data.val.type);
+		return EXP_OK;
+	}
+
+	for (i = 0; i < c->nsyms; i++) {
+		if (strcmp(c->syms[i], exp->data.sym.name) == 0) break;
+	}
+	if (i == c->nsyms) {
+		return exp_error_set(c->err, EXP_EEVAL, 0, "Compile Error - Unknown symbol \"%s\"", exp->data.sym.name);
+	}
+	if (i + 1 > c->nvars) c->nvars = i + 1;
+	bc_emit(c, BC_LOAD, (sys_int_long) i, 0, 1);
+	bc_push_type(p, VAL_LINT);
+	return EXP_OK;
+}
+
+/** Emit code for a comparison or logical operation, which leaves a long int 1 or 0.
+ * Two long ints are compared as long ints, and anything else as doubles.
+ * Each operand of && and || is made a truth value as soon as it is on the stack,
+ * the left one by the walk between the operands.
+ * @param op The long int form of the operation.
+ */
+static void
+bc_compile_test (struct bc_compiler *c, struct bc_pending *p, enum bc_opcode op) {
+	enum value_types right_type = p->types[--p->ntypes];
+	enum value_types left_type  = p->types[--p->ntypes];
+
+	if (((op == BC_AND) || (op == BC_OR)) && (right_type == VAL_DOUBLE)) {
+		bc_emit(c, BC_FTEST, 0, 1, 1);
+		right_type = VAL_LINT;
+	}
+
+	bc_push_type(p, VAL_LINT);
+	if ((left_type == VAL_LINT) && (right_type == VAL_LINT)) {
+		bc_emit(c, op, 0, 2, 1);
+		return;
+	}
+	if (left_type == VAL_LINT)  bc_emit(c, BC_ITOF2, 0, 1, 1);
+	if (right_type == VAL_LINT) bc_emit(c, BC_ITOF, 0, 1, 1);
+	bc_emit(c, (enum bc_opcode) (op + BC_COMPARE_DOUBLE_OFFSET), 0, 2, 1);
+}
+
+/** Emit code for a select, c ? a : b.
+ * The condition and both arms are left on the stack for BC_SELECT to pick from.
+ * If either arm is a double, the other is converted, like the operands of an operation.
+ */
+static void
+bc_compile_select (struct bc_compiler *c, struct bc_pending *p) {
+	enum value_types else_type = p->types[--p->ntypes];
+	enum value_types then_type = p->types[--p->ntypes];
+
+	p->ntypes--; // the condition, made a truth value by the walk between it and the arms
+	if (then_type != else_type) {
+		bc_emit(c, (then_type == VAL_LINT) ? BC_ITOF2 : BC_ITOF, 0, 1, 1);
+	}
+	bc_emit(c, BC_SELECT, 0, 3, 1);
+	bc_push_type(p, ((then_type == VAL_DOUBLE) || (else_type == VAL_DOUBLE)) ? VAL_DOUBLE : VAL_LINT);
+}
+
+/** Emit code for an arithmetic operation.
+ * A tree of two long ints is a long int, and a tree with a double on either side
+ * is a double, so the long int side is converted to a double.
+ * @param along Non-zero if the right operand is a constant riding along in the instruction,
+ *              in which case no code was emitted for it.
+ */
+static void
+bc_compile_binary (struct bc_compiler *c, struct bc_pending *p, expression_t exp, int along) {
+	enum bc_opcode op = bc_binary_op(exp->data.tree.op, along);
+	enum value_types right_type, left_type;
+
+	if (along) {
+		value_t val = exp->data.tree.right->data.val;
+		left_type = p->types[--p->ntypes];
+		if ((left_type == VAL_LINT) && (val.type == VAL_LINT)) {
+			bc_emit(c, op, val.data.lint, 1, 1);
+			bc_push_type(p, VAL_LINT);
+			return;
+		}
+		if (left_type == VAL_LINT) bc_emit(c, BC_ITOF, 0, 1, 1);
+		bc_emit(c, (enum bc_opcode) (op + BC_DOUBLE_OFFSET),
+		        bc_const(c, (val.type == VAL_DOUBLE) ? val.data.dbl : (double) val.data.lint), 1, 1);
+		bc_push_type(p, VAL_DOUBLE);
+		return;
+	}
+
+	right_type = p->types[--p->ntypes];
+	left_type  = p->types[--p->ntypes];
+	if ((left_type == VAL_LINT) && (right_type == VAL_LINT)) {
+		bc_emit(c, op, 0, 2, 1);
+		bc_push_type(p, VAL_LINT);
+		return;
+	}
+	if (left_type == VAL_LINT)  bc_emit(c, BC_ITOF2, 0, 1, 1);
+	if (right_type == VAL_LINT) bc_emit(c, BC_ITOF, 0, 1, 1);
+	bc_emit(c, (enum bc_opcode) (op + BC_DOUBLE_OFFSET), 0, 2, 1);
+	bc_push_type(p, VAL_DOUBLE);
+}
+
+/** Emit code for exp in postfix order.
+ * The tree is walked without recursion, and the types of the values waiting for
+ * their parent are kept on a stack, so they are inferred bottom up.
+ * Comparisons and logical operations are long ints, and a select is typed by its arms.
+ * Symbols are long int variables. A call's type is given by its function.
+ * @param[out] type Set to the type exp's code leaves on the stack, VAL_LINT or VAL_DOUBLE.
+ */
+static int
+bc_compile_exp (struct bc_compiler *c, expression_t exp, enum value_types *type) {
+	struct bc_pending p = {NULL, 0, 0, NULL, 0, 0};
+	struct exp_walk w;
+	enum exp_walk_event event;
+	expression_t node, parent;
+	enum value_types *top;
+	char op;
+	int along = 0; // set between an operation and its constant right operand
+	int ret = EXP_OK;
+
+	exp_walk_init(&w, exp);
+	while ((ret == EXP_OK) && exp_walk_next(&w, &node, &event)) {
+		switch (node->type) {
+		case EXP_VALUE:
+			if (event != EXP_WALK_LEAVE) break;
+			if (along) {
+				along = 0; // emitted with its operation
+				break;
+			}
+			ret = bc_compile_leaf(c, &p, node);
+			break;
+
+		case EXP_SYMBOLIC:
+			if (!node->data.sym.p) {
+				if (event == EXP_WALK_LEAVE) ret = bc_compile_leaf(c, &p, node);
+			} else if (event == EXP_WALK_ENTER) {
+				ret = bc_enter_call(c, &p, node);
+			} else if (event == EXP_WALK_LEAVE) {
+				bc_leave_call(c, &p);
+			}
+			break;
+
+		case EXP_TREE:
+			op = node->data.tree.op;
+			if (event == EXP_WALK_ENTER) {
+				// ',' and ':' only have a meaning as a call's arguments or a select's arms
+				parent = (w.depth > 1) ? w.stack[w.depth - 2].exp : NULL;
+				if (((op == ',') && bc_is_args(&w, w.depth - 1)) || ((op == ':') && bc_is_arms(node, parent))) break;
+				if (!EXP_IS_SELECT(node) && (bc_test_op(op) == BC_OPCODE_COUNT) && (bc_binary_op(op, 0) == BC_OPCODE_COUNT)) {
+					ret = exp_error_set(c->err, EXP_EEVAL, 0, "Compile Error - Invalid operation \'%c\'", op);
+				}
+			}
+			else if (event == EXP_WALK_BETWEEN) {
+				top = &p.types[p.ntypes - 1];
+				// a select's condition, and the left operand of && and ||, are made truth values
+				if ((EXP_IS_SELECT(node) || (op == '&') || (op == '|')) && (*top == VAL_DOUBLE)) {
+					bc_emit(c, BC_FTEST, 0, 1, 1);
+					*top = VAL_LINT;
+				}
+				along = bc_rides_along(node);
+			}
+			else if ((op == ',') || (op == ':')) {
+				// the arguments or arms stay on the stack for the call or select
+			}
+			else if (EXP_IS_SELECT(node)) {
+				bc_compile_select(c, &p);
+			}
+			else if (bc_test_op(op) != BC_OPCODE_COUNT) {
+				bc_compile_test(c, &p, bc_test_op(op));
+			}
+			else {
+				bc_compile_binary(c, &p, node, bc_rides_along(node));
+			}
+			break;
+
+		default:
+			ret = exp_error_set(c->err, EXP_EEVAL, 0, "Compile Error - Invalid expression type");
+			break;
+		}
+	}
+	exp_walk_free(&w);
+
+	if (ret == EXP_OK) {
+		assert(p.ntypes == 1);
+		*type = p.types[0];
+	}
+	free(p.types);
+	free(p.calls);
+	return ret;
+}
+
+/** Compile an expression to bytecode.
+ * Symbols with a parameter cannot be compiled. See @ref bytecode_compile_funcs for that.
+ * @param exp The expression to compile.
+ * @param nsyms Number of symbol names.
+ * @param syms Symbol names the expression may use. Symbol syms[i] reads vars[i] when run.
+ * @param[out] prog Set to the compiled program, or NULL on error. Free with @ref bytecode_free.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+bytecode_compile (expression_t exp,
+                  size_t nsyms,
+                  char const *const *syms,
+                  struct bc_program **prog,
+                  struct exp_error *err) {
+	return bytecode_compile_funcs(exp, nsyms, syms, NULL, prog, err);
+}
+
+/** Compile an expression with function calls to bytecode.
+ * Each symbol with a parameter, like max(a, b), is looked up in funcs and its
+ * arguments are checked against the function now, so running the program does not.
+ * The tree is walked twice, once to size the program and once to emit it,
+ * so the program is a single allocation.
+ * @param exp The expression to compile.
+ * @param nsyms Number of symbol names.
+ * @param syms Symbol names the expression may use. Symbol syms[i] reads vars[i] when run.
+ * @param funcs Functions the expression may call, or NULL for none. Must outlive the program.
+ * @param[out] prog Set to the compiled program, or NULL on error. Free with @ref bytecode_free.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+bytecode_compile_funcs (expression_t exp,
+                        size_t nsyms,
+                        char const *const *syms,
+                        struct exp_funcs const *funcs,
+                        struct bc_program **prog,
+                        struct exp_error *err) {
+	struct bc_compiler c;
+	enum value_types type;
+	int ret;
+
+	assert(exp);
+	assert(prog);
+	assert(syms || (nsyms == 0));
+
+	exp_error_clear(err);
+	*prog = NULL;
+
+	/* Pass 1 - size the program */
+	c.nsyms = nsyms;
+	c.syms  = syms;
+	c.code  = NULL;
+	c.len   = 0;
+	c.depth = c.max_depth = 0;
+	c.nvars = 0;
+	c.consts  = NULL;
+	c.nconsts = 0;
+	c.funcs   = funcs;
+	c.calls   = NULL;
+	c.ncalls  = 0;
+	c.doubles = NULL;
+	c.nargs   = 0;
+	c.err   = err;
+	if ((ret = bc_compile_exp(&c, exp, &type)) != EXP_OK) return ret;
+	bc_emit(&c, (type == VAL_DOUBLE) ? BC_FRET : BC_RET, 0, 1, 0);
+
+	*prog = (struct bc_program *) malloc(sizeof(struct bc_program)
+	                                     + (c.len * sizeof(struct bc_insn))
+	                                     + (c.nconsts * sizeof(double))
+	                                     + (c.ncalls * sizeof(struct bc_call))
+	                                     + c.nargs);
+	assert(*prog); // throw error - bytecode_compile: malloc could not do allocation
+	(*prog)->len     = c.len;
+	(*prog)->depth   = c.max_depth;
+	(*prog)->nvars   = c.nvars;
+	(*prog)->type    = type;
+	(*prog)->nconsts = c.nconsts;
+	(*prog)->ncalls  = c.ncalls;
+	(*prog)->code    = (struct bc_insn *) (*prog + 1);
+	(*prog)->consts  = (double *) ((*prog)->code + c.len);
+	(*prog)->calls   = (struct bc_call *) ((*prog)->consts + c.nconsts);
+
+	/* Pass 2 - emit */
+	c.code  = (*prog)->code;
+	c.len   = 0;
+	c.depth = c.max_depth = 0;
+	c.consts  = (*prog)->consts;
+	c.nconsts = 0;
+	c.calls   = (*prog)->calls;
+	c.ncalls  = 0;
+	c.doubles = (unsigned char *) ((*prog)->calls + (*prog)->ncalls);
+	c.nargs   = 0;
+	bc_compile_exp(&c, exp, &type);
+	bc_emit(&c, (type == VAL_DOUBLE) ? BC_FRET : BC_RET, 0, 1, 0);
+	assert(c.len == (*prog)->len);
+
+	return EXP_OK;
+}
+
+/** Free a compiled program.
+ * @param prog The program to free.
+ */
+void
+bytecode_free (struct bc_program *prog) {
+	free(prog);
+}
+
+/** Make the function call of a BC_CALL.
+ * @param args The call's arguments on the stack. The function's value replaces the first.
+ * @return EXP_OK or the error code
+ */
+static int
+bc_call_run (struct bc_call const *call, union bc_slot *args) {
+	value_t  local[BC_CALL_LOCAL];
+	value_t *argv = local;
+	value_t  val;
+	size_t   i;
+	int      ret;
+
+	if (call->argc > BC_CALL_LOCAL) {
+		argv = (value_t *) malloc(call->argc * sizeof(value_t));
+		assert(argv); // throw error - bc_call_run: malloc could not do allocation
+	}
+	for (i = 0; i < call->argc; i++) {
+		argv[i] = call->doubles[i] ? value_new_double(args[i].dbl) : value_new_lint(args[i].lint);
+	}
+
+	ret = exp_func_call(call->func, call->argc, argv, &val, NULL);
+	if (ret == EXP_OK) {
+		if (call->type == VAL_DOUBLE) args[0].dbl  = val.data.dbl;
+		else                          args[0].lint = val.data.lint;
+	}
+
+	if (argv != local) free(argv);
+	return ret;
+}
+
+/* Apply a binary operation in place, *l = *l op r, and give its fault.
+ * A division that faults is not made. */
+static unsigned char
+bc_apply (enum bc_opcode op, union bc_slot *l, union bc_slot r) {
+	unsigned char fault = 0;
+
+	switch (op) {
+	case BC_ADD:  l->lint = l->lint + r.lint; break;
+	case BC_SUB:  l->lint = l->lint - r.lint; break;
+	case BC_MUL:  l->lint = l->lint * r.lint; break;
+	case BC_DIV:
+		if ((fault = BC_DIV_FAULT(l->lint, r.lint)) == 0) l->lint = l->lint / r.lint;
+		break;
+	case BC_FADD: l->dbl = l->dbl + r.dbl; break;
+	case BC_FSUB: l->dbl = l->dbl - r.dbl; break;
+	case BC_FMUL: l->dbl = l->dbl * r.dbl; break;
+	case BC_FDIV:
+		if (r.dbl == 0.0) fault = BC_FAULT_ZERO;
+		else              l->dbl = l->dbl / r.dbl;
+		break;
+	case BC_LT:   l->lint = l->lint <  r.lint; break;
+	case BC_GT:   l->lint = l->lint >  r.lint; break;
+	case BC_LE:   l->lint = l->lint <= r.lint; break;
+	case BC_GE:   l->lint = l->lint >= r.lint; break;
+	case BC_EQ:   l->lint = l->lint == r.lint; break;
+	case BC_NE:   l->lint = l->lint != r.lint; break;
+	case BC_FLT:  l->lint = l->dbl <  r.dbl; break;
+	case BC_FGT:  l->lint = l->dbl >  r.dbl; break;
+	case BC_FLE:  l->lint = l->dbl <= r.dbl; break;
+	case BC_FGE:  l->lint = l->dbl >= r.dbl; break;
+	case BC_FEQ:  l->lint = l->dbl == r.dbl; break;
+	case BC_FNE:  l->lint = l->dbl != r.dbl; break;
+	case BC_AND:  l->lint = (l->lint != 0) & (r.lint != 0); break;
+	case BC_OR:   l->lint = (l->lint != 0) | (r.lint != 0); break;
+	default:
+		assert(0); // throw error - bc_apply: not a binary operation
+		break;
+	}
+	return fault;
+}
+
+/** Run the rest of a program after an operation faulted.
+ * Like @ref range_run, each stack entry now has a fault beside it, passed up the way
+ * @ref expression_evaluate passes its errors: an operation keeps the fault of its left
+ * operand, then of its right, then gets its own, and && and || drop a fault on their
+ * right when their left decides them. A select keeps a fault of its condition, or
+ * else of the arm it takes. A call passes on the fault of its first faulted argument
+ * without being made. Only a fault that reaches the result gives it.
+ * @param stack The stack, with sp one past its top
+ * @param ip The instruction after the one that faulted
+ * @param fault The fault of the entry on top of the stack
+ * @return The value of the expression, or a VAL_ERROR or VAL_INF value for a fault
+ */
+static value_t
+bc_run_faults (struct bc_program const *prog,
+               sys_int_long const *vars,
+               union bc_slot *stack,
+               union bc_slot *sp,
+               struct bc_insn const *ip,
+               unsigned char fault) {
+	unsigned char  local[BC_STACK_LOCAL];
+	unsigned char *faults = local; // fault of each stack entry
+	double const  *k = prog->consts;
+	union bc_slot  r;
+	unsigned char  rf;
+	size_t         top, i;
+	value_t        result;
+
+	if (prog->depth > BC_STACK_LOCAL) {
+		faults = (unsigned char *) malloc(prog->depth);
+		assert(faults); // throw error - bc_run_faults: malloc could not do allocation
+	}
+	memset(faults, 0, (size_t) (sp - stack));
+	faults[sp - 1 - stack] = fault;
+
+	for (;; ip++) {
+		enum bc_opcode op = ip->op;
+
+		switch (op) {
+		case BC_CONST:
+		case BC_LOAD:
+		case BC_FCONST:
+			faults[sp - stack] = 0;
+			if (op == BC_FCONST) sp->dbl  = k[ip->arg];
+			else                 sp->lint = (op == BC_CONST) ? ip->arg : vars[ip->arg];
+			sp++;
+			continue;
+		case BC_RET:
+		case BC_FRET:
+			top = (size_t) (--sp - stack);
+			if (faults[top])       result = value_new_type(BC_FAULT_TYPE(faults[top]));
+			else if (op == BC_RET) result = value_new_lint(sp->lint);
+			else                   result = value_new_double(sp->dbl);
+			goto done;
+		case BC_ITOF:  sp[-1].dbl  = (double) sp[-1].lint; continue;
+		case BC_ITOF2: sp[-2].dbl  = (double) sp[-2].lint; continue;
+		case BC_FTEST: sp[-1].lint = sp[-1].dbl != 0.0;    continue;
+		case BC_CALL:
+			sp -= prog->calls[ip->arg].argc;
+			top = (size_t) (sp - stack);
+			// an argument's fault is passed on instead, without making the call
+			for (i = 0, fault = 0; !fault && (i < prog->calls[ip->arg].argc); i++) fault = faults[top + i];
+			if (!fault && (bc_call_run(&prog->calls[ip->arg], sp) != EXP_OK)) fault = BC_FAULT_CALL;
+			faults[top] = fault;
+			sp++;
+			continue;
+		case BC_SELECT:
+			// cond, then, else -- then is one past cond and else two
+			sp -= 2;
+			top = (size_t) (sp - 1 - stack);
+			if (!faults[top]) faults[top] = faults[top + 1 + (sp[-1].lint == 0)];
+			sp[-1] = sp[sp[-1].lint == 0];
+			continue;
+		/* the _K opcodes are in the same order as their plain forms */
+		case BC_ADD_K: case BC_SUB_K: case BC_MUL_K: case BC_DIV_K:
+			op = (enum bc_opcode) (BC_ADD + (op - BC_ADD_K));
+			r.lint = ip->arg;
+			rf = 0;
+			break;
+		case BC_FADD_K: case BC_FSUB_K: case BC_FMUL_K: case BC_FDIV_K:
+			op = (enum bc_opcode) (BC_FADD + (op - BC_FADD_K));
+			r.dbl = k[ip->arg];
+			rf = 0;
+			break;
+		default:
+			r  = *--sp;
+			rf = faults[sp - stack];
+			break;
+		}
+		top = (size_t) (sp - 1 - stack);
+
+		if (!faults[top] && (((op != BC_AND) && (op != BC_OR)) || ((sp[-1].lint != 0) != (op == BC_OR)))) {
+			faults[top] = rf;
+		}
+		fault = bc_apply(op, &sp[-1], r);
+		if (!faults[top]) faults[top] = fault;
+	}
+
+done:
+	if (faults != local) free(faults);
+	return result;
+}
+
+#ifdef BYTECODE_COMPUTED_GOTO
+/* Labels as values are a GNU extension */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+/** Run a compiled program.
+ * Gives the same result as @ref expression_evaluate on the expression it was compiled from.
+ * Both arms of a select are run, so a division that would trap is not made. It faults, as does
+ * a call that fails, and the rest of the program runs in @ref bc_run_faults, which passes the
+ * fault on like an error.
+ * BC_DIV_K is never given a divisor of 0 or -1.
+ * @param prog The program to run.
+ * @param vars Variable values, indexed like the symbol names given to @ref bytecode_compile.
+ * 		May be NULL if the program reads no variables.
+ * @return The value of the expression, or a VAL_ERROR or VAL_INF value if it faulted or a function call failed.
+ */
+value_t
+bytecode_run (struct bc_program const *prog,
+              sys_int_long const *vars) {
+	union bc_slot  local[BC_STACK_LOCAL];
+	union bc_slot *stack = local;
+	union bc_slot *sp;          // one past the top of the stack
+	struct bc_insn const *ip;   // next instruction
+	double const  *k;           // double constants
+	unsigned char  fault;       // fault of the operation that stopped the fast path
+	value_t        result;
+
+	assert(prog);
+	assert(vars || (prog->nvars == 0));
+
+	if (prog->depth > BC_STACK_LOCAL) {
+		stack = (union bc_slot *) malloc(prog->depth * sizeof(union bc_slot));
+		assert(stack); // throw error - bytecode_run: malloc could not do allocation
+	}
+	sp = stack;
+	ip = prog->code;
+	k  = prog->consts;
+
+#ifdef BYTECODE_COMPUTED_GOTO
+	{
+		static void const *const labels[BC_OPCODE_COUNT] = {
+			[BC_CONST]  = &&L_BC_CONST,  [BC_LOAD]   = &&L_BC_LOAD,
+			[BC_ADD]    = &&L_BC_ADD,    [BC_SUB]    = &&L_BC_SUB,
+			[BC_MUL]    = &&L_BC_MUL,    [BC_DIV]    = &&L_BC_DIV,
+			[BC_ADD_K]  = &&L_BC_ADD_K,  [BC_SUB_K]  = &&L_BC_SUB_K,
+			[BC_MUL_K]  = &&L_BC_MUL_K,  [BC_DIV_K]  = &&L_BC_DIV_K,
+			[BC_RET]    = &&L_BC_RET,
+			[BC_FCONST] = &&L_BC_FCONST,
+			[BC_FADD]   = &&L_BC_FADD,   [BC_FSUB]   = &&L_BC_FSUB,
+			[BC_FMUL]   = &&L_BC_FMUL,   [BC_FDIV]   = &&L_BC_FDIV,
+			[BC_FADD_K] = &&L_BC_FADD_K, [BC_FSUB_K] = &&L_BC_FSUB_K,
+			[BC_FMUL_K] = &&L_BC_FMUL_K, [BC_FDIV_K] = &&L_BC_FDIV_K,
+			[BC_ITOF]   = &&L_BC_ITOF,   [BC_ITOF2]  = &&L_BC_ITOF2,
+			[BC_FRET]   = &&L_BC_FRET,   [BC_CALL]   = &&L_BC_CALL,
+			[BC_LT]     = &&L_BC_LT,     [BC_GT]     = &&L_BC_GT,
+			[BC_LE]     = &&L_BC_LE,     [BC_GE]     = &&L_BC_GE,
+			[BC_EQ]     = &&L_BC_EQ,     [BC_NE]     = &&L_BC_NE,
+			[BC_FLT]    = &&L_BC_FLT,    [BC_FGT]    = &&L_BC_FGT,
+			[BC_FLE]    = &&L_BC_FLE,    [BC_FGE]    = &&L_BC_FGE,
+			[BC_FEQ]    = &&L_BC_FEQ,    [BC_FNE]    = &&L_BC_FNE,
+			[BC_AND]    = &&L_BC_AND,    [BC_OR]     = &&L_BC_OR,
+			[BC_FTEST]  = &&L_BC_FTEST,  [BC_SELECT] = &&L_BC_SELECT
+		};
+		#define BC_CASE(op) L_##op:
+		#define BC_NEXT()   goto *labels[(ip++)->op]
+
+		BC_NEXT();
+#else
+	for (;;) {
+		#define BC_CASE(op) case op:
+		#define BC_NEXT()   break
+
+		switch ((ip++)->op) {
+#endif
+		BC_CASE(BC_CONST)  sp++; sp[-1].lint = ip[-1].arg;                  BC_NEXT();
+		BC_CASE(BC_LOAD)   sp++; sp[-1].lint = vars[ip[-1].arg];            BC_NEXT();
+		BC_CASE(BC_ADD)    sp--; sp[-1].lint = sp[-1].lint + sp[0].lint;    BC_NEXT();
+		BC_CASE(BC_SUB)    sp--; sp[-1].lint = sp[-1].lint - sp[0].lint;    BC_NEXT();
+		BC_CASE(BC_MUL)    sp--; sp[-1].lint = sp[-1].lint * sp[0].lint;    BC_NEXT();
+		BC_CASE(BC_DIV)
+			sp--;
+			if ((fault = BC_DIV_FAULT(sp[-1].lint, sp[0].lint)) != 0) goto faulted;
+			sp[-1].lint = sp[-1].lint / sp[0].lint;
+			BC_NEXT();
+		BC_CASE(BC_ADD_K)  sp[-1].lint = sp[-1].lint + ip[-1].arg;          BC_NEXT();
+		BC_CASE(BC_SUB_K)  sp[-1].lint = sp[-1].lint - ip[-1].arg;          BC_NEXT();
+		BC_CASE(BC_MUL_K)  sp[-1].lint = sp[-1].lint * ip[-1].arg;          BC_NEXT();
+		BC_CASE(BC_DIV_K)  sp[-1].lint = sp[-1].lint / ip[-1].arg;          BC_NEXT();
+		BC_CASE(BC_RET)    result = value_new_lint((--sp)->lint);           goto done;
+		BC_CASE(BC_FCONST) sp++; sp[-1].dbl = k[ip[-1].arg];                BC_NEXT();
+		BC_CASE(BC_FADD)   sp--; sp[-1].dbl = sp[-1].dbl + sp[0].dbl;       BC_NEXT();
+		BC_CASE(BC_FSUB)   sp--; sp[-1].dbl = sp[-1].dbl - sp[0].dbl;       BC_NEXT();
+		BC_CASE(BC_FMUL)   sp--; sp[-1].dbl = sp[-1].dbl * sp[0].dbl;       BC_NEXT();
+		BC_CASE(BC_FDIV)
+			sp--;
+			if (sp[0].dbl == 0.0) { fault = BC_FAULT_ZERO; goto faulted; }
+			sp[-1].dbl = sp[-1].dbl / sp[0].dbl;
+			BC_NEXT();
+		BC_CASE(BC_FADD_K) sp[-1].dbl = sp[-1].dbl + k[ip[-1].arg];         BC_NEXT();
+		BC_CASE(BC_FSUB_K) sp[-1].dbl = sp[-1].dbl - k[ip[-1].arg];         BC_NEXT();
+		BC_CASE(BC_FMUL_K) sp[-1].dbl = sp[-1].dbl * k[ip[-1].arg];         BC_NEXT();
+		BC_CASE(BC_FDIV_K)
+			if (k[ip[-1].arg] == 0.0) { fault = BC_FAULT_ZERO; goto faulted; }
+			sp[-1].dbl = sp[-1].dbl / k[ip[-1].arg];
+			BC_NEXT();
+		BC_CASE(BC_ITOF)   sp[-1].dbl = (double) sp[-1].lint;               BC_NEXT();
+		BC_CASE(BC_ITOF2)  sp[-2].dbl = (double) sp[-2].lint;               BC_NEXT();
+		BC_CASE(BC_FRET)   result = value_new_double((--sp)->dbl);         goto done;
+		BC_CASE(BC_CALL)
+			sp -= prog->calls[ip[-1].arg].argc;
+			if (bc_call_run(&prog->calls[ip[-1].arg], sp) != EXP_OK) {
+				sp++;
+				fault = BC_FAULT_CALL;
+				goto faulted;
+			}
+			sp++;
+			BC_NEXT();
+		BC_CASE(BC_LT)     sp--; sp[-1].lint = sp[-1].lint <  sp[0].lint;   BC_NEXT();
+		BC_CASE(BC_GT)     sp--; sp[-1].lint = sp[-1].lint >  sp[0].lint;   BC_NEXT();
+		BC_CASE(BC_LE)     sp--; sp[-1].lint = sp[-1].lint <= sp[0].lint;   BC_NEXT();
+		BC_CASE(BC_GE)     sp--; sp[-1].lint = sp[-1].lint >= sp[0].lint;   BC_NEXT();
+		BC_CASE(BC_EQ)     sp--; sp[-1].lint = sp[-1].lint == sp[0].lint;   BC_NEXT();
+		BC_CASE(BC_NE)     sp--; sp[-1].lint = sp[-1].lint != sp[0].lint;   BC_NEXT();
+		BC_CASE(BC_FLT)    sp--; sp[-1].lint = sp[-1].dbl <  sp[0].dbl;     BC_NEXT();
+		BC_CASE(BC_FGT)    sp--; sp[-1].lint = sp[-1].dbl >  sp[0].dbl;     BC_NEXT();
+		BC_CASE(BC_FLE)    sp--; sp[-1].lint = sp[-1].dbl <= sp[0].dbl;     BC_NEXT();
+		BC_CASE(BC_FGE)    sp--; sp[-1].lint = sp[-1].dbl >= sp[0].dbl;     BC_NEXT();
+		BC_CASE(BC_FEQ)    sp--; sp[-1].lint = sp[-1].dbl == sp[0].dbl;     BC_NEXT();
+		BC_CASE(BC_FNE)    sp--; sp[-1].lint = sp[-1].dbl != sp[0].dbl;     BC_NEXT();
+		BC_CASE(BC_AND)    sp--; sp[-1].lint = (sp[-1].lint != 0) & (sp[0].lint != 0); BC_NEXT();
+		BC_CASE(BC_OR)     sp--; sp[-1].lint = (sp[-1].lint != 0) | (sp[0].lint != 0); BC_NEXT();
+		BC_CASE(BC_FTEST)  sp[-1].lint = sp[-1].dbl != 0.0;                 BC_NEXT();
+		// cond, then, else -- then is one past cond and else two
+		BC_CASE(BC_SELECT) sp -= 2; sp[-1] = sp[sp[-1].lint == 0];          BC_NEXT();
+#ifndef BYTECODE_COMPUTED_GOTO
+		default:
+			assert(0); // throw error - bytecode_run: invalid opcode
+			result = value_new_type(VAL_ERROR);
+			goto done;
+		}
+#endif
+	}
+	#undef BC_CASE
+	#undef BC_NEXT
+
+faulted:
+	result = bc_run_faults(prog, vars, stack, sp, ip, fault);
+done:
+	if (stack != local) free(stack);
+	return result;
+}
+
+#ifdef BYTECODE_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef BYTECODE_TEST_MAIN
+/*
+ * Checks bytecode_run against expression_evaluate_r on random expressions: integer
+ * arithmetic, doubles, comparisons, selects, and calls compiled by bytecode_compile_funcs.
+ * The tree evaluator gets the same expression with the variables written in as constants.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DBYTECODE_TEST_MAIN -o bytecode bytecode.c expression.c token.c symbolic.c reparse.c scan.c types.c workspace.c errors.c traverse.c funcs.c arena.c -pthread -lm
+ */
+#include <stdio.h>
+#include <math.h>
+
+#define TEST_RUNS 2000
+#define TEST_VARS 3
+
+#define TEST_DOUBLES  0x1 ///< Double constants
+#define TEST_COMPARES 0x2 ///< Comparisons, && and ||
+#define TEST_SELECTS  0x4 ///< c ? t : e
+#define TEST_CALLS    0x8 ///< Calls to the builtin functions
+
+static char const *const test_syms[TEST_VARS] = {"a", "b", "c"};
+
+static int const test_kinds[] = {
+	0,
+	TEST_DOUBLES,
+	TEST_COMPARES,
+	TEST_SELECTS,
+	TEST_COMPARES | TEST_SELECTS,
+	TEST_CALLS,
+	TEST_DOUBLES | TEST_COMPARES | TEST_SELECTS | TEST_CALLS,
+};
+
+#define TEST_KIND_COUNT (sizeof(test_kinds) / sizeof(test_kinds[0]))
+
+/**
+ * The same random expression twice, once with symbols and once with their values.
+ */
+struct test_exp {
+	char                sym[4096]; ///< With the variables as symbols, for the bytecode
+	char                val[4096]; ///< With the variables written in, for the tree
+	size_t              nsym;      ///< Length of sym
+	size_t              nval;      ///< Length of val
+	int                 calls;     ///< Non-zero if it has a function call
+	sys_int_long const *vars;      ///< Values written in for the variables
+};
+
+/* Append str to both forms */
+static void
+test_put (struct test_exp *t, char const *str) {
+	t->nsym += (size_t) sprintf(t->sym + t->nsym, "%s", str);
+	t->nval += (size_t) sprintf(t->val + t->nval, "%s", str);
+}
+
+/* Append a random expression of up to depth levels using the kinds of operation in kind */
+static void
+test_expression (struct test_exp *t, int kind, int depth) {
+	static char const *const arith[] = {"+", "-", "*", "/"};
+	static char const *const compare[] = {"<", ">", "<=", ">=", "==", "!=", "&&", "||"};
+	static struct { char const *name; int args; } const funcs[] = {
+		{"abs", 1}, {"sign", 1}, {"min", 0}, {"max", 0}, {"pow", 2}, {"clamp", 3},
+	};
+	char str[32];
+	int pick, n, k;
+
+	if ((depth == 0) || (rand() % 4 == 0)) {
+		pick = rand() % 6;
+		if (pick < 3) {
+			t->nsym += (size_t) sprintf(t->sym + t->nsym, "%s", test_syms[pick]);
+			t->nval += (size_t) sprintf(t->val + t->nval, "(0%+ld)", t->vars[pick]);
+			return;
+		}
+		if ((pick == 3) && (kind & TEST_DOUBLES)) sprintf(str, "%d.%d", rand() % 4, (rand() % 2) * 5);
+		else if (pick == 4) sprintf(str, "(0-%d)", rand() % 3);
+		else sprintf(str, "%d", rand() % 10);
+		test_put(t, str);
+		return;
+	}
+
+	pick = rand() % 4;
+	if ((pick == 1) && (kind & TEST_SELECTS)) {
+		test_put(t, "(");
+		test_expression(t, kind, depth - 1);
+		test_put(t, " ? ");
+		test_expression(t, kind, depth - 1);
+		test_put(t, " : ");
+		test_expression(t, kind, depth - 1);
+		test_put(t, ")");
+	} else if ((pick == 2) && (kind & TEST_CALLS)) {
+		k = rand() % (int) (sizeof(funcs) / sizeof(funcs[0]));
+		n = funcs[k].args ? funcs[k].args : 1 + (rand() % 3);
+		t->calls = 1;
+		test_put(t, funcs[k].name);
+		test_put(t, "(");
+		while (n--) {
+			test_expression(t, kind, depth - 1);
+			if (n) test_put(t, ", ");
+		}
+		test_put(t, ")");
+	} else {
+		test_put(t, "(");
+		test_expression(t, kind, depth - 1);
+		test_put(t, " ");
+		if ((pick == 3) && (kind & TEST_COMPARES)) test_put(t, compare[rand() % 8]);
+		else test_put(t, arith[rand() % 4]);
+		test_put(t, " ");
+		test_expression(t, kind, depth - 1);
+		test_put(t, ")");
+	}
+}
+
+/* True if the bytecode result got matches the tree result want, or both are errors */
+static int
+test_same (int ret, value_t want, value_t got) {
+	if (ret != EXP_OK) return !VAL_IS_NUMBER(got);
+	if (want.type != got.type) return 0;
+	if (want.type == VAL_LINT) return want.data.lint == got.data.lint;
+	return (want.data.dbl == got.data.dbl) || (isnan(want.data.dbl) && isnan(got.data.dbl));
+}
+
+int
+main (void) {
+	struct exp_funcs *funcs = exp_funcs_new();
+	sys_int_long vars[TEST_VARS];
+	struct test_exp *t = malloc(sizeof(*t));
+	size_t kind;
+	int run, bad = 0;
+
+	srand(1);
+	for (kind = 0; kind < TEST_KIND_COUNT; kind++) {
+		for (run = 0; run < TEST_RUNS; run++) {
+			struct bc_program *prog;
+			struct exp_error err;
+			expression_t exp, con;
+			value_t want, got;
+			int ret;
+
+			vars[0] = (rand() % 41) - 20;
+			vars[1] = (rand() % 5) - 2; // divisors of 0 and -1 in many runs
+			vars[2] = (rand() % 41) - 20;
+			t->nsym = t->nval = 0;
+			t->calls = 0;
+			t->vars = vars;
+			test_expression(t, test_kinds[kind], 4);
+
+			if ((string_to_expression_r(t->nsym, t->sym, &exp, &err) != EXP_OK)
+			    || (string_to_expression_r(t->nval, t->val, &con, &err) != EXP_OK)) {
+				printf("FAIL parse %s: %s\n", t->sym, err.msg);
+				return 1;
+			}
+			ret = t->calls ? bytecode_compile_funcs(exp, TEST_VARS, test_syms, funcs, &prog, &err)
+			               : bytecode_compile(exp, TEST_VARS, test_syms, &prog, &err);
+			if (ret != EXP_OK) {
+				printf("FAIL compile %s: %s\n", t->sym, err.msg);
+				return 1;
+			}
+
+			ret = t->calls ? expression_evaluate_calls_r(con, exp_funcs_resolve, funcs, &want, &err)
+			               : expression_evaluate_r(con, &want, &err);
+			got = bytecode_run(prog, vars);
+			if (!test_same(ret, want, got)) {
+				printf("FAIL a = %ld, b = %ld, c = %ld: %s\n", vars[0], vars[1], vars[2], t->sym);
+				bad++;
+			}
+
+			bytecode_free(prog);
+			expression_free(con);
+			expression_free(exp);
+		}
+	}
+
+	printf("%lu cases, %d failures\n", (unsigned long) (TEST_KIND_COUNT * TEST_RUNS), bad);
+	free(t);
+	exp_funcs_free(funcs);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef BYTECODE_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,153 @@
+/**
+ * @file bytecode.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Compiles expression trees to flat postfix bytecode and runs it on a small stack machine.
+ * A compiled program is one contiguous block, so running it never chases tree pointers.
+ *
+ * Each operation is typed when compiled. A subtree of long ints only uses the long int
+ * operations, and a subtree with any double in it uses the double operations, with its
+ * long int parts converted where they meet. The machine never looks at a value's type.
+ * Comparisons and logical operations give a long int whatever their operands are.
+ *
+ * A select, c ? a : b, runs the code for both arms and then picks one by indexing
+ * the stack, so the program has no jumps and the machine never branches on data.
+ * A division that would trap in an arm is not made, and a call that fails has no value.
+ * Their stack entries are marked with a fault instead, which only gives the result if it reaches it.
+ *
+ * Programs compiled with a function registry may call functions, like max(a, b).
+ * Each call is resolved when compiling, so running it calls through a function pointer.
+ */
+#ifndef _BYTECODE_H_
+#define _BYTECODE_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "expression_lite.h" // just need pointer expression_t
+
+struct exp_func;
+struct exp_funcs;
+
+/**
+ * Bytecode operations.
+ * Operations pop their operands from the stack and push their result.
+ * The _K forms take their right operand from arg instead of the stack.
+ * The BC_F forms work on doubles and take constants from the program's consts, with arg as the index.
+ * Comparisons push 1 if they hold and 0 otherwise.
+ */
+enum bc_opcode {
+	BC_CONST, ///< Push arg
+	BC_LOAD,  ///< Push vars[arg]
+	BC_ADD,   ///< Pop right, pop left, push left + right
+	BC_SUB,   ///< Pop right, pop left, push left - right
+	BC_MUL,   ///< Pop right, pop left, push left * right
+	BC_DIV,   ///< Pop right, pop left, push left / right. Faults on a divisor of 0, and of -1 with LONG_MIN.
+	BC_ADD_K, ///< Pop left, push left + arg
+	BC_SUB_K, ///< Pop left, push left - arg
+	BC_MUL_K, ///< Pop left, push left * arg
+	BC_DIV_K, ///< Pop left, push left / arg. arg is never 0 or -1.
+	BC_RET,   ///< Pop the result and stop
+	BC_FCONST, ///< Push consts[arg]
+	BC_FADD,   ///< Pop right, pop left, push left + right
+	BC_FSUB,   ///< Pop right, pop left, push left - right
+	BC_FMUL,   ///< Pop right, pop left, push left * right
+	BC_FDIV,   ///< Pop right, pop left, push left / right. Faults on a divisor of 0.0.
+	BC_FADD_K, ///< Pop left, push left + consts[arg]
+	BC_FSUB_K, ///< Pop left, push left - consts[arg]
+	BC_FMUL_K, ///< Pop left, push left * consts[arg]
+	BC_FDIV_K, ///< Pop left, push left / consts[arg]. Faults on a divisor of 0.0.
+	BC_ITOF,   ///< Convert the long int on top of the stack to a double
+	BC_ITOF2,  ///< Convert the long int under the top of the stack to a double
+	BC_FRET,   ///< Pop the double result and stop
+	BC_CALL,   ///< Pop calls[arg].argc arguments, push the function's value
+	BC_LT,     ///< Pop right, pop left, push left < right
+	BC_GT,     ///< Pop right, pop left, push left > right
+	BC_LE,     ///< Pop right, pop left, push left <= right
+	BC_GE,     ///< Pop right, pop left, push left >= right
+	BC_EQ,     ///< Pop right, pop left, push left == right
+	BC_NE,     ///< Pop right, pop left, push left != right
+	BC_FLT,    ///< Pop double right, pop double left, push left < right
+	BC_FGT,    ///< Pop double right, pop double left, push left > right
+	BC_FLE,    ///< Pop double right, pop double left, push left <= right
+	BC_FGE,    ///< Pop double right, pop double left, push left >= right
+	BC_FEQ,    ///< Pop double right, pop double left, push left == right
+	BC_FNE,    ///< Pop double right, pop double left, push left != right
+	BC_AND,    ///< Pop right, pop left, push left && right
+	BC_OR,     ///< Pop right, pop left, push left || right
+	BC_FTEST,  ///< Replace the double on top of the stack with 1 if it is not zero and 0 if it is
+	BC_SELECT, ///< Pop else, pop then, pop cond, push then if cond is not zero and else if it is
+	BC_OPCODE_COUNT ///< Number of opcodes
+};
+
+/// Faults a stack entry can have, 0 for none
+#define BC_FAULT_ZERO 1 ///< Division by zero, giving a VAL_ERROR result
+#define BC_FAULT_DIV  2 ///< LONG_MIN / -1, giving a VAL_INF result
+#define BC_FAULT_CALL 3 ///< A function call failed, giving a VAL_ERROR result
+
+/// Type of the result a fault gives
+#define BC_FAULT_TYPE(fault) (((fault) == BC_FAULT_DIV) ? VAL_INF : VAL_ERROR)
+
+/// Fault of the long int division l / r, 0 if it can be made
+#define BC_DIV_FAULT(l, r) (((r) == 0) ? BC_FAULT_ZERO : (((r) == -1) && ((l) == SYS_INT_LONG_T_MIN)) ? BC_FAULT_DIV : 0)
+
+/**
+ * A single bytecode instruction.
+ */
+struct bc_insn {
+	enum bc_opcode op;  ///< The operation
+	sys_int_long   arg; ///< Constant or variable index, when the operation takes one
+};
+
+/**
+ * A function call site.
+ */
+struct bc_call {
+	struct exp_func const *func;    ///< The function, resolved when compiled
+	size_t                 argc;    ///< Number of arguments
+	unsigned char const   *doubles; ///< Non-zero for each argument that is a double
+	enum value_types       type;    ///< Type of the function's value
+};
+
+/**
+ * A compiled expression.
+ */
+struct bc_program {
+	size_t          len;   ///< Number of instructions, including the final BC_RET
+	size_t          depth; ///< Largest number of stack entries used at once
+	size_t          nvars; ///< Number of variables the program reads
+	enum value_types type; ///< Type of the result. Programs without consts or calls use no double operations.
+	size_t          nconsts; ///< Number of double constants
+	size_t          ncalls; ///< Number of function calls
+	struct bc_insn *code;  ///< Instructions
+	double         *consts; ///< Double constants
+	struct bc_call *calls; ///< Function call sites
+};
+
+int
+bytecode_compile (expression_t exp,
+                  size_t nsyms,
+                  char const *const *syms,
+                  struct bc_program **prog,
+                  struct exp_error *err);
+
+int
+bytecode_compile_funcs (expression_t exp,
+                        size_t nsyms,
+                        char const *const *syms,
+                        struct exp_funcs const *funcs,
+                        struct bc_program **prog,
+                        struct exp_error *err);
+
+void
+bytecode_free (struct bc_program *prog);
+
+value_t
+bytecode_run (struct bc_program const *prog,
+              sys_int_long const *vars);
+
+#endif /* _BYTECODE_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,488 @@
+/**
+ * @file cache.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * A least recently used cache of parsed expressions, keyed by their source string.
+ *
+ * Entries live in a hash table with chained buckets and on a doubly linked list
+ * ordered from most to least recently used. Lookups hash the string while skipping
+ * whitespace that does not separate tokens, so a hit never allocates or parses.
+ */
+#include <stdlib.h> // malloc(), calloc(), free()
+#include "errors.h"
+#include "types.h"
+#include "expression.h"
+#include "cache.h"
+
+/**
+ * A single cached expression.
+ */
+struct exp_cache_entry {
+	unsigned long hash;      ///< Hash of key
+	char         *key;       ///< Source string with insignificant whitespace removed. Not NULL terminated.
+	size_t        key_len;   ///< Length of key
+	expression_t  exp;       ///< The parsed expression
+	struct exp_cache_entry *chain; ///< Next entry in the same bucket
+	struct exp_cache_entry *newer; ///< More recently used entry or NULL
+	struct exp_cache_entry *older; ///< Less recently used entry or NULL
+};
+
+struct exp_cache {
+	struct exp_cache_entry **buckets; ///< Hash table
+	size_t                   nbuckets; ///< Number of buckets. Always a power of 2.
+	struct exp_cache_entry  *newest;  ///< Most recently used entry
+	struct exp_cache_entry  *oldest;  ///< Least recently used entry, the next to be evicted
+	struct exp_cache_stats   stats;   ///< Counters
+};
+
+/// FNV-1a hash parameters
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME  16777619UL
+
+/**
+ * Walks a string's key chars.
+ * Whitespace is dropped, except that a run of whitespace becomes a single space where
+ * dropping it could join two tokens into one. This keeps "1 2" and "12", "1 .5" and "1.5",
+ * "a < = b" and "a <= b", and "1e - 5" and "1e-5" apart, while "1 + 2" and "1+2" match.
+ */
+struct cache_key_iter {
+	char const *str;   ///< Source string
+	size_t      len;   ///< Length of str
+	size_t      index; ///< Index of the next unread char
+	int         prev;  ///< Last key char given or -1
+	int         prev2; ///< Key char before prev or -1
+};
+
+/* True if c can continue a name or a number */
+#define CACHE_IS_WORD(c) (IS_ALNUM(c) || ((c) == '.'))
+/* True if c can start or end a two char operator */
+#define CACHE_IS_OP2(c)  (((c) == '<') || ((c) == '>') || ((c) == '=') || ((c) == '!') || ((c) == '&') || ((c) == '|'))
+
+/** True if the key chars p, a and b could read differently without whitespace between a and b.
+ * That is between parts of a name or a number, between two chars of an operator like <= or &&,
+ * and around the sign of an exponent like 1e-5.
+ */
+static int
+cache_key_joins (int p, int a, int b) {
+	if (CACHE_IS_WORD(a) && CACHE_IS_WORD(b)) return 1;
+	if (CACHE_IS_OP2(a) && CACHE_IS_OP2(b)) return 1;
+	if (((a == 'e') || (a == 'E')) && ((b == '+') || (b == '-'))) return 1;
+	if (((p == 'e') || (p == 'E')) && ((a == '+') || (a == '-')) && CACHE_IS_WORD(b)) return 1;
+	return 0;
+}
+
+/** Next key char.
+ * @return The next key char or -1 at the end of the string.
+ */
+static int
+cache_key_next (struct cache_key_iter *it) {
+	int c;
+
+	if ((it->index < it->len) && IS_WHITESPACE(it->str[it->index])) {
+		for (; (it->index < it->len) && IS_WHITESPACE(it->str[it->index]); it->index++)
+			;
+		// whitespace keeps two tokens apart
+		if ((it->prev != -1) && (it->index < it->len)
+		    && cache_key_joins(it->prev2, it->prev, (unsigned char) it->str[it->index])) {
+			it->prev2 = it->prev;
+			return it->prev = ' ';
+		}
+	}
+	if (it->index >= it->len) return -1;
+
+	c = (unsigned char) it->str[it->index++];
+	it->prev2 = it->prev;
+	return it->prev = c;
+}
+
+/** Start walking a string's key chars.
+ */
+static void
+cache_key_start (struct cache_key_iter *it, size_t str_len, char const *str) {
+	it->str   = str;
+	it->len   = str_len;
+	it->index = 0;
+	it->prev  = -1;
+	it->prev2 = -1;
+}
+
+/** Hash a string's key.
+ * @param[out] key_len Set to the number of key chars.
+ */
+static unsigned long
+cache_hash (size_t str_len, char const *str, size_t *key_len) {
+	struct cache_key_iter it;
+	unsigned long hash = FNV_OFFSET;
+	size_t len = 0;
+	int c;
+
+	cache_key_start(&it, str_len, str);
+	while ((c = cache_key_next(&it)) != -1) {
+		hash = (hash ^ (unsigned long) c) * FNV_PRIME;
+		len++;
+	}
+	*key_len = len;
+	return hash;
+}
+
+/** Compare a string's key to an entry's key.
+ * @return Non-zero if they match.
+ */
+static int
+cache_key_matches (struct exp_cache_entry const *entry, size_t str_len, char const *str) {
+	struct cache_key_iter it;
+	size_t kindex = 0;
+	int c;
+
+	cache_key_start(&it, str_len, str);
+	while ((c = cache_key_next(&it)) != -1) {
+		if (c != (unsigned char) entry->key[kindex++]) return 0;
+	}
+	return 1;
+}
+
+/** Take an entry off the recently used list.
+ */
+static void
+cache_unlink (struct exp_cache *cache, struct exp_cache_entry *entry) {
+	if (entry->newer) entry->newer->older = entry->older;
+	else              cache->newest       = entry->older;
+	if (entry->older) entry->older->newer = entry->newer;
+	else              cache->oldest       = entry->newer;
+	entry->newer = entry->older = NULL;
+}
+
+/** Put an entry at the front of the recently used list.
+ */
+static void
+cache_push_newest (struct exp_cache *cache, struct exp_cache_entry *entry) {
+	entry->older = cache->newest;
+	entry->newer = NULL;
+	if (cache->newest) cache->newest->newer = entry;
+	else               cache->oldest        = entry;
+	cache->newest = entry;
+}
+
+/** Remove an entry from the cache and free it.
+ */
+static void
+cache_remove (struct exp_cache *cache, struct exp_cache_entry *entry) {
+	struct exp_cache_entry **link = &cache->buckets[entry->hash & (cache->nbuckets - 1)];
+
+	// take it out of its bucket
+	while (*link != entry) link = &(*link)->chain;
+	*link = entry->chain;
+
+	cache_unlink(cache, entry);
+	cache->stats.count--;
+
+	expression_free(entry->exp);
+	free(entry->key);
+	free(entry);
+}
+
+/** New expression cache.
+ * @param capacity The maximum number of expressions to hold. Must be at least 1.
+ * @return The new cache. Free with @ref exp_cache_free.
+ */
+struct exp_cache *
+exp_cache_new (size_t capacity) {
+	struct exp_cache *cache;
+	size_t nbuckets = 1;
+
+	assert(capacity > 0);
+
+	// keep chains short -- at least one bucket per entry
+	while (nbuckets < capacity) nbuckets <<= 1;
+
+	cache = (struct exp_cache *) malloc(sizeof(struct exp_cache));
+	assert(cache); // throw error - exp_cache_new: malloc could not do allocation
+	cache->buckets = (struct exp_cache_entry **) calloc(nbuckets, sizeof(struct exp_cache_entry *));
+	assert(cache->buckets); // throw error - exp_cache_new: calloc could not do allocation
+	cache->nbuckets = nbuckets;
+	cache->newest = cache->oldest = NULL;
+
+	cache->stats.hits      = 0;
+	cache->stats.misses    = 0;
+	cache->stats.evictions = 0;
+	cache->stats.count     = 0;
+	cache->stats.capacity  = capacity;
+	return cache;
+}
+
+/** Drop every entry from a cache.
+ * The counters are kept.
+ * @param cache The cache to clear.
+ */
+void
+exp_cache_clear (struct exp_cache *cache) {
+	assert(cache);
+	while (cache->oldest) cache_remove(cache, cache->oldest);
+}
+
+/** Free a cache and every expression it holds.
+ * @param cache The cache to free.
+ */
+void
+exp_cache_free (struct exp_cache *cache) {
+	if (!cache) return;
+	exp_cache_clear(cache);
+	free(cache->buckets);
+	free(cache);
+}
+
+/** Get the parsed expression for a string.
+ * On a hit the cached expression is returned without parsing.
+ * On a miss the string is parsed and added, evicting the least recently used entry when full.
+ * Strings with bad syntax are not cached.
+ *
+ * @param cache The cache to look in.
+ * @param str_len Length of given string
+ * @param str String to parse
+ * @param[out] exp Set to the expression, or NULL on error.
+ * 		The expression belongs to the cache and must not be changed.
+ * 		It stays valid until a later @ref exp_cache_get evicts it or the cache is cleared or freed,
+ * 		unless the caller takes its own reference with @ref expression_ref and later gives it to @ref expression_free.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+exp_cache_get (struct exp_cache *cache,
+               size_t str_len,
+               char const *str,
+               expression_t *exp,
+               struct exp_error *err) {
+	struct exp_cache_entry *entry;
+	struct cache_key_iter it;
+	unsigned long hash;
+	size_t key_len, kindex;
+	int c, ret;
+
+	assert(cache);
+	assert(exp);
+
+	hash = cache_hash(str_len, str, &key_len);
+
+	/* Look for a hit */
+	for (entry = cache->buckets[hash & (cache->nbuckets - 1)]; entry; entry = entry->chain) {
+		if ((entry->hash == hash) && (entry->key_len == key_len) && cache_key_matches(entry, str_len, str)) {
+			cache->stats.hits++;
+			cache_unlink(cache, entry);
+			cache_push_newest(cache, entry);
+			exp_error_clear(err);
+			*exp = entry->exp;
+			return EXP_OK;
+		}
+	}
+
+	/* Miss -- parse it */
+	cache->stats.misses++;
+	if ((ret = string_to_expression_r(str_len, str, exp, err)) != EXP_OK) {
+		return ret;
+	}
+
+	// make room
+	if (cache->stats.count == cache->stats.capacity) {
+		cache_remove(cache, cache->oldest);
+		cache->stats.evictions++;
+	}
+
+	entry = (struct exp_cache_entry *) malloc(sizeof(struct exp_cache_entry));
+	assert(entry); // throw error - exp_cache_get: malloc could not do allocation
+	entry->key = (char *) malloc(key_len ? key_len : 1);
+	assert(entry->key); // throw error - exp_cache_get: malloc could not do allocation
+	cache_key_start(&it, str_len, str);
+	for (kindex = 0; (c = cache_key_next(&it)) != -1; kindex++) {
+		entry->key[kindex] = (char) c;
+	}
+	entry->hash    = hash;
+	entry->key_len = key_len;
+	entry->exp     = *exp;
+
+	entry->chain = cache->buckets[hash & (cache->nbuckets - 1)];
+	cache->buckets[hash & (cache->nbuckets - 1)] = entry;
+	cache_push_newest(cache, entry);
+	cache->stats.count++;
+
+	return EXP_OK;
+}
+
+/** Read a cache's counters.
+ * @param cache The cache to read.
+ * @param[out] stats Set to the cache's counters.
+ */
+void
+exp_cache_stats (struct exp_cache const *cache,
+                 struct exp_cache_stats *stats) {
+	assert(cache);
+	assert(stats);
+	*stats = cache->stats;
+}
+
+#ifdef CACHE_TEST_MAIN
+/*
+ * Checks which strings share a cache entry, then the LRU order and counters.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DCACHE_TEST_MAIN -o cachetest cache.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c arena.c simplify.c
+ */
+#include <stdio.h>
+#include <string.h>
+#include "simplify.h" // expression_equal()
+
+/**
+ * A string that is cached, and another looked up after it.
+ */
+struct test_pair {
+	char const *first; ///< Cached first
+	char const *then;  ///< Looked up next
+	int         hit;   ///< Non-zero if then must hit first's entry
+};
+
+static struct test_pair const test_pairs[] = {
+	{"1 + 2",    "1+2",        1},
+	{"(a*b)-c",  " ( a * b ) - c ", 1},
+	{"a <= b",   "a<=b",       1},
+	{"12",       "1 2",        0},
+	{"1.5",      "1 .5",       0},
+	{"1.5",      "1. 5",       0},
+	{"a <= b",   "a < = b",    0},
+	{"a != b",   "a ! = b",    0},
+	{"a && b",   "a & & b",    0},
+	{"a || b",   "a | | b",    0},
+	{"1e-5",     "1e - 5",     0},
+	{"1e-5",     "1e- 5",      0},
+	{"1e+5",     "1e +5",      0},
+};
+
+#define TEST_COUNT (sizeof(test_pairs) / sizeof(test_pairs[0]))
+
+/**
+ * A lookup in the LRU run, on a cache that holds two entries.
+ */
+struct test_step {
+	char const *str; ///< String looked up
+	int         hit; ///< Non-zero if it must be answered from the cache
+};
+
+static struct test_step const test_steps[] = {
+	{"a+1", 0},
+	{"b+2", 0},
+	{"a+1", 1}, // a+1 is now the newest
+	{"c+3", 0}, // evicts b+2, the oldest
+	{"a+1", 1},
+	{"b+2", 0}, // evicts c+3
+	{"c+3", 0}, // evicts a+1
+	{"b+2", 1},
+	{"1+",  0}, // bad syntax is counted as a miss but not cached
+	{"c+3", 1},
+};
+
+#define TEST_STEPS (sizeof(test_steps) / sizeof(test_steps[0]))
+
+/* Run the lookups of test_steps, checking each against the counters */
+static int
+test_lru (void) {
+	struct exp_cache *cache = exp_cache_new(2);
+	struct exp_cache_stats stats;
+	struct exp_error err;
+	expression_t exp, first_a = NULL, kept;
+	unsigned long hits = 0;
+	size_t i;
+	int bad = 0;
+
+	for (i = 0; i < TEST_STEPS; i++) {
+		int ret = exp_cache_get(cache, strlen(test_steps[i].str), test_steps[i].str, &exp, &err);
+		exp_cache_stats(cache, &stats);
+		hits += test_steps[i].hit;
+		if (stats.hits != hits) {
+			printf("FAIL step %lu \"%s\": %s\n", (unsigned long) i, test_steps[i].str, test_steps[i].hit ? "missed" : "hit");
+			bad++;
+			hits = stats.hits;
+		}
+		if ((ret == EXP_OK) && (strcmp(test_steps[i].str, "a+1") == 0)) {
+			// a hit hands back the same tree
+			if (!first_a) first_a = exp;
+			else if (exp != first_a) {
+				printf("FAIL step %lu: a+1 was parsed again\n", (unsigned long) i);
+				bad++;
+			}
+		}
+	}
+
+	exp_cache_stats(cache, &stats);
+	if ((stats.hits != 4) || (stats.misses != 6) || (stats.evictions != 3) || (stats.count != 2) || (stats.capacity != 2)) {
+		printf("FAIL counters: %lu hits, %lu misses, %lu evictions, %lu of %lu held\n",
+		       stats.hits, stats.misses, stats.evictions, (unsigned long) stats.count, (unsigned long) stats.capacity);
+		bad++;
+	}
+
+	/* A reference taken by the caller outlives the entry */
+	exp_cache_get(cache, 3, "d*4", &kept, &err);
+	expression_ref(kept);
+	exp_cache_get(cache, 3, "e*5", &exp, &err);
+	exp_cache_get(cache, 3, "f*6", &exp, &err); // evicts d*4
+	exp_cache_get(cache, 3, "d*4", &exp, &err);
+	if (exp == kept) {
+		printf("FAIL d*4 was not evicted\n");
+		bad++;
+	}
+	if (!expression_equal(kept, exp)) {
+		printf("FAIL the kept tree of d*4 changed\n");
+		bad++;
+	}
+	expression_free(kept);
+
+	/* Clearing keeps the counters */
+	exp_cache_clear(cache);
+	exp_cache_stats(cache, &stats);
+	if ((stats.count != 0) || (stats.hits != 4) || (stats.misses != 10)) {
+		printf("FAIL clear: %lu held, %lu hits, %lu misses\n", (unsigned long) stats.count, stats.hits, stats.misses);
+		bad++;
+	}
+
+	exp_cache_free(cache);
+	return bad;
+}
+
+int
+main (void) {
+	struct exp_cache_stats stats;
+	struct exp_error err;
+	expression_t first, then;
+	size_t i;
+	int bad = 0;
+
+	for (i = 0; i < TEST_COUNT; i++) {
+		struct test_pair const *t = &test_pairs[i];
+		struct exp_cache *cache = exp_cache_new(8);
+
+		if (exp_cache_get(cache, strlen(t->first), t->first, &first, &err) != EXP_OK) {
+			printf("FAIL parse \"%s\": %s\n", t->first, err.msg);
+			bad++;
+		} else {
+			int ret = exp_cache_get(cache, strlen(t->then), t->then, &then, &err);
+			exp_cache_stats(cache, &stats);
+			if ((stats.hits == 1) != t->hit) {
+				printf("FAIL \"%s\" after \"%s\": %s\n", t->then, t->first, t->hit ? "missed" : "hit");
+				bad++;
+			}
+			if (!t->hit && (ret == EXP_OK) && (then == first)) {
+				printf("FAIL \"%s\" got the tree of \"%s\"\n", t->then, t->first);
+				bad++;
+			}
+		}
+		exp_cache_free(cache);
+	}
+
+	bad += test_lru();
+
+	printf("%lu pairs, %lu lookups, %d failures\n", (unsigned long) TEST_COUNT, (unsigned long) TEST_STEPS, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef CACHE_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,54 @@
+/**
+ * @file cache.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * A least recently used cache of parsed expressions, keyed by their source string.
+ * Strings that only differ in whitespace between tokens share one cache entry,
+ * unless without it two tokens could run together, like "a < = b" and "a <= b".
+ */
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "expression_lite.h" // just need pointer expression_t
+
+/// An expression cache. Its fields are private to cache.c.
+struct exp_cache;
+
+/**
+ * Counters kept by an expression cache.
+ */
+struct exp_cache_stats {
+	unsigned long hits;      ///< Lookups answered from the cache
+	unsigned long misses;    ///< Lookups that had to parse
+	unsigned long evictions; ///< Entries dropped to make room
+	size_t        count;     ///< Entries currently held
+	size_t        capacity;  ///< Maximum number of entries
+};
+
+struct exp_cache *
+exp_cache_new (size_t capacity);
+
+void
+exp_cache_free (struct exp_cache *cache);
+
+void
+exp_cache_clear (struct exp_cache *cache);
+
+int
+exp_cache_get (struct exp_cache *cache,
+               size_t str_len,
+               char const *str,
+               expression_t *exp,
+               struct exp_error *err);
+
+void
+exp_cache_stats (struct exp_cache const *cache,
+                 struct exp_cache_stats *stats);
+
+#endif /* _CACHE_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,428 @@
+/**
+ * @file compact.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Compact, index based expressions.
+ *
+ * A compact expression is one allocation: the header, then the value data, the left
+ * and right child indices, the op codes, and last the symbol names. The ',' trees
+ * of symbol calls and the ':' trees of selects get op codes of their own, so the
+ * evaluator can tell them apart without looking at their parents.
+ */
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memchr(), memcpy(), strncpy()
+#include "errors.h"
+#include "types.h"
+#include "symbolic.h"
+#include "expression.h"
+#include "traverse.h"
+#include "compact.h"
+
+/// Node values kept on the C stack by the evaluator before it moves to the heap
+#define COMPACT_LOCAL 64
+
+/* Length of a symbol's name, which may fill its whole buffer */
+static size_t
+compact_name_len (sym_t const *sym) {
+	char const *end = (char const *) memchr(sym->name, '\0', SYMBOLIC_NAME_SIZE);
+	return end ? (size_t) (end - sym->name) : SYMBOLIC_NAME_SIZE;
+}
+
+/* Op code of a tree node, given its parent or NULL for the root.
+ * Matches how @ref expression_evaluate_calls_r tells argument lists and select arms apart. */
+static unsigned char
+compact_tree_op (expression_t exp, expression_t parent) {
+	char op = exp->data.tree.op;
+
+	assert((unsigned char) op > EXP_COMPACT_VALUE + VAL_DOUBLE); // throw error - compact_tree_op: op collides with the op codes
+	if (parent && (op == ',')
+	    && ((parent->type == EXP_SYMBOLIC) || ((parent->type == EXP_TREE) && (parent->data.tree.op == ',')))) {
+		return EXP_COMPACT_ARGS;
+	}
+	if (parent && (op == ':') && EXP_IS_SELECT(parent) && (parent->data.tree.right == exp)) {
+		return EXP_COMPACT_ARMS;
+	}
+	return (unsigned char) op;
+}
+
+/** Convert an Expression to its compact form.
+ * The expression is walked twice, once to size the allocation and once to fill it in.
+ * A node with several owners is laid out once for each.
+ * @param exp The expression to convert. It is left alone.
+ * @return The compact expression. Free with @ref exp_compact_free.
+ */
+struct exp_compact *
+expression_to_compact (expression_t exp) {
+	struct exp_compact *c;
+	struct exp_walk w;
+	expression_t node, parent;
+	uint32_t *stack; // nodes waiting for their parent
+	size_t count = 0, nvals = 0, names = 0;
+	size_t i = 0, depth = 0, name = 0, len;
+
+	assert(exp);
+
+	/* Count nodes, values, and name chars */
+	exp_walk_init(&w, exp);
+	while ((node = exp_walk_next_post(&w))) {
+		count++;
+		if (node->type == EXP_VALUE) nvals++;
+		if (node->type == EXP_SYMBOLIC) names += compact_name_len(&node->data.sym) + 1;
+	}
+	exp_walk_free(&w);
+	assert(count < EXP_COMPACT_NONE); // throw error - expression_to_compact: too many nodes for 32-bit indices
+	assert(names < EXP_COMPACT_NONE); // throw error - expression_to_compact: too many names for 32-bit offsets
+
+	/* One block, ordered so each array is aligned */
+	c = (struct exp_compact *) malloc(sizeof(struct exp_compact)
+	                                  + (nvals * sizeof(union value_data))
+	                                  + (count * ((2 * sizeof(uint32_t)) + 1))
+	                                  + names);
+	assert(c); // throw error - expression_to_compact: malloc could not do allocation
+	c->count = count;
+	c->nvals = 0;
+	c->vals  = (union value_data *) (c + 1);
+	c->left  = (uint32_t *) (c->vals + nvals);
+	c->right = c->left + count;
+	c->ops   = (unsigned char *) (c->right + count);
+	c->names = (char *) (c->ops + count);
+
+	stack = (uint32_t *) malloc(count * sizeof(uint32_t));
+	assert(stack); // throw error - expression_to_compact: malloc could not do allocation
+
+	/* Lay out the nodes in post-order. Children are popped in reverse. */
+	exp_walk_init(&w, exp);
+	while ((node = exp_walk_next_post(&w))) {
+		parent = w.depth ? w.stack[w.depth - 1].exp : NULL;
+		switch (node->type) {
+		case EXP_TREE:
+			c->right[i] = stack[--depth];
+			c->left[i]  = stack[--depth];
+			c->ops[i]   = compact_tree_op(node, parent);
+			break;
+		case EXP_SYMBOLIC:
+			c->left[i]  = node->data.sym.p ? stack[--depth] : EXP_COMPACT_NONE;
+			c->right[i] = (uint32_t) name;
+			c->ops[i]   = EXP_COMPACT_SYMBOL;
+			len = compact_name_len(&node->data.sym);
+			memcpy(&c->names[name], node->data.sym.name, len);
+			c->names[name + len] = '\0';
+			name += len + 1;
+			break;
+		default:
+			c->left[i]  = (uint32_t) c->nvals;
+			c->right[i] = EXP_COMPACT_NONE;
+			c->ops[i]   = (unsigned char) (EXP_COMPACT_VALUE + node->data.val.type);
+			c->vals[c->nvals++] = node->data.val.data;
+			break;
+		}
+		stack[depth++] = (uint32_t) i++;
+	}
+	exp_walk_free(&w);
+	assert(depth == 1);
+	assert(c->nvals == nvals);
+
+	free(stack);
+	return c;
+}
+
+/** Convert a compact expression back to an Expression.
+ * @param compact The compact expression. It is left alone.
+ * @param arena The arena to build in, or NULL to malloc the nodes
+ * @return The expression_t representation of compact
+ */
+expression_t
+compact_to_expression (struct exp_compact const *compact,
+                       struct exp_arena *arena) {
+	expression_t *nodes, exp;
+	value_t val;
+	sym_t sym;
+	size_t i;
+	unsigned char op;
+
+	assert(compact);
+	assert(compact->count > 0);
+
+	nodes = (expression_t *) malloc(compact->count * sizeof(expression_t));
+	assert(nodes); // throw error - compact_to_expression: malloc could not do allocation
+
+	// children come first, so they are always built by the time their parent is
+	for (i = 0; i < compact->count; i++) {
+		op = compact->ops[i];
+		if (EXP_COMPACT_IS_VALUE(op)) {
+			val.type = (enum value_types) (op - EXP_COMPACT_VALUE);
+			val.data = compact->vals[compact->left[i]];
+			nodes[i] = expression_new_value_in(arena, val);
+		}
+		else if (op == EXP_COMPACT_SYMBOL) {
+			strncpy(sym.name, &compact->names[compact->right[i]], SYMBOLIC_NAME_SIZE);
+			sym.p = (compact->left[i] == EXP_COMPACT_NONE) ? NULL : nodes[compact->left[i]];
+			nodes[i] = expression_new_sym_in(arena, sym);
+		}
+		else {
+			if (op == EXP_COMPACT_ARGS) op = ',';
+			if (op == EXP_COMPACT_ARMS) op = ':';
+			nodes[i] = expression_new_tree_in(arena, (char) op, nodes[compact->left[i]], nodes[compact->right[i]]);
+		}
+	}
+
+	exp = nodes[compact->count - 1];
+	free(nodes);
+	return exp;
+}
+
+/** Free a compact expression.
+ * @param compact The compact expression to free
+ */
+void
+exp_compact_free (struct exp_compact *compact) {
+	assert(compact);
+	free(compact);
+}
+
+/* Gather the arguments of a symbol call from its parameter, in order.
+ * pending must hold as many indices as there are nodes. */
+static size_t
+compact_args (struct exp_compact const *c,
+              uint32_t param,
+              value_t const *res,
+              value_t *args,
+              uint32_t *pending) {
+	size_t nargs = 0, depth = 0;
+	uint32_t j;
+
+	pending[depth++] = param;
+	while (depth) {
+		j = pending[--depth];
+		if (c->ops[j] == EXP_COMPACT_ARGS) {
+			pending[depth++] = c->right[j];
+			pending[depth++] = c->left[j];
+		} else {
+			args[nargs++] = res[j];
+		}
+	}
+	return nargs;
+}
+
+/** Evaluate a compact expression, reporting errors instead of exiting.
+ * Gives the same result as @ref expression_evaluate_calls_r on the expression it was made from.
+ * Every node's value is computed in order, each from values already computed,
+ * so a select's arms and a call's arguments are ready by the time it is reached.
+ * Errors are held as values, like @ref expression_evaluate_calls_r does, and only
+ * one that reaches the root is reported.
+ * @param compact The compact expression to evaluate
+ * @param call Resolves symbol calls, or NULL to make every symbol an error
+ * @param ctx Passed to call
+ * @param[out] result Set to the value of compact
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+exp_compact_evaluate_r (struct exp_compact const *compact,
+                        exp_call_fn call,
+                        void *ctx,
+                        value_t *result,
+                        struct exp_error *err) {
+	value_t   local[COMPACT_LOCAL];
+	value_t  *res = local;
+	value_t  *args = NULL;    // allocated at the first call
+	uint32_t *pending = NULL; // allocated at the first call
+	uint32_t  arms;
+	struct exp_held  held;
+	struct exp_error call_err;
+	size_t    i, j, nargs;
+	unsigned char op;
+	int ret;
+
+	assert(compact);
+	assert(compact->count > 0);
+	assert(result);
+
+	exp_error_clear(err);
+	exp_held_init(&held);
+	if (compact->count > COMPACT_LOCAL) {
+		res = (value_t *) malloc(compact->count * sizeof(value_t));
+		assert(res); // throw error - exp_compact_evaluate_r: malloc could not do allocation
+	}
+
+	for (i = 0; i < compact->count; i++) {
+		op = compact->ops[i];
+		if (EXP_COMPACT_IS_VALUE(op)) {
+			res[i].type = (enum value_types) (op - EXP_COMPACT_VALUE);
+			res[i].data = compact->vals[compact->left[i]];
+		}
+		else if ((op == EXP_COMPACT_ARGS) || (op == EXP_COMPACT_ARMS)) {
+			// used by the call or select above, not as a value of its own
+			res[i] = value_new_type(VAL_UNDEF);
+		}
+		else if (op == EXP_COMPACT_SYMBOL) {
+			exp_error_clear(&call_err);
+			if (!call || (compact->left[i] == EXP_COMPACT_NONE)) {
+				exp_error_set(&call_err, EXP_EEVAL, 0, "Evaluation Error - Cannot evaluate symbol \"%s\"", &compact->names[compact->right[i]]);
+				res[i] = exp_held_add(&held, VAL_ERROR, 0, &call_err);
+				continue;
+			}
+			if (!args) {
+				args    = (value_t *) malloc(compact->count * sizeof(value_t));
+				pending = (uint32_t *) malloc(compact->count * sizeof(uint32_t));
+				assert(args && pending); // throw error - exp_compact_evaluate_r: malloc could not do allocation
+			}
+			nargs = compact_args(compact, compact->left[i], res, args, pending);
+			for (j = 0; (j < nargs) && VAL_IS_NUMBER(args[j]); j++);
+			if (j < nargs) {
+				// an argument's error is passed on without making the call
+				res[i] = args[j];
+			}
+			else if ((ret = call(&compact->names[compact->right[i]], nargs, args, &res[i], ctx, &call_err)) != EXP_OK) {
+				exp_error_set(&call_err, ret, 0, "Evaluation Error - Call to \"%s\" failed", &compact->names[compact->right[i]]);
+				res[i] = exp_held_add(&held, VAL_ERROR, 0, &call_err);
+			}
+		}
+		else if ((op == '?') && (compact->ops[compact->right[i]] == EXP_COMPACT_ARMS)) {
+			arms = compact->right[i];
+			res[i] = expression_select(res[compact->left[i]], res[compact->left[arms]], res[compact->right[arms]]);
+		}
+		else {
+			res[i] = exp_held_operate(&held, (char) op, res[compact->left[i]], res[compact->right[i]]);
+		}
+	}
+
+	*result = res[compact->count - 1];
+	ret = exp_held_report(&held, *result, err);
+	exp_held_free(&held);
+	if (res != local) free(res);
+	free(args);
+	free(pending);
+	return ret;
+}
+
+#ifdef COMPACT_TEST_MAIN
+/*
+ * Round trips expressions through the compact form, and checks that compact
+ * evaluation gives what the tree evaluator gives.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DCOMPACT_TEST_MAIN -o compact compact.c simplify.c funcs.c arena.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c -lm
+ */
+#include <stdio.h>
+#include <string.h> // strcmp(), strlen()
+#include "arena.h"
+#include "funcs.h"
+#include "simplify.h" // expression_equal()
+
+/// Expressions to round trip and evaluate
+static char const *const test_strs[] = {
+	"42",
+	"2.5",
+	"1+2*3-4/2",
+	"7/2.0 + 1",
+	"x*2 + y",
+	"3 < 4 ? 10 : 20",
+	"0 ? 1/0 : 5",
+	"1 ? (2 ? 3 : 4) : 5",
+	"max(1, 2, 3)",
+	"max(1, min(5, 4), pow(2, 3)) + abs(0-7)",
+	"clamp(9, 0, 4) ? max(1,2) : 1/0",
+	"pow(0, 0-1)",
+	"nosuch(1) + 2",
+	"max(1/0, 2)",
+	"1/0 + 2.5",
+};
+#define TEST_STR_COUNT (sizeof(test_strs) / sizeof(test_strs[0]))
+
+/// Terms in the long chain, far more than the evaluator keeps on the C stack
+#define TEST_CHAIN 100000
+
+static int cases, bad;
+
+/* Round trip exp, with and without an arena, and compare the evaluations */
+static void
+test_round_trip (char const *what, expression_t exp, struct exp_funcs *funcs, struct exp_arena *arena) {
+	struct exp_compact *c = expression_to_compact(exp);
+	struct exp_error want_err, err;
+	value_t want, result;
+	expression_t back;
+	int want_ret, ret;
+
+	back = compact_to_expression(c, NULL);
+	cases++;
+	if (!expression_equal(exp, back)) {
+		printf("FAIL %s: changed by the round trip\n", what);
+		bad++;
+	}
+	expression_free(back);
+
+	back = compact_to_expression(c, arena);
+	cases++;
+	if (!expression_equal(exp, back)) {
+		printf("FAIL %s: changed by the round trip into an arena\n", what);
+		bad++;
+	}
+	exp_arena_reset(arena);
+
+	/* With and without a resolver */
+	want_ret = expression_evaluate_calls_r(exp, exp_funcs_resolve, funcs, &want, &want_err);
+	ret = exp_compact_evaluate_r(c, exp_funcs_resolve, funcs, &result, &err);
+	cases++;
+	if ((ret != want_ret) || !value_equal(result, want) || strcmp(err.msg, want_err.msg)) {
+		printf("FAIL %s: returned %d \"%s\", want %d \"%s\"\n", what, ret, err.msg, want_ret, want_err.msg);
+		bad++;
+	}
+	want_ret = expression_evaluate_r(exp, &want, &want_err);
+	ret = exp_compact_evaluate_r(c, NULL, NULL, &result, &err);
+	cases++;
+	if ((ret != want_ret) || !value_equal(result, want) || strcmp(err.msg, want_err.msg)) {
+		printf("FAIL %s without calls: returned %d \"%s\", want %d \"%s\"\n", what, ret, err.msg, want_ret, want_err.msg);
+		bad++;
+	}
+	exp_compact_free(c);
+}
+
+int
+main (void) {
+	struct exp_funcs *funcs = exp_funcs_new();
+	struct exp_arena *arena = exp_arena_new(0);
+	struct exp_compact *c;
+	struct exp_error err;
+	expression_t exp, shared;
+	size_t i;
+
+	for (i = 0; i < TEST_STR_COUNT; i++) {
+		string_to_expression_r(strlen(test_strs[i]), (char *) test_strs[i], &exp, &err);
+		test_round_trip(test_strs[i], exp, funcs, arena);
+		expression_free(exp);
+	}
+
+	/* A shared node is laid out once for each owner */
+	string_to_expression_r(5, "1+2*3", &shared, &err);
+	exp = expression_new_tree('*', shared, expression_ref(shared));
+	c = expression_to_compact(exp);
+	cases++;
+	if ((c->count != 11) || (c->nvals != 6)) {
+		printf("FAIL shared: %lu nodes %lu values, want 11 and 6\n", (unsigned long) c->count, (unsigned long) c->nvals);
+		bad++;
+	}
+	exp_compact_free(c);
+	test_round_trip("shared", exp, funcs, arena);
+	expression_free(exp);
+
+	/* A long chain */
+	exp = expression_new_value(value_new_lint(1));
+	for (i = 1; i < TEST_CHAIN; i++) {
+		exp = expression_new_tree((i % 2) ? '+' : '-', exp, expression_new_value(value_new_lint((sys_int_long) i)));
+	}
+	test_round_trip("chain", exp, funcs, arena);
+	expression_free(exp);
+
+	exp_arena_free(arena);
+	exp_funcs_free(funcs);
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef COMPACT_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
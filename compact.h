@@ -0,0 +1,75 @@
+/**
+ * @file compact.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * A compact, index based layout of expressions.
+ *
+ * Instead of one tagged union per node, the nodes are split over parallel arrays
+ * of op codes, 32-bit child indices and values, and symbol names are kept out of
+ * line. Each node takes 9 bytes, and a value 8 more for its data, against the
+ * 32 of a struct expression.
+ *
+ * The nodes are in post-order, so every node comes after its children and the
+ * root is the last node. @ref exp_compact_evaluate_r evaluates them in one pass
+ * from the first node to the last, without following any pointers.
+ */
+#ifndef _COMPACT_H_
+#define _COMPACT_H_
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint32_t */
+#include "errors.h"
+#include "types.h"
+#include "expression.h"
+
+/// Child index of a symbol without a parameter
+#define EXP_COMPACT_NONE UINT32_MAX
+
+/// Op code of a symbol
+#define EXP_COMPACT_SYMBOL 1
+/// Op code of a ',' between the arguments of a symbol call
+#define EXP_COMPACT_ARGS   2
+/// Op code of the ':' tree that holds the arms of a select
+#define EXP_COMPACT_ARMS   3
+/// Op code of a value of type t is EXP_COMPACT_VALUE + t. Any other op code is a tree's operation.
+#define EXP_COMPACT_VALUE  4
+
+/// True if an op code is a value's
+#define EXP_COMPACT_IS_VALUE(op) ( ((op) >= EXP_COMPACT_VALUE) && ((op) <= EXP_COMPACT_VALUE + VAL_DOUBLE) )
+
+/**
+ * An expression in structure of arrays form.
+ * Made in one allocation by @ref expression_to_compact. Free with @ref exp_compact_free.
+ */
+struct exp_compact {
+	size_t             count; ///< Number of nodes. The root is the last.
+	unsigned char     *ops;   ///< Op code of each node
+	uint32_t          *left;  ///< A tree's left child, a symbol's parameter or EXP_COMPACT_NONE, or the index of a value's data in vals
+	uint32_t          *right; ///< A tree's right child, or the offset of a symbol's name in names
+	size_t             nvals; ///< Number of values
+	union value_data  *vals;  ///< The data of each value, in node order. Its type is in the value's op code.
+	char              *names; ///< Symbol names, each NUL terminated
+};
+
+struct exp_compact *
+expression_to_compact (expression_t exp);
+
+expression_t
+compact_to_expression (struct exp_compact const *compact,
+                       struct exp_arena *arena);
+
+void
+exp_compact_free (struct exp_compact *compact);
+
+int
+exp_compact_evaluate_r (struct exp_compact const *compact,
+                        exp_call_fn call,
+                        void *ctx,
+                        value_t *result,
+                        struct exp_error *err);
+
+#endif /* _COMPACT_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
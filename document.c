@@ -0,0 +1,510 @@
+/**
+ * @file document.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Documents hold many expressions, one per line of a string or file.
+ */
+#define _POSIX_C_SOURCE 200809L // mmap(), open(), fstat()
+
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memchr(), memcpy()
+#include <pthread.h>  // pthread_create(), pthread_join()
+#include <sys/mman.h> // mmap(), munmap()
+#include <sys/stat.h> // fstat()
+#include <fcntl.h>    // open()
+#include <unistd.h>   // close()
+
+#include "errors.h"
+#include "types.h"
+#include "token.h"
+#include "expression.h"
+#include "arena.h"
+#include "document.h"
+
+/** Convert a multi-line String to a Document, reporting errors instead of exiting.
+ * The string is tokenized once, and the token counts are used to size an arena
+ * whose one block holds every expression node.
+ * A line with bad syntax gets a NULL root and parsing carries on with the next line.
+ * @param str_len Length of given string
+ * @param str String to parse. Need not be NULL terminated.
+ * @param[out] err Filled in with the first error, or cleared if every line parsed. May be NULL.
+ * @return The new document. Free with @ref document_free.
+ */
+struct document *
+string_to_document_r (size_t str_len,
+                      char const *str,
+                      struct exp_error *err) {
+	struct token_list list;
+	struct document *doc;
+	size_t count = 0; // number of non-blank lines
+	size_t nodes = 0; // number of nodes needed
+	pindex_t index;
+	size_t root;
+
+	assert(str || (str_len == 0));
+	exp_error_clear(err);
+
+	/* Count lines and nodes -- every number, symbol, and operation is one node */
+	token_list_init(&list);
+	string_to_line_tokens(str_len, str, &list);
+	for (index = 0; index < list.count; index++) {
+		switch (list.tokens[index].kind) {
+		case TOK_END:
+			// line has something on it
+			if ((index > 0) && (list.tokens[index-1].kind != TOK_END)) count++;
+			break;
+		case TOK_NUMBER:
+		case TOK_SYMBOL:
+		case TOK_OP:
+			nodes++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* The document header, then the root index. The nodes go in an arena sized to hold them all. */
+	doc = (struct document *) malloc(sizeof(struct document) + (count * sizeof(expression_t)));
+	assert(doc); // throw error - string_to_document: malloc could not do allocation
+	doc->count  = count;
+	doc->errors = 0;
+	doc->nparts = 0;
+	doc->parts  = NULL;
+	doc->roots  = (expression_t *) (doc + 1);
+	doc->arena  = exp_arena_new(nodes);
+
+	/* Parse each line into the shared nodes */
+	for (index = 0, root = 0; index < list.count; ) {
+		// skip blank lines
+		if (list.tokens[index].kind == TOK_END) {
+			index++;
+			continue;
+		}
+		doc->roots[root] = tokens_to_expression_arena(str, list.tokens, &index, doc->arena, err);
+		if (!doc->roots[root]) doc->errors++;
+		root++;
+	}
+	assert(root == count);
+
+	token_list_free(&list);
+	return doc;
+}
+
+/** Convert a multi-line String to a Document.
+ * Same as @ref string_to_document_r, but exits with a runtime error on bad syntax.
+ * @param str_len Length of given string
+ * @param str String to parse. Need not be NULL terminated.
+ * @return The new document. Free with @ref document_free.
+ */
+struct document *
+string_to_document (size_t str_len,
+                    char const *str) {
+	struct exp_error err;
+	struct document *doc = string_to_document_r(str_len, str, &err);
+
+	if (doc->errors) {
+		rerror("%s (at index %zu)", err.msg, err.index);
+	}
+	return doc;
+}
+
+/** Memory map a whole file for reading.
+ * @param path Path of the file to map.
+ * @param[out] map Set to the mapping, or NULL for an empty file.
+ * @param[out] len Set to the length of the file.
+ * @return 0 on success or -1 if the file could not be opened or mapped.
+ */
+static int
+document_map (char const *path, void **map, size_t *len) {
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	// an empty file cannot be mapped, but is an empty document
+	*len = (size_t) st.st_size;
+	*map = NULL;
+	if (*len == 0) {
+		close(fd);
+		return 0;
+	}
+
+	*map = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (*map == MAP_FAILED) return -1;
+	return 0;
+}
+
+/** Load a Document from a file, reporting errors instead of exiting.
+ * The file is memory mapped instead of read, and parsed as by @ref string_to_document_r.
+ * @param path Path of the file to load.
+ * @param[out] err Filled in with the first error, or cleared if every line parsed. May be NULL.
+ * @return The new document or NULL if the file could not be opened or mapped.
+ */
+struct document *
+document_load_r (char const *path,
+                 struct exp_error *err) {
+	struct document *doc;
+	void *map;
+	size_t len;
+
+	assert(path);
+
+	if (document_map(path, &map, &len) < 0) return NULL;
+	doc = string_to_document_r(len, (char const *) map, err);
+	if (map) munmap(map, len);
+	return doc;
+}
+
+/** Load a Document from a file.
+ * Same as @ref document_load_r, but exits with a runtime error on bad syntax.
+ * @param path Path of the file to load.
+ * @return The new document or NULL if the file could not be opened or mapped.
+ */
+struct document *
+document_load (char const *path) {
+	struct exp_error err;
+	struct document *doc = document_load_r(path, &err);
+
+	if (doc && doc->errors) {
+		rerror("%s: %s (at index %zu)", path, err.msg, err.index);
+	}
+	return doc;
+}
+
+/**
+ * One worker's share of a parallel parse.
+ */
+struct document_chunk {
+	char const       *str;  ///< First char of the chunk. Starts a line.
+	size_t            len;  ///< Length of the chunk. Ends just past a '\n' or at the end of the input.
+	struct document  *doc;  ///< The chunk's parsed lines
+	struct exp_error  err;  ///< The chunk's first error
+	int               joinable; ///< Set if a worker thread was started for the chunk
+};
+
+/* Worker thread -- parse one chunk */
+static void *
+document_chunk_parse (void *arg) {
+	struct document_chunk *chunk = (struct document_chunk *) arg;
+	chunk->doc = string_to_document_r(chunk->len, chunk->str, &chunk->err);
+	return NULL;
+}
+
+/** Convert a multi-line String to a Document using worker threads, reporting errors instead of exiting.
+ * The string is split at line boundaries into one chunk per thread.
+ * Each thread parses its chunk into its own arena, exactly as by @ref string_to_document_r,
+ * and the chunks' expressions are gathered into one document in line order.
+ * This is possible because the parser keeps all of its state in locals.
+ * @param str_len Length of given string
+ * @param str String to parse. Need not be NULL terminated.
+ * @param nthreads Number of threads to use, or 0 to use one per online CPU.
+ * @param[out] err Filled in with the first error in line order, or cleared if every line parsed. May be NULL.
+ * 		The error index is relative to the start of str.
+ * @return The new document. Free with @ref document_free.
+ */
+struct document *
+string_to_document_parallel_r (size_t str_len,
+                               char const *str,
+                               unsigned nthreads,
+                               struct exp_error *err) {
+	struct document_chunk *chunks;
+	pthread_t *threads;
+	struct document *doc;
+	size_t nchunks = 0, count = 0, errors = 0;
+	size_t i, root;
+	pindex_t start;
+
+	assert(str || (str_len == 0));
+
+	if (nthreads == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpu > 0) ? (unsigned) ncpu : 1;
+	}
+	if (nthreads == 1) {
+		return string_to_document_r(str_len, str, err);
+	}
+
+	chunks  = (struct document_chunk *) malloc(nthreads * sizeof(struct document_chunk));
+	threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+	assert(chunks && threads); // throw error - string_to_document_parallel_r: malloc could not do allocation
+
+	/* Split into chunks that end just past a '\n' */
+	for (start = 0; (start < str_len) && (nchunks < nthreads); nchunks++) {
+		pindex_t end = (nchunks == nthreads - 1) ? str_len : start + ((str_len - start) / (nthreads - nchunks));
+		char const *nl;
+
+		if (end < str_len) {
+			nl  = (char const *) memchr(&str[end], '\n', str_len - end);
+			end = nl ? (pindex_t) (nl - str) + 1 : str_len;
+		}
+		chunks[nchunks].str = &str[start];
+		chunks[nchunks].len = end - start;
+		start = end;
+	}
+
+	/* Parse chunks in parallel -- the calling thread takes the first chunk */
+	for (i = 1; i < nchunks; i++) {
+		chunks[i].joinable = (pthread_create(&threads[i], NULL, document_chunk_parse, &chunks[i]) == 0);
+		if (!chunks[i].joinable) {
+			// could not start a thread, so do the work here
+			document_chunk_parse(&chunks[i]);
+		}
+	}
+	if (nchunks > 0) document_chunk_parse(&chunks[0]);
+	for (i = 1; i < nchunks; i++) {
+		if (chunks[i].joinable) pthread_join(threads[i], NULL);
+	}
+
+	/* Gather roots in line order */
+	exp_error_clear(err);
+	for (i = 0; i < nchunks; i++) {
+		count += chunks[i].doc->count;
+		if (chunks[i].doc->errors && !errors) {
+			// first error in line order -- make its index relative to str
+			exp_error_set(err, chunks[i].err.code, (size_t) (chunks[i].str - str) + chunks[i].err.index, "%s", chunks[i].err.msg);
+		}
+		errors += chunks[i].doc->errors;
+	}
+
+	doc = (struct document *) malloc(sizeof(struct document)
+	                                 + (count * sizeof(expression_t))
+	                                 + (nchunks * sizeof(struct document *)));
+	assert(doc); // throw error - string_to_document_parallel_r: malloc could not do allocation
+	doc->count  = count;
+	doc->errors = errors;
+	doc->roots  = (expression_t *) (doc + 1);
+	doc->arena  = NULL;
+	doc->nparts = nchunks;
+	doc->parts  = (struct document **) (doc->roots + count);
+
+	for (i = 0, root = 0; i < nchunks; i++) {
+		memcpy(&doc->roots[root], chunks[i].doc->roots, chunks[i].doc->count * sizeof(expression_t));
+		root += chunks[i].doc->count;
+		doc->parts[i] = chunks[i].doc;
+	}
+
+	free(threads);
+	free(chunks);
+	return doc;
+}
+
+/** Load a Document from a file using worker threads, reporting errors instead of exiting.
+ * The file is memory mapped instead of read, and parsed as by @ref string_to_document_parallel_r.
+ * @param path Path of the file to load.
+ * @param nthreads Number of threads to use, or 0 to use one per online CPU.
+ * @param[out] err Filled in with the first error in line order, or cleared if every line parsed. May be NULL.
+ * @return The new document or NULL if the file could not be opened or mapped.
+ */
+struct document *
+document_load_parallel_r (char const *path,
+                          unsigned nthreads,
+                          struct exp_error *err) {
+	struct document *doc;
+	void *map;
+	size_t len;
+
+	assert(path);
+
+	if (document_map(path, &map, &len) < 0) return NULL;
+	doc = string_to_document_parallel_r(len, (char const *) map, nthreads, err);
+	if (map) munmap(map, len);
+	return doc;
+}
+
+/** Free a Document and all of its expressions.
+ * @param doc The document to free.
+ */
+void
+document_free (struct document *doc) {
+	size_t i;
+
+	if (!doc) return;
+	for (i = 0; i < doc->nparts; i++) {
+		document_free(doc->parts[i]);
+	}
+	if (doc->arena) exp_arena_free(doc->arena);
+	free(doc);
+}
+
+#ifdef DOCUMENT_TEST_MAIN
+/*
+ * Checks line splitting, CRLF line ends, blank lines, and lines that fail to parse,
+ * then checks that the parallel loader gives the serial result at several thread counts,
+ * from a string and from a file.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DDOCUMENT_TEST_MAIN -o document document.c expression.c token.c symbolic.c reparse.c scan.c types.c workspace.c errors.c traverse.c funcs.c arena.c -pthread -lm
+ */
+#include <stdio.h>
+
+#define TEST_LINES 5000
+
+/**
+ * A document and what each of its lines should parse to.
+ */
+struct test_case {
+	char const *str;      ///< The document
+	size_t      count;    ///< Number of non-blank lines
+	size_t      errors;   ///< Number of lines that fail to parse
+	char const *roots[4]; ///< Each expression as a string, or NULL where its line fails
+};
+
+static struct test_case const test_cases[] = {
+	{"",                         0, 0, {NULL}},
+	{"\n\n  \n\t\n",             0, 0, {NULL}},
+	{"\r\n\r\n",                 0, 0, {NULL}},
+	{"1+2",                      1, 0, {"(1 + 2)"}},
+	{"1+2\n",                    1, 0, {"(1 + 2)"}},
+	{"1+2\n3*x\n",               2, 0, {"(1 + 2)", "(3 * x)"}},
+	{"1+2\r\n3*x\r\n",           2, 0, {"(1 + 2)", "(3 * x)"}},
+	{"1+2\r\n3*x",               2, 0, {"(1 + 2)", "(3 * x)"}},
+	{"\r\n a \r\n\r\n\tb\t\n",   2, 0, {"a", "b"}},
+	{"\n\nx ? 1 : 2\n\n(a)\n\n", 2, 0, {"(x ? 1 : 2)", "a"}},
+	{"1+\n2\n)(\n",              3, 2, {NULL, "2", NULL}},
+	{"1+\r\n\r\n2\r\n",          2, 1, {NULL, "2"}},
+	{"(1\nmin(a, 2)\n1.5*b",     3, 1, {NULL, "min(a, 2)", "(1.5 * b)"}},
+	{"*\n*\n*\n*",               4, 4, {NULL, NULL, NULL, NULL}},
+};
+
+#define TEST_COUNT (sizeof(test_cases) / sizeof(test_cases[0]))
+
+static unsigned const test_threads[] = {0, 1, 2, 3, 4, 7, 16, 64};
+
+#define TEST_THREAD_COUNT (sizeof(test_threads) / sizeof(test_threads[0]))
+
+/* True if root is the expression want, or both are NULL */
+static int
+test_root_is (expression_t root, char const *want) {
+	char buf[256];
+
+	if (!root || !want) return !root && !want;
+	expression_to_string(buf, root);
+	return strcmp(buf, want) == 0;
+}
+
+/* True if two documents and their first errors are the same */
+static int
+test_same (struct document const *a, struct exp_error const *aerr,
+           struct document const *b, struct exp_error const *berr) {
+	char buf[256];
+	size_t i;
+
+	if (!a || !b || (a->count != b->count) || (a->errors != b->errors)) return 0;
+	if ((aerr->code != berr->code) || (a->errors && (aerr->index != berr->index))) return 0;
+	for (i = 0; i < a->count; i++) {
+		if (a->roots[i]) expression_to_string(buf, a->roots[i]);
+		if (!test_root_is(b->roots[i], a->roots[i] ? buf : NULL)) return 0;
+	}
+	return 1;
+}
+
+/* Check one table case, parsed serially and in parallel */
+static int
+test_case (struct test_case const *t) {
+	struct document *doc, *par;
+	struct exp_error err, perr;
+	size_t i, len = strlen(t->str);
+	int bad = 0;
+
+	doc = string_to_document_r(len, t->str, &err);
+	if ((doc->count != t->count) || (doc->errors != t->errors) || ((err.code != EXP_OK) != (t->errors != 0))) {
+		bad = 1;
+	}
+	for (i = 0; !bad && (i < t->count); i++) {
+		if (!test_root_is(doc->roots[i], t->roots[i])) bad = 1;
+	}
+	for (i = 0; !bad && (i < TEST_THREAD_COUNT); i++) {
+		par = string_to_document_parallel_r(len, t->str, test_threads[i], &perr);
+		if (!test_same(doc, &err, par, &perr)) bad = 1;
+		document_free(par);
+	}
+	if (bad) printf("FAIL \"%s\"\n", t->str);
+
+	document_free(doc);
+	return bad;
+}
+
+/* A large document with every kind of line, serially and in parallel, from a string and a file */
+static int
+test_large (void) {
+	static char const *const forms[] = {"a+%d\n", "(b*%d)-c\r\n", "\n", "\r\n", "%d +\n", "x ? %d : 2\n", " \t%d\r\n", "min(%d, a)\n"};
+	char *str = (char *) malloc(TEST_LINES * 32);
+	char path[] = "/tmp/document_testXXXXXX";
+	struct document *doc, *par;
+	struct exp_error err, perr;
+	size_t len = 0, i;
+	int fd, bad = 0;
+
+	for (i = 0; i < TEST_LINES; i++) {
+		len += (size_t) sprintf(&str[len], forms[(i * 7 + i / 3) % 8], (int) i);
+	}
+	doc = string_to_document_r(len, str, &err);
+	if ((doc->count < TEST_LINES / 2) || (doc->errors == 0)) {
+		printf("FAIL large: %lu lines, %lu errors\n", (unsigned long) doc->count, (unsigned long) doc->errors);
+		bad++;
+	}
+
+	for (i = 0; i < TEST_THREAD_COUNT; i++) {
+		par = string_to_document_parallel_r(len, str, test_threads[i], &perr);
+		if (!test_same(doc, &err, par, &perr)) {
+			printf("FAIL large with %u threads\n", test_threads[i]);
+			bad++;
+		}
+		document_free(par);
+	}
+
+	fd = mkstemp(path);
+	if ((fd < 0) || (write(fd, str, len) != (ssize_t) len)) {
+		printf("FAIL could not write %s\n", path);
+		bad++;
+	} else {
+		par = document_load_r(path, &perr);
+		if (!test_same(doc, &err, par, &perr)) {
+			printf("FAIL large from a file\n");
+			bad++;
+		}
+		document_free(par);
+		for (i = 0; i < TEST_THREAD_COUNT; i++) {
+			par = document_load_parallel_r(path, test_threads[i], &perr);
+			if (!test_same(doc, &err, par, &perr)) {
+				printf("FAIL large from a file with %u threads\n", test_threads[i]);
+				bad++;
+			}
+			document_free(par);
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+
+	document_free(doc);
+	free(str);
+	return bad;
+}
+
+int
+main (void) {
+	size_t i;
+	int bad = 0;
+
+	for (i = 0; i < TEST_COUNT; i++) {
+		bad += test_case(&test_cases[i]);
+	}
+	bad += test_large();
+
+	printf("%lu cases, %d failures\n", (unsigned long) TEST_COUNT + 1, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef DOCUMENT_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,68 @@
+/**
+ * @file document.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Documents hold many expressions, one per line of a string or file.
+ * All of a document's expressions are built in one arena and are freed together.
+ * Large inputs can be split into chunks of lines that are parsed by worker threads,
+ * in which case each chunk has its own arena.
+ */
+#ifndef _DOCUMENT_H_
+#define _DOCUMENT_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "expression_lite.h" // just need pointer expression_t
+
+/**
+ * A parsed set of newline separated expressions.
+ * Blank lines do not produce an expression.
+ * The expressions belong to the document and are freed with it. Their nodes are arena
+ * nodes, so @ref expression_free leaves them alone, and @ref expression_simplify
+ * rewrites them in place.
+ */
+struct document {
+	size_t        count;  ///< Number of expressions
+	size_t        errors; ///< Number of lines that failed to parse
+	expression_t *roots;  ///< The expressions, in line order. NULL for lines that failed to parse.
+
+	struct exp_arena *arena;  ///< Arena holding the nodes of roots, or NULL if they are in parts. Private.
+	size_t            nparts; ///< Number of documents in parts. Private.
+	struct document **parts;  ///< Documents whose nodes are shared by roots. Private.
+};
+
+struct document *
+string_to_document (size_t str_len,
+                    char const *str);
+
+struct document *
+string_to_document_r (size_t str_len,
+                      char const *str,
+                      struct exp_error *err);
+
+struct document *
+document_load (char const *path);
+
+struct document *
+document_load_r (char const *path,
+                 struct exp_error *err);
+
+struct document *
+string_to_document_parallel_r (size_t str_len,
+                               char const *str,
+                               unsigned nthreads,
+                               struct exp_error *err);
+
+struct document *
+document_load_parallel_r (char const *path,
+                          unsigned nthreads,
+                          struct exp_error *err);
+
+void
+document_free (struct document *doc);
+
+#endif /* _DOCUMENT_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
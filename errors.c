@@ -12,6 +12,45 @@
 
 #include "errors.h"
 
+/*
+ * Reentrant error reporting
+ */
+
+/** Reset an error structure to EXP_OK.
+ * @param err The error to clear. May be NULL.
+ */
+void
+exp_error_clear(struct exp_error *err) {
+	if (!err) return;
+	err->code   = EXP_OK;
+	err->index  = 0;
+	err->msg[0] = '\0';
+}
+
+/** Record an error.
+ * Only the first error is kept, so the earliest cause is reported.
+ * @param err The error to fill in. May be NULL.
+ * @param code The error code to record.
+ * @param index Index into the source string where the error was found.
+ * @param fmt printf style message.
+ * @return code, so callers can return the result directly.
+ */
+int
+exp_error_set(struct exp_error *err,
+              int code,
+              size_t index,
+              char const *fmt,
+              ...) {
+	va_list args;
+	if (!err || (err->code != EXP_OK)) return code;
+	err->code  = code;
+	err->index = index;
+	va_start(args, fmt);
+	vsnprintf(err->msg, EXP_ERROR_MSG_SIZE, fmt, args);
+	va_end (args);
+	return code;
+}
+
 /*
  * Runtime Error
  */
@@ -9,6 +9,7 @@
 #define ERRORS_H_
 
 #include <assert.h> /* assert() */
+#include <stddef.h> /* size_t */
 
 #ifdef DEBUG
 	// Make sure assert is enabled
@@ -24,6 +25,42 @@
 #endif
 
 
+/*---------------------------------------------*
+ *     Reentrant error reporting               *
+ *---------------------------------------------*/
+
+/// Indicates that a reentrant (_r) operation was successful.
+#define EXP_OK      0
+/// Indicates that a reentrant (_r) operation failed because of a syntax error in the string.
+#define EXP_ESYNTAX 1
+/// Indicates that a reentrant (_r) operation failed because of a bad symbol name.
+#define EXP_ESYMBOL 2
+/// Indicates that a reentrant (_r) operation failed while evaluating an expression.
+#define EXP_EEVAL   3
+
+/// The length in chars of an error message, including the NULL byte.
+#define EXP_ERROR_MSG_SIZE 96
+
+/**
+ * Error details filled in by the reentrant (_r) functions.
+ * The caller owns the structure, so any number of threads may report errors at once.
+ */
+struct exp_error {
+	int    code;  ///< One of EXP_OK, EXP_ESYNTAX, EXP_ESYMBOL or EXP_EEVAL
+	size_t index; ///< Index into the source string where the error was found. Is 0 for evaluation errors.
+	char   msg[EXP_ERROR_MSG_SIZE]; ///< NULL terminated description of the error
+};
+
+void
+exp_error_clear(struct exp_error *err);
+
+int
+exp_error_set(struct exp_error *err,
+              int code,
+              size_t index,
+              char const *fmt,
+              ...);
+
 /*
  * Runtime Error
  */
@@ -13,6 +13,9 @@
 #include "errors.h"
 #include "symbolic.h"
 #include "expression.h"
+#include "arena.h"
+#include "reparse.h"
+#include "traverse.h"
 
 
 /*---------------------------------------------*
@@ -27,23 +30,65 @@ expression_t
 expression_new (void) {
     expression_t exp = (expression_t) malloc(sizeof(struct expression));
     assert(exp); // throw error - expression_new: malloc could not do allocation
+    exp->refs = 1;
     return exp;
 }
 
+/** New blank expression in an arena.
+ * \param arena The arena to build in, or NULL to malloc the node like @ref expression_new
+ * \return A new empty expression
+ */
 expression_t
-expression_new_value (value_t val) {
-    expression_t exp = expression_new ();
-    exp->type = EXP_VALUE;
-    exp->data.val = val;
+expression_new_in (struct exp_arena *arena) {
+    return arena ? exp_arena_node(arena) : expression_new();
+}
+
+/** Add an owner to an expression.
+ * Each owner releases its reference with @ref expression_free.
+ * Arena nodes have no owners, so they are given back as is.
+ * \return exp
+ */
+expression_t
+expression_ref (expression_t exp) {
+    assert(exp);
+    assert(exp->refs > 0); // throw error - expression_ref: node was already freed
+    if (exp->refs != EXP_ARENA_REFS) exp->refs++;
     return exp;
 }
 
+expression_t
+expression_new_value (value_t val) {
+    return expression_new_value_in(NULL, val);
+}
+
 expression_t
 expression_new_tree (char op,
                      expression_t left,
                      expression_t right) {
+    return expression_new_tree_in(NULL, op, left, right);
+}
+
+expression_t
+expression_new_sym (sym_t sym) {
+    return expression_new_sym_in(NULL, sym);
+}
+
+expression_t
+expression_new_value_in (struct exp_arena *arena,
+                         value_t val) {
+    expression_t exp = expression_new_in (arena);
+    exp->type = EXP_VALUE;
+    exp->data.val = val;
+    return exp;
+}
 
-    expression_t exp = expression_new ();
+expression_t
+expression_new_tree_in (struct exp_arena *arena,
+                        char op,
+                        expression_t left,
+                        expression_t right) {
+
+    expression_t exp = expression_new_in (arena);
     exp->type = EXP_TREE;
     exp->data.tree.op = op;
     exp->data.tree.left = left;
@@ -52,29 +97,48 @@ expression_new_tree (char op,
 }
 
 expression_t
-expression_new_sym (sym_t sym) {
-    expression_t exp = expression_new ();
+expression_new_sym_in (struct exp_arena *arena,
+                       sym_t sym) {
+    expression_t exp = expression_new_in (arena);
     exp->type = EXP_SYMBOLIC;
     exp->data.sym = sym;
     return exp;
 }
 
 /** Free an expression.
+ * Drops one owner of exp. The node and its children are only freed once the last owner is gone.
+ * Arena nodes are skipped, they are released with their arena.
  * \param exp The expression to free
  */
 void
 expression_free (expression_t exp) {
-    assert(exp);
+    struct exp_walk w;
+    enum exp_walk_event event;
+    expression_t node;
 
-    if (exp->type == EXP_SYMBOLIC) {
-    	//sym_free(exp->data.sym);
-    }
-    else if (exp->type == EXP_TREE) {
-    	expression_free(exp->data.tree.left);
-    	expression_free(exp->data.tree.right);
+    assert(exp);
+    assert(exp->refs > 0); // throw error - expression_free: node was already freed
+
+    if (exp->refs == EXP_ARENA_REFS) return;
+    // shared nodes outlive all but their last owner
+    if (--exp->refs > 0) return;
+    if ((exp->type == EXP_VALUE) || ((exp->type == EXP_SYMBOLIC) && (exp->data.sym.p == NULL))) {
+    	free(exp);
+    	return;
     }
 
-    free(exp);
+    // the symbol parameter belongs to the symbol, so it is walked like a child
+    exp_walk_init(&w, exp);
+    while (exp_walk_next(&w, &node, &event)) {
+    	if (event == EXP_WALK_ENTER) {
+    		// children of a node that still has owners stay
+    		if ((node != exp) && ((node->refs == EXP_ARENA_REFS) || (--node->refs > 0))) exp_walk_skip(&w);
+    	}
+    	else if ((event == EXP_WALK_LEAVE) && (node->refs == 0)) {
+    		free(node);
+    	}
+    }
+    exp_walk_free(&w);
 }
 
 
@@ -83,74 +147,675 @@ expression_free (expression_t exp) {
  *     expression_t manipulation functions     *
  *---------------------------------------------*/
 
-/* Evaluate Expression recursively */
+/* An error value from a struct exp_held keeps its error's index plus one above
+ * its lowest bit, which is set if the value it stands in for is a double */
+#define HELD_DOUBLE 1
+#define HELD_INDEX(val) ((size_t) ((val).data.lint >> 1))
+
+/* A number value as a double */
+static double
+operand_double (value_t val) {
+	return (val.type == VAL_DOUBLE) ? val.data.dbl : (double) val.data.lint;
+}
+
+/* A number value as a truth value, 1 unless it is zero */
+static int
+operand_truth (value_t val) {
+	return (val.type == VAL_DOUBLE) ? (val.data.dbl != 0.0) : (val.data.lint != 0);
+}
+
+/* Apply a binary operation in double arithmetic. Comparisons give a long int. */
+static value_t
+operate_double (char op,
+                double left,
+                double right) {
+	switch (op) {
+	case '+': return value_new_double(left + right);
+	case '-': return value_new_double(left - right);
+	case '*': return value_new_double(left * right);
+	case '/': return value_new_double(left / right);
+	case '<': return value_new_lint(left < right);
+	case '>': return value_new_lint(left > right);
+	case 'L': return value_new_lint(left <= right);
+	case 'G': return value_new_lint(left >= right);
+	case '=': return value_new_lint(left == right);
+	case '!': return value_new_lint(left != right);
+	case '&': return value_new_lint((left != 0.0) & (right != 0.0));
+	case '|': return value_new_lint((left != 0.0) | (right != 0.0));
+	default:  return value_new_type(VAL_ERROR);
+	}
+}
+
+/* Apply a comparison or logical operation to two long ints.
+ * Both sides are always taken, so && and || do not branch on their left side.
+ * Returns 0 if op is not one. */
+static int
+operate_test (char op,
+              sys_int_long left,
+              sys_int_long right,
+              sys_int_long *result) {
+	switch (op) {
+	case '<': *result = (left < right);  return 1;
+	case '>': *result = (left > right);  return 1;
+	case 'L': *result = (left <= right); return 1;
+	case 'G': *result = (left >= right); return 1;
+	case '=': *result = (left == right); return 1;
+	case '!': *result = (left != right); return 1;
+	case '&': *result = (left != 0) & (right != 0); return 1;
+	case '|': *result = (left != 0) | (right != 0); return 1;
+	default:  return 0;
+	}
+}
+
+/** Apply a binary operation to two values.
+ * This is the arithmetic behind @ref expression_evaluate.
+ * Two long ints give a long int. If either value is a double, both are taken as doubles.
+ * Comparisons and the logical operations && and || give a long int 1 or 0.
+ * Nothing traps. Division by zero gives a VAL_ERROR value and LONG_MIN / -1 a VAL_INF value,
+ * like @ref expression_operate_r, which also says why.
+ * \return The result or a VAL_ERROR value if op is not a known operation
+ */
+value_t
+expression_operate (char op,
+                    value_t left_val,
+                    value_t right_val) {
+    value_t ret_val;
+
+    expression_operate_r(op, left_val, right_val, &ret_val, NULL);
+    return ret_val;
+}
+
+/* True if val is a double, or an error standing in for one */
+static int
+operand_is_double (value_t val) {
+	return (val.type == VAL_DOUBLE) || (!VAL_IS_NUMBER(val) && (val.data.lint & HELD_DOUBLE));
+}
+
+/* val as a double, or marked as standing in for one if it is an error */
+static value_t
+operand_to_double (value_t val) {
+	if (VAL_IS_NUMBER(val)) return value_new_double(operand_double(val));
+	val.data.lint |= HELD_DOUBLE;
+	return val;
+}
+
+/** Pick one of a select's arms, c ? a : b.
+ * Both arms are already evaluated, and the pick indexes them rather than branching.
+ * If either arm is a double, the result is a double like with the other operations.
+ * An arm that is an error only matters if it is taken, and a condition that is
+ * an error is the result.
+ * @param cond_val The condition, true unless it is zero
+ * @param then_val Value of the arm taken when cond_val is true
+ * @param else_val Value of the arm taken when cond_val is false
+ * \return The value of the taken arm
+ */
+value_t
+expression_select (value_t cond_val,
+                   value_t then_val,
+                   value_t else_val) {
+	value_t arms[2];
+
+	if (!VAL_IS_NUMBER(cond_val)) {
+		// the error stands in for the select's value, whose type is the arms'
+		cond_val.data.lint = (cond_val.data.lint & ~(sys_int_long) HELD_DOUBLE)
+		                   | (operand_is_double(then_val) || operand_is_double(else_val));
+		return cond_val;
+	}
+	if (operand_is_double(then_val) || operand_is_double(else_val)) {
+		then_val = operand_to_double(then_val);
+		else_val = operand_to_double(else_val);
+	}
+	arms[0] = else_val;
+	arms[1] = then_val;
+	return arms[operand_truth(cond_val)];
+}
+
+/** Find the number types an expression is made of.
+ * Stops as soon as both types are seen. A symbol stands for a long int, and its
+ * parameter is not looked at. A symbol call may give either type, so it counts as both.
+ * @param exp The expression to look through
+ * @return Which number types exp holds
+ */
+enum exp_num_class
+expression_infer (expression_t exp) {
+	struct exp_walk w;
+	enum exp_walk_event event;
+	expression_t node;
+	int ints = 0, doubles = 0;
+
+	assert(exp);
+
+	exp_walk_init(&w, exp);
+	while (!(ints && doubles) && exp_walk_next(&w, &node, &event)) {
+		if (event != EXP_WALK_ENTER) continue;
+		if (node->type == EXP_SYMBOLIC) {
+			ints = 1;
+			if (node->data.sym.p) doubles = 1;
+			exp_walk_skip(&w);
+		} else if (node->type == EXP_VALUE) {
+			if (node->data.val.type == VAL_DOUBLE) doubles = 1;
+			else if (node->data.val.type == VAL_LINT) ints = 1;
+		}
+	}
+	exp_walk_free(&w);
+
+	if (doubles) return ints ? EXP_NUM_MIXED : EXP_NUM_DOUBLE;
+	return EXP_NUM_INT;
+}
+
+/**
+ * A tree node being evaluated.
+ */
+struct eval_frame {
+	expression_t exp;       ///< The tree node
+	int          left_done; ///< Non-zero once left_val is set
+	value_t      left_val;  ///< Value of the left child
+	size_t       base;      ///< For a symbol call, the number of gathered arguments when it started
+};
+
+/**
+ * Growable stack of tree nodes for the evaluators.
+ */
+struct eval_stack {
+	struct eval_frame *frames; ///< Nodes from the root down, bottom first
+	size_t             count;  ///< Number of frames
+	size_t             size;   ///< Number of frames the stack can hold
+	struct eval_frame  local[EXP_WALK_LOCAL]; ///< Starting storage
+	value_t           *args;   ///< Symbol call arguments gathered so far, or NULL before the first
+	size_t             nargs;  ///< Number of gathered arguments
+	size_t             args_size; ///< Number of arguments args can hold
+};
+
+static void
+eval_stack_push (struct eval_stack *st, expression_t exp) {
+	if (st->count == st->size) {
+		size_t size = st->size * 2;
+		if (st->frames == st->local) {
+			st->frames = (struct eval_frame *) malloc(size * sizeof(struct eval_frame));
+			assert(st->frames); // throw error - eval_stack_push: malloc could not do allocation
+			memcpy(st->frames, st->local, st->count * sizeof(struct eval_frame));
+		} else {
+			st->frames = (struct eval_frame *) realloc(st->frames, size * sizeof(struct eval_frame));
+			assert(st->frames); // throw error - eval_stack_push: realloc could not do allocation
+		}
+		st->size = size;
+	}
+	st->frames[st->count].exp       = exp;
+	st->frames[st->count].left_done = 0;
+	st->frames[st->count].base      = st->nargs;
+	st->count++;
+}
+
+/* Gather one symbol call argument */
+static void
+eval_args_push (struct eval_stack *st, value_t val) {
+	if (st->nargs == st->args_size) {
+		st->args_size = st->args_size ? (st->args_size * 2) : EXP_WALK_LOCAL;
+		st->args = (value_t *) realloc(st->args, st->args_size * sizeof(value_t));
+		assert(st->args); // throw error - eval_args_push: realloc could not do allocation
+	}
+	st->args[st->nargs++] = val;
+}
+
+/* True if frame i is a ',' between the arguments of a symbol call */
+static int
+eval_is_comma (struct eval_stack const *st, size_t i) {
+	expression_t parent;
+
+	if ((st->frames[i].exp->type != EXP_TREE) || (st->frames[i].exp->data.tree.op != ',') || (i == 0)) return 0;
+	parent = st->frames[i - 1].exp;
+	return (parent->type == EXP_SYMBOLIC) || ((parent->type == EXP_TREE) && (parent->data.tree.op == ','));
+}
+
+/* True if frame i holds the arms of the select in frame i - 1, whose condition is done */
+static int
+eval_is_arms (struct eval_stack const *st, size_t i) {
+	struct eval_frame const *parent;
+
+	if ((st->frames[i].exp->type != EXP_TREE) || (st->frames[i].exp->data.tree.op != ':') || (i == 0)) return 0;
+	parent = &st->frames[i - 1];
+	return parent->left_done && EXP_IS_SELECT(parent->exp) && (parent->exp->data.tree.right == st->frames[i].exp);
+}
+
+/** Apply a binary operation to two values, reporting errors instead of trapping.
+ * Same as @ref expression_operate, but division by zero, division overflow and
+ * unknown operations are reported in err.
+ * @param[out] result Set to the result. On error, a VAL_ERROR or VAL_INF value.
+ * @param[out] err Filled in with the error details. Left alone on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+expression_operate_r (char op,
+                      value_t left_val,
+                      value_t right_val,
+                      value_t *result,
+                      struct exp_error *err) {
+	if ((left_val.type == VAL_DOUBLE) || (right_val.type == VAL_DOUBLE)) {
+		double right = operand_double(right_val);
+		if ((op == '/') && (right == 0.0)) {
+			*result = value_new_type(VAL_ERROR);
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Division by zero");
+		}
+		*result = operate_double(op, operand_double(left_val), right);
+		if (result->type == VAL_ERROR) {
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Invalid operation \'%c\'", op);
+		}
+		return EXP_OK;
+	}
+
+	*result = value_new_lint(0);
+	switch (op) {
+	case '+':
+		result->data.lint = left_val.data.lint + right_val.data.lint;
+		break;
+	case '-':
+		result->data.lint = left_val.data.lint - right_val.data.lint;
+		break;
+	case '*':
+		result->data.lint = left_val.data.lint * right_val.data.lint;
+		break;
+	case '/':
+		if (right_val.data.lint == 0) {
+			*result = value_new_type(VAL_ERROR);
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Division by zero");
+		}
+		if ((right_val.data.lint == -1) && (left_val.data.lint == SYS_INT_LONG_T_MIN)) {
+			*result = value_new_type(VAL_INF);
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Division overflow");
+		}
+		result->data.lint = left_val.data.lint / right_val.data.lint;
+		break;
+	default:
+		if (!operate_test(op, left_val.data.lint, right_val.data.lint, &result->data.lint)) {
+			*result = value_new_type(VAL_ERROR);
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Invalid operation \'%c\'", op);
+		}
+		break;
+	}
+	return EXP_OK;
+}
+
+/** Start with no held errors.
+ */
+void
+exp_held_init (struct exp_held *held) {
+	assert(held);
+	held->errors = NULL;
+	held->count  = 0;
+	held->size   = 0;
+}
+
+/** Free the held errors.
+ */
+void
+exp_held_free (struct exp_held *held) {
+	assert(held);
+	free(held->errors);
+	exp_held_init(held);
+}
+
+/** Hold an error, and get the value that stands in for it.
+ * @param held Where to hold the error, or NULL to only make the value.
+ * @param type VAL_ERROR or VAL_INF
+ * @param dbl Non-zero if the value the error stands in for is a double
+ * @param err The error
+ * @return The error value
+ */
+value_t
+exp_held_add (struct exp_held *held,
+              enum value_types type,
+              int dbl,
+              struct exp_error const *err) {
+	value_t val = value_new_type(type);
+
+	assert(!VAL_IS_NUMBER(val));
+	assert(err);
+	if (held) {
+		if (held->count == held->size) {
+			held->size = held->size ? (held->size * 2) : 4;
+			held->errors = (struct exp_error *) realloc(held->errors, held->size * sizeof(struct exp_error));
+			assert(held->errors); // throw error - exp_held_add: realloc could not do allocation
+		}
+		held->errors[held->count++] = *err;
+		val.data.lint = (sys_int_long) held->count << 1;
+	}
+	if (dbl) val.data.lint |= HELD_DOUBLE;
+	return val;
+}
+
+/** Apply a binary operation to two values that may be errors.
+ * Same as @ref expression_operate_r, but an error is held and its value is the result.
+ * An error operand is passed on as the result, the left one first. The exception is
+ * && and ||, which pass on an error on their right only if the left value does not
+ * decide them, as with 0 && x or 1 || x.
+ * @param held Where to hold a new error, or NULL to only make its value.
+ * @return The result, or an error value
+ */
+value_t
+exp_held_operate (struct exp_held *held,
+                  char op,
+                  value_t left_val,
+                  value_t right_val) {
+	struct exp_error err;
+	value_t result;
+	int arith = (op == '+') || (op == '-') || (op == '*') || (op == '/');
+	int dbl = arith && (operand_is_double(left_val) || operand_is_double(right_val));
+
+	if (!VAL_IS_NUMBER(left_val) || !VAL_IS_NUMBER(right_val)) {
+		if (VAL_IS_NUMBER(left_val) && ((op == '&') || (op == '|')) && (operand_truth(left_val) == (op == '|'))) {
+			return value_new_lint(op == '|');
+		}
+		result = VAL_IS_NUMBER(left_val) ? right_val : left_val;
+		result.data.lint = (result.data.lint & ~(sys_int_long) HELD_DOUBLE) | dbl;
+		return result;
+	}
+
+	exp_error_clear(&err);
+	if (expression_operate_r(op, left_val, right_val, &result, &err) != EXP_OK) {
+		return exp_held_add(held, result.type, dbl, &err);
+	}
+	return result;
+}
+
+/** Report the held error a result stands for.
+ * @param result The final value of an evaluation
+ * @param[out] err Filled in with the error details, unless it already holds an error. May be NULL.
+ * @return EXP_OK if result is not a held error, or the error's code
+ */
+int
+exp_held_report (struct exp_held const *held,
+                 value_t result,
+                 struct exp_error *err) {
+	size_t index;
+
+	assert(held);
+	if (VAL_IS_NUMBER(result)) return EXP_OK;
+	index = HELD_INDEX(result);
+	if ((index == 0) || (index > held->count)) return EXP_OK;
+	if (err && (err->code == EXP_OK)) *err = held->errors[index - 1];
+	return held->errors[index - 1].code;
+}
+
+/* Make a call on gathered arguments, holding its error if it fails.
+ * An argument that is an error is passed on instead, without making the call. */
+static value_t
+eval_call (struct exp_held *held, exp_call_fn call, char const *name, size_t argc, value_t const *argv, void *ctx) {
+	struct exp_error err;
+	value_t val;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < argc; i++) {
+		if (!VAL_IS_NUMBER(argv[i])) return argv[i];
+	}
+	exp_error_clear(&err);
+	if ((ret = call(name, argc, argv, &val, ctx, &err)) != EXP_OK) {
+		// in case the call did not say why
+		exp_error_set(&err, ret, 0, "Evaluation Error - Call to \"%s\" failed", name);
+		return exp_held_add(held, VAL_ERROR, 0, &err);
+	}
+	return val;
+}
+
+/** Evaluate an expression without recursion.
+ * This is the hot path, so rather than the general @ref exp_walk it uses a stack
+ * of its own that also holds each tree's left value. It runs down the left spine
+ * to a leaf, then back up, combining each tree whose right side is done.
+ * A select evaluates its condition and both of its arms, then picks one with
+ * @ref expression_select as its ':' tree is done, so which arm is taken never steers the walk.
+ * When call is given, a symbol with a parameter is a node with one child, its parameter,
+ * and is combined by handing the parameter's value to call. The ',' trees between
+ * a call's arguments add their left value to the gathered arguments as they go,
+ * so the call finds all of its arguments in order.
+ * Errors, including symbols that have no value, are values rather than stopping the walk,
+ * since they may be in an arm that is not taken. When checked, they are also held, and
+ * only one that reaches the result is reported.
+ * @param checked Non-zero to report errors in err, zero to behave like @ref expression_evaluate.
+ * @param call Resolves symbol calls or NULL. Only used when checked.
+ * @param ctx Passed to call
+ * @return EXP_OK or the error code
+ */
+static int
+evaluate_walk (expression_t exp,
+               value_t *result,
+               struct exp_error *err,
+               int checked,
+               exp_call_fn call,
+               void *ctx) {
+	struct eval_stack st;
+	struct exp_held held;
+	struct exp_held *holder = checked ? &held : NULL;
+	value_t val;
+	int ret = EXP_OK;
+
+	st.frames = st.local;
+	st.count  = 0;
+	st.size   = EXP_WALK_LOCAL;
+	st.args   = NULL;
+	st.nargs  = st.args_size = 0;
+	exp_held_init(&held);
+
+	for (;;) {
+		/* Down the left spine */
+		for (;;) {
+			if (exp->type == EXP_TREE) {
+				eval_stack_push(&st, exp);
+				exp = exp->data.tree.left;
+			}
+			else if (call && (exp->type == EXP_SYMBOLIC) && exp->data.sym.p) {
+				eval_stack_push(&st, exp);
+				exp = exp->data.sym.p;
+			}
+			else break;
+		}
+
+		/* The leaf */
+		if (exp->type == EXP_VALUE) {
+			val = exp->data.val;
+		}
+		else {
+			// an error like any other, so a select's untaken arm may hold a symbol
+			struct exp_error leaf_err;
+			exp_error_clear(&leaf_err);
+			if (exp->type == EXP_SYMBOLIC) {
+				exp_error_set(&leaf_err, EXP_EEVAL, 0, "Evaluation Error - Cannot evaluate symbol \"%s\"", exp->data.sym.name);
+			} else {
+				exp_error_set(&leaf_err, EXP_EEVAL, 0, "Evaluation Error - Invalid expression type");
+			}
+			val = exp_held_add(holder, VAL_ERROR, 0, &leaf_err);
+		}
+
+		/* Up until a tree still needs its right side */
+		while (st.count) {
+			struct eval_frame *f = &st.frames[st.count - 1];
+			if (f->exp->type == EXP_SYMBOLIC) {
+				eval_args_push(&st, val);
+				val = eval_call(&held, call, f->exp->data.sym.name, st.nargs - f->base, &st.args[f->base], ctx);
+				st.nargs = f->base;
+				st.count--;
+				continue;
+			}
+			if (call && eval_is_comma(&st, st.count - 1)) {
+				// the right argument's value is passed on up
+				if (!f->left_done) {
+					f->left_done = 1;
+					eval_args_push(&st, val);
+					break;
+				}
+				st.count--;
+				continue;
+			}
+			if (!f->left_done) {
+				f->left_done = 1;
+				f->left_val  = val;
+				break;
+			}
+			if (eval_is_arms(&st, st.count - 1)) {
+				// the select's frame is done along with its arms
+				val = expression_select(f[-1].left_val, f->left_val, val);
+				st.count -= 2;
+				continue;
+			}
+			val = exp_held_operate(holder, f->exp->data.tree.op, f->left_val, val);
+			st.count--;
+		}
+		if (st.count == 0) break;
+		exp = st.frames[st.count - 1].exp->data.tree.right;
+	}
+
+	*result = val;
+	if (checked) ret = exp_held_report(&held, val, err);
+	exp_held_free(&held);
+	if (st.frames != st.local) free(st.frames);
+	free(st.args);
+	return ret;
+}
+
+/** Evaluate Expression.
+ * Errors, such as a symbol or a division by zero, give a VAL_ERROR or VAL_INF value.
+ * Use @ref expression_evaluate_r to find out why.
+ */
 value_t
 expression_evaluate (expression_t exp) {
+    value_t ret_val;
+
     if (exp->type == EXP_VALUE) return exp->data.val;
-    else if (exp->type == EXP_TREE)
-    {
-    	value_t ret_val;
-    	value_t left_val, right_val;
-
-    	ret_val.type = VAL_LINT;
-		left_val  = expression_evaluate(exp->data.tree.left);
-		right_val = expression_evaluate(exp->data.tree.right);
-        switch (exp->data.tree.op) {
-        case '+':
-			ret_val.data.lint = left_val.data.lint + right_val.data.lint;
-            break;
-        case '-':
-        	ret_val.data.lint =  left_val.data.lint - right_val.data.lint;
-            break;
-        case '*':
-        	ret_val.data.lint =  left_val.data.lint * right_val.data.lint;
-            break;
-        case '/':
-        	ret_val.data.lint =  left_val.data.lint / right_val.data.lint;
-            break;
-        default:
-            /* throw error - invalid operation in expression */
-        	ret_val.type = VAL_ERROR;
-            break;
-        }
-        return ret_val;
-    }
-    else //if(exp->type == EXP_SYMBOLIC) // Optimize for speed not errors
-    {
-    	assert((exp->type == EXP_SYMBOLIC));
-    	pferror("expression_evaluate","SYMBOLIC types evaluator is unimplemented");
-    }
+    evaluate_walk(exp, &ret_val, NULL, 0, NULL, NULL);
+    return ret_val;
+}
 
-    /* throw error - invalid state in expression */
-    //return -1; //error
-	assert(0);
-	return value_new_type(VAL_ERROR);
+
+/** Evaluate Expression, reporting errors.
+ * Same as @ref expression_evaluate, but an error that reaches the result is also reported.
+ * This includes symbolic expressions, division by zero and LONG_MIN / -1.
+ * An error in the arm a select does not take, or on the right of a && or ||
+ * that its left side decides, does not change the result and is not reported.
+ * @param exp The expression to evaluate
+ * @param[out] result Set to the value of exp
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+expression_evaluate_r (expression_t exp,
+                       value_t *result,
+                       struct exp_error *err) {
+	assert(exp);
+	assert(result);
+
+	exp_error_clear(err);
+	return evaluate_walk(exp, result, err, 1, NULL, NULL);
+}
+
+/** Evaluate Expression with symbol calls, reporting errors instead of exiting.
+ * Same as @ref expression_evaluate_r, but a symbol with a parameter, like f(x+1) or max(a, b),
+ * is evaluated by evaluating its arguments and handing their values to call.
+ * Symbols without a parameter are still errors. A call with an argument that is an
+ * error is not made, and passes the argument's error on.
+ * @param exp The expression to evaluate
+ * @param call Resolves each symbol call
+ * @param ctx Passed to call
+ * @param[out] result Set to the value of exp
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+expression_evaluate_calls_r (expression_t exp,
+                             exp_call_fn call,
+                             void *ctx,
+                             value_t *result,
+                             struct exp_error *err) {
+	assert(exp);
+	assert(call);
+	assert(result);
+
+	exp_error_clear(err);
+	return evaluate_walk(exp, result, err, 1, call, ctx);
 }
 
 
-/** Expression to String */
+/* Append src to the string of length *len in dst, truncating at EXP_BUF_SIZE */
+static void
+string_append (char *dst, size_t *len, char const *src) {
+	while (*src && (*len < EXP_BUF_SIZE - 1)) {
+		dst[(*len)++] = *src++;
+	}
+	dst[*len] = '\0';
+}
+
+/* How a two char operation is written, with a space on either side, or NULL if op is its own spelling */
+static char const *
+op_spelling (char op) {
+	switch (op) {
+	case 'L': return " <= ";
+	case 'G': return " >= ";
+	case '=': return " == ";
+	case '!': return " != ";
+	case '&': return " && ";
+	case '|': return " || ";
+	default:  return NULL;
+	}
+}
+
+/** Expression to String
+ * Trees are fully parenthesised, and a select's arms share its parens.
+ * The result is truncated to fit an @ref exp_buf.
+ */
 void
 expression_to_string (char *dst_str,
 					  expression_t src_exp) {
-	switch (src_exp->type) {
-	case EXP_VALUE:
-		value_to_string(dst_str, src_exp->data.val);
-        break;
-	case EXP_TREE:
-		{
-			exp_buf left, right;
-			expression_to_string (left, src_exp->data.tree.left);
-			expression_to_string (right, src_exp->data.tree.right);
-			snprintf(dst_str, EXP_BUF_SIZE, "(%s %c %s)", left, src_exp->data.tree.op, right);
+	struct exp_walk w;
+	enum exp_walk_event event;
+	expression_t node;
+	exp_buf piece;
+	size_t len = 0;
+
+	dst_str[0] = '\0';
+	exp_walk_init(&w, src_exp);
+	while (exp_walk_next(&w, &node, &event)) {
+		switch (node->type) {
+		case EXP_VALUE:
+			if (event == EXP_WALK_ENTER) {
+				value_to_string(piece, node->data.val);
+				string_append(dst_str, &len, piece);
+			}
+			break;
+		case EXP_TREE:
+			// arguments are only separated, the call's parens already group them
+			if (node->data.tree.op == ',') {
+				if (event == EXP_WALK_BETWEEN) string_append(dst_str, &len, ", ");
+			} else if (node->data.tree.op == ':') {
+				if (event == EXP_WALK_BETWEEN) string_append(dst_str, &len, " : ");
+			} else if (event == EXP_WALK_ENTER) {
+				string_append(dst_str, &len, "(");
+			} else if (event == EXP_WALK_BETWEEN) {
+				char const *spelling = op_spelling(node->data.tree.op);
+				if (!spelling) {
+					piece[0] = ' ';
+					piece[1] = node->data.tree.op;
+					piece[2] = ' ';
+					piece[3] = '\0';
+					spelling = piece;
+				}
+				string_append(dst_str, &len, spelling);
+			} else {
+				string_append(dst_str, &len, ")");
+			}
+			break;
+		case EXP_SYMBOLIC:
+			// same form as sym_to_string, with the parameter walked in place
+			if (event == EXP_WALK_ENTER) {
+				string_append(dst_str, &len, node->data.sym.name);
+				if (node->data.sym.p) string_append(dst_str, &len, "(");
+			} else if (node->data.sym.p) {
+				string_append(dst_str, &len, ")");
+			}
+			break;
+		default:
+			assert(0);
+			break;
 		}
-		break;
-	case EXP_SYMBOLIC:
-		sym_to_string(dst_str, src_exp->data.sym);
-        break;
-	default:
-		assert(0);
-		break;
 	}
+	exp_walk_free(&w);
 }
 
 
@@ -159,50 +824,566 @@ expression_to_string (char *dst_str,
  * Helper functions for String to Expression   *
  *---------------------------------------------*/
 
-size_t
-number_len(size_t str_len, char *str) {
-    size_t index;
-    for(index = 0; (index < str_len) && IS_DIGIT(str[index]); index++)
-        ;
-    return index;
+/** Parser state shared by the string to expression helpers.
+ * The parser walks the token array once from left to right, so index only ever moves forward.
+ * All state lives here, so any number of parses may run at once.
+ */
+struct parser {
+	char const         *str;    ///< Source string the tokens were made from
+	struct token const *tokens; ///< Token array, terminated by TOK_END
+	pindex_t            index;  ///< Index of the next unread token
+	struct exp_arena   *arena;  ///< Arena to build in, or NULL to malloc nodes
+	struct exp_error   *err;    ///< Where to report errors
+	struct exp_spans   *spans;  ///< Where to record parenthesized groups or NULL
+	pindex_t            base;   ///< Index of str within the string the spans refer to
+	size_t              group;  ///< Span of the group being parsed or EXP_SPAN_NONE
+};
+
+/** New node for the parser to fill in.
+ */
+static expression_t
+parser_node (struct parser *p) {
+	return expression_new_in(p->arena);
 }
 
-/** Same as strncpy, but throws an error if a null character is reached in src.
- *
- * @param dest Destination string buffer.
- * @param src Source string buffer.
- * @param count The number of bytes to copy.
+/** Drop a partially built expression after an error.
+ * Arena nodes are left alone, they are released with the arena.
  */
-void
-str_cpy(char *dest, const char *src, size_t count) {
-	size_t index;
-	assert(src);
-	assert(dest);
-	for(index = 0; index < count; index++) {
-		if (src[index] == '\0') {
-			pferror("str_cpy", "encountered NULL byte while copying \"%s\"", src);
+static void
+parser_discard (struct parser *p, expression_t exp) {
+	if (exp && !p->arena) expression_free(exp);
+}
+
+/// Precedence of ',' between symbol arguments, the loosest binding
+#define PREC_ARGS 1
+/// Lowest precedence outside of symbol arguments, that of a select's '?'
+#define PREC_EXPR 2
+
+/** Binding power of a binary operation.
+ * The order is C's, from a select's '?' up through ||, &&, equality, comparison,
+ * then + and -, and * and / binding tightest.
+ * @param op Operation char.
+ * @return The precedence of op or 0 if op is not a binary operation.
+ */
+static int
+op_precedence (char op) {
+	switch (op) {
+	case ',':
+		return PREC_ARGS;
+	case '?':
+		return PREC_EXPR;
+	case '|':
+		return PREC_EXPR + 1;
+	case '&':
+		return PREC_EXPR + 2;
+	case '=':
+	case '!':
+		return PREC_EXPR + 3;
+	case '<':
+	case '>':
+	case 'L':
+	case 'G':
+		return PREC_EXPR + 4;
+	case '+':
+	case '-':
+		return PREC_EXPR + 5;
+	case '*':
+	case '/':
+		return PREC_EXPR + 6;
+	default:
+		return 0;
+	}
+}
+
+/** The next unread token.
+ */
+#define PARSER_PEEK(p) (&(p)->tokens[(p)->index])
+
+/** Report a token that cannot appear where it was found.
+ * @return NULL, so callers can return the result directly.
+ */
+static expression_t
+parser_unexpected (struct parser *p, struct token const *tok) {
+	char c = p->str[tok->offset];
+
+	switch (tok->kind) {
+	case TOK_END:
+		exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Expected a number, symbol, or parenthesis at end of string");
+		break;
+	case TOK_NUMBER:
+	case TOK_SYMBOL:
+	case TOK_OPEN:
+		exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Expected an operation before \'%c\'", c);
+		break;
+	case TOK_ERROR:
+		if ((c == '\0') || (c == '\n') || (c == '\r')) {
+			exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Encountered a string terminating character early");
+		} else {
+			exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Unrecognized character \'%c\'", c);
 		}
-		dest[index] = src[index];
+		break;
+	case TOK_CLOSE:
+	case TOK_OP:
+	default:
+		exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Expected a number, symbol, or parenthesis before \'%c\'", c);
+		break;
+	}
+	return NULL;
+}
+
+static expression_t
+parse_expression (struct parser *p, int min_prec);
+
+/** Report a token left over after an expression.
+ * @return NULL, so callers can return the result directly.
+ */
+static expression_t
+parser_leftover (struct parser *p, struct token const *tok) {
+	if ((tok->kind == TOK_OP) && (tok->op == ',')) {
+		exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Comma outside of a symbol's arguments");
+		return NULL;
 	}
+	if ((tok->kind == TOK_OP) && (tok->op == ':')) {
+		exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - \':\' without a \'?\' before it");
+		return NULL;
+	}
+	return parser_unexpected(p, tok);
+}
+
+/** Parse the inside of a parenthesized group and its closing paren.
+ * @param open The group's open paren token, which was already consumed.
+ * @param min_prec PREC_ARGS for a symbol's arguments, PREC_EXPR otherwise.
+ * @param msg Error message for a missing closing paren.
+ */
+static expression_t
+parse_group (struct parser *p, struct token const *open, int min_prec, char const *msg) {
+	size_t outer = p->group;
+	expression_t exp;
+	struct token const *tok;
+
+	// groups are recorded as their parens are found, which chains them in string order
+	if (p->spans) {
+		p->group = exp_spans_open(p->spans, p->base + open->offset, outer);
+	}
+
+	exp = parse_expression(p, min_prec);
+	tok = PARSER_PEEK(p);
+
+	if (!exp) return NULL;
+	if (tok->kind != TOK_CLOSE) {
+		if (tok->kind == TOK_END) {
+			exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "%s", msg);
+		} else {
+			parser_leftover(p, tok);
+		}
+		parser_discard(p, exp);
+		return NULL;
+	}
+	p->index++;
+
+	if (p->spans) {
+		exp_spans_close(p->spans, p->group, p->base + tok->offset, exp);
+		p->group = outer;
+	}
+	return exp;
+}
+
+/** Parse a number, a symbol (with optional comma separated arguments), or a parenthesized sub-expression.
+ * A symbol's arguments are a chain of ',' trees, leaning left like other operations.
+ */
+static expression_t
+parse_primary (struct parser *p) {
+	struct token const *tok = PARSER_PEEK(p);
+
+	switch (tok->kind) {
+
+	/* Parenthesized sub-expression */
+	case TOK_OPEN:
+		p->index++;
+		return parse_group(p, tok, PREC_EXPR, "Syntax Error - Unmatched parenthesis");
+
+	/* Number -- value was pre-parsed by the lexer */
+	case TOK_NUMBER:
+		{
+			expression_t exp;
+
+			if (!VAL_IS_NUMBER(tok->val)) {
+				exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Whole number is too large for a long int");
+				return NULL;
+			}
+			exp = parser_node(p);
+			exp->type = EXP_VALUE;
+			exp->data.val = tok->val;
+			p->index++;
+			return exp;
+		}
+
+	/* Symbol name and possible symbol parameter */
+	case TOK_SYMBOL:
+		{
+			expression_t exp;
+			sym_t sym;
+
+			// check if the name will fit in the sym_t name
+			if (tok->length >= SYMBOLIC_NAME_SIZE) {
+				exp_error_set(p->err, EXP_ESYMBOL, tok->offset, "Symbol Error - Symbol name is too large");
+				return NULL;
+			}
+			memcpy(sym.name, &p->str[tok->offset], tok->length);
+			sym.name[tok->length] = '\0';
+			sym.p = NULL;
+			p->index++;
+
+			// check for presence of '(' signifying the start of a symbol parameter
+			if (PARSER_PEEK(p)->kind == TOK_OPEN) {
+				struct token const *open = PARSER_PEEK(p);
+				p->index++;
+				sym.p = parse_group(p, open, PREC_ARGS, "Syntax Error - Unmatched parenthesis around symbol parameter");
+				if (!sym.p) return NULL;
+			}
+			exp = parser_node(p);
+			exp->type = EXP_SYMBOLIC;
+			exp->data.sym = sym;
+			return exp;
+		}
+
+	default:
+		return parser_unexpected(p, tok);
+	}
+}
+
+static expression_t
+parse_select_arms (struct parser *p);
+
+/** Precedence climbing over binary operations.
+ * Parses operations whose precedence is at least min_prec, folding them
+ * to the left so that equal precedence operations are left associative.
+ * A select's '?' takes both of its arms as its right operand.
+ */
+static expression_t
+parse_expression (struct parser *p, int min_prec) {
+	expression_t left = parse_primary(p);
+
+	while (left) {
+		struct token const *tok = PARSER_PEEK(p);
+		int prec;
+		expression_t right;
+
+		if (tok->kind != TOK_OP) break;
+		prec = op_precedence(tok->op);
+
+		// binds looser than what we are collecting
+		if (prec < min_prec) break;
+		p->index++;
+
+		// everything binding tighter than op belongs to the right operand
+		right = (tok->op == '?') ? parse_select_arms(p) : parse_expression(p, prec + 1);
+		if (!right) {
+			parser_discard(p, left);
+			return NULL;
+		}
+		{
+			expression_t exp = parser_node(p);
+			exp->type = EXP_TREE;
+			exp->data.tree.op    = tok->op;
+			exp->data.tree.left  = left;
+			exp->data.tree.right = right;
+			left = exp;
+		}
+	}
+
+	return left;
+}
+
+/** Parse the arms of a select, after its '?', into a ':' tree.
+ * Like C, the else arm may itself be a select, so selects chain to the right.
+ */
+static expression_t
+parse_select_arms (struct parser *p) {
+	expression_t then_exp, else_exp, exp;
+	struct token const *tok;
+
+	if (!(then_exp = parse_expression(p, PREC_EXPR))) return NULL;
+	tok = PARSER_PEEK(p);
+	if ((tok->kind != TOK_OP) || (tok->op != ':')) {
+		if (tok->kind == TOK_ERROR) {
+			parser_unexpected(p, tok);
+		} else {
+			exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Expected \':\' after the first arm of a \'?\'");
+		}
+		parser_discard(p, then_exp);
+		return NULL;
+	}
+	p->index++;
+	if (!(else_exp = parse_expression(p, PREC_EXPR))) {
+		parser_discard(p, then_exp);
+		return NULL;
+	}
+
+	exp = parser_node(p);
+	exp->type = EXP_TREE;
+	exp->data.tree.op    = ':';
+	exp->data.tree.left  = then_exp;
+	exp->data.tree.right = else_exp;
+	return exp;
+}
+
+/** Parse tokens up to the next TOK_END.
+ * On error, index is still moved past the next TOK_END.
+ */
+static expression_t
+parse_tokens (struct parser *p) {
+	expression_t exp = parse_expression(p, PREC_EXPR);
+	struct token const *tok = PARSER_PEEK(p);
+
+	/* All tokens up to TOK_END must have been consumed */
+	if (exp && (tok->kind != TOK_END)) {
+		if (tok->kind == TOK_CLOSE) {
+			exp_error_set(p->err, EXP_ESYNTAX, tok->offset, "Syntax Error - Unmatched closing parenthesis");
+		} else {
+			parser_leftover(p, tok);
+		}
+		parser_discard(p, exp);
+		exp = NULL;
+	}
+
+	// step over TOK_END
+	while (PARSER_PEEK(p)->kind != TOK_END) p->index++;
+	p->index++;
+
+	return exp;
+}
+
+/** Convert Tokens to an Expression, reporting errors instead of exiting.
+ * Parses a token array made by @ref string_to_tokens.
+ * The token array is only read, so it may be parsed any number of times.
+ *
+ * @param str The source string the tokens were made from
+ * @param list Tokens to parse
+ * @param[out] exp Set to the expression_t representation of the tokens, or NULL on error
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+tokens_to_expression_r (char const *str,
+                        struct token_list const *list,
+                        expression_t *exp,
+                        struct exp_error *err) {
+	struct parser p;
+	struct exp_error local;
+
+	assert(str);
+	assert(list);
+	assert(exp);
+	assert(list->count > 0); // must at least have TOK_END
+
+	// still need somewhere to put the error when the caller does not want the details
+	if (!err) err = &local;
+	exp_error_clear(err);
+	p.str    = str;
+	p.tokens = list->tokens;
+	p.index  = 0;
+	p.arena  = NULL;
+	p.err    = err;
+	p.spans  = NULL;
+	p.base   = 0;
+	p.group  = EXP_SPAN_NONE;
+
+	*exp = parse_tokens(&p);
+	return err->code;
+}
+
+/** Convert Tokens to an Expression.
+ * Same as @ref tokens_to_expression_r, but exits with a runtime error on bad syntax.
+ *
+ * @param str The source string the tokens were made from
+ * @param list Tokens to parse
+ * @return The expression_t representation of the tokens
+ */
+expression_t
+tokens_to_expression (char const *str,
+                      struct token_list const *list) {
+	struct exp_error err;
+	expression_t exp;
+
+	if (tokens_to_expression_r(str, list, &exp, &err) != EXP_OK) {
+		rerror("%s", err.msg);
+	}
+	return exp;
+}
+
+/** Convert Tokens to an Expression built in an arena.
+ * Parses the tokens from index up to the next TOK_END, such as one line of
+ * the tokens made by @ref string_to_line_tokens.
+ * Each number, symbol, and operation token takes at most one node from the arena.
+ * On error, the nodes already taken stay in the arena until it is reset or freed.
+ *
+ * @param str The source string the tokens were made from
+ * @param tokens Token array
+ * @param[in,out] index Index of the first token to parse. Is left one past the TOK_END token, even on error.
+ * @param arena Arena to build in
+ * @param[out] err Filled in with the error details on error. May be NULL.
+ * @return The expression_t representation of the tokens, or NULL on error
+ */
+expression_t
+tokens_to_expression_arena (char const *str,
+                            struct token const *tokens,
+                            pindex_t *index,
+                            struct exp_arena *arena,
+                            struct exp_error *err) {
+	struct parser p;
+	expression_t  exp;
+
+	assert(str);
+	assert(tokens);
+	assert(index);
+	assert(arena);
+
+	p.str    = str;
+	p.tokens = tokens;
+	p.index  = *index;
+	p.arena  = arena;
+	p.err    = err;
+	p.spans  = NULL;
+	p.base   = 0;
+	p.group  = EXP_SPAN_NONE;
+
+	exp = parse_tokens(&p);
+	*index = p.index;
+	return exp;
+}
+
+/** Convert Tokens to an Expression, recording its parenthesized groups.
+ * Same as @ref tokens_to_expression_r, but every group is added to spans.
+ * Groups that are not inside another group of str get EXP_SPAN_NONE as their parent.
+ * Used by @ref reparse.c.
+ *
+ * @param str The source string the tokens were made from
+ * @param list Tokens to parse
+ * @param base Index of str within the string the spans refer to. Added to every recorded index.
+ * @param[out] exp Set to the expression_t representation of the tokens, or NULL on error
+ * @param spans Where to add the groups. On error, some groups may have been added.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+tokens_to_expression_spans_r (char const *str,
+                              struct token_list const *list,
+                              pindex_t base,
+                              expression_t *exp,
+                              struct exp_spans *spans,
+                              struct exp_error *err) {
+	struct parser p;
+	struct exp_error local;
+
+	assert(str);
+	assert(list);
+	assert(exp);
+	assert(spans);
+	assert(list->count > 0); // must at least have TOK_END
+
+	if (!err) err = &local;
+	exp_error_clear(err);
+	p.str    = str;
+	p.tokens = list->tokens;
+	p.index  = 0;
+	p.arena  = NULL;
+	p.err    = err;
+	p.spans  = spans;
+	p.base   = base;
+	p.group  = EXP_SPAN_NONE;
+
+	*exp = parse_tokens(&p);
+	return err->code;
+}
+
+/** Convert String to an Expression, reporting errors instead of exiting.
+ * Same as @ref string_to_expression, but never exits and keeps no global state.
+ * A syntax error leaves nothing allocated.
+ *
+ * @param str_len Length of given string
+ * @param str String to parse
+ * @param[out] exp Set to the expression_t representation of the string, or NULL on error
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+string_to_expression_r (size_t str_len,
+                        char const *str,
+                        expression_t *exp,
+                        struct exp_error *err) {
+	struct token_list list;
+	int ret;
+
+	token_list_init(&list);
+	string_to_tokens(str_len, str, &list);
+	ret = tokens_to_expression_r(str, &list, exp, err);
+	token_list_free(&list);
+
+	return ret;
+}
+
+/** Convert String to an Expression built in an arena.
+ * Same as @ref string_to_expression_r, but every node is taken from arena.
+ * On error, the nodes already taken stay in the arena until it is reset or freed.
+ *
+ * @param str_len Length of given string
+ * @param str String to parse
+ * @param arena Arena to build in
+ * @param[out] exp Set to the expression_t representation of the string, or NULL on error
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+string_to_expression_arena_r (size_t str_len,
+                              char const *str,
+                              struct exp_arena *arena,
+                              expression_t *exp,
+                              struct exp_error *err) {
+	struct token_list list;
+	struct parser p;
+	struct exp_error local;
+
+	assert(str);
+	assert(arena);
+	assert(exp);
+
+	if (!err) err = &local;
+	exp_error_clear(err);
+	token_list_init(&list);
+	string_to_tokens(str_len, str, &list);
+	p.str    = str;
+	p.tokens = list.tokens;
+	p.index  = 0;
+	p.arena  = arena;
+	p.err    = err;
+	p.spans  = NULL;
+	p.base   = 0;
+	p.group  = EXP_SPAN_NONE;
+
+	*exp = parse_tokens(&p);
+	token_list_free(&list);
+	return err->code;
 }
 
 /** Convert String to an Expression.
  * Parses a string into an expression.
- * @note level was type int - changed to unsigned to temporarily quiet compiler
  * @bug Cannot parse negative numbers
  * @warning Symbols must start with ALPHA chars to be properly identified.
+ * @warning Exits with a runtime error on bad syntax. Use @ref string_to_expression_r to handle errors.
  *
  * @section parsing_algorithm Algorithm
  * @subsection parsing_overview Parsing Overview
- * 	- Step 1: Recording details about the string while scanning from left to right.
- * 	- Step 2: There are two real cases. The string is a single number (with no operations)
- * 		or it is two sub-expressions joined by an operation.\n
- * 		Cases:
- * 		- If it is a simple number, we know how to parse it and create a value expression.
- * 		- If it is not just a number, we want split the string about the operation at the lowest level.
- * 			(in practice, we end up finding the one that is farthest left of the lowest level)
- * 			We then construct a tree expression with the chosen operation and the sub-expression results
- * 			from running the function recursively on each of the sub-strings.
+ * 	- Step 1: The string is split into tokens by @ref string_to_tokens, which classifies each char once
+ * 		and pre-parses numbers.
+ * 	- Step 2: The tokens are parsed in a single left to right pass using precedence climbing.
+ * 		- A primary is a number, a symbol with an optional parenthesized parameter, or a
+ * 			parenthesized sub-expression.
+ * 		- After each primary, operations are folded into the left operand as long as they bind at least
+ * 			as tight as the current level. The right operand collects everything that binds tighter.
+ * 			This gives '*' and '/' precedence over '+' and '-', and makes equal precedence operations left associative.
+ *
+ * Parsing time is linear in the string length.
  *
  * @param str_len Length of given string
  * @param str String to parse
@@ -214,280 +1395,357 @@ str_cpy(char *dest, const char *src, size_t count) {
 expression_t
 string_to_expression (size_t str_len,
 					  char const *str) {
+	struct exp_error err;
+	expression_t exp;
+
+	assert(str_len > 0); // must has size of at least 1
+
+	if (string_to_expression_r(str_len, str, &exp, &err) != EXP_OK) {
+		rerror("%s", err.msg);
+	}
+	return exp;
+}
+
+#ifdef EXPRESSION_TEST_MAIN
+/*
+ * Checks that every evaluator drops errors in a select's untaken arm, and on the
+ * right of a && or || that its left side decides, and still reports the others.
+ * Expressions are run with the variable x, or with x written in as a constant for
+ * the evaluators that take no variables. Function calls are only run by the
+ * evaluators that resolve them.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DEXPRESSION_TEST_MAIN -o exptest -pthread errors.c scan.c types.c traverse.c workspace.c symbolic.c token.c expression.c document.c cache.c reparse.c bytecode.c batch.c jit.c simplify.c hashcons.c link.c reactive.c memo.c parallel.c range.c funcs.c arena.c compact.c -lm
+ */
+#include <ctype.h>
+#include "bytecode.h"
+#include "batch.h"
+#include "jit.h"
+#include "range.h"
+#include "hashcons.h"
+#include "compact.h"
+#include "reactive.h"
+#include "parallel.h"
+#include "workspace.h"
+#include "funcs.h"
+
+/**
+ * An expression in x, with its value or the error it reports.
+ */
+struct test_case {
+	char const  *str;  ///< The expression
+	sys_int_long x;    ///< Value of x
+	int          ret;  ///< EXP_OK or the error code
+	double       want; ///< The value when ret is EXP_OK
+	int          dbl;  ///< Non-zero if the value is a double
+};
+
+static struct test_case const test_cases[] = {
+	{"1 ? 2 : 3/0",                     0, EXP_OK,    2.0, 0},
+	{"0 ? 3/0 : 4",                     0, EXP_OK,    4.0, 0},
+	{"x == 0 ? 0 : 10/x",               0, EXP_OK,    0.0, 0},
+	{"x == 0 ? 0 : 10/x",               5, EXP_OK,    2.0, 0},
+	{"x == 0-1 ? 7 : (0-2147483647-1)*2147483648*2/x", -1, EXP_OK, 7.0, 0},
+	{"(0-2147483647-1)*2147483648*2/x", -1, EXP_EEVAL, 0.0, 0},
+	{"(x != 0 ? 10/x : 0) + 1",         0, EXP_OK,    1.0, 0},
+	{"1 || 3/0",                        0, EXP_OK,    1.0, 0},
+	{"0 && 3/0",                        0, EXP_OK,    0.0, 0},
+	{"x > 0 && 10/x > 1",               0, EXP_OK,    0.0, 0},
+	{"1 ? 2 : 1/0 + 1.5",               0, EXP_OK,    2.0, 1},
+	{"1 ? 3/0 : 2",                     0, EXP_EEVAL, 0.0, 0},
+	{"0 || 3/0",                        0, EXP_EEVAL, 0.0, 0},
+	{"3/x ? 1 : 2",                     0, EXP_EEVAL, 0.0, 0},
+	{"1 ? 2 : 3/0 + 4/0 * 1/x",         0, EXP_OK,    2.0, 0},
+	{"7/x",                             0, EXP_EEVAL, 0.0, 0},
+	{"1 + 7/x * 2",                     0, EXP_EEVAL, 0.0, 0},
+	{"7.5/x",                           0, EXP_EEVAL, 0.0, 1},
+	{"x ? 7.5/x : 1.5",                 0, EXP_OK,    1.5, 1},
+	{"x ? 7.5/x : 1.5",                 3, EXP_OK,    2.5, 1},
+	{"1.5/0.0 < 1",                     0, EXP_EEVAL, 0.0, 0},
+	{"0 ? (0.0/x ? 7 : 1) : 2",         0, EXP_OK,    2.0, 0},
+	{"1 ? 2 : pow(0, 0-1)",             0, EXP_OK,    2.0, 0},
+	{"pow(0, 0-1)",                     0, EXP_EEVAL, 0.0, 0},
+	{"x ? pow(x, 0-1) : 5",             0, EXP_OK,    5.0, 0},
+	{"x ? pow(x, 0-1) : 5",             1, EXP_OK,    1.0, 0},
+	{"pow(x, 0-1) + 1",                 0, EXP_EEVAL, 0.0, 0},
+	{"min(x, 2) * 3",                   5, EXP_OK,    6.0, 0},
+	{"min(1, 7/x)",                     0, EXP_EEVAL, 0.0, 0},
+	{"0 && abs(1/x)",                   0, EXP_OK,    0.0, 0},
+	{"x || pow(0, 0-1)",                1, EXP_OK,    1.0, 0},
+};
+
+#define TEST_COUNT (sizeof(test_cases) / sizeof(test_cases[0]))
+
+static char const *const test_syms[1] = {"x"};
+
+/* True if str has a function call, a name followed by '(' */
+static int
+test_has_call (char const *str) {
+	size_t i;
+
+	for (i = 1; str[i]; i++) {
+		if ((str[i] == '(') && isalpha((unsigned char) str[i - 1])) return 1;
+	}
+	return 0;
+}
+
+/* True if val is the expected value of t */
+static int
+test_value (struct test_case const *t, value_t val) {
+	if (t->dbl) return (val.type == VAL_DOUBLE) && (val.data.dbl == t->want);
+	return (val.type == VAL_LINT) && (val.data.lint == (sys_int_long) t->want);
+}
+
+/* Report a failed check */
+static int
+test_fail (struct test_case const *t, char const *evaluator) {
+	printf("FAIL %-10s x = %ld: %s\n", evaluator, t->x, t->str);
+	return 1;
+}
+
+/* Check an evaluator that reports errors */
+static int
+test_checked (struct test_case const *t, char const *evaluator, int ret, value_t val) {
+	if ((ret != t->ret) || ((ret == EXP_OK) && !test_value(t, val))) return test_fail(t, evaluator);
+	return 0;
+}
+
+/* Check an evaluator that does not report errors, and gives them as values */
+static int
+test_unchecked (struct test_case const *t, char const *evaluator, value_t val) {
+	if ((t->ret == EXP_OK) ? !test_value(t, val) : VAL_IS_NUMBER(val)) return test_fail(t, evaluator);
+	return 0;
+}
 
-    size_t index;         // main index into str
-//    int level_change = 0; // flag set to 1 if level ever goes above level_base
-    size_t level = 0;     // indicates runtime depth of open parens '('  -- 0 for none
-//    int level_base = 0;   // indicates current accepted level of open parens (will increase to "rip off" outside parens)
-
-    /* Statistics about Open Parens seen during parsing */
-    int oparen_count = 0; // total number seen
-//    size_t oparen_index = SIZE_T_MAX;
-//    size_t oparen_level = SIZE_T_MAX;
-
-    /* Statistics about Closed Parens seen during parsing */
-    int cparen_count = 0; // total number seen
-//    size_t cparen_index = SIZE_T_MAX;
-//    size_t cparen_level = SIZE_T_MAX;
-
-    /* Statistics about Operations seen during parsing */
-    int op_count = 0;             // indicates how many operations have been seen on current pass
-    size_t op_index = -1;         // index of operation at lowest level found
-    size_t op_level = SIZE_T_MAX; // level of the current operation found
-
-    /* Statistics about Whole Numbers seen during parsing */
-    int num_count = 0;   // indicates how many numbers have been seen on current pass
-    size_t num_index = -1; // index of number at lowest level found
-    size_t num_level = SIZE_T_MAX; // level of the current number found
-    size_t num_len;                // length in chars of the number found
-
-    /* Statistics about Symbols found */
-    // Note: The lowest level matters when parsing a symbol fn. of a symbol. Ex. "sin( pi )"
-    int    sym_count = 0;          // indicates how many symbols have been seen on current pass
-    size_t sym_index = -1;         // index of symbol at lowest level found
-    size_t sym_level = SIZE_T_MAX; // level of the current symbol found
-    size_t sym_len;
-
-//    exp_buf left_operand;
-    assert(str_len > 0); // must has size of at least 1
-
-    /*
-     * Stage 1
-     * Scan through elements of string from left to right once
-     */
-    for(index = 0; index < str_len; index++) {
-    	/* Grab current char */
-        char c = str[index];
-
-        /* Identify the char grabbed */
-        switch(c) {
-
-        /* Parentheses */
-        case '(':
-            oparen_count++;
-//            if (level < op_level) {
-//                oparen_index = index;
-//                oparen_level = level;
-//            }
-
-//            if(++level > level_base) level_change = 1;
-            level++;
-            break;
-        case ')':
-            cparen_count++;
-//            if (level < op_level) {
-//                cparen_index = index;
-//                cparen_level = level;
-//            }
-            level--;
-            break;
-
-        /* Operation chars */
-        case '+':
-        case '-':
-        case '*':
-        case '/':
-        	// add one to op counter
-            op_count++;
-            // if lower level op was found
-            if (level < op_level) {
-                op_index = index;
-                op_level = level;
-            }
-            break;
-
-        /* White space chars */
-        case ' ':
-        case '\t':
-            /* Ignore - Continue Past */
-            break;
-
-        /* End of strings chars */
-        case '\0':
-        case '\n':
-        case '\r':
-            /* Throw Error - encountered end of string char! */
-        	pferror("string_to_expression", "Parsing Error - Encountered a string terminating character early");
-            break;
-
-        default:
-        	///@todo Allow symbols to be detected when they start with numeric digits also. @ref string_to_sym is already compatible.
-
-        	// if we encounter the start of a number
-            if( IS_DIGIT(c) )
-            {
-                size_t start_index = index;
-
-                num_count++;
-
-                // get over number
-                for (; (index < str_len) && IS_DIGIT(str[index]); index++ )
-                    ;
-                // one too far - since index will be incremented again in the outer most parsing for loop
-                index--;
-
-                if (level < num_level) {
-                    num_index = start_index;
-                    num_level = level;
-                    num_len   = (index+1)-start_index;
-                }
-
-            }
-            // if we encounter the start of a symbol name - looks for alpha char
-            else if( IS_ALPHA(c) ) {
-                pindex_t start_index = index; ///< Store original index
-                pindex_t sym_index_tmp;       ///< Used to explore the presence of a symbol parameter
-
-                // found one more symbol
-                sym_count++;
-
-                // get over symbol name
-                for (; (index < str_len) && IS_ALNUM(str[index]); index++)
-                	;
-                // one too far - since index will be incremented again in the outer most parsing for loop
-                index--; // ready to exit symbol sub-parser
-
-                // navigate over possible whitespace to next real character -- using a temp index
-                for (sym_index_tmp = index+1; (sym_index_tmp < str_len) && IS_WHITESPACE(str[sym_index_tmp]); sym_index_tmp++)
-                	;
-
-                // check for presence of '(' signifying the start of a symbol parameter
-                if ( (sym_index_tmp < str_len) && (str[sym_index_tmp] == '(') ) {
-                	size_t end;
-                	// find end of parameter string
-                	end = find_matching(str_len, str, sym_index_tmp);
-
-                	// check if the parameter string is not valid
-                	if (end == PINDEX_BAD) {
-                		rerror("Syntax Error - Unmatched parenthesis around symbol parameter");
-                	}
-
-                	// parameter must be valid
-                	// move index over symbol parameter also
-                	index = end; // ready to exit symbol sub-parser
-                }
-
-                // record sym if lowest level
-                if(level < sym_level) {
-                	sym_index = start_index;
-                	sym_level = level;
-                	sym_len   = (index+1) - start_index;
-                }
-            }
-            else {
-                // Throw Error - Unknown character encountered
-            	rerror("Syntax Error - Unrecognized character \'%c\'", c);
-            }
-            break;
-
-        } // switch() end
-
-    } // for() end
-
-    /*
-     * Stage 2
-     * Analyze what happened
-     */
-
-    // Two Main Cases: 1) Found an operation -- multiple terms 2) Else, found just a number
-
-	/* TODO (craig#1#04/07/2014): Syntax Sanity Check. Check level==0, level_changed if op_level is set... */
-    ///@todo Do series of additional syntax checks here.
-    ///@todo Syntax Check: Check that level==0
-    ///@todo Syntax Check: Check that oparen_count==cparen_count
-
-	/* If operation was detected, use it */
-	if (op_index != SIZE_T_MAX) {
-		pindex_t sindex; // search index
-		pcount_t prm;    // number of open parens removed from one of the sides of the string
-
-		// OpIndex + OpLevel + NullByte
-		// (size of str to left of op) + (# of parens to add) + (1 null byte)
-//		size_t left_buf_size = op_index + op_level + sizeof(char);
-		// StrLen - ( OpIndex + 1 ) + Level + NullByte
-		// str_len - (op_index + 1) + (# of parens to add) + (1 null byte)
-//		size_t right_buf_size = str_len - (op_index + 1) + op_level + sizeof(char);
-
-		// We found the primary left-most operation
-		expression_t left, right;
-
-		/* Create temporary sub expression string buffers */
-        ///@note left_buf and right_buf were changed to use malloc to avoid errors with C90 compilers
-//        char *left_buf = malloc(left_buf_size);
-//        char *right_buf = malloc(right_buf_size);
-
-		/* Build left expression buffer */
-
-        prm = 0;
-        // find start of inner expression by eliminating open parens from left side
-        for (sindex=0; (sindex < str_len) && (prm < op_level); sindex++) {
-        	if (str[sindex] == '(') prm++;
-        	assert(sindex < op_index); // don't go past operation's index
-        }
-        // sindex should now be one after last paren found
-
-        left  = string_to_expression(op_index-sindex, &str[sindex]);
-
-//		memset(left_buf + ( left_buf_size - (op_level + sizeof(char)) ), ')', op_level); // place op_level many closing parens to match the op_level open ones
-//		str_cpy(left_buf , str , op_index); // will copy op_index bytes
-//		left_buf[left_buf_size-1] = '\0'; // place ending NULL byte
-
-		/* Build right expression buffer */
-
-        prm = 0;
-        // find start of inner expression by eliminating open parens from right side
-        for (sindex=str_len-1; (0 < sindex) && (prm < op_level); sindex--) {
-        	//pindex_t rindex = (str_len-1) - sindex; // calculate index coming from right to left
-        	if (str[sindex] == ')') prm++;
-        	assert(sindex > op_index); // don't go past operation's index
-        }
-        // sindex should now be one before last paren found
-        sindex++; // use as upper size
-
-        right = string_to_expression(sindex - (op_index+1), &str[op_index + 1]);
-
-//		memset(right_buf, '(', op_level);
-		// to=(at the beginning, just past any open parens) from=(one past op_index) count=(diff. of the original length and the count up to and including the operation)
-//		str_cpy(right_buf+op_level , str+op_index+1 , str_len-(op_index+1));
-//		right_buf[right_buf_size-1] = '\0'; // place ending NULL byte
-
-		/* Recurse on the left and right expressions */
-//		left  = string_to_expression(strlen(left_buf), left_buf);
-//		right = string_to_expression(strlen(right_buf), right_buf);
-
-//        free(left_buf);
-//        free(right_buf);
-
-		/* Create symbolic expression from the sub expressions and the operation */
-		return expression_new_tree(str[op_index], left, right);
-	}
-
-	/* If a symbol was detected, use it */
-	else if (sym_index != SIZE_T_MAX) {
-		if(num_index != SIZE_T_MAX) {
-			rerror("Syntax Error - Symbol and number detected without an operation");
+/**
+ * An expression with a symbol that has no value, which is an error like any other.
+ */
+struct test_unbound {
+	char const  *str;  ///< The expression
+	int          ret;  ///< EXP_OK or the error code
+	sys_int_long want; ///< The value when ret is EXP_OK
+};
+
+static struct test_unbound const test_unbounds[] = {
+	{"1 ? 2 : y",      EXP_OK,    2},
+	{"0 ? y : 3",      EXP_OK,    3},
+	{"0 && y",         EXP_OK,    0},
+	{"y",              EXP_EEVAL, 0},
+	{"1 + y * 2",      EXP_EEVAL, 0},
+	{"y ? 1 : 2",      EXP_EEVAL, 0},
+};
+
+#define TEST_UNBOUND_COUNT (sizeof(test_unbounds) / sizeof(test_unbounds[0]))
+
+/* The tree evaluators on an expression with a symbol that has no value */
+static int
+test_unbound (struct test_unbound const *t) {
+	struct exp_hashcons *hc;
+	struct exp_error err;
+	expression_t exp, dag;
+	value_t val[3];
+	int ret, i;
+
+	if (string_to_expression_r(strlen(t->str), t->str, &exp, &err) != EXP_OK) return 1;
+	val[0] = expression_evaluate(exp);
+	ret    = expression_evaluate_r(exp, &val[1], &err);
+	hc  = exp_hashcons_new();
+	dag = expression_hashcons(hc, expression_ref(exp));
+	val[2] = expression_evaluate_dag(dag);
+	expression_free(dag);
+	exp_hashcons_free(hc);
+	expression_free(exp);
+
+	for (i = 0; i < 3; i++) {
+		if ((t->ret == EXP_OK) ? ((val[i].type != VAL_LINT) || (val[i].data.lint != t->want)) : VAL_IS_NUMBER(val[i])) {
+			printf("FAIL unbound %d: %s\n", i, t->str);
+			return 1;
 		}
-		return expression_new_sym( string_to_sym(sym_len, &str[sym_index]) );
 	}
+	if (ret != t->ret) {
+		printf("FAIL unbound evaluate_r: %s\n", t->str);
+		return 1;
+	}
+	return 0;
+}
 
-	/* If number detected, use it */
-	else if (num_index != SIZE_T_MAX) {
-		if (num_count == 1) {
-			/* Create value expression using the single number */
-			return expression_new_value( string_to_value(num_len, &str[num_index]) ); // since we give the exact start location of num, buffer size should just be number length
+/**
+ * A number, with its value or the error parsing it reports.
+ */
+struct test_literal {
+	char const  *str;  ///< The expression
+	int          ret;  ///< EXP_OK or the error code
+	int          dbl;  ///< Non-zero if the value is a double
+	sys_int_long lint; ///< The value when it is a long int
+	double       want; ///< The value when it is a double
+};
+
+static struct test_literal const test_literals[] = {
+	{"9223372036854775807",      EXP_OK,      0, SYS_INT_LONG_T_MAX, 0.0},
+	{"0009223372036854775807",   EXP_OK,      0, SYS_INT_LONG_T_MAX, 0.0},
+	{"9223372036854775808",      EXP_ESYNTAX, 0, 0,                  0.0},
+	{"18446744073709551626",     EXP_ESYNTAX, 0, 0,                  0.0}, // 10 once wrapped
+	{"1 + 99999999999999999999", EXP_ESYNTAX, 0, 0,                  0.0},
+	{"9223372036854775808.0",    EXP_OK,      1, 0,                  9223372036854775808.0},
+	{"92233720368547758080e-1",  EXP_OK,      1, 0,                  9223372036854775808.0},
+};
+
+#define TEST_LITERAL_COUNT (sizeof(test_literals) / sizeof(test_literals[0]))
+
+/* Parse and evaluate a number that may not fit in a long int */
+static int
+test_literal (struct test_literal const *t) {
+	struct exp_error err;
+	expression_t exp;
+	value_t val;
+	int ret;
+
+	ret = string_to_expression_r(strlen(t->str), t->str, &exp, &err);
+	if (ret == EXP_OK) {
+		val = expression_evaluate(exp);
+		expression_free(exp);
+		if (t->dbl ? ((val.type != VAL_DOUBLE) || (val.data.dbl != t->want))
+		           : ((val.type != VAL_LINT) || (val.data.lint != t->lint))) {
+			ret = -1;
 		}
-		 else {
-		 	 // Throw Error - detected more than one number, but no operator was detected
-			 rerror("Syntax Error - More than one number detected without an operation");
-		 }
 	}
-	/* They gave us crap -- Error out */
-	else {
-		/* Throw Error -- Syntax error */
-		rerror("Syntax Error - No numbers or operations detected");
+	if (ret != t->ret) {
+		printf("FAIL literal: %s\n", t->str);
+		return 1;
 	}
+	return 0;
+}
 
-	return NULL;
+/* Evaluators of the expression with x written in as a constant */
+static int
+test_constant (struct test_case const *t, struct exp_par_pool *pool, struct exp_funcs *funcs) {
+	char str[256];
+	struct exp_hashcons *hc;
+	struct exp_compact *c;
+	struct exp_par_plan *plan;
+	struct exp_error err;
+	expression_t exp, dag;
+	value_t val;
+	size_t i, n = 0;
+	int bad = 0;
+
+	for (i = 0; t->str[i]; i++) {
+		if (t->str[i] == 'x') n += (size_t) sprintf(&str[n], "(0%+ld)", t->x);
+		else str[n++] = t->str[i];
+	}
+	str[n] = '\0';
+	if (string_to_expression_r(n, str, &exp, &err) != EXP_OK) return test_fail(t, "parse");
+
+	// only the tree evaluator takes a resolver for calls
+	if (test_has_call(t->str)) {
+		bad += test_checked(t, "calls_r", expression_evaluate_calls_r(exp, exp_funcs_resolve, funcs, &val, &err), val);
+		expression_free(exp);
+		return bad;
+	}
+
+	bad += test_unchecked(t, "evaluate", expression_evaluate(exp));
+	bad += test_checked(t, "evaluate_r", expression_evaluate_r(exp, &val, &err), val);
+
+	c = expression_to_compact(exp);
+	bad += test_checked(t, "compact", exp_compact_evaluate_r(c, NULL, NULL, &val, &err), val);
+	exp_compact_free(c);
+
+	hc = exp_hashcons_new();
+	dag = expression_hashcons(hc, expression_ref(exp));
+	bad += test_unchecked(t, "dag", expression_evaluate_dag(dag));
+	expression_free(dag);
+	exp_hashcons_free(hc);
+
+	plan = exp_par_plan_new(exp, 2);
+	bad += test_checked(t, "parallel", expression_evaluate_parallel_r(pool, plan, &val, &err), val);
+	exp_par_plan_free(plan);
+
+	expression_free(exp);
+	return bad;
+}
+
+/* Evaluators of the expression with x as a variable */
+static int
+test_variable (struct test_case const *t, struct exp_reactive *r, struct exp_funcs *funcs) {
+	static struct exp_range const x_range = {-10, 10};
+	sys_int_long const *cols[1];
+	sys_int_long out;
+	unsigned char fault;
+	struct bc_program *prog;
+	struct jit_program *jp;
+	struct range_program *rp;
+	struct exp_error err;
+	expression_t exp;
+	value_t val, x;
+	size_t id;
+	int bad = 0;
+
+	if (string_to_expression_r(strlen(t->str), t->str, &exp, &err) != EXP_OK) return test_fail(t, "parse");
+
+	assert(bytecode_compile_funcs(exp, 1, test_syms, funcs, &prog, &err) == EXP_OK);
+	bad += test_unchecked(t, "bytecode", bytecode_run(prog, &t->x));
+	if (prog->ncalls) {
+		bytecode_free(prog);
+		expression_free(exp);
+		return bad;
+	}
+	if ((prog->type == VAL_LINT) && (prog->nconsts == 0)) {
+		cols[0] = &t->x;
+		batch_run(prog, cols, 1, &out, &fault);
+		bad += test_unchecked(t, "batch", fault ? value_new_type(BC_FAULT_TYPE(fault)) : value_new_lint(out));
+	}
+	bytecode_free(prog);
+
+	assert(jit_compile(exp, 1, test_syms, &jp, &err) == EXP_OK);
+	bad += test_unchecked(t, "jit", jit_run(jp, &t->x));
+	jit_free(jp);
+
+	// a variable range that proves nothing about the divisions
+	if (range_compile(exp, 1, test_syms, &x_range, &rp, &err) == EXP_OK) {
+		if (t->x >= x_range.lo) bad += test_checked(t, "range", range_run(rp, &t->x, &val, &err), val);
+		range_free(rp);
+	}
+
+	x = value_new_lint(t->x);
+	workspace_set("x", &x);
+	assert(exp_reactive_add(r, exp, &id, &err) == EXP_OK);
+	bad += test_checked(t, "reactive", exp_reactive_get(r, id, &val, &err), val);
+	workspace_unset("x");
+
+	expression_free(exp);
+	return bad;
+}
+
+int
+main (void) {
+	struct exp_par_pool *pool;
+	struct exp_reactive *r;
+	struct exp_funcs *funcs;
+	size_t i;
+	int bad = 0;
+
+	workspace_init();
+	pool = exp_par_pool_new(2);
+	r = exp_reactive_new();
+	funcs = exp_funcs_new();
+	for (i = 0; i < TEST_COUNT; i++) {
+		bad += test_constant(&test_cases[i], pool, funcs);
+		bad += test_variable(&test_cases[i], r, funcs);
+	}
+	for (i = 0; i < TEST_UNBOUND_COUNT; i++) {
+		bad += test_unbound(&test_unbounds[i]);
+	}
+	for (i = 0; i < TEST_LITERAL_COUNT; i++) {
+		bad += test_literal(&test_literals[i]);
+	}
+	exp_funcs_free(funcs);
+	exp_reactive_free(r);
+	exp_par_pool_free(pool);
+
+	printf("%lu cases, %d failures\n", (unsigned long) (TEST_COUNT + TEST_UNBOUND_COUNT + TEST_LITERAL_COUNT), bad);
+	return bad ? 1 : 0;
 }
+#endif // #ifdef EXPRESSION_TEST_MAIN
 
 /* vim: set ts=4 sw=4 expandtab: */
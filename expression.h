@@ -9,8 +9,10 @@
 
 #include <stddef.h> /* size_t */
 
+#include "errors.h"
 #include "types.h"
 #include "symbolic.h"
+#include "token.h"
 #include "expression_lite.h" /* expression_t only exists in expression_lite.h */
 
 /*---------------------------------------------*
@@ -29,14 +31,23 @@ typedef char exp_buf[EXP_BUF_SIZE];
  */
 struct expression_data_tree {
 	/** The joining operation of the two sub-expressions.
+	 * Comparisons and logical operations give a long int 1 or 0, and use the op chars
+	 * of @ref token for the two char ones. A select, c ? a : b, is a '?' tree whose
+	 * right side is a ':' tree of its two arms.
 	 * \note Previously implemented using enumerations, but proved to be more of a burden.
 	 */
-    char op; // '+', '-', '*', or '/'
+    char op; // '+', '-', '*', '/', '<', '>', 'L', 'G', '=', '!', '&', '|', '?', ':' or ','
     expression_t left;  ///< Left sub-expression
     expression_t right; ///< Right sub-expression
 };
 
 
+/** True if exp is a select, a '?' tree whose right side is the ':' tree of its arms.
+ */
+#define EXP_IS_SELECT(exp) (((exp)->type == EXP_TREE) && ((exp)->data.tree.op == '?') \
+                            && ((exp)->data.tree.right->type == EXP_TREE) && ((exp)->data.tree.right->data.tree.op == ':'))
+
+
 /*---------------------------------------------*
  *     expression components                   *
  *---------------------------------------------*/
@@ -71,16 +82,70 @@ union expression_data {
 /// \note New types must have an entry in the \ref type enumeration and an associated entry in the \ref data union.
 struct expression {
 	enum expression_type  type; ///< The expression's selected type
+	unsigned int          refs; ///< Number of owners. The node is freed when the last one calls @ref expression_free. EXP_ARENA_REFS for arena nodes.
     union expression_data data; ///< The expression's data corresponding to it's \ref type.
 };
 
+/*---------------------------------------------*
+ *     number types                            *
+ *---------------------------------------------*/
+/** The number types an expression is made of.
+ * Symbols are long int variables. A comparison or logical operation gives a long int
+ * whatever its operands are, so only EXP_NUM_INT promises the type of the result.
+ */
+enum exp_num_class {
+	EXP_NUM_INT,    ///< Long ints only. Evaluates to a long int.
+	EXP_NUM_DOUBLE, ///< Doubles only. Evaluates to a double, unless compared.
+	EXP_NUM_MIXED   ///< Both. Evaluates to a double, with the long ints converted, unless compared.
+};
+
+/*---------------------------------------------*
+ *     symbol calls                            *
+ *---------------------------------------------*/
+/** Resolves a symbol call, like f(x+1) or max(a, b), to a value.
+ * @param name The symbol's name
+ * @param argc Number of arguments, at least 1
+ * @param argv Values of the comma separated arguments, in order
+ * @param[out] result Set to the call's value
+ * @param ctx The context given with the resolver
+ * @param[out] err Filled in with the error details on error. May be NULL.
+ * @return EXP_OK or the error code
+ */
+typedef int (*exp_call_fn)(char const *name,
+                           size_t argc,
+                           value_t const *argv,
+                           value_t *result,
+                           void *ctx,
+                           struct exp_error *err);
+
+/*---------------------------------------------*
+ *     held errors                             *
+ *---------------------------------------------*/
+/** Errors met while evaluating that are not reported yet.
+ * Both arms of a select, and both sides of && and ||, are always evaluated, so an
+ * error can turn up in a value that is thrown away. The checked evaluators hold each
+ * error they meet and carry on with a VAL_ERROR or VAL_INF value standing in for it,
+ * which @ref exp_held_operate and @ref expression_select pass along like any other.
+ * @ref exp_held_report reports an error only if its value makes it to the result.
+ */
+struct exp_held {
+	struct exp_error *errors; ///< Errors held, or NULL before the first
+	size_t            count;  ///< Number of errors held
+	size_t            size;   ///< Number of errors that fit in errors
+};
+
 /*---------------------------------------------*
  *     expression_t allocation functions       *
  *---------------------------------------------*/
 
+struct exp_arena;
+
 expression_t
 expression_new (void);
 
+expression_t
+expression_ref (expression_t exp);
+
 expression_t
 expression_new_value (value_t val);
 
@@ -92,6 +157,23 @@ expression_new_tree (char op,
 expression_t
 expression_new_sym (sym_t sym);
 
+expression_t
+expression_new_in (struct exp_arena *arena);
+
+expression_t
+expression_new_value_in (struct exp_arena *arena,
+                         value_t val);
+
+expression_t
+expression_new_tree_in (struct exp_arena *arena,
+                        char op,
+                        expression_t left,
+                        expression_t right);
+
+expression_t
+expression_new_sym_in (struct exp_arena *arena,
+                       sym_t sym);
+
 void
 expression_free (expression_t exp);
 
@@ -100,9 +182,64 @@ expression_free (expression_t exp);
  *     expression_t manipulation functions     *
  *---------------------------------------------*/
 
+value_t
+expression_operate (char op,
+                    value_t left_val,
+                    value_t right_val);
+
+int
+expression_operate_r (char op,
+                      value_t left_val,
+                      value_t right_val,
+                      value_t *result,
+                      struct exp_error *err);
+
+value_t
+expression_select (value_t cond_val,
+                   value_t then_val,
+                   value_t else_val);
+
+void
+exp_held_init (struct exp_held *held);
+
+void
+exp_held_free (struct exp_held *held);
+
+value_t
+exp_held_add (struct exp_held *held,
+              enum value_types type,
+              int dbl,
+              struct exp_error const *err);
+
+value_t
+exp_held_operate (struct exp_held *held,
+                  char op,
+                  value_t left_val,
+                  value_t right_val);
+
+int
+exp_held_report (struct exp_held const *held,
+                 value_t result,
+                 struct exp_error *err);
+
+enum exp_num_class
+expression_infer (expression_t exp);
+
 value_t
 expression_evaluate (expression_t exp);
 
+int
+expression_evaluate_r (expression_t exp,
+                       value_t *result,
+                       struct exp_error *err);
+
+int
+expression_evaluate_calls_r (expression_t exp,
+                             exp_call_fn call,
+                             void *ctx,
+                             value_t *result,
+                             struct exp_error *err);
+
 void
 expression_to_string (char *dst_str,
 		              expression_t src_exp);
@@ -111,6 +248,46 @@ expression_t
 string_to_expression (size_t str_len,
 					  char const *str);
 
+int
+string_to_expression_r (size_t str_len,
+                        char const *str,
+                        expression_t *exp,
+                        struct exp_error *err);
+
+int
+string_to_expression_arena_r (size_t str_len,
+                              char const *str,
+                              struct exp_arena *arena,
+                              expression_t *exp,
+                              struct exp_error *err);
+
+expression_t
+tokens_to_expression (char const *str,
+                      struct token_list const *list);
+
+int
+tokens_to_expression_r (char const *str,
+                        struct token_list const *list,
+                        expression_t *exp,
+                        struct exp_error *err);
+
+struct exp_spans;
+
+int
+tokens_to_expression_spans_r (char const *str,
+                              struct token_list const *list,
+                              pindex_t base,
+                              expression_t *exp,
+                              struct exp_spans *spans,
+                              struct exp_error *err);
+
+expression_t
+tokens_to_expression_arena (char const *str,
+                            struct token const *tokens,
+                            pindex_t *index,
+                            struct exp_arena *arena,
+                            struct exp_error *err);
+
 #endif // EXPRESSION_H_INCLUDED
 
 /* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,614 @@
+/**
+ * @file expression.hpp
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Compile time expressions for C++17.
+ *
+ * A string literal is parsed while compiling, with the same grammar as
+ * @ref string_to_expression. The result is a type whose evaluator is built from
+ * templates, one function per tree node, so no tree exists at run time:
+ * @code
+ * constexpr auto area = EXP_LITERAL("w * h + 2.5");
+ * double a = area(3, 4);                   // symbols in order of first appearance
+ * static_assert(EXP_LITERAL("6*7").value() == 42);
+ * @endcode
+ *
+ * Values follow the bytecode evaluator. Long int operations wrap on overflow,
+ * and an operation on a double and a long int converts the long int to double.
+ * Symbols are long int variables. The result type is sys_int_long or double,
+ * whichever the tree infers to. Comparisons, && and || give a long int 1 or 0,
+ * and a select, c ? a : b, evaluates both arms and then picks one.
+ *
+ * Malformed literals fail to compile. So do symbol parameters, which need a
+ * run time call, and decimal numbers that cannot be converted exactly while
+ * compiling, those with digits beyond 2^53 or a decimal exponent beyond 22.
+ * Such formulas still work through @ref string_to_expression.
+ * A division by zero, or LONG_MIN / -1, faults like in the bytecode evaluator, so it can
+ * sit in a select's untaken arm. A fault that reaches the result fails to compile when
+ * it is a constant, is reported by @ref expr::formula::evaluate_r, and is thrown as an
+ * @ref expr::fault by the other evaluators.
+ *
+ * Header only. It uses the C headers for types but needs none of the C library.
+ */
+#ifndef _EXPRESSION_HPP_
+#define _EXPRESSION_HPP_
+
+#include <cstddef>     // std::size_t
+#include <string_view> // std::string_view
+#include <type_traits> // std::is_integral
+extern "C" {
+#include "types.h"
+#include "symbolic.h"
+#include "errors.h"
+#include "bytecode.h"
+}
+
+namespace expr {
+
+/**
+ * Thrown for a division that faults and reaches the result.
+ */
+struct fault {
+	unsigned char kind; ///< BC_FAULT_ZERO or BC_FAULT_DIV
+};
+
+namespace detail {
+
+/// Extra error code for a decimal number that cannot be converted exactly at compile time
+constexpr int EINEXACT = EXP_EEVAL + 1;
+
+/// Extra error code for a whole number above SYS_INT_LONG_T_MAX, which token.c reports as a syntax error
+constexpr int EBIG = EXP_EEVAL + 2;
+
+enum class node_kind {
+	lint,
+	dbl,
+	symbol,
+	tree
+};
+
+/**
+ * A parsed node. Children are referred to by index into the tree's nodes.
+ */
+struct node {
+	node_kind    kind   = node_kind::lint; ///< What the node holds
+	char         op     = '\0';            ///< Operation of a tree node
+	std::size_t  left   = 0;               ///< Left child of a tree node
+	std::size_t  right  = 0;               ///< Right child of a tree node
+	sys_int_long lint   = 0;               ///< Value of a long int node
+	double       dbl    = 0.0;             ///< Value of a double node
+	std::size_t  sym    = 0;               ///< Variable index of a symbol node
+	bool         param  = false;           ///< Symbol node had a parameter
+};
+
+/**
+ * A parsed literal. Every node uses at least one char of the string, so N chars are enough.
+ */
+template <std::size_t N>
+struct tree {
+	node             nodes[N] = {};
+	std::size_t      count = 0;    ///< Nodes in use
+	std::size_t      root = 0;     ///< Index of the root node
+	std::string_view syms[N] = {}; ///< Symbol names in order of first appearance
+	std::size_t      nsyms = 0;    ///< Number of distinct symbols
+	int              err = EXP_OK; ///< Error code of the first error
+	std::size_t      index = 0;    ///< Position of the first error in the string
+};
+
+constexpr bool
+is_digit (char c) {
+	return ('0' <= c) && (c <= '9');
+}
+
+constexpr bool
+is_alpha (char c) {
+	return (('a' <= c) && (c <= 'z')) || (('A' <= c) && (c <= 'Z'));
+}
+
+/// Precedence of ',' between symbol arguments, the loosest binding
+constexpr int PREC_ARGS = 1;
+/// Lowest precedence outside of symbol arguments, that of a select's '?'
+constexpr int PREC_EXPR = 2;
+
+/// Same binding powers as op_precedence() in expression.c
+constexpr int
+op_precedence (char op) {
+	switch (op) {
+	case ',':
+		return PREC_ARGS;
+	case '?':
+		return PREC_EXPR;
+	case '|':
+		return PREC_EXPR + 1;
+	case '&':
+		return PREC_EXPR + 2;
+	case '=':
+	case '!':
+		return PREC_EXPR + 3;
+	case '<':
+	case '>':
+	case 'L':
+	case 'G':
+		return PREC_EXPR + 4;
+	case '+':
+	case '-':
+		return PREC_EXPR + 5;
+	case '*':
+	case '/':
+		return PREC_EXPR + 6;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Recursive descent parser, mirroring the precedence climbing in expression.c.
+ */
+template <std::size_t N>
+class parser {
+public:
+	static constexpr std::size_t npos = ~std::size_t(0);
+
+	constexpr explicit
+	parser (std::string_view str) : s(str) {}
+
+	constexpr tree<N>
+	run () {
+		std::size_t root = expression(PREC_EXPR);
+		if ((root != npos) && (peek() != '\0')) {
+			fail(EXP_ESYNTAX, pos);
+		}
+		if (t.err != EXP_OK) {
+			// leave a constant, so only the static_assert reports the error
+			t.nodes[0] = node();
+			root = 0;
+		}
+		t.root = root;
+		return t;
+	}
+
+private:
+	std::string_view s;
+	std::size_t      pos = 0;
+	tree<N>          t = {};
+
+	constexpr std::size_t
+	fail (int code, std::size_t index) {
+		if (t.err == EXP_OK) {
+			t.err   = code;
+			t.index = index;
+		}
+		return npos;
+	}
+
+	/// Next char after whitespace, or '\0' at the end
+	constexpr char
+	peek () {
+		while ((pos < s.size()) && ((s[pos] == ' ') || (s[pos] == '\t'))) pos++;
+		return (pos < s.size()) ? s[pos] : '\0';
+	}
+
+	/** The operation after whitespace, with the op chars of token.c for two char ones.
+	 * @param[out] len Number of chars the operation takes
+	 * @return The op char, or '\0' if no operation is next
+	 */
+	constexpr char
+	peek_op (std::size_t &len) {
+		char c = peek();
+		char next = (pos + 1 < s.size()) ? s[pos + 1] : '\0';
+
+		len = 1;
+		switch (c) {
+		case '<':
+		case '>':
+			if (next != '=') return c;
+			len = 2;
+			return (c == '<') ? 'L' : 'G';
+		case '=':
+		case '!':
+			len = 2;
+			return (next == '=') ? c : '\0';
+		case '&':
+		case '|':
+			len = 2;
+			return (next == c) ? c : '\0';
+		default:
+			return c;
+		}
+	}
+
+	constexpr std::size_t
+	add (node n) {
+		t.nodes[t.count] = n;
+		return t.count++;
+	}
+
+	constexpr std::size_t
+	expression (int min_prec) {
+		std::size_t left = primary();
+
+		while (left != npos) {
+			std::size_t len = 0;
+			char op = peek_op(len);
+			int prec = op_precedence(op);
+			std::size_t right = npos;
+			node n;
+
+			if ((prec == 0) || (prec < min_prec)) break;
+			pos += len;
+			right = (op == '?') ? select_arms() : expression(prec + 1);
+			if (right == npos) return npos;
+			n.kind  = node_kind::tree;
+			n.op    = op;
+			n.left  = left;
+			n.right = right;
+			left = add(n);
+		}
+		return left;
+	}
+
+	/// The arms of a select after its '?', as a ':' node
+	constexpr std::size_t
+	select_arms () {
+		node n;
+
+		n.kind = node_kind::tree;
+		n.op   = ':';
+		n.left = expression(PREC_EXPR);
+		if (n.left == npos) return npos;
+		if (peek() != ':') return fail(EXP_ESYNTAX, pos);
+		pos++;
+		n.right = expression(PREC_EXPR);
+		if (n.right == npos) return npos;
+		return add(n);
+	}
+
+	constexpr std::size_t
+	group (int min_prec) {
+		std::size_t exp = expression(min_prec);
+		if (exp == npos) return npos;
+		if (peek() != ')') return fail(EXP_ESYNTAX, pos);
+		pos++;
+		return exp;
+	}
+
+	constexpr std::size_t
+	primary () {
+		char c = peek();
+		std::size_t start = pos;
+
+		if (c == '(') {
+			pos++;
+			return group(PREC_EXPR);
+		}
+		if (is_digit(c)) return number();
+		if (is_alpha(c)) {
+			std::string_view name;
+			node n;
+			std::size_t i = 0;
+
+			while ((pos < s.size()) && (is_alpha(s[pos]) || is_digit(s[pos]))) pos++;
+			name = s.substr(start, pos - start);
+			if (name.size() >= SYMBOLIC_NAME_SIZE) return fail(EXP_ESYMBOL, start);
+
+			for (; (i < t.nsyms) && (t.syms[i] != name); i++)
+				;
+			if (i == t.nsyms) t.syms[t.nsyms++] = name;
+			n.kind = node_kind::symbol;
+			n.sym  = i;
+
+			// a parameter is parsed so errors match, the evaluator refuses it
+			if (peek() == '(') {
+				pos++;
+				if (group(PREC_ARGS) == npos) return npos;
+				n.param = true;
+			}
+			return add(n);
+		}
+		return fail(EXP_ESYNTAX, pos);
+	}
+
+	/// Same scan as token_number() in token.c
+	constexpr std::size_t
+	number () {
+		std::size_t start = pos;
+		unsigned long lint = 0;
+		unsigned long long mant = 0; // significant digits
+		int digits = 0;              // significant digits in mant
+		int exp10 = 0;               // power of ten applied to mant
+		bool decimal = false, big = false;
+		node n;
+
+		for (; (pos < s.size()) && is_digit(s[pos]); pos++) {
+			unsigned long d = (unsigned long) (s[pos] - '0');
+			if (lint > ((unsigned long) SYS_INT_LONG_T_MAX - d) / 10) big = true;
+			if (!big) lint = (lint * 10) + d;
+			digit(s[pos], mant, digits, exp10, false);
+		}
+		if ((pos + 1 < s.size()) && (s[pos] == '.') && is_digit(s[pos + 1])) {
+			for (pos++; (pos < s.size()) && is_digit(s[pos]); pos++) {
+				digit(s[pos], mant, digits, exp10, true);
+			}
+			decimal = true;
+		}
+		if ((pos < s.size()) && ((s[pos] == 'e') || (s[pos] == 'E'))) {
+			std::size_t e = pos + 1;
+			bool neg = false;
+			int value = 0;
+
+			if ((e < s.size()) && ((s[e] == '+') || (s[e] == '-'))) neg = (s[e++] == '-');
+			if ((e < s.size()) && is_digit(s[e])) {
+				for (pos = e; (pos < s.size()) && is_digit(s[pos]); pos++) {
+					if (value < 10000) value = (value * 10) + (s[pos] - '0');
+				}
+				exp10 += neg ? -value : value;
+				decimal = true;
+			}
+		}
+
+		if (!decimal) {
+			if (big) return fail(EBIG, start);
+			n.kind = node_kind::lint;
+			n.lint = (sys_int_long) lint;
+			return add(n);
+		}
+
+		/* Exact when both the digits and the power of ten are exact doubles,
+		 * since one multiply or divide then rounds correctly, like strtod() */
+		n.kind = node_kind::dbl;
+		if (mant == 0) {
+			n.dbl = 0.0;
+		} else if ((digits < 20) && (mant <= (1ULL << 53)) && (-22 <= exp10) && (exp10 <= 22)) {
+			double p = 1.0;
+			for (int i = 0; i < ((exp10 < 0) ? -exp10 : exp10); i++) p *= 10.0;
+			n.dbl = (exp10 < 0) ? ((double) mant / p) : ((double) mant * p);
+		} else {
+			return fail(EINEXACT, pos);
+		}
+		return add(n);
+	}
+
+	/// Accumulate one digit of a decimal, dropping leading and trailing zeros
+	static constexpr void
+	digit (char c, unsigned long long &mant, int &digits, int &exp10, bool fraction) {
+		int d = c - '0';
+		if (fraction) exp10--;
+		if ((mant == 0) && (d == 0)) return;
+		if (digits < 19) {
+			mant = (mant * 10) + (unsigned) d;
+			digits++;
+		} else {
+			// past 19 digits the decimal is inexact unless the rest are zeros
+			if (d != 0) digits = 20;
+			exp10++;
+		}
+	}
+};
+
+/// Parse a literal at compile time
+template <std::size_t N>
+constexpr tree<N>
+parse (std::string_view str) {
+	return parser<N>(str).run();
+}
+
+/// Apply a comparison or logical operation, giving a long int 1 or 0
+template <char OP, class T>
+constexpr sys_int_long
+test (T l, T r) {
+	if constexpr (OP == '<') return l < r;
+	else if constexpr (OP == '>') return l > r;
+	else if constexpr (OP == 'L') return l <= r;
+	else if constexpr (OP == 'G') return l >= r;
+	else if constexpr (OP == '=') return l == r;
+	else if constexpr (OP == '!') return l != r;
+	else if constexpr (OP == '&') return (l != 0) & (r != 0);
+	else return (l != 0) | (r != 0);
+}
+
+/**
+ * A node's value with its fault, like a bytecode stack entry.
+ */
+template <class T>
+struct result {
+	T             val   = T(); ///< The value, unspecified if there is a fault
+	unsigned char fault = 0;   ///< BC_FAULT_ZERO, BC_FAULT_DIV, or 0 for none
+};
+
+/// Apply a binary operation on long ints. Overflow wraps and a division that would trap faults, like the bytecode evaluator.
+template <char OP>
+constexpr result<sys_int_long>
+operate (sys_int_long l, sys_int_long r) {
+	unsigned long ul = (unsigned long) l, ur = (unsigned long) r;
+	if constexpr (OP == '+') return { (sys_int_long) (ul + ur) };
+	else if constexpr (OP == '-') return { (sys_int_long) (ul - ur) };
+	else if constexpr (OP == '*') return { (sys_int_long) (ul * ur) };
+	else if constexpr (OP == '/') {
+		unsigned char f = BC_DIV_FAULT(l, r);
+		return { f ? 0 : l / r, f };
+	}
+	else return { test<OP>(l, r) };
+}
+
+/// Apply a binary operation on doubles. Comparisons still give a long int.
+template <char OP>
+constexpr auto
+operate (double l, double r) {
+	if constexpr (OP == '+') return result<double>{ l + r };
+	else if constexpr (OP == '-') return result<double>{ l - r };
+	else if constexpr (OP == '*') return result<double>{ l * r };
+	else if constexpr (OP == '/') {
+		if (r == 0.0) return result<double>{ 0.0, BC_FAULT_ZERO };
+		return result<double>{ l / r };
+	}
+	else return result<sys_int_long>{ test<OP>(l, r) };
+}
+
+/// Fault of an operation: that of its left operand, then of its right, then its own.
+/// && and || drop a fault on their right when their left decides them.
+template <char OP, class L, class R>
+constexpr unsigned char
+pass_fault (result<L> l, result<R> r, unsigned char own) {
+	if (l.fault) return l.fault;
+	if (((OP != '&') || (l.val != 0)) && ((OP != '|') || (l.val == 0)) && r.fault) return r.fault;
+	return own;
+}
+
+/// Pick a select's arm by indexing, like expression_select(). A fault of the condition is kept.
+template <class C, class T>
+constexpr result<T>
+select (result<C> cond, result<T> then_val, result<T> else_val) {
+	result<T> const arms[2] = { else_val, then_val };
+	result<T> picked = arms[cond.val != 0];
+	if (cond.fault) picked.fault = cond.fault;
+	return picked;
+}
+
+/// Convert a long int node's result to a double
+template <class T>
+constexpr result<double>
+to_double (result<T> r) {
+	return { (double) r.val, r.fault };
+}
+
+} // namespace detail
+
+/**
+ * A parsed literal. Lit must have a static constexpr text() returning the string,
+ * which @ref EXP_LITERAL provides.
+ */
+template <class Lit>
+class formula {
+	static constexpr std::string_view str = Lit::text();
+	static constexpr auto t = detail::parse<str.size() + 1>(str);
+
+	static_assert(t.err != EXP_ESYNTAX, "expression literal has a syntax error");
+	static_assert(t.err != EXP_ESYMBOL, "expression literal has a symbol name that is too large");
+	static_assert(t.err != detail::EINEXACT, "expression literal has a decimal number that cannot be converted exactly at compile time");
+	static_assert(t.err != detail::EBIG, "expression literal has a whole number too large for a long int");
+
+	/// Evaluate node I, recursion happens in template instantiation only
+	template <std::size_t I>
+	static constexpr auto
+	eval_node (sys_int_long const *vars) {
+		constexpr detail::node n = t.nodes[I];
+
+		if constexpr (n.kind == detail::node_kind::lint) {
+			return detail::result<sys_int_long>{ n.lint };
+		} else if constexpr (n.kind == detail::node_kind::dbl) {
+			return detail::result<double>{ n.dbl };
+		} else if constexpr (n.kind == detail::node_kind::symbol) {
+			static_assert(!n.param, "expression literal has a symbol parameter, which cannot be compiled");
+			return detail::result<sys_int_long>{ vars[n.sym] };
+		} else if constexpr (n.op == '?') {
+			constexpr detail::node arms = t.nodes[n.right];
+			auto c = eval_node<n.left>(vars);
+			auto a = eval_node<arms.left>(vars);
+			auto b = eval_node<arms.right>(vars);
+			if constexpr (std::is_same_v<decltype(a), decltype(b)>) {
+				return detail::select(c, a, b);
+			} else {
+				return detail::select(c, detail::to_double(a), detail::to_double(b));
+			}
+		} else {
+			auto l = eval_node<n.left>(vars);
+			auto r = eval_node<n.right>(vars);
+			// promote a long int side when the other is a double
+			if constexpr (std::is_same_v<decltype(l), decltype(r)>) {
+				auto v = detail::operate<n.op>(l.val, r.val);
+				v.fault = detail::pass_fault<n.op>(l, r, v.fault);
+				return v;
+			} else {
+				auto v = detail::operate<n.op>((double) l.val, (double) r.val);
+				v.fault = detail::pass_fault<n.op>(l, r, v.fault);
+				return v;
+			}
+		}
+	}
+
+	/// Value of the whole tree with its fault
+	using root_result = decltype(eval_node<t.root>(nullptr));
+
+public:
+	/// sys_int_long or double, whichever the tree infers to
+	using result_type = decltype(root_result::val);
+
+	/// Number of distinct symbols
+	static constexpr std::size_t symbols = t.nsyms;
+
+	/// The literal the formula was parsed from
+	static constexpr std::string_view
+	text () {
+		return str;
+	}
+
+	/// Name of the symbol bound to variable i
+	static constexpr std::string_view
+	symbol (std::size_t i) {
+		return t.syms[i];
+	}
+
+	/** Evaluate with variables given as an array, like @ref bytecode_run.
+	 * A fault that reaches the result is thrown, which fails to compile in a constant expression.
+	 * @param vars One long int per symbol, in order of first appearance
+	 */
+	static constexpr result_type
+	evaluate (sys_int_long const *vars) {
+		root_result r = eval_node<t.root>(vars);
+		if (r.fault) throw fault{ r.fault };
+		return r.val;
+	}
+
+	/** Evaluate with variables given as an array, reporting a fault instead of throwing it.
+	 * @param vars One long int per symbol, in order of first appearance
+	 * @param[out] result Set to the value of the formula. Left alone on a fault.
+	 * @return EXP_OK, or EXP_EEVAL for a division by zero or LONG_MIN / -1 that reaches the result
+	 */
+	static constexpr int
+	evaluate_r (sys_int_long const *vars, result_type *result) {
+		root_result r = eval_node<t.root>(vars);
+		if (r.fault) return EXP_EEVAL;
+		*result = r.val;
+		return EXP_OK;
+	}
+
+	/// Evaluate with one long int argument per symbol, in order of first appearance
+	template <class... Args>
+	constexpr result_type
+	operator() (Args... args) const {
+		static_assert(sizeof...(Args) == symbols, "wrong number of arguments for the expression's symbols");
+		static_assert((std::is_integral_v<Args> && ...), "expression symbols are long int variables");
+		sys_int_long vars[symbols ? symbols : 1] = { (sys_int_long) args... };
+		return evaluate(vars);
+	}
+
+	/// Value of a formula without symbols, folded while compiling
+	static constexpr result_type
+	value () {
+		static_assert(symbols == 0, "only an expression without symbols has a constant value");
+		constexpr root_result r = eval_node<t.root>(nullptr);
+		static_assert(r.fault != BC_FAULT_ZERO, "expression literal divides by zero");
+		static_assert(r.fault != BC_FAULT_DIV, "expression literal divides LONG_MIN by -1");
+		return r.val;
+	}
+};
+
+} // namespace expr
+
+/**
+ * Parse a string literal at compile time.
+ * @return An @ref expr::formula object for the literal.
+ */
+#define EXP_LITERAL(str)                                                     \
+	([] {                                                                    \
+		struct exp_literal_ {                                                \
+			static constexpr std::string_view text () { return str; }        \
+		};                                                                   \
+		return ::expr::formula<exp_literal_>{};                              \
+	}())
+
+#endif /* _EXPRESSION_HPP_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,130 @@
+/**
+ * @file expression_test.cpp
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Checks of the C++ front-end in expression.hpp.
+ *
+ * Most checks are static_asserts, so the file failing to compile is the failure.
+ * The rest run the formulas with variables that are only known at run time.
+ *
+ * make tests
+ * or
+ * g++ -std=c++17 -Wall -Wextra -pedantic -o exptest_cpp expression_test.cpp
+ */
+#include <cstdio>      // std::printf
+#include <cstdlib>     // std::atol
+#include <type_traits> // std::is_same_v
+#include "expression.hpp"
+
+/* Errors in a select's untaken arm, and on the right of a decided && or ||, never trap */
+static_assert(EXP_LITERAL("1 ? 2 : 3/0").value() == 2);
+static_assert(EXP_LITERAL("0 ? 3/0 : 4").value() == 4);
+static_assert(EXP_LITERAL("1 || 3/0").value() == 1);
+static_assert(EXP_LITERAL("0 && 3/0").value() == 0);
+static_assert(EXP_LITERAL("x == 0 ? 0 : 10/x")(0) == 0);
+static_assert(EXP_LITERAL("x == 0 ? 0 : 10/x")(5) == 2);
+static_assert(EXP_LITERAL("x == 0-1 ? 7 : (0-2147483647-1)*2147483648*2/x")(-1) == 7);
+
+/* Precedence and associativity follow C */
+static_assert(EXP_LITERAL("6*7").value() == 42);
+static_assert(EXP_LITERAL("1+2*3").value() == 7);
+static_assert(EXP_LITERAL("(1+2)*3").value() == 9);
+static_assert(EXP_LITERAL("10-4-3").value() == 3);
+static_assert(EXP_LITERAL("100/10/5").value() == 2);
+static_assert(EXP_LITERAL("1 + 2 < 4 == 1").value() == 1);
+static_assert(EXP_LITERAL("0 || 1 && 0").value() == 0);
+static_assert(EXP_LITERAL("1 ? 0 ? 2 : 3 : 4").value() == 3);
+static_assert(EXP_LITERAL("  2 *( 3+4 )  ").value() == 14);
+
+/* Comparisons and logical operations give 1 or 0 */
+static_assert(EXP_LITERAL("2 <= 2").value() == 1);
+static_assert(EXP_LITERAL("2 >= 3").value() == 0);
+static_assert(EXP_LITERAL("2 != 3").value() == 1);
+static_assert(EXP_LITERAL("5 && 7").value() == 1);
+static_assert(EXP_LITERAL("0 || 0").value() == 0);
+static_assert(EXP_LITERAL("1.5 < 2").value() == 1);
+
+/* Types: a double anywhere makes the result a double, and comparisons are long ints */
+constexpr auto lint_sum   = EXP_LITERAL("1+2");
+constexpr auto dbl_sum    = EXP_LITERAL("1+2.0");
+constexpr auto dbl_test   = EXP_LITERAL("1.0 < 2.0");
+constexpr auto dbl_select = EXP_LITERAL("x ? 1 : 2.5");
+static_assert(std::is_same_v<decltype(lint_sum)::result_type, sys_int_long>);
+static_assert(std::is_same_v<decltype(dbl_sum)::result_type, double>);
+static_assert(std::is_same_v<decltype(dbl_test)::result_type, sys_int_long>);
+static_assert(std::is_same_v<decltype(dbl_select)::result_type, double>);
+static_assert(EXP_LITERAL("7/2").value() == 3);
+static_assert(EXP_LITERAL("7/2.0").value() == 3.5);
+static_assert(EXP_LITERAL("0 ? 1 : 2.5").value() == 2.5);
+static_assert(EXP_LITERAL("1 ? 1 : 2.5").value() == 1.0);
+
+/* Decimals are converted exactly, like strtod would */
+static_assert(EXP_LITERAL("0.1+0.2").value() == 0.1 + 0.2);
+static_assert(EXP_LITERAL("2.5e3").value() == 2500.0);
+static_assert(EXP_LITERAL("1.25e-2").value() == 0.0125);
+
+/* Long ints wrap */
+static_assert(EXP_LITERAL("9223372036854775807+1").value() == SYS_INT_LONG_T_MIN);
+
+/* A whole number too large for a long int does not parse, though it may as a decimal */
+static_assert(expr::detail::parse<32>("9223372036854775808").err == expr::detail::EBIG);
+static_assert(expr::detail::parse<32>("1 + 18446744073709551626").err == expr::detail::EBIG);
+static_assert(EXP_LITERAL("0009223372036854775807").value() == SYS_INT_LONG_T_MAX);
+static_assert(EXP_LITERAL("1e19").value() == 1e19);
+
+/* A division that faults is reported when it reaches the result */
+constexpr int
+div_by (sys_int_long x) {
+	constexpr auto f = EXP_LITERAL("(x == 1 ? 7 : 1) + 10/x");
+	sys_int_long const vars[1] = { x };
+	sys_int_long v = 0;
+	return (f.evaluate_r(vars, &v) == EXP_OK) ? (int) v : -1;
+}
+static_assert(div_by(2) == 6);
+static_assert(div_by(0) == -1);
+static_assert(EXP_LITERAL("x ? 2.0/x : 1")(0) == 1.0);
+
+/* Symbols are bound in order of first appearance */
+constexpr auto twice_b = EXP_LITERAL("b*a+b");
+static_assert(twice_b.symbols == 2);
+static_assert(twice_b.symbol(0) == "b");
+static_assert(twice_b.symbol(1) == "a");
+static_assert(lint_sum.symbols == 0);
+static_assert(twice_b(2, 5) == 12);
+static_assert(EXP_LITERAL("w * h + 2.5")(3, 4) == 14.5);
+static_assert(EXP_LITERAL("x - y*x")(3, 2) == -3);
+static_assert(EXP_LITERAL("x < y ? y : x")(8, 5) == 8);
+static_assert(EXP_LITERAL("x < y ? y : x")(2, 5) == 5);
+static_assert(EXP_LITERAL("6*7").text() == "6*7");
+
+int
+main (int argc, char *argv[]) {
+	// a zero the compiler cannot see
+	long zero = (argc > 1) ? std::atol(argv[1]) : 0;
+	int bad = 0;
+
+	if (EXP_LITERAL("x == 0 ? 0 : 10/x")(zero) != 0) bad++;
+	if (EXP_LITERAL("x != 0 && 10/x > 1")(zero) != 0) bad++;
+	if (EXP_LITERAL("x*x + 3*x - 1")(zero + 4) != 27) bad++;
+	if (EXP_LITERAL("x / 2.0")(zero + 5) != 2.5) bad++;
+	if (EXP_LITERAL("x + 9223372036854775807")(zero + 1) != SYS_INT_LONG_T_MIN) bad++;
+	try {
+		EXP_LITERAL("10/x")(zero);
+		bad++;
+	} catch (expr::fault const &f) {
+		if (f.kind != BC_FAULT_ZERO) bad++;
+	}
+	try {
+		EXP_LITERAL("(0-9223372036854775807-1)/(x-1)")(zero);
+		bad++;
+	} catch (expr::fault const &f) {
+		if (f.kind != BC_FAULT_DIV) bad++;
+	}
+
+	std::printf("%d failures\n", bad);
+	return bad ? 1 : 0;
+}
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,509 @@
+/**
+ * @file funcs.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * A registry of native functions for symbol calls.
+ *
+ * Functions live in a small hash table with chained buckets. Each function is
+ * allocated on its own, so its address stays put as others are registered.
+ */
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // strcmp(), strlen(), strcpy()
+#include <math.h>   // fabs(), pow()
+#include "errors.h"
+#include "types.h"
+#include "symbolic.h"
+#include "funcs.h"
+
+/// Number of hash buckets. Always a power of 2.
+#define FUNCS_BUCKETS 32
+
+struct exp_funcs {
+	struct exp_func *buckets[FUNCS_BUCKETS]; ///< Hash table
+};
+
+/// FNV-1a hash parameters
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME  16777619UL
+
+/* Hash a function name */
+static unsigned long
+funcs_hash (char const *name) {
+	unsigned long hash = FNV_OFFSET;
+	for (; *name; name++) {
+		hash = (hash ^ (unsigned char) *name) * FNV_PRIME;
+	}
+	return hash;
+}
+
+
+/*---------------------------------------------*
+ *               built in functions            *
+ *---------------------------------------------*/
+
+/* A long int or double argument as a double */
+static double
+func_double (value_t val) {
+	return (val.type == VAL_DOUBLE) ? val.data.dbl : (double) val.data.lint;
+}
+
+/* True if any argument is a double */
+static int
+func_doubles (size_t argc, value_t const *argv) {
+	size_t i;
+	for (i = 0; i < argc; i++) {
+		if (argv[i].type == VAL_DOUBLE) return 1;
+	}
+	return 0;
+}
+
+/* abs(x) -- the absolute value of LONG_MIN wraps to itself */
+static int
+func_abs (size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	(void) argc; (void) ctx; (void) err;
+	if (argv[0].type == VAL_DOUBLE) {
+		*result = value_new_double(fabs(argv[0].data.dbl));
+	} else {
+		sys_int_long x = argv[0].data.lint;
+		*result = value_new_lint((x < 0) ? (sys_int_long) (0UL - (unsigned long) x) : x);
+	}
+	return EXP_OK;
+}
+
+/* sign(x) -- -1, 0 or 1. A double zero or NaN is given back as is. */
+static int
+func_sign (size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	(void) argc; (void) ctx; (void) err;
+	if (argv[0].type == VAL_DOUBLE) {
+		double x = argv[0].data.dbl;
+		*result = value_new_double((x > 0.0) ? 1.0 : (x < 0.0) ? -1.0 : x);
+	} else {
+		sys_int_long x = argv[0].data.lint;
+		*result = value_new_lint((x > 0) - (x < 0));
+	}
+	return EXP_OK;
+}
+
+/* The smallest, or largest when max is set, of the arguments. The first of equals is kept. */
+static value_t
+func_pick (size_t argc, value_t const *argv, int max) {
+	size_t i;
+
+	if (func_doubles(argc, argv)) {
+		double best = func_double(argv[0]);
+		for (i = 1; i < argc; i++) {
+			double x = func_double(argv[i]);
+			if (max ? (x > best) : (x < best)) best = x;
+		}
+		return value_new_double(best);
+	} else {
+		sys_int_long best = argv[0].data.lint;
+		for (i = 1; i < argc; i++) {
+			sys_int_long x = argv[i].data.lint;
+			if (max ? (x > best) : (x < best)) best = x;
+		}
+		return value_new_lint(best);
+	}
+}
+
+/* min(a, ...) */
+static int
+func_min (size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	(void) ctx; (void) err;
+	*result = func_pick(argc, argv, 0);
+	return EXP_OK;
+}
+
+/* max(a, ...) */
+static int
+func_max (size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	(void) ctx; (void) err;
+	*result = func_pick(argc, argv, 1);
+	return EXP_OK;
+}
+
+/* clamp(x, lo, hi) -- lo when x is below lo, otherwise hi when x is above hi, otherwise x */
+static int
+func_clamp (size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	(void) argc; (void) ctx; (void) err;
+	if (func_doubles(3, argv)) {
+		double x = func_double(argv[0]), lo = func_double(argv[1]), hi = func_double(argv[2]);
+		*result = value_new_double((x < lo) ? lo : (x > hi) ? hi : x);
+	} else {
+		sys_int_long x = argv[0].data.lint, lo = argv[1].data.lint, hi = argv[2].data.lint;
+		*result = value_new_lint((x < lo) ? lo : (x > hi) ? hi : x);
+	}
+	return EXP_OK;
+}
+
+/* pow(x, n) -- long int powers wrap, and negative ones truncate like 1 / x^-n */
+static int
+func_pow (size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	sys_int_long x, n;
+	unsigned long base, acc = 1;
+
+	(void) argc; (void) ctx;
+	if (func_doubles(2, argv)) {
+		*result = value_new_double(pow(func_double(argv[0]), func_double(argv[1])));
+		return EXP_OK;
+	}
+
+	x = argv[0].data.lint;
+	n = argv[1].data.lint;
+	if (n < 0) {
+		if (x == 0) {
+			*result = value_new_type(VAL_ERROR);
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Division by zero");
+		}
+		if (x == 1)       acc = 1;
+		else if (x == -1) acc = (n % 2) ? (unsigned long) -1 : 1;
+		else              acc = 0;
+	} else {
+		// square and multiply
+		unsigned long e = (unsigned long) n;
+		for (base = (unsigned long) x; e; e >>= 1) {
+			if (e & 1) acc *= base;
+			base *= base;
+		}
+	}
+	*result = value_new_lint((sys_int_long) acc);
+	return EXP_OK;
+}
+
+
+/*---------------------------------------------*
+ *               registry                      *
+ *---------------------------------------------*/
+
+/** New function registry, holding the built in functions.
+ * @return The new registry. Free with @ref exp_funcs_free.
+ */
+struct exp_funcs *
+exp_funcs_new (void) {
+	struct exp_funcs *funcs;
+	size_t i;
+
+	funcs = (struct exp_funcs *) malloc(sizeof(struct exp_funcs));
+	assert(funcs); // throw error - exp_funcs_new: malloc could not do allocation
+	for (i = 0; i < FUNCS_BUCKETS; i++) funcs->buckets[i] = NULL;
+
+	exp_funcs_register(funcs, "abs",   1, 1, VAL_UNDEF, func_abs,   NULL, NULL);
+	exp_funcs_register(funcs, "sign",  1, 1, VAL_UNDEF, func_sign,  NULL, NULL);
+	exp_funcs_register(funcs, "min",   1, EXP_FUNC_VARIADIC, VAL_UNDEF, func_min, NULL, NULL);
+	exp_funcs_register(funcs, "max",   1, EXP_FUNC_VARIADIC, VAL_UNDEF, func_max, NULL, NULL);
+	exp_funcs_register(funcs, "pow",   2, 2, VAL_UNDEF, func_pow,   NULL, NULL);
+	exp_funcs_register(funcs, "clamp", 3, 3, VAL_UNDEF, func_clamp, NULL, NULL);
+	return funcs;
+}
+
+/** Free a function registry.
+ * Programs compiled against it must not be run afterwards.
+ * @param funcs The registry to free.
+ */
+void
+exp_funcs_free (struct exp_funcs *funcs) {
+	size_t i;
+
+	if (!funcs) return;
+	for (i = 0; i < FUNCS_BUCKETS; i++) {
+		struct exp_func *func = funcs->buckets[i];
+		while (func) {
+			struct exp_func *next = func->chain;
+			free(func);
+			func = next;
+		}
+	}
+	free(funcs);
+}
+
+/** Add a function to a registry.
+ * @param funcs The registry to add to.
+ * @param name Name the function is called by.
+ * @param min_args Fewest arguments. Must be at least 1.
+ * @param max_args Most arguments, or @ref EXP_FUNC_VARIADIC. Must be at least min_args.
+ * @param type Type fn gives, VAL_LINT or VAL_DOUBLE, or VAL_UNDEF for a long int when
+ * 		all arguments are long ints and a double otherwise.
+ * @param fn The function.
+ * @param ctx Passed to fn.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code. A name that is too long or already registered is an error.
+ */
+int
+exp_funcs_register (struct exp_funcs *funcs,
+                    char const *name,
+                    size_t min_args,
+                    size_t max_args,
+                    enum value_types type,
+                    exp_func_fn fn,
+                    void *ctx,
+                    struct exp_error *err) {
+	struct exp_func *func;
+	unsigned long hash;
+
+	assert(funcs);
+	assert(name);
+	assert(fn);
+	assert((min_args >= 1) && (min_args <= max_args));
+	assert((type == VAL_LINT) || (type == VAL_DOUBLE) || (type == VAL_UNDEF));
+
+	exp_error_clear(err);
+	if (strlen(name) >= SYMBOLIC_NAME_SIZE) {
+		return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - Symbol name is too large");
+	}
+	if (exp_funcs_find(funcs, name)) {
+		return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - Function \"%s\" is already registered", name);
+	}
+
+	func = (struct exp_func *) malloc(sizeof(struct exp_func));
+	assert(func); // throw error - exp_funcs_register: malloc could not do allocation
+	strcpy(func->name, name); // safe to copy because length was verified above
+	func->min_args = min_args;
+	func->max_args = max_args;
+	func->type     = type;
+	func->fn       = fn;
+	func->ctx      = ctx;
+
+	hash = funcs_hash(name);
+	func->chain = funcs->buckets[hash & (FUNCS_BUCKETS - 1)];
+	funcs->buckets[hash & (FUNCS_BUCKETS - 1)] = func;
+	return EXP_OK;
+}
+
+/** Look a function up by name.
+ * @param funcs The registry to look in.
+ * @param name The function's name.
+ * @return The function or NULL if there is none by that name.
+ */
+struct exp_func const *
+exp_funcs_find (struct exp_funcs const *funcs,
+                char const *name) {
+	struct exp_func const *func;
+
+	assert(funcs);
+	assert(name);
+	for (func = funcs->buckets[funcs_hash(name) & (FUNCS_BUCKETS - 1)]; func; func = func->chain) {
+		if (strcmp(func->name, name) == 0) return func;
+	}
+	return NULL;
+}
+
+/** Type of value a function gives.
+ * @param func The function.
+ * @param doubles Non-zero if any argument is a double.
+ * @return VAL_LINT or VAL_DOUBLE
+ */
+enum value_types
+exp_func_type (struct exp_func const *func,
+               int doubles) {
+	assert(func);
+	if (func->type != VAL_UNDEF) return func->type;
+	return doubles ? VAL_DOUBLE : VAL_LINT;
+}
+
+/** Call a function, checking its arguments and the type of what it gives.
+ * @param func The function to call.
+ * @param argc Number of arguments.
+ * @param argv Argument values.
+ * @param[out] result Set to the function's value.
+ * @param[out] err Filled in with the error details on error. Left alone on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+exp_func_call (struct exp_func const *func,
+               size_t argc,
+               value_t const *argv,
+               value_t *result,
+               struct exp_error *err) {
+	size_t i;
+	int ret;
+
+	assert(func);
+	assert(argv || (argc == 0));
+	assert(result);
+
+	if ((argc < func->min_args) || (argc > func->max_args)) {
+		*result = value_new_type(VAL_ERROR);
+		return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - Wrong number of arguments for \"%s\"", func->name);
+	}
+	for (i = 0; i < argc; i++) {
+		if (!VAL_IS_NUMBER(argv[i])) {
+			*result = value_new_type(VAL_ERROR);
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Arguments of \"%s\" must be numbers", func->name);
+		}
+	}
+
+	if ((ret = func->fn(argc, argv, result, func->ctx, err)) != EXP_OK) return ret;
+
+	if (result->type != exp_func_type(func, func_doubles(argc, argv))) {
+		*result = value_new_type(VAL_ERROR);
+		return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Function \"%s\" gave the wrong type of value", func->name);
+	}
+	return EXP_OK;
+}
+
+/** Resolve a symbol call by looking its name up in a registry.
+ * An @ref exp_call_fn, for use with @ref expression_evaluate_calls_r or a memo.
+ * @param funcs The struct exp_funcs to look in
+ * @return EXP_OK or the error code
+ */
+int
+exp_funcs_resolve (char const *name,
+                   size_t argc,
+                   value_t const *argv,
+                   value_t *result,
+                   void *funcs,
+                   struct exp_error *err) {
+	struct exp_func const *func = exp_funcs_find((struct exp_funcs const *) funcs, name);
+
+	if (!func) {
+		*result = value_new_type(VAL_ERROR);
+		return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - Unknown function \"%s\"", name);
+	}
+	return exp_func_call(func, argc, argv, result, err);
+}
+
+#ifdef FUNCS_TEST_MAIN
+/*
+ * Checks the built in functions through the tree evaluator and compiled bytecode,
+ * and registering functions of one's own.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DFUNCS_TEST_MAIN -o funcs funcs.c bytecode.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c arena.c -lm
+ */
+#include <stdio.h>
+#include "expression.h"
+#include "bytecode.h"
+
+/**
+ * A call and what it should give.
+ */
+static struct test_call {
+	char const      *str;  ///< The expression
+	int              ret;  ///< Return code
+	enum value_types type; ///< Type of the value when EXP_OK
+	sys_int_long     lint; ///< Value when a long int
+	double           dbl;  ///< Value when a double
+} test_calls[] = {
+	{ "abs(0-3)",                      EXP_OK,      VAL_LINT,   3,                  0.0 },
+	{ "abs(2.5-4)",                    EXP_OK,      VAL_DOUBLE, 0,                  1.5 },
+	{ "abs(0-9223372036854775807-1)",  EXP_OK,      VAL_LINT,   SYS_INT_LONG_T_MIN, 0.0 }, // wraps to itself
+	{ "sign(0-7)",                     EXP_OK,      VAL_LINT,   -1,                 0.0 },
+	{ "sign(0)",                       EXP_OK,      VAL_LINT,   0,                  0.0 },
+	{ "sign(0.0-2.5)",                 EXP_OK,      VAL_DOUBLE, 0,                  -1.0 },
+	{ "min(3)",                        EXP_OK,      VAL_LINT,   3,                  0.0 },
+	{ "min(4,2,8)",                    EXP_OK,      VAL_LINT,   2,                  0.0 },
+	{ "max(4,2,8)",                    EXP_OK,      VAL_LINT,   8,                  0.0 },
+	{ "max(1,2.5)",                    EXP_OK,      VAL_DOUBLE, 0,                  2.5 },
+	{ "min(1,2.0)",                    EXP_OK,      VAL_DOUBLE, 0,                  1.0 }, // a double if any argument is
+	{ "pow(2,10)",                     EXP_OK,      VAL_LINT,   1024,               0.0 },
+	{ "pow(2,64)",                     EXP_OK,      VAL_LINT,   0,                  0.0 }, // wraps
+	{ "pow(2,0-1)",                    EXP_OK,      VAL_LINT,   0,                  0.0 }, // truncates
+	{ "pow(0-1,0-3)",                  EXP_OK,      VAL_LINT,   -1,                 0.0 },
+	{ "pow(1,0-5)",                    EXP_OK,      VAL_LINT,   1,                  0.0 },
+	{ "pow(4.0,0.5)",                  EXP_OK,      VAL_DOUBLE, 0,                  2.0 },
+	{ "pow(0,0-1)",                    EXP_EEVAL,   VAL_ERROR,  0,                  0.0 },
+	{ "clamp(5,0,3)",                  EXP_OK,      VAL_LINT,   3,                  0.0 },
+	{ "clamp(0-1,0,3)",                EXP_OK,      VAL_LINT,   0,                  0.0 },
+	{ "clamp(2,0,3.5)",                EXP_OK,      VAL_DOUBLE, 0,                  2.0 },
+	{ "1+max(2,abs(0-3))*2",           EXP_OK,      VAL_LINT,   7,                  0.0 },
+	{ "scale(7)",                      EXP_OK,      VAL_LINT,   21,                 0.0 },
+	{ "pow(2)",                        EXP_ESYMBOL, VAL_ERROR,  0,                  0.0 },
+	{ "clamp(1,2,3,4)",                EXP_ESYMBOL, VAL_ERROR,  0,                  0.0 },
+	{ "nosuch(1)",                     EXP_ESYMBOL, VAL_ERROR,  0,                  0.0 },
+	{ "wrong(1)",                      EXP_EEVAL,   VAL_ERROR,  0,                  0.0 }, // gave a double
+	{ "abs(1/0)",                      EXP_EEVAL,   VAL_ERROR,  0,                  0.0 },
+};
+#define TEST_CALL_COUNT (sizeof(test_calls) / sizeof(test_calls[0]))
+
+/* scale(x) -- x times the long int at ctx */
+static int
+test_scale (size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	(void) argc; (void) err;
+	*result = value_new_lint(argv[0].data.lint * *(sys_int_long const *) ctx);
+	return EXP_OK;
+}
+
+/* wrong(x) -- registered as a long int, but gives a double */
+static int
+test_wrong (size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	(void) argc; (void) argv; (void) ctx; (void) err;
+	*result = value_new_double(0.5);
+	return EXP_OK;
+}
+
+/* True if val is what t wants */
+static int
+test_value_ok (struct test_call const *t, value_t val) {
+	if (val.type != t->type) return 0;
+	if (val.type == VAL_LINT)   return val.data.lint == t->lint;
+	if (val.type == VAL_DOUBLE) return val.data.dbl == t->dbl;
+	return 1;
+}
+
+int
+main (void) {
+	struct exp_funcs *funcs = exp_funcs_new();
+	struct bc_program *prog;
+	struct exp_error err;
+	sys_int_long factor = 3;
+	expression_t exp;
+	value_t result;
+	size_t i;
+	int bad = 0, cases = 0, ret;
+
+	exp_funcs_register(funcs, "scale", 1, 1, VAL_LINT, test_scale, &factor, NULL);
+	exp_funcs_register(funcs, "wrong", 1, 1, VAL_LINT, test_wrong, NULL, NULL);
+
+	for (i = 0; i < TEST_CALL_COUNT; i++) {
+		struct test_call const *t = &test_calls[i];
+
+		string_to_expression_r(strlen(t->str), (char *) t->str, &exp, &err);
+		ret = expression_evaluate_calls_r(exp, exp_funcs_resolve, funcs, &result, &err);
+		cases++;
+		if ((ret != t->ret) || ((ret == EXP_OK) && !test_value_ok(t, result))) {
+			printf("FAIL \"%s\": returned %d type %d (%s), want %d type %d\n", t->str, ret, result.type, err.msg, t->ret, t->type);
+			bad++;
+		}
+
+		/* Compiled calls go straight through the function pointers */
+		if ((t->ret == EXP_OK) && (bytecode_compile_funcs(exp, 0, NULL, funcs, &prog, &err) == EXP_OK)) {
+			result = bytecode_run(prog, NULL);
+			cases++;
+			if (!test_value_ok(t, result)) {
+				printf("FAIL \"%s\" compiled: type %d\n", t->str, result.type);
+				bad++;
+			}
+			bytecode_free(prog);
+		}
+		expression_free(exp);
+	}
+
+	/* Registering */
+	cases++;
+	if (exp_funcs_register(funcs, "max", 1, 1, VAL_LINT, test_scale, &factor, &err) != EXP_ESYMBOL) {
+		printf("FAIL max was registered twice\n");
+		bad++;
+	}
+	cases++;
+	if (exp_funcs_register(funcs, "a_very_long_function_name", 1, 1, VAL_LINT, test_scale, &factor, &err) != EXP_ESYMBOL) {
+		printf("FAIL a name too long was registered\n");
+		bad++;
+	}
+	cases++;
+	if (!exp_funcs_find(funcs, "clamp") || exp_funcs_find(funcs, "nosuch")
+	    || (exp_func_type(exp_funcs_find(funcs, "abs"), 1) != VAL_DOUBLE)
+	    || (exp_func_type(exp_funcs_find(funcs, "scale"), 1) != VAL_LINT)) {
+		printf("FAIL lookup\n");
+		bad++;
+	}
+	exp_funcs_free(funcs);
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef FUNCS_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,106 @@
+/**
+ * @file funcs.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * A registry of native functions for symbol calls, like max(a, b) or pow(x, 2).
+ *
+ * A new registry holds the built in functions, and C callbacks can be added to it:
+ * - abs(x) and sign(x)
+ * - min(a, ...) and max(a, ...), with one or more arguments
+ * - pow(x, n)
+ * - clamp(x, lo, hi)
+ *
+ * The built in functions give a long int when all of their arguments are long ints
+ * and a double otherwise. Integer pow wraps on overflow like the other operations,
+ * and truncates negative powers toward zero like division.
+ *
+ * @ref bytecode_compile_funcs resolves each call once, when compiling, so running the
+ * program calls through the function pointer. @ref exp_funcs_resolve is an
+ * @ref exp_call_fn for the tree evaluators, which looks the name up on each call.
+ */
+#ifndef _FUNCS_H_
+#define _FUNCS_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "symbolic.h"
+
+/// max_args for a function that takes any number of arguments
+#define EXP_FUNC_VARIADIC SIZE_T_MAX
+
+/** A native function.
+ * @param argc Number of arguments, within the function's registered bounds
+ * @param argv Argument values, each a long int or a double
+ * @param[out] result Set to the function's value, of the type it was registered with
+ * @param ctx The context given when the function was registered
+ * @param[out] err Filled in with the error details on error. May be NULL.
+ * @return EXP_OK or the error code
+ */
+typedef int (*exp_func_fn)(size_t argc,
+                           value_t const *argv,
+                           value_t *result,
+                           void *ctx,
+                           struct exp_error *err);
+
+/**
+ * A registered function.
+ * Its address does not change while it is registered, so compiled programs may keep it.
+ */
+struct exp_func {
+	char             name[SYMBOLIC_NAME_SIZE]; ///< Name it is called by
+	size_t           min_args; ///< Fewest arguments, at least 1
+	size_t           max_args; ///< Most arguments or @ref EXP_FUNC_VARIADIC
+	enum value_types type;     ///< VAL_LINT, VAL_DOUBLE, or VAL_UNDEF for a long int when all arguments are long ints and a double otherwise
+	exp_func_fn      fn;       ///< The function
+	void            *ctx;      ///< Passed to fn
+	struct exp_func *chain;    ///< Next function in the same bucket
+};
+
+/// A function registry. Its fields are private to funcs.c.
+struct exp_funcs;
+
+struct exp_funcs *
+exp_funcs_new (void);
+
+void
+exp_funcs_free (struct exp_funcs *funcs);
+
+int
+exp_funcs_register (struct exp_funcs *funcs,
+                    char const *name,
+                    size_t min_args,
+                    size_t max_args,
+                    enum value_types type,
+                    exp_func_fn fn,
+                    void *ctx,
+                    struct exp_error *err);
+
+struct exp_func const *
+exp_funcs_find (struct exp_funcs const *funcs,
+                char const *name);
+
+enum value_types
+exp_func_type (struct exp_func const *func,
+               int doubles);
+
+int
+exp_func_call (struct exp_func const *func,
+               size_t argc,
+               value_t const *argv,
+               value_t *result,
+               struct exp_error *err);
+
+int
+exp_funcs_resolve (char const *name,
+                   size_t argc,
+                   value_t const *argv,
+                   value_t *result,
+                   void *funcs,
+                   struct exp_error *err);
+
+#endif /* _FUNCS_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
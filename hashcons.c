@@ -0,0 +1,574 @@
+/**
+ * @file hashcons.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Hash-consed expression construction.
+ *
+ * Nodes are only built from children that are already shared, so two nodes are
+ * structurally equal exactly when their own fields and child pointers are equal.
+ * That keeps hashing and comparison to one node at a time.
+ * The table is open addressed with linear probing and never more than half full.
+ */
+#include <stdlib.h> // malloc(), calloc(), free()
+#include <string.h> // strcmp(), strncpy()
+#include "errors.h"
+#include "types.h"
+#include "symbolic.h"
+#include "expression.h"
+#include "arena.h"
+#include "traverse.h"
+#include "hashcons.h"
+
+/// Starting number of slots. Must be a power of two.
+#define HASHCONS_INITIAL_SIZE 64
+
+struct exp_hashcons {
+	expression_t *slots; ///< Shared nodes or NULL
+	size_t        count; ///< Number of nodes in slots
+	size_t        size;  ///< Number of slots, a power of two
+};
+
+/* Mix a word into an FNV-1a style hash */
+static size_t
+hash_mix (size_t h, unsigned long v) {
+	int i;
+	for (i = 0; i < (int) sizeof(v); i++) {
+		h ^= (v >> (8 * i)) & 0xFF;
+		h *= (size_t) 1099511628211UL;
+	}
+	return h;
+}
+
+/* Hash a node by its own fields and its children's addresses */
+static size_t
+hash_node (expression_t exp) {
+	size_t h = hash_mix((size_t) 14695981039346656037UL, (unsigned long) exp->type);
+	char const *c;
+
+	switch (exp->type) {
+	case EXP_VALUE:
+		h = hash_mix(h, (unsigned long) exp->data.val.type);
+		h = hash_mix(h, value_bits(exp->data.val));
+		break;
+	case EXP_TREE:
+		h = hash_mix(h, (unsigned long) (unsigned char) exp->data.tree.op);
+		h = hash_mix(h, (unsigned long) (size_t) exp->data.tree.left);
+		h = hash_mix(h, (unsigned long) (size_t) exp->data.tree.right);
+		break;
+	case EXP_SYMBOLIC:
+		for (c = exp->data.sym.name; *c; c++) h = hash_mix(h, (unsigned long) (unsigned char) *c);
+		h = hash_mix(h, (unsigned long) (size_t) exp->data.sym.p);
+		break;
+	default:
+		break;
+	}
+	return h;
+}
+
+/* Compare two nodes by their own fields and their children's addresses */
+static int
+node_equal (expression_t a, expression_t b) {
+	if (a->type != b->type) return 0;
+	switch (a->type) {
+	case EXP_VALUE:
+		return value_equal(a->data.val, b->data.val);
+	case EXP_TREE:
+		return (a->data.tree.op == b->data.tree.op)
+		    && (a->data.tree.left == b->data.tree.left)
+		    && (a->data.tree.right == b->data.tree.right);
+	case EXP_SYMBOLIC:
+		return (strcmp(a->data.sym.name, b->data.sym.name) == 0) && (a->data.sym.p == b->data.sym.p);
+	default:
+		return 0;
+	}
+}
+
+/** Create an empty table.
+ * @return The new table. Free it with @ref exp_hashcons_free.
+ */
+struct exp_hashcons *
+exp_hashcons_new (void) {
+	struct exp_hashcons *hc = (struct exp_hashcons *) malloc(sizeof(struct exp_hashcons));
+	assert(hc); // throw error - exp_hashcons_new: malloc could not do allocation
+	hc->slots = (expression_t *) calloc(HASHCONS_INITIAL_SIZE, sizeof(expression_t));
+	assert(hc->slots); // throw error - exp_hashcons_new: calloc could not do allocation
+	hc->count = 0;
+	hc->size  = HASHCONS_INITIAL_SIZE;
+	return hc;
+}
+
+/** Free a table.
+ * The table's references are released. Nodes still owned elsewhere stay valid.
+ * @param hc The table to free.
+ */
+void
+exp_hashcons_free (struct exp_hashcons *hc) {
+	size_t i;
+	if (hc == NULL) return;
+	for (i = 0; i < hc->size; i++) {
+		if (hc->slots[i]) expression_free(hc->slots[i]);
+	}
+	free(hc->slots);
+	free(hc);
+}
+
+/** Number of distinct nodes in a table.
+ */
+size_t
+exp_hashcons_count (struct exp_hashcons const *hc) {
+	assert(hc);
+	return hc->count;
+}
+
+/* Double the number of slots */
+static void
+hashcons_grow (struct exp_hashcons *hc) {
+	size_t size = hc->size * 2;
+	expression_t *slots = (expression_t *) calloc(size, sizeof(expression_t));
+	size_t i;
+
+	assert(slots); // throw error - hashcons_grow: calloc could not do allocation
+	for (i = 0; i < hc->size; i++) {
+		if (hc->slots[i]) {
+			size_t j = hash_node(hc->slots[i]) & (size - 1);
+			while (slots[j]) j = (j + 1) & (size - 1);
+			slots[j] = hc->slots[i];
+		}
+	}
+	free(hc->slots);
+	hc->slots = slots;
+	hc->size  = size;
+}
+
+/** Find or add the node described by key.
+ * key's children are references the caller gives up.
+ * @return A new reference to the shared node.
+ */
+static expression_t
+hashcons_intern (struct exp_hashcons *hc, struct expression const *key) {
+	size_t h = hash_node((expression_t) key);
+	size_t i;
+	expression_t exp;
+
+	for (i = h & (hc->size - 1); hc->slots[i]; i = (i + 1) & (hc->size - 1)) {
+		if (node_equal(hc->slots[i], (expression_t) key)) {
+			// the shared node already owns equal children
+			if (key->type == EXP_TREE) {
+				expression_free(key->data.tree.left);
+				expression_free(key->data.tree.right);
+			} else if ((key->type == EXP_SYMBOLIC) && key->data.sym.p) {
+				expression_free(key->data.sym.p);
+			}
+			return expression_ref(hc->slots[i]);
+		}
+	}
+
+	exp = expression_new();
+	exp->type = key->type;
+	exp->data = key->data;
+	exp->refs = 2; // the caller and the table
+
+	if (2 * (hc->count + 1) > hc->size) {
+		hashcons_grow(hc);
+		for (i = h & (hc->size - 1); hc->slots[i]; i = (i + 1) & (hc->size - 1)) ;
+	}
+	hc->slots[i] = exp;
+	hc->count++;
+	return exp;
+}
+
+/** Shared value node.
+ * @return A reference to the node, to be released with @ref expression_free.
+ */
+expression_t
+exp_hashcons_value (struct exp_hashcons *hc,
+                    value_t val) {
+	struct expression key;
+	assert(hc);
+	key.type = EXP_VALUE;
+	key.data.val = val;
+	return hashcons_intern(hc, &key);
+}
+
+/** Shared tree node.
+ * Like @ref expression_new_tree, the node takes over the caller's references to its children.
+ * @param left Left operand, which must come from the same table.
+ * @param right Right operand, which must come from the same table.
+ * @return A reference to the node, to be released with @ref expression_free.
+ */
+expression_t
+exp_hashcons_tree (struct exp_hashcons *hc,
+                   char op,
+                   expression_t left,
+                   expression_t right) {
+	struct expression key;
+	assert(hc);
+	assert(left && right);
+	key.type = EXP_TREE;
+	key.data.tree.op    = op;
+	key.data.tree.left  = left;
+	key.data.tree.right = right;
+	return hashcons_intern(hc, &key);
+}
+
+/** Shared symbol node.
+ * @param sym The symbol. Its parameter, if any, must come from the same table
+ * 		and the node takes over the caller's reference to it.
+ * @return A reference to the node, to be released with @ref expression_free.
+ */
+expression_t
+exp_hashcons_sym (struct exp_hashcons *hc,
+                  sym_t sym) {
+	struct expression key;
+	assert(hc);
+	key.type = EXP_SYMBOLIC;
+	key.data.sym = sym;
+	return hashcons_intern(hc, &key);
+}
+
+/* Push a node onto a stack of nodes waiting for their parent */
+static void
+hashcons_push (expression_t **stack, size_t *depth, size_t *size, expression_t exp) {
+	if (*depth == *size) {
+		*size = *size ? (*size * 2) : EXP_WALK_LOCAL;
+		*stack = (expression_t *) realloc(*stack, *size * sizeof(expression_t));
+		assert(*stack); // throw error - hashcons_push: realloc could not do allocation
+	}
+	(*stack)[(*depth)++] = exp;
+}
+
+/* Shared copy of exp, leaving exp alone.
+ * Built in post-order, so each node's shared children wait on a stack for it. */
+static expression_t
+hashcons_copy (struct exp_hashcons *hc, expression_t exp) {
+	struct exp_walk w;
+	expression_t node, shared = NULL;
+	expression_t *stack = NULL;
+	size_t depth = 0, size = 0;
+	sym_t sym;
+
+	exp_walk_init(&w, exp);
+	while ((node = exp_walk_next_post(&w)) != NULL) {
+		switch (node->type) {
+		case EXP_VALUE:
+			shared = exp_hashcons_value(hc, node->data.val);
+			break;
+		case EXP_TREE:
+			depth -= 2;
+			shared = exp_hashcons_tree(hc, node->data.tree.op, stack[depth], stack[depth + 1]);
+			break;
+		case EXP_SYMBOLIC:
+			sym = node->data.sym;
+			if (sym.p) sym.p = stack[--depth];
+			shared = exp_hashcons_sym(hc, sym);
+			break;
+		default:
+			assert(0); // throw error - hashcons_copy: invalid expression type
+			break;
+		}
+		hashcons_push(&stack, &depth, &size, shared);
+	}
+	exp_walk_free(&w);
+
+	assert(depth == 1);
+	shared = stack[0];
+	free(stack);
+	return shared;
+}
+
+/** Convert an expression to shared nodes.
+ * Repeated subexpressions in exp, and ones already in the table, become one node.
+ * @param exp The expression to convert. The caller's reference to it is released.
+ * @return A reference to the shared expression, to be released with @ref expression_free.
+ */
+expression_t
+expression_hashcons (struct exp_hashcons *hc,
+                     expression_t exp) {
+	expression_t shared;
+	assert(hc);
+	assert(exp);
+	shared = hashcons_copy(hc, exp);
+	expression_free(exp);
+	return shared;
+}
+
+/*---------------------------------------------*
+ *     DAG evaluation                          *
+ *---------------------------------------------*/
+
+/**
+ * Values of shared nodes seen during one evaluation.
+ * Open addressed on the node address.
+ */
+struct dag_memo {
+	expression_t *keys;  ///< Nodes or NULL
+	value_t      *vals;  ///< Value of each node in keys
+	size_t        count; ///< Number of nodes in keys
+	size_t        size;  ///< Number of slots, a power of two
+};
+
+/* Slot for exp, which is either its entry or the empty slot where it would go */
+static size_t
+dag_memo_slot (struct dag_memo const *memo, expression_t exp) {
+	size_t i = ((size_t) exp >> 4) * (size_t) 11400714819323198485UL;
+	for (i &= memo->size - 1; memo->keys[i] && (memo->keys[i] != exp); i = (i + 1) & (memo->size - 1)) ;
+	return i;
+}
+
+static void
+dag_memo_put (struct dag_memo *memo, expression_t exp, value_t val) {
+	size_t i;
+
+	if (2 * (memo->count + 1) > memo->size) {
+		struct dag_memo bigger;
+		bigger.size  = memo->size ? (memo->size * 2) : HASHCONS_INITIAL_SIZE;
+		bigger.count = 0;
+		bigger.keys  = (expression_t *) calloc(bigger.size, sizeof(expression_t));
+		bigger.vals  = (value_t *) malloc(bigger.size * sizeof(value_t));
+		assert(bigger.keys && bigger.vals); // throw error - dag_memo_put: allocation failed
+		for (i = 0; i < memo->size; i++) {
+			if (memo->keys[i]) dag_memo_put(&bigger, memo->keys[i], memo->vals[i]);
+		}
+		free(memo->keys);
+		free(memo->vals);
+		*memo = bigger;
+	}
+	i = dag_memo_slot(memo, exp);
+	memo->keys[i] = exp;
+	memo->vals[i] = val;
+	memo->count++;
+}
+
+/* True if exp may be reached more than once and its value is worth keeping.
+ * An arena node only hangs from its parent, whatever its refs say.
+ * A ':' node is left out, since as a select's arms it has no value of its own. */
+static int
+dag_memo_wanted (expression_t exp) {
+	return (exp->refs > 1) && (exp->refs != EXP_ARENA_REFS) && (exp->data.tree.op != ':');
+}
+
+/* Value of exp if it is already in memo, or NULL */
+static value_t const *
+dag_memo_get (struct dag_memo const *memo, expression_t exp) {
+	size_t i;
+
+	if (!memo->size || !dag_memo_wanted(exp)) return NULL;
+	i = dag_memo_slot(memo, exp);
+	return memo->keys[i] ? &memo->vals[i] : NULL;
+}
+
+/* Evaluate exp without recursion. Each node's value waits on a stack for its parent,
+ * and a shared node that is already known is not walked into again. */
+static value_t
+evaluate_dag (expression_t exp, struct dag_memo *memo) {
+	struct exp_walk w;
+	enum exp_walk_event event;
+	expression_t node, parent;
+	value_t const *known;
+	value_t *vals = NULL;
+	value_t val;
+	size_t depth = 0, size = 0;
+
+	exp_walk_init(&w, exp);
+	while (exp_walk_next(&w, &node, &event)) {
+		if (event == EXP_WALK_ENTER) {
+			// leaves are evaluated whole, and known nodes are not walked
+			if ((node->type != EXP_TREE) || dag_memo_get(memo, node)) exp_walk_skip(&w);
+			continue;
+		}
+		if (event != EXP_WALK_LEAVE) continue;
+
+		if (node->type != EXP_TREE) {
+			val = expression_evaluate(node);
+		} else if ((known = dag_memo_get(memo, node)) != NULL) {
+			val = *known;
+		} else {
+			parent = w.depth ? w.stack[w.depth - 1].exp : NULL;
+			if (parent && EXP_IS_SELECT(parent) && (parent->data.tree.right == node)) {
+				continue; // the arms' values wait for the select
+			}
+			if (EXP_IS_SELECT(node)) {
+				depth -= 3;
+				val = expression_select(vals[depth], vals[depth + 1], vals[depth + 2]);
+			} else {
+				depth -= 2;
+				val = exp_held_operate(NULL, node->data.tree.op, vals[depth], vals[depth + 1]);
+			}
+			if (dag_memo_wanted(node)) dag_memo_put(memo, node, val);
+		}
+
+		if (depth == size) {
+			size = size ? (size * 2) : EXP_WALK_LOCAL;
+			vals = (value_t *) realloc(vals, size * sizeof(value_t));
+			assert(vals); // throw error - evaluate_dag: realloc could not do allocation
+		}
+		vals[depth++] = val;
+	}
+	exp_walk_free(&w);
+
+	assert(depth == 1);
+	val = vals[0];
+	free(vals);
+	return val;
+}
+
+/** Evaluate an expression, computing each shared node only once.
+ * Gives the same result as @ref expression_evaluate.
+ * @param exp The expression to evaluate, usually built by @ref expression_hashcons.
+ * @return The value of the expression.
+ */
+value_t
+expression_evaluate_dag (expression_t exp) {
+	struct dag_memo memo = {NULL, NULL, 0, 0};
+	value_t val;
+
+	assert(exp);
+	val = evaluate_dag(exp, &memo);
+	free(memo.keys);
+	free(memo.vals);
+	return val;
+}
+
+#ifdef HASHCONS_TEST_MAIN
+/*
+ * Checks that equal subexpressions become one node, that the DAG evaluator agrees
+ * with the tree evaluator, and that deep and heavily shared expressions are fine.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DHASHCONS_TEST_MAIN -o hashcons hashcons.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c arena.c -lm
+ */
+#include <stdio.h>
+#include "arena.h"
+
+/// Expressions evaluated both as trees and as DAGs
+static char const *const test_strs[] = {
+	"(1+2)*(1+2)",
+	"(2*3)-(2*3)/(0+1)",
+	"(1 ? 2 : 3/0) + (1 ? 2 : 3/0)",
+	"(0 ? 1 : 4) * (0 ? 1 : 4) + 1.5",
+	"(3/0) + (3/0)",
+	"(1 < 2) && (1 < 2) || (5/0)",
+	"(2.5*2.5) - (2.5*2.5) * (1 == 1)",
+};
+
+#define TEST_COUNT (sizeof(test_strs) / sizeof(test_strs[0]))
+
+/// Terms in the long chain
+#define TEST_CHAIN 1000000
+
+/// Doublings in the shared chain, whose tree has 2^TEST_DOUBLINGS leaves
+#define TEST_DOUBLINGS 60
+
+/* Parse str into shared nodes */
+static expression_t
+test_parse (struct exp_hashcons *hc, char const *str) {
+	return expression_hashcons(hc, string_to_expression(strlen(str), (char *) str));
+}
+
+/* True if two results agree, errors only by type */
+static int
+test_same (value_t a, value_t b) {
+	if (a.type != b.type) return 0;
+	return !VAL_IS_NUMBER(a) || value_equal(a, b);
+}
+
+int
+main (void) {
+	struct exp_hashcons *hc = exp_hashcons_new();
+	struct exp_arena *arena;
+	struct exp_error err;
+	expression_t exp, other;
+	value_t want, got;
+	size_t i, count;
+	int bad = 0, cases = 0;
+
+	/* Equal subexpressions are one node, within and across expressions */
+	exp = test_parse(hc, "(a+b)*(a+b)");
+	cases++;
+	if ((exp->data.tree.left != exp->data.tree.right) || (exp_hashcons_count(hc) != 4)) {
+		printf("FAIL (a+b)*(a+b): %lu nodes\n", (unsigned long) exp_hashcons_count(hc));
+		bad++;
+	}
+	other = test_parse(hc, "(a+b)-1");
+	cases++;
+	if ((other->data.tree.left != exp->data.tree.left) || (exp_hashcons_count(hc) != 6)) {
+		printf("FAIL (a+b)-1: %lu nodes\n", (unsigned long) exp_hashcons_count(hc));
+		bad++;
+	}
+	expression_free(exp);
+	expression_free(other);
+
+	/* A long int and a double of the same value stay apart */
+	exp = test_parse(hc, "1+1.0");
+	cases++;
+	if (exp->data.tree.left == exp->data.tree.right) {
+		printf("FAIL 1+1.0: 1 and 1.0 are one node\n");
+		bad++;
+	}
+	expression_free(exp);
+
+	/* The DAG evaluator gives the tree evaluator's results, errors included */
+	for (i = 0; i < TEST_COUNT; i++) {
+		other = string_to_expression(strlen(test_strs[i]), (char *) test_strs[i]);
+		want  = expression_evaluate(other);
+		exp   = expression_hashcons(hc, other);
+		got   = expression_evaluate_dag(exp);
+		cases++;
+		if (!test_same(want, got)) {
+			printf("FAIL \"%s\": DAG gives type %d, tree gives type %d\n", test_strs[i], got.type, want.type);
+			bad++;
+		}
+		expression_free(exp);
+	}
+
+	/* Each shared node is evaluated once, or this would take 2^60 steps */
+	exp = exp_hashcons_value(hc, value_new_lint(1));
+	for (i = 0; i < TEST_DOUBLINGS; i++) {
+		expression_ref(exp);
+		exp = exp_hashcons_tree(hc, '+', exp, exp);
+	}
+	got = expression_evaluate_dag(exp);
+	cases++;
+	if ((got.type != VAL_LINT) || (got.data.lint != (1L << TEST_DOUBLINGS))) {
+		printf("FAIL doublings: got %ld\n", (long) got.data.lint);
+		bad++;
+	}
+	expression_free(exp);
+
+	/* 1+1+...+1, leaning left, is converted and evaluated without running out of stack.
+	 * Its 1 and 1+1 are already in the table from the doublings. */
+	count = exp_hashcons_count(hc);
+	exp = expression_new_value(value_new_lint(1));
+	for (i = 1; i < TEST_CHAIN; i++) {
+		exp = expression_new_tree('+', exp, expression_new_value(value_new_lint(1)));
+	}
+	exp = expression_hashcons(hc, exp);
+	got = expression_evaluate_dag(exp);
+	cases++;
+	if ((got.type != VAL_LINT) || (got.data.lint != TEST_CHAIN) || (exp_hashcons_count(hc) != count + TEST_CHAIN - 2)) {
+		printf("FAIL chain: got %ld, %lu new nodes\n", (long) got.data.lint, (unsigned long) (exp_hashcons_count(hc) - count));
+		bad++;
+	}
+	expression_free(exp);
+	exp_hashcons_free(hc);
+
+	/* Arena nodes are evaluated like any other */
+	arena = exp_arena_new(0);
+	string_to_expression_arena_r(15, "(1+2)*(1+2)-0.5", arena, &exp, &err);
+	got = expression_evaluate_dag(exp);
+	cases++;
+	if ((got.type != VAL_DOUBLE) || (got.data.dbl != 8.5)) {
+		printf("FAIL arena: got type %d\n", got.type);
+		bad++;
+	}
+	exp_arena_free(arena);
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef HASHCONS_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,57 @@
+/**
+ * @file hashcons.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Hash-consed expression construction.
+ * Structurally identical subexpressions built through the same table are one
+ * shared node, so an expression becomes a DAG instead of a tree.
+ */
+#ifndef _HASHCONS_H_
+#define _HASHCONS_H_
+
+#include <stddef.h> /* size_t */
+#include "types.h"
+#include "symbolic.h"
+#include "expression_lite.h" // just need pointer expression_t
+
+/**
+ * Table of shared expression nodes.
+ * The table owns one reference to every node in it.
+ */
+struct exp_hashcons;
+
+struct exp_hashcons *
+exp_hashcons_new (void);
+
+void
+exp_hashcons_free (struct exp_hashcons *hc);
+
+size_t
+exp_hashcons_count (struct exp_hashcons const *hc);
+
+expression_t
+exp_hashcons_value (struct exp_hashcons *hc,
+                    value_t val);
+
+expression_t
+exp_hashcons_tree (struct exp_hashcons *hc,
+                   char op,
+                   expression_t left,
+                   expression_t right);
+
+expression_t
+exp_hashcons_sym (struct exp_hashcons *hc,
+                  sym_t sym);
+
+expression_t
+expression_hashcons (struct exp_hashcons *hc,
+                     expression_t exp);
+
+value_t
+expression_evaluate_dag (expression_t exp);
+
+#endif /* _HASHCONS_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
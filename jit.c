@@ -0,0 +1,452 @@
+/**
+ * @file jit.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Compiles expressions to native x86-64 machine code.
+ *
+ * The expression is first compiled to bytecode, then each instruction is
+ * translated to straight-line machine code. The top of the bytecode stack is
+ * kept in rax and the rest lives on the machine stack, so most instructions
+ * become one or two machine instructions. The code is written into a fresh
+ * mapping that is made executable only once it is complete.
+ *
+ * Native code is only made for programs without selects, && or ||, so every
+ * operation's value reaches the result. The first division that faults is then
+ * the result's fault, and the code returns as soon as it meets one.
+ *
+ * Define JIT_FORCE_VM to never generate native code.
+ */
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+
+#include <stdlib.h> // malloc(), free()
+#include <string.h> // memcpy()
+#include "errors.h"
+#include "types.h"
+#include "bytecode.h"
+#include "jit.h"
+
+#if !defined(JIT_FORCE_VM) && defined(__x86_64__) && defined(__LP64__) && (defined(__unix__) || defined(__APPLE__))
+	#define JIT_HAVE_X86_64
+	#include <sys/mman.h> // mmap(), mprotect(), munmap()
+	#include <unistd.h>   // sysconf()
+	#ifndef MAP_ANONYMOUS
+		#define MAP_ANONYMOUS MAP_ANON
+	#endif
+#endif
+
+#ifdef JIT_HAVE_X86_64
+
+/// Most machine code bytes emitted for one bytecode instruction
+#define JIT_INSN_MAX 48
+
+/**
+ * Machine code being written.
+ */
+struct jit_emitter {
+	unsigned char *p; ///< Where the next byte goes
+};
+
+static void
+emit_bytes (struct jit_emitter *e, unsigned char const *bytes, size_t n) {
+	memcpy(e->p, bytes, n);
+	e->p += n;
+}
+
+/* Little endian immediates */
+static void
+emit_imm32 (struct jit_emitter *e, sys_int_long v) {
+	unsigned long u = (unsigned long) v;
+	int i;
+	for (i = 0; i < 4; i++) *e->p++ = (unsigned char) (u >> (8 * i));
+}
+
+static void
+emit_imm64 (struct jit_emitter *e, sys_int_long v) {
+	unsigned long u = (unsigned long) v;
+	int i;
+	for (i = 0; i < 8; i++) *e->p++ = (unsigned char) (u >> (8 * i));
+}
+
+/* True if v can be a sign extended 32 bit immediate */
+static int
+fits_imm32 (sys_int_long v) {
+	return (v >= -2147483647L - 1) && (v <= 2147483647L);
+}
+
+/* mov rcx, v */
+static void
+emit_mov_rcx (struct jit_emitter *e, sys_int_long v) {
+	if (fits_imm32(v)) {
+		static unsigned char const mov[] = {0x48, 0xC7, 0xC1}; // mov rcx, imm32
+		emit_bytes(e, mov, sizeof(mov));
+		emit_imm32(e, v);
+	} else {
+		static unsigned char const mov[] = {0x48, 0xB9};       // mov rcx, imm64
+		emit_bytes(e, mov, sizeof(mov));
+		emit_imm64(e, v);
+	}
+}
+
+/** Translate bytecode to machine code.
+ * vars arrives in rdi, the fault pointer in rsi, and the result leaves in rax.
+ * r9 keeps the stack pointer the code was called with, to return from anywhere.
+ * @return Non-zero on success, zero if prog uses an instruction with no translation.
+ */
+static int
+jit_emit (struct jit_emitter *e, struct bc_program const *prog) {
+	static unsigned char const push_rax[] = {0x50};
+	static unsigned char const pop_rcx[]  = {0x59};
+	static unsigned char const pop_rax[]  = {0x58};
+	static unsigned char const add[]      = {0x48, 0x01, 0xC8};       // add rax, rcx
+	static unsigned char const sub_rcx[]  = {0x48, 0x29, 0xC1};       // sub rcx, rax
+	static unsigned char const sub[]      = {0x48, 0x29, 0xC8};       // sub rax, rcx
+	static unsigned char const imul[]     = {0x48, 0x0F, 0xAF, 0xC1}; // imul rax, rcx
+	static unsigned char const mov_rax[]  = {0x48, 0x89, 0xC8};       // mov rax, rcx
+	static unsigned char const mov_rcx[]  = {0x48, 0x89, 0xC1};       // mov rcx, rax
+	static unsigned char const idiv[]     = {0x48, 0x99, 0x48, 0xF7, 0xF9}; // cqo; idiv rcx
+	static unsigned char const enter[]    = {0x49, 0x89, 0xE1};       // mov r9, rsp
+	/* Return with the fault of rax / rcx if it has one. neg overflows only on LONG_MIN. */
+	static unsigned char const div_fault[] = {
+		0x48, 0x85, 0xC9,             // test rcx, rcx
+		0x75, 0x07,                   // jne not_zero
+		0xC6, 0x06, BC_FAULT_ZERO,    // mov byte [rsi], BC_FAULT_ZERO
+		0x4C, 0x89, 0xCC,             // mov rsp, r9
+		0xC3,                         // ret
+		                              // not_zero:
+		0x48, 0x83, 0xF9, 0xFF,       // cmp rcx, -1
+		0x75, 0x0F,                   // jne ok
+		0x48, 0x89, 0xC2,             // mov rdx, rax
+		0x48, 0xF7, 0xDA,             // neg rdx
+		0x71, 0x07,                   // jno ok
+		0xC6, 0x06, BC_FAULT_DIV,     // mov byte [rsi], BC_FAULT_DIV
+		0x4C, 0x89, 0xCC,             // mov rsp, r9
+		0xC3                          // ret
+		                              // ok:
+	};
+	static unsigned char const ret[]      = {0xC3};
+	size_t depth = 0;
+	size_t i;
+
+	emit_bytes(e, enter, sizeof(enter));
+
+	for (i = 0; i < prog->len; i++) {
+		struct bc_insn const *in = &prog->code[i];
+		switch (in->op) {
+		case BC_CONST:
+			if (depth++) emit_bytes(e, push_rax, sizeof(push_rax));
+			if (fits_imm32(in->arg)) {
+				static unsigned char const mov[] = {0x48, 0xC7, 0xC0}; // mov rax, imm32
+				emit_bytes(e, mov, sizeof(mov));
+				emit_imm32(e, in->arg);
+			} else {
+				static unsigned char const mov[] = {0x48, 0xB8};       // mov rax, imm64
+				emit_bytes(e, mov, sizeof(mov));
+				emit_imm64(e, in->arg);
+			}
+			break;
+		case BC_LOAD:
+			{
+				static unsigned char const mov[] = {0x48, 0x8B, 0x87}; // mov rax, [rdi + disp32]
+				if (in->arg > 2147483647L / 8) return 0;
+				if (depth++) emit_bytes(e, push_rax, sizeof(push_rax));
+				emit_bytes(e, mov, sizeof(mov));
+				emit_imm32(e, in->arg * 8);
+				break;
+			}
+
+		/* left is on the machine stack, right is in rax */
+		case BC_ADD:
+			emit_bytes(e, pop_rcx, sizeof(pop_rcx));
+			emit_bytes(e, add, sizeof(add));
+			depth--;
+			break;
+		case BC_SUB:
+			emit_bytes(e, pop_rcx, sizeof(pop_rcx));
+			emit_bytes(e, sub_rcx, sizeof(sub_rcx));
+			emit_bytes(e, mov_rax, sizeof(mov_rax));
+			depth--;
+			break;
+		case BC_MUL:
+			emit_bytes(e, pop_rcx, sizeof(pop_rcx));
+			emit_bytes(e, imul, sizeof(imul));
+			depth--;
+			break;
+		case BC_DIV:
+			emit_bytes(e, mov_rcx, sizeof(mov_rcx));
+			emit_bytes(e, pop_rax, sizeof(pop_rax));
+			emit_bytes(e, div_fault, sizeof(div_fault));
+			emit_bytes(e, idiv, sizeof(idiv));
+			depth--;
+			break;
+
+		/* left is in rax, right is the argument */
+		case BC_ADD_K:
+			emit_mov_rcx(e, in->arg);
+			emit_bytes(e, add, sizeof(add));
+			break;
+		case BC_SUB_K:
+			emit_mov_rcx(e, in->arg);
+			emit_bytes(e, sub, sizeof(sub));
+			break;
+		case BC_MUL_K:
+			if (fits_imm32(in->arg)) {
+				static unsigned char const mul[] = {0x48, 0x69, 0xC0}; // imul rax, rax, imm32
+				emit_bytes(e, mul, sizeof(mul));
+				emit_imm32(e, in->arg);
+			} else {
+				emit_mov_rcx(e, in->arg);
+				emit_bytes(e, imul, sizeof(imul));
+			}
+			break;
+		case BC_DIV_K:
+			// the compiler never gives a divisor of 0 or -1
+			emit_mov_rcx(e, in->arg);
+			emit_bytes(e, idiv, sizeof(idiv));
+			break;
+
+		case BC_RET:
+			emit_bytes(e, ret, sizeof(ret));
+			return 1;
+
+		default:
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/** Generate native code for prog into jp.
+ * Leaves jp->fn NULL if prog cannot be translated.
+ */
+static void
+jit_native (struct jit_program *jp) {
+	struct jit_emitter e;
+	size_t page = (size_t) sysconf(_SC_PAGESIZE);
+	size_t size = ((jp->prog->len * JIT_INSN_MAX) + page - 1) / page * page;
+	void *mem;
+
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) return;
+
+	e.p = (unsigned char *) mem;
+	if (!jit_emit(&e, jp->prog) || (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0)) {
+		munmap(mem, size);
+		return;
+	}
+	assert((size_t) (e.p - (unsigned char *) mem) <= jp->prog->len * JIT_INSN_MAX);
+
+	jp->mem      = mem;
+	jp->mem_size = size;
+	memcpy(&jp->fn, &mem, sizeof(jp->fn)); // ISO C has no cast from object to function pointer
+}
+
+#endif /* JIT_HAVE_X86_64 */
+
+/** Compile an expression to native code.
+ * If native code cannot be generated, the program still compiles and
+ * @ref jit_run uses the bytecode interpreter.
+ * @param exp The expression to compile.
+ * @param nsyms Number of symbol names.
+ * @param syms Symbol names the expression may use. Symbol syms[i] reads vars[i] when run.
+ * @param[out] jp Set to the compiled program, or NULL on error. Free with @ref jit_free.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+jit_compile (expression_t exp,
+             size_t nsyms,
+             char const *const *syms,
+             struct jit_program **jp,
+             struct exp_error *err) {
+	struct bc_program *prog;
+	int ret;
+
+	assert(jp);
+	*jp = NULL;
+
+	if ((ret = bytecode_compile(exp, nsyms, syms, &prog, err)) != EXP_OK) {
+		return ret;
+	}
+
+	*jp = (struct jit_program *) malloc(sizeof(struct jit_program));
+	assert(*jp); // throw error - jit_compile: malloc could not do allocation
+	(*jp)->prog     = prog;
+	(*jp)->fn       = NULL;
+	(*jp)->mem      = NULL;
+	(*jp)->mem_size = 0;
+
+#ifdef JIT_HAVE_X86_64
+	jit_native(*jp);
+#endif
+	return EXP_OK;
+}
+
+/** Free a compiled program, including its native code.
+ * @param jp The program to free.
+ */
+void
+jit_free (struct jit_program *jp) {
+	if (jp == NULL) return;
+#ifdef JIT_HAVE_X86_64
+	if (jp->mem) munmap(jp->mem, jp->mem_size);
+#endif
+	bytecode_free(jp->prog);
+	free(jp);
+}
+
+/** Run a compiled program.
+ * Gives the same result as @ref bytecode_run on the same expression.
+ * @param jp The program to run.
+ * @param vars Variable values. May be NULL if the program reads no variables.
+ * @return The value of the expression, or a VAL_ERROR or VAL_INF value if it faulted.
+ */
+value_t
+jit_run (struct jit_program const *jp,
+         sys_int_long const *vars) {
+	assert(jp);
+	if (jp->fn) {
+		unsigned char fault = 0;
+		sys_int_long val = jp->fn(vars, &fault);
+		return fault ? value_new_type(BC_FAULT_TYPE(fault)) : value_new_lint(val);
+	}
+	return bytecode_run(jp->prog, vars);
+}
+
+#ifdef JIT_TEST_MAIN
+/*
+ * Checks native code against expression_evaluate on random constant expressions
+ * and against the bytecode interpreter on random expressions with symbols,
+ * then times both on one expression.
+ *
+ * make tests
+ * or
+ * gcc -O2 -DDEBUG -DJIT_TEST_MAIN -o jit jit.c bytecode.c expression.c token.c symbolic.c reparse.c scan.c types.c workspace.c errors.c traverse.c funcs.c arena.c -pthread -lm
+ */
+#include <stdio.h>
+#include <time.h>
+#include "expression.h"
+
+#define TEST_RUNS 20000
+#define TEST_VARS 3
+
+static char const *const test_syms[TEST_VARS] = {"a", "b", "c"};
+
+/* Random expression string with small operands so nothing overflows */
+static size_t
+test_expression (char *buf, int use_syms) {
+	size_t n = 0;
+	int depth = 0;
+	int terms = 1 + (rand() % 12);
+	int k;
+
+	for (k = 0; k < terms; k++) {
+		while ((rand() % 3 == 0) && (depth < 8)) {
+			buf[n++] = '(';
+			depth++;
+		}
+		if (use_syms && (rand() % 2)) {
+			buf[n++] = test_syms[rand() % TEST_VARS][0];
+		} else {
+			n += (size_t) sprintf(buf + n, "%d", rand() % ((rand() % 8) ? 100 : 2000000000));
+		}
+		while (depth && (rand() % 3 == 0)) {
+			buf[n++] = ')';
+			depth--;
+		}
+		if (k + 1 < terms) {
+			buf[n++] = "+-*/"[rand() % 4];
+			if (buf[n - 1] == '/') {
+				// a constant divisor is never zero, but a variable one may be zero or -1
+				if (use_syms && (rand() % 2)) buf[n++] = test_syms[rand() % TEST_VARS][0];
+				else n += (size_t) sprintf(buf + n, "%d", 1 + (rand() % 9));
+				if (k + 2 >= terms) break;
+				buf[n++] = "+-*"[rand() % 3];
+			}
+		}
+	}
+	while (depth--) buf[n++] = ')';
+	buf[n] = '\0';
+	return n;
+}
+
+int
+main (void) {
+	sys_int_long vars[TEST_VARS];
+	char buf[512];
+	int run, bad = 0;
+
+	srand(1);
+	for (run = 0; run < TEST_RUNS; run++) {
+		int use_syms = run % 2;
+		size_t len = test_expression(buf, use_syms);
+		struct jit_program *jp;
+		struct exp_error err;
+		expression_t exp;
+		value_t want, got;
+
+		if (string_to_expression_r(len, buf, &exp, &err) != EXP_OK) {
+			printf("Parse failed: %s: %s\n", buf, err.msg);
+			return 1;
+		}
+		if (jit_compile(exp, TEST_VARS, test_syms, &jp, &err) != EXP_OK) {
+			printf("Compile failed: %s: %s\n", buf, err.msg);
+			return 1;
+		}
+		if (jp->fn == NULL) {
+			printf("No native code for %s\n", buf);
+			return 1;
+		}
+
+		vars[0] = (rand() % 2001) - 1000;
+		vars[1] = (rand() % 5) - 2;
+		vars[2] = (rand() % 2001) - 1000;
+		want = use_syms ? bytecode_run(jp->prog, vars) : expression_evaluate(exp);
+		got  = jit_run(jp, vars);
+		if ((want.type != got.type) || (VAL_IS_NUMBER(want) && (want.data.lint != got.data.lint))) {
+			printf("Mismatch on %s: want %ld got %ld\n", buf, want.data.lint, got.data.lint);
+			bad++;
+		}
+
+		jit_free(jp);
+		expression_free(exp);
+	}
+	printf("%d runs, %d mismatches\n", TEST_RUNS, bad);
+
+	{
+		char const *str = "(a*3+b)*(c-7)+a*b-c*2+(a-b)/3";
+		struct jit_program *jp;
+		struct exp_error err;
+		expression_t exp;
+		sys_int_long sum[2] = {0, 0};
+		unsigned char fault = 0;
+		clock_t start;
+		long i;
+		int mode;
+
+		string_to_expression_r(strlen(str), str, &exp, &err);
+		jit_compile(exp, TEST_VARS, test_syms, &jp, &err);
+		for (mode = 0; mode < 2; mode++) {
+			start = clock();
+			for (i = 0; i < 10000000; i++) {
+				vars[0] = i;
+				vars[1] = i >> 3;
+				vars[2] = i & 0xFF;
+				sum[mode] += mode ? jp->fn(vars, &fault) : bytecode_run(jp->prog, vars).data.lint;
+			}
+			printf("%-8s %.3fs\n", mode ? "native" : "bytecode", (double) (clock() - start) / CLOCKS_PER_SEC);
+		}
+		if (sum[0] != sum[1]) {
+			printf("Sums differ\n");
+			bad++;
+		}
+		jit_free(jp);
+		expression_free(exp);
+	}
+
+	return bad ? 1 : 0;
+}
+#endif // #ifdef JIT_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
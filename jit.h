@@ -0,0 +1,54 @@
+/**
+ * @file jit.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Compiles expressions to native x86-64 machine code.
+ * On other targets, or for operations the code generator does not know,
+ * the compiled expression runs on the bytecode interpreter instead.
+ */
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "expression_lite.h" // just need pointer expression_t
+#include "bytecode.h"
+
+/**
+ * Native code for an expression.
+ * Takes the variable values, indexed like the symbol names given to @ref jit_compile.
+ * If the result faulted, its fault is written to fault, and the value is unspecified.
+ * Otherwise fault is left alone.
+ */
+typedef sys_int_long (*jit_fn)(sys_int_long const *vars, unsigned char *fault);
+
+/**
+ * A compiled expression.
+ */
+struct jit_program {
+	struct bc_program *prog;     ///< The bytecode the native code was generated from
+	jit_fn             fn;       ///< The native code or NULL if only the bytecode can be run
+	void              *mem;      ///< Executable pages holding fn
+	size_t             mem_size; ///< Size of mem in bytes
+};
+
+int
+jit_compile (expression_t exp,
+             size_t nsyms,
+             char const *const *syms,
+             struct jit_program **jp,
+             struct exp_error *err);
+
+void
+jit_free (struct jit_program *jp);
+
+value_t
+jit_run (struct jit_program const *jp,
+         sys_int_long const *vars);
+
+#endif /* _JIT_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,263 @@
+/**
+ * @file link.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Links an expression's symbols to workspace entries once, so evaluating it
+ * reads variable values directly instead of looking names up.
+ *
+ * Linking saves a pointer to each symbol's workspace value along with the
+ * workspace generation. Every workspace change bumps the generation, so one
+ * compare before each evaluation tells whether the saved pointers still hold.
+ */
+#include <stdlib.h> // malloc(), realloc(), free()
+#include <string.h> // strcmp(), strncpy()
+#include "errors.h"
+#include "types.h"
+#include "symbolic.h"
+#include "workspace.h"
+#include "expression.h"
+#include "traverse.h"
+#include "bytecode.h"
+#include "link.h"
+
+/** Link an expression.
+ * Finds the distinct symbols in exp and compiles it to read them from slots.
+ * Symbols are looked up in the workspace on the first evaluation.
+ * @param[out] link The link to set up. Free it with @ref exp_link_free.
+ * @param exp The expression to link. It is not needed once linked.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+exp_link_init (struct exp_link *link,
+               expression_t exp,
+               struct exp_error *err) {
+	char (*names)[SYMBOLIC_NAME_SIZE] = NULL;
+	char const **list;
+	size_t count = 0, size = 0;
+	struct exp_walk w;
+	expression_t node;
+	int ret;
+	size_t i;
+
+	assert(link);
+	assert(exp);
+
+	/* Collect distinct symbol names, in the order they first appear */
+	exp_walk_init(&w, exp);
+	while ((node = exp_walk_next_post(&w)) != NULL) {
+		if (node->type != EXP_SYMBOLIC) continue;
+		for (i = 0; i < count; i++) {
+			if (strcmp(names[i], node->data.sym.name) == 0) break;
+		}
+		if (i < count) continue;
+		if (count == size) {
+			size = size ? (size * 2) : 8;
+			names = realloc(names, size * sizeof(*names));
+			assert(names); // throw error - exp_link_init: realloc could not do allocation
+		}
+		strncpy(names[count], node->data.sym.name, SYMBOLIC_NAME_SIZE);
+		count++;
+	}
+	exp_walk_free(&w);
+
+	list = (char const **) malloc((count ? count : 1) * sizeof(char const *));
+	assert(list); // throw error - exp_link_init: malloc could not do allocation
+	for (i = 0; i < count; i++) list[i] = names[i];
+	ret = bytecode_compile(exp, count, list, &link->prog, err);
+	free(list);
+	if (ret != EXP_OK) {
+		free(names);
+		return ret;
+	}
+
+	link->nslots     = count;
+	link->names      = names;
+	link->data       = (value_t const **) malloc((count ? count : 1) * (sizeof(value_t const *) + sizeof(sys_int_long)));
+	assert(link->data); // throw error - exp_link_init: malloc could not do allocation
+	link->vals       = (sys_int_long *) (link->data + (count ? count : 1));
+	link->generation = 0;
+	return EXP_OK;
+}
+
+/** Free the memory held by a link.
+ */
+void
+exp_link_free (struct exp_link *link) {
+	assert(link);
+	bytecode_free(link->prog);
+	free(link->names);
+	free(link->data);
+	link->prog  = NULL;
+	link->names = NULL;
+	link->data  = NULL;
+	link->vals  = NULL;
+}
+
+/** Look up every symbol of a link in the workspace.
+ * Done automatically by @ref exp_link_evaluate when the workspace has changed.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or EXP_ESYMBOL if a symbol is not set or has no value
+ */
+int
+exp_link_resolve (struct exp_link *link,
+                  struct exp_error *err) {
+	size_t i;
+
+	assert(link);
+	exp_error_clear(err);
+
+	link->generation = 0;
+	for (i = 0; i < link->nslots; i++) {
+		int windex = workspace_index(link->names[i]);
+		if (windex == WORKSPACE_NOTFOUND) {
+			return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - \"%s\" is not set", link->names[i]);
+		}
+		link->data[i] = (value_t const *) workspace_get_index(windex);
+		if (link->data[i] == NULL) {
+			return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - \"%s\" has no value", link->names[i]);
+		}
+	}
+	link->generation = workspace_generation();
+	return EXP_OK;
+}
+
+/** Evaluate a linked expression with the current workspace values.
+ * The symbols are only looked up again if the workspace has changed since the last time.
+ * Arithmetic is the same as @ref expression_evaluate.
+ * @param[out] result Set to the value of the expression.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+exp_link_evaluate (struct exp_link *link,
+                   value_t *result,
+                   struct exp_error *err) {
+	size_t i;
+	int ret;
+
+	assert(link);
+	assert(result);
+
+	if (link->generation != workspace_generation()) {
+		if ((ret = exp_link_resolve(link, err)) != EXP_OK) {
+			*result = value_new_type(VAL_ERROR);
+			return ret;
+		}
+	} else {
+		exp_error_clear(err);
+	}
+
+	for (i = 0; i < link->nslots; i++) {
+		if (link->data[i]->type != VAL_LINT) {
+			*result = value_new_type(VAL_ERROR);
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Symbol \"%s\" is not a long int", link->names[i]);
+		}
+		link->vals[i] = link->data[i]->data.lint;
+	}
+
+	*result = bytecode_run(link->prog, link->vals);
+	return EXP_OK;
+}
+
+#ifdef LINK_TEST_MAIN
+/*
+ * Checks that linked expressions see workspace values changed in place,
+ * and look symbols up again only after the workspace changes.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DLINK_TEST_MAIN -o link link.c bytecode.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c funcs.c arena.c -lm
+ */
+#include <stdio.h>
+
+/* Link and evaluate str, checking the result and return code */
+static int
+test_eval (struct exp_link *link, char const *what, int want_ret, sys_int_long want) {
+	struct exp_error err;
+	value_t result;
+	int ret = exp_link_evaluate(link, &result, &err);
+
+	if (ret != want_ret) {
+		printf("FAIL %s: returned %d, want %d (%s)\n", what, ret, want_ret, err.msg);
+		return 1;
+	}
+	if ((ret == EXP_OK) && ((result.type != VAL_LINT) || (result.data.lint != want))) {
+		printf("FAIL %s: got %ld, want %ld\n", what, (long) result.data.lint, (long) want);
+		return 1;
+	}
+	if ((ret != EXP_OK) && (result.type != VAL_ERROR)) {
+		printf("FAIL %s: failed without an error value\n", what);
+		return 1;
+	}
+	return 0;
+}
+
+int
+main (void) {
+	value_t x = value_new_lint(3), y = value_new_lint(4), y2 = value_new_lint(40), d = value_new_double(0.5);
+	struct exp_link link, constant;
+	struct exp_error err;
+	expression_t exp;
+	unsigned long generation;
+	int bad = 0, cases = 0;
+
+	workspace_init();
+	workspace_set("x", &x);
+	workspace_set("y", &y);
+
+	string_to_expression_r(9, "x*2+y-x/y", &exp, &err);
+	if (exp_link_init(&link, exp, &err) != EXP_OK) {
+		printf("FAIL link: %s\n", err.msg);
+		return 1;
+	}
+	expression_free(exp);
+	if (link.nslots != 2) {
+		printf("FAIL link: %lu slots, want 2\n", (unsigned long) link.nslots);
+		bad++;
+	}
+
+	cases++, bad += test_eval(&link, "first", EXP_OK, 10);
+	generation = link.generation;
+
+	/* A value changed in place is seen without a lookup */
+	x.data.lint = 8;
+	cases++, bad += test_eval(&link, "in place", EXP_OK, 18);
+	if (link.generation != generation) {
+		printf("FAIL in place: symbols were looked up again\n");
+		bad++;
+	}
+
+	/* Any workspace change makes the next evaluation look them up again */
+	workspace_set("y", &y2);
+	cases++, bad += test_eval(&link, "new y", EXP_OK, 56);
+	if (link.generation == generation) {
+		printf("FAIL new y: symbols were not looked up again\n");
+		bad++;
+	}
+
+	workspace_unset("y");
+	cases++, bad += test_eval(&link, "y unset", EXP_ESYMBOL, 0);
+	workspace_set("y", NULL);
+	cases++, bad += test_eval(&link, "y without a value", EXP_ESYMBOL, 0);
+	workspace_set("y", &d);
+	cases++, bad += test_eval(&link, "y a double", EXP_EEVAL, 0);
+	workspace_set("y", &y);
+	cases++, bad += test_eval(&link, "y back", EXP_OK, 18);
+	exp_link_free(&link);
+
+	/* No symbols at all */
+	string_to_expression_r(5, "1+2*3", &exp, &err);
+	exp_link_init(&constant, exp, &err);
+	expression_free(exp);
+	cases++, bad += test_eval(&constant, "constant", EXP_OK, 7);
+	exp_link_free(&constant);
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef LINK_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,55 @@
+/**
+ * @file link.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Links an expression's symbols to workspace entries once, so evaluating it
+ * reads variable values directly instead of looking names up.
+ *
+ * Workspace entries used by linked expressions must hold a pointer to a @ref value_t.
+ * Changing the value in place takes effect on the next evaluation without relinking.
+ */
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "symbolic.h"
+#include "expression_lite.h" // just need pointer expression_t
+#include "bytecode.h"
+
+/**
+ * An expression linked to the workspace.
+ * Each distinct symbol is given a slot, and the expression is compiled to read slots.
+ */
+struct exp_link {
+	struct bc_program *prog;       ///< The expression, compiled to read slot i as variable i
+	size_t             nslots;     ///< Number of distinct symbols
+	char             (*names)[SYMBOLIC_NAME_SIZE]; ///< Symbol name of each slot
+	value_t const    **data;       ///< Workspace value of each slot
+	sys_int_long      *vals;       ///< Slot values gathered for a run
+	unsigned long      generation; ///< Workspace generation data was resolved at or 0 if never
+};
+
+int
+exp_link_init (struct exp_link *link,
+               expression_t exp,
+               struct exp_error *err);
+
+void
+exp_link_free (struct exp_link *link);
+
+int
+exp_link_resolve (struct exp_link *link,
+                  struct exp_error *err);
+
+int
+exp_link_evaluate (struct exp_link *link,
+                   value_t *result,
+                   struct exp_error *err);
+
+#endif /* _LINK_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -14,6 +14,7 @@
 #include "types.h"
 #include "workspace.h"
 #include "expression.h"
+#include "document.h"
 
 #define BLACK  30
 #define RED    31
@@ -124,6 +125,7 @@ test0(void) {
 void
 test1(char *str) {
 	char buf[512] = {0};
+	exp_buf val_buf;
 	expression_t e1;
 	value_t val;
 
@@ -153,10 +155,45 @@ test1(char *str) {
 
 	// Show results
 	val = expression_evaluate(e1);
-	printf("Expression(both string and value): "RESULT("%s = %ld")"\n", buf, val.data.lint);
+	value_to_string(val_buf, val);
+	printf("Expression(both string and value): "RESULT("%s = %s")"\n", buf, val_buf);
 
 	expression_free(e1);
 }
+/** Tests \ref document_load on a file of expressions, one per line.
+ * Each expression is shown as a string and evaluated.
+ * @param path The file to load.
+ */
+void
+test2(char *path) {
+	struct document *doc;
+	size_t i;
+
+	/// Call \ref document_load on path
+	/// @code
+	doc = document_load(path);
+	/// @endcode
+	if (!doc) {
+		fprintf(stderr, "test2: Error - could not load \"%s\"\n", path);
+		exit (2);
+	}
+
+	printf("Loaded %zu expressions from \"%s\"\n", doc->count, path);
+	for (i = 0; i < doc->count; i++) {
+		exp_buf buf, val_buf;
+		value_t val;
+		expression_to_string (buf, doc->roots[i]);
+		val = expression_evaluate(doc->roots[i]);
+		value_to_string(val_buf, val);
+		printf("Expression %zu: "RESULT("%s = %s")"\n", i, buf, val_buf);
+	}
+
+	/// Call \ref document_free to free every expression at once
+	/// @code
+	document_free(doc);
+	/// @endcode
+}
+
 /// @callgraph
 int main(int argc, char *argv[]) {
 	workspace_init();
@@ -187,8 +224,13 @@ int main(int argc, char *argv[]) {
 	printf("\n\n\n");
 
 	puts("# main:");
+	if ((argc == 3) && (strcmp(argv[1], "-f") == 0)) {
+		puts("# test2 ( argv[2] ):");
+		test2(argv[2]);
+		return 0;
+	}
 	if (argc != 2) {
-		fprintf(stderr, "main: Error - Need expression as only argument for test1()\n");
+		fprintf(stderr, "main: Error - Need expression as only argument for test1() or -f <file> for test2()\n");
 		return 1;
 	}
 	puts("# test1 ( argv[1] ):");
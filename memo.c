@@ -0,0 +1,420 @@
+/**
+ * @file memo.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * A bounded memo of symbol call results.
+ *
+ * The capacity is fixed when the memo is made, so every entry is allocated up front
+ * in one block and an eviction reuses the entry it frees. Entries live in a hash table
+ * with chained buckets and on a doubly linked list ordered from most to least recently used.
+ */
+#include <stdlib.h> // malloc(), calloc(), free()
+#include <string.h> // strncmp(), strncpy(), memcpy()
+#include "errors.h"
+#include "types.h"
+#include "symbolic.h"
+#include "expression.h"
+#include "memo.h"
+
+/**
+ * A single remembered call.
+ */
+struct exp_memo_entry {
+	unsigned long hash;                     ///< Hash of name and args
+	char          name[SYMBOLIC_NAME_SIZE]; ///< The called symbol's name
+	size_t        argc;                     ///< Number of arguments
+	value_t       args[EXP_MEMO_ARGS];      ///< The arguments
+	value_t       result;                   ///< What the call gave
+	struct exp_memo_entry *chain; ///< Next entry in the same bucket, or the next free entry
+	struct exp_memo_entry *newer; ///< More recently used entry or NULL
+	struct exp_memo_entry *older; ///< Less recently used entry or NULL
+};
+
+struct exp_memo {
+	struct exp_memo_entry **buckets;  ///< Hash table
+	size_t                  nbuckets; ///< Number of buckets. Always a power of 2.
+	struct exp_memo_entry  *entries;  ///< Block of capacity entries
+	struct exp_memo_entry  *unused;   ///< Entries not in the table, linked by chain
+	struct exp_memo_entry  *newest;   ///< Most recently used entry
+	struct exp_memo_entry  *oldest;   ///< Least recently used entry, the next to be evicted
+	struct exp_memo_stats   stats;    ///< Counters
+};
+
+/// FNV-1a hash parameters
+#define FNV_OFFSET 2166136261UL
+#define FNV_PRIME  16777619UL
+
+/* Hash a call's name and arguments */
+static unsigned long
+memo_hash (char const *name, size_t argc, value_t const *argv) {
+	unsigned long hash = FNV_OFFSET;
+	unsigned long v;
+	size_t a;
+	int i;
+
+	for (i = 0; (i < SYMBOLIC_NAME_SIZE) && name[i]; i++) {
+		hash = (hash ^ (unsigned char) name[i]) * FNV_PRIME;
+	}
+	for (a = 0; a < argc; a++) {
+		hash = (hash ^ (unsigned long) argv[a].type) * FNV_PRIME;
+		v = value_bits(argv[a]);
+		for (i = 0; i < (int) sizeof(v); i++) {
+			hash = (hash ^ ((v >> (8 * i)) & 0xFF)) * FNV_PRIME;
+		}
+	}
+	return hash;
+}
+
+/* True if entry remembers a call with these arguments */
+static int
+memo_args_equal (struct exp_memo_entry const *entry, size_t argc, value_t const *argv) {
+	size_t a;
+
+	if (entry->argc != argc) return 0;
+	for (a = 0; a < argc; a++) {
+		if (!value_equal(entry->args[a], argv[a])) return 0;
+	}
+	return 1;
+}
+
+/** Take an entry off the recently used list.
+ */
+static void
+memo_unlink (struct exp_memo *memo, struct exp_memo_entry *entry) {
+	if (entry->newer) entry->newer->older = entry->older;
+	else              memo->newest        = entry->older;
+	if (entry->older) entry->older->newer = entry->newer;
+	else              memo->oldest        = entry->newer;
+	entry->newer = entry->older = NULL;
+}
+
+/** Put an entry at the front of the recently used list.
+ */
+static void
+memo_push_newest (struct exp_memo *memo, struct exp_memo_entry *entry) {
+	entry->older = memo->newest;
+	entry->newer = NULL;
+	if (memo->newest) memo->newest->newer = entry;
+	else              memo->oldest        = entry;
+	memo->newest = entry;
+}
+
+/** Remove an entry from the memo and put it on the unused list.
+ */
+static void
+memo_remove (struct exp_memo *memo, struct exp_memo_entry *entry) {
+	struct exp_memo_entry **link = &memo->buckets[entry->hash & (memo->nbuckets - 1)];
+
+	// take it out of its bucket
+	while (*link != entry) link = &(*link)->chain;
+	*link = entry->chain;
+
+	memo_unlink(memo, entry);
+	memo->stats.count--;
+
+	entry->chain = memo->unused;
+	memo->unused = entry;
+}
+
+/** New call memo.
+ * @param capacity The maximum number of results to hold. Must be at least 1.
+ * @return The new memo. Free with @ref exp_memo_free.
+ */
+struct exp_memo *
+exp_memo_new (size_t capacity) {
+	struct exp_memo *memo;
+	size_t nbuckets = 1;
+	size_t i;
+
+	assert(capacity > 0);
+
+	// keep chains short -- at least one bucket per entry
+	while (nbuckets < capacity) nbuckets <<= 1;
+
+	memo = (struct exp_memo *) malloc(sizeof(struct exp_memo));
+	assert(memo); // throw error - exp_memo_new: malloc could not do allocation
+	memo->buckets = (struct exp_memo_entry **) calloc(nbuckets, sizeof(struct exp_memo_entry *));
+	assert(memo->buckets); // throw error - exp_memo_new: calloc could not do allocation
+	memo->entries = (struct exp_memo_entry *) malloc(capacity * sizeof(struct exp_memo_entry));
+	assert(memo->entries); // throw error - exp_memo_new: malloc could not do allocation
+	memo->nbuckets = nbuckets;
+	memo->newest = memo->oldest = NULL;
+
+	memo->unused = NULL;
+	for (i = capacity; i > 0; i--) {
+		memo->entries[i - 1].chain = memo->unused;
+		memo->unused = &memo->entries[i - 1];
+	}
+
+	memo->stats.hits      = 0;
+	memo->stats.misses    = 0;
+	memo->stats.evictions = 0;
+	memo->stats.count     = 0;
+	memo->stats.capacity  = capacity;
+	return memo;
+}
+
+/** Forget every result in a memo.
+ * Needed whenever a resolver's answers change. The counters are kept.
+ * @param memo The memo to clear.
+ */
+void
+exp_memo_clear (struct exp_memo *memo) {
+	assert(memo);
+	while (memo->oldest) memo_remove(memo, memo->oldest);
+}
+
+/** Free a memo.
+ * @param memo The memo to free.
+ */
+void
+exp_memo_free (struct exp_memo *memo) {
+	if (!memo) return;
+	free(memo->entries);
+	free(memo->buckets);
+	free(memo);
+}
+
+/** Make a symbol call through a memo.
+ * On a hit the remembered result is given without calling.
+ * On a miss call is made and its result remembered, evicting the least recently used result when full.
+ * Calls that fail are not remembered, and neither are calls with more than @ref EXP_MEMO_ARGS arguments.
+ *
+ * @param memo The memo to look in.
+ * @param name The called symbol's name
+ * @param argc Number of arguments
+ * @param argv Values of the arguments
+ * @param call The resolver to use on a miss
+ * @param ctx Passed to call
+ * @param[out] result Set to the call's value
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+exp_memo_call (struct exp_memo *memo,
+               char const *name,
+               size_t argc,
+               value_t const *argv,
+               exp_call_fn call,
+               void *ctx,
+               value_t *result,
+               struct exp_error *err) {
+	struct exp_memo_entry *entry;
+	unsigned long hash;
+	int ret;
+
+	assert(memo);
+	assert(name);
+	assert(call);
+	assert(result);
+
+	assert(argv || (argc == 0));
+
+	if (argc > EXP_MEMO_ARGS) {
+		memo->stats.misses++;
+		exp_error_clear(err);
+		return call(name, argc, argv, result, ctx, err);
+	}
+
+	hash = memo_hash(name, argc, argv);
+
+	/* Look for a hit */
+	for (entry = memo->buckets[hash & (memo->nbuckets - 1)]; entry; entry = entry->chain) {
+		if ((entry->hash == hash) && memo_args_equal(entry, argc, argv)
+				&& (strncmp(entry->name, name, SYMBOLIC_NAME_SIZE) == 0)) {
+			memo->stats.hits++;
+			if (entry != memo->newest) {
+				memo_unlink(memo, entry);
+				memo_push_newest(memo, entry);
+			}
+			exp_error_clear(err);
+			*result = entry->result;
+			return EXP_OK;
+		}
+	}
+
+	/* Miss -- make the call */
+	memo->stats.misses++;
+	exp_error_clear(err);
+	if ((ret = call(name, argc, argv, result, ctx, err)) != EXP_OK) {
+		return ret;
+	}
+
+	// make room
+	if (!memo->unused) {
+		memo_remove(memo, memo->oldest);
+		memo->stats.evictions++;
+	}
+	entry = memo->unused;
+	memo->unused = entry->chain;
+
+	entry->hash = hash;
+	strncpy(entry->name, name, SYMBOLIC_NAME_SIZE);
+	entry->argc = argc;
+	memcpy(entry->args, argv, argc * sizeof(value_t));
+	entry->result = *result;
+
+	entry->chain = memo->buckets[hash & (memo->nbuckets - 1)];
+	memo->buckets[hash & (memo->nbuckets - 1)] = entry;
+	memo_push_newest(memo, entry);
+	memo->stats.count++;
+
+	return EXP_OK;
+}
+
+/** Resolve a symbol call through a memo.
+ * An @ref exp_call_fn, for use with @ref expression_evaluate_calls_r or anywhere
+ * else a resolver is taken, that puts a memo in front of another resolver.
+ * @param resolver A struct exp_memo_resolver naming the memo and the resolver behind it
+ * @return EXP_OK or the error code
+ */
+int
+exp_memo_resolve (char const *name,
+                  size_t argc,
+                  value_t const *argv,
+                  value_t *result,
+                  void *resolver,
+                  struct exp_error *err) {
+	struct exp_memo_resolver *r = (struct exp_memo_resolver *) resolver;
+
+	assert(r);
+	return exp_memo_call(r->memo, name, argc, argv, r->call, r->ctx, result, err);
+}
+
+/** Read a memo's counters.
+ * @param memo The memo to read.
+ * @param[out] stats Set to the memo's counters.
+ */
+void
+exp_memo_stats (struct exp_memo const *memo,
+                struct exp_memo_stats *stats) {
+	assert(memo);
+	assert(stats);
+	*stats = memo->stats;
+}
+
+#ifdef MEMO_TEST_MAIN
+/*
+ * Checks memo hits, misses and evictions against a resolver that counts its calls.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DMEMO_TEST_MAIN -o memo memo.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c funcs.c arena.c -lm
+ */
+#include <stdio.h>
+#include <string.h> // strcmp(), strlen()
+
+/* sq(x) is x*x, and any other name gives how many arguments it was called with.
+ * fail fails. ctx counts the calls made. */
+static int
+test_resolve (char const *name, size_t argc, value_t const *argv, value_t *result, void *ctx, struct exp_error *err) {
+	(*(unsigned long *) ctx)++;
+	if (strcmp(name, "fail") == 0) {
+		return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - fail was called");
+	}
+	if ((strcmp(name, "sq") == 0) && (argc == 1) && (argv[0].type == VAL_LINT)) {
+		*result = value_new_lint(argv[0].data.lint * argv[0].data.lint);
+	} else if ((strcmp(name, "sq") == 0) && (argc == 1)) {
+		*result = value_new_double(argv[0].data.dbl * argv[0].data.dbl);
+	} else {
+		*result = value_new_lint((sys_int_long) argc);
+	}
+	return EXP_OK;
+}
+
+/**
+ * Evaluations through a memo of capacity 2, run in order, with the counters after each.
+ */
+static struct test_memo {
+	char const   *str;       ///< The expression
+	int           ret;       ///< Its return code
+	sys_int_long  value;     ///< Its value when EXP_OK
+	unsigned long calls;     ///< Calls that reached the resolver so far
+	unsigned long hits;      ///< Memo hits so far
+	unsigned long evictions; ///< Memo evictions so far
+} test_memos[] = {
+	{ "sq(3)+sq(3)",                EXP_OK,    18, 1, 1, 0 },
+	{ "sq(3)",                      EXP_OK,     9, 1, 2, 0 },
+	{ "sq(4)",                      EXP_OK,    16, 2, 2, 0 },
+	{ "n(1,2)",                     EXP_OK,     2, 3, 2, 1 }, // sq(3) is the oldest
+	{ "sq(4)",                      EXP_OK,    16, 3, 3, 1 },
+	{ "sq(3)",                      EXP_OK,     9, 4, 3, 2 }, // n(1,2) is the oldest now
+	{ "sq(4)",                      EXP_OK,    16, 4, 4, 2 },
+	{ "m(1,2)",                     EXP_OK,     2, 5, 4, 3 }, // same args, other name
+	{ "fail(1)",                    EXP_EEVAL,  0, 6, 4, 3 }, // failures are not remembered
+	{ "fail(1)",                    EXP_EEVAL,  0, 7, 4, 3 },
+	{ "n(1,2,3,4,5)+n(1,2,3,4,5)",  EXP_OK,    10, 9, 4, 3 }, // too many args to remember
+	{ "sq(4)",                      EXP_OK,    16, 9, 5, 3 },
+};
+#define TEST_MEMO_COUNT (sizeof(test_memos) / sizeof(test_memos[0]))
+
+int
+main (void) {
+	struct exp_memo_resolver resolver;
+	struct exp_memo_stats stats;
+	struct exp_error err;
+	unsigned long calls = 0, before;
+	expression_t exp;
+	value_t result, arg;
+	size_t i;
+	int bad = 0, cases = 0, ret;
+
+	resolver.memo = exp_memo_new(2);
+	resolver.call = test_resolve;
+	resolver.ctx  = &calls;
+
+	for (i = 0; i < TEST_MEMO_COUNT; i++) {
+		struct test_memo const *t = &test_memos[i];
+		string_to_expression_r(strlen(t->str), (char *) t->str, &exp, &err);
+		ret = expression_evaluate_calls_r(exp, exp_memo_resolve, &resolver, &result, &err);
+		expression_free(exp);
+		exp_memo_stats(resolver.memo, &stats);
+		cases++;
+		if ((ret != t->ret) || ((ret == EXP_OK) && ((result.type != VAL_LINT) || (result.data.lint != t->value)))) {
+			printf("FAIL \"%s\": returned %d value %ld, want %d value %ld\n", t->str, ret, (long) result.data.lint, t->ret, (long) t->value);
+			bad++;
+		} else if ((calls != t->calls) || (stats.hits != t->hits) || (stats.evictions != t->evictions)) {
+			printf("FAIL \"%s\": %lu calls %lu hits %lu evictions, want %lu %lu %lu\n",
+			       t->str, calls, stats.hits, stats.evictions, t->calls, t->hits, t->evictions);
+			bad++;
+		} else if ((stats.misses != calls) || (stats.count > stats.capacity)) {
+			printf("FAIL \"%s\": %lu misses for %lu calls, %lu of %lu held\n",
+			       t->str, stats.misses, calls, (unsigned long) stats.count, (unsigned long) stats.capacity);
+			bad++;
+		}
+	}
+
+	/* 1 and 1.0 are different calls */
+	before = calls;
+	arg = value_new_lint(1);
+	exp_memo_call(resolver.memo, "sq", 1, &arg, test_resolve, &calls, &result, &err);
+	arg = value_new_double(1.0);
+	exp_memo_call(resolver.memo, "sq", 1, &arg, test_resolve, &calls, &result, &err);
+	cases++;
+	if ((calls - before != 2) || (result.type != VAL_DOUBLE)) {
+		printf("FAIL sq(1.0): answered with sq(1)\n");
+		bad++;
+	}
+
+	/* Clearing forgets the results and keeps the counters */
+	exp_memo_clear(resolver.memo);
+	exp_memo_stats(resolver.memo, &stats);
+	before = stats.hits;
+	exp_memo_call(resolver.memo, "sq", 1, &arg, test_resolve, &calls, &result, &err);
+	exp_memo_call(resolver.memo, "sq", 1, &arg, test_resolve, &calls, &result, &err);
+	exp_memo_stats(resolver.memo, &stats);
+	cases++;
+	if ((stats.count != 1) || (stats.hits != before + 1) || (stats.misses != calls)) {
+		printf("FAIL clear: %lu held, %lu hits, %lu misses\n", (unsigned long) stats.count, stats.hits, stats.misses);
+		bad++;
+	}
+	exp_memo_free(resolver.memo);
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef MEMO_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
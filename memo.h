@@ -0,0 +1,79 @@
+/**
+ * @file memo.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * A bounded memo of symbol call results, keyed by the symbol's name and the values of its arguments.
+ * A memo sits in front of an @ref exp_call_fn, so repeated calls with the same argument
+ * cost one hash lookup instead of a call.
+ */
+#ifndef _MEMO_H_
+#define _MEMO_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "expression.h"
+
+/// Most arguments a remembered call may have. Calls with more always go to the resolver.
+#define EXP_MEMO_ARGS 4
+
+/// A call memo. Its fields are private to memo.c.
+struct exp_memo;
+
+/**
+ * Counters kept by a call memo.
+ */
+struct exp_memo_stats {
+	unsigned long hits;      ///< Calls answered from the memo
+	unsigned long misses;    ///< Calls that went to the resolver
+	unsigned long evictions; ///< Results dropped to make room
+	size_t        count;     ///< Results currently held
+	size_t        capacity;  ///< Maximum number of results
+};
+
+/**
+ * A resolver with a memo in front of it.
+ * Give @ref exp_memo_resolve as the @ref exp_call_fn and a pointer to this as its context.
+ */
+struct exp_memo_resolver {
+	struct exp_memo *memo; ///< The memo to look in first
+	exp_call_fn      call; ///< The resolver behind the memo
+	void            *ctx;  ///< Context for call
+};
+
+struct exp_memo *
+exp_memo_new (size_t capacity);
+
+void
+exp_memo_free (struct exp_memo *memo);
+
+void
+exp_memo_clear (struct exp_memo *memo);
+
+int
+exp_memo_call (struct exp_memo *memo,
+               char const *name,
+               size_t argc,
+               value_t const *argv,
+               exp_call_fn call,
+               void *ctx,
+               value_t *result,
+               struct exp_error *err);
+
+int
+exp_memo_resolve (char const *name,
+                  size_t argc,
+                  value_t const *argv,
+                  value_t *result,
+                  void *resolver,
+                  struct exp_error *err);
+
+void
+exp_memo_stats (struct exp_memo const *memo,
+                struct exp_memo_stats *stats);
+
+#endif /* _MEMO_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
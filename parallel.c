@@ -0,0 +1,794 @@
+/**
+ * @file parallel.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Parallel evaluation of large expression trees on a work-stealing thread pool.
+ *
+ * A plan's tasks are the forks of the expression: nodes whose subtree reaches the
+ * threshold and whose children are both big or both small. A run of big nodes that
+ * each have only one big child holds no parallel work, so it hangs off the fork below
+ * it as the task's chain and is climbed by the same thread once the fork is done.
+ *
+ * A run starts with the tasks that have no big children, dealt in contiguous blocks
+ * to the workers' deques. A worker takes from the bottom of its own deque and steals
+ * from the top of the others'. The worker that finishes a task's last child goes straight
+ * on to the task itself, so only the starting tasks are ever queued.
+ *
+ * Every node is combined exactly as @ref expression_evaluate_r would, and an error in a
+ * left subtree wins over one in its right, unless the left side of a && or || decides it,
+ * so results and errors match the sequential evaluator. Selects are never split.
+ */
+#define _DEFAULT_SOURCE // sysconf(_SC_NPROCESSORS_ONLN)
+
+#include <stdlib.h>  // malloc(), realloc(), free()
+#include <pthread.h> // pthread_create(), pthread_join(), pthread_mutex_*, pthread_cond_*
+#include <unistd.h>  // sysconf()
+
+#include "errors.h"
+#include "types.h"
+#include "expression.h"
+#include "traverse.h"
+#include "parallel.h"
+
+/// No task
+#define PAR_NONE ((size_t) -1)
+
+/**
+ * A node of a chain, with one big child below it in the chain and one small child.
+ */
+struct par_link {
+	expression_t exp;      ///< The tree node
+	int          big_left; ///< Non-zero if the chain continues down the left child
+};
+
+/**
+ * A fork and the chain above it.
+ */
+struct par_task {
+	expression_t fork;   ///< The lowest node of the task
+	size_t       left;   ///< Task of the fork's left child, or PAR_NONE if it is small
+	size_t       right;  ///< Task of the fork's right child, or PAR_NONE if it is small
+	size_t       parent; ///< Task waiting on this one, or PAR_NONE for the root task
+	size_t       link;   ///< Index of the first node of the chain in the plan's links
+	size_t       nlinks; ///< Length of the chain, bottom first
+	unsigned     pending; ///< Child tasks not yet done in the current run
+	int          ret;    ///< Result code of the current run
+	value_t      val;    ///< Value of the task's top node
+	struct exp_error err; ///< The error, when ret is not EXP_OK
+};
+
+struct exp_par_plan {
+	expression_t     exp;    ///< The planned expression, referenced by the plan
+	size_t           root;   ///< Task of exp, or PAR_NONE if exp is evaluated sequentially
+	struct par_task *tasks;  ///< Tasks in post-order
+	size_t           ntasks; ///< Number of tasks
+	struct par_link *links;  ///< Every task's chain
+	size_t          *ready;  ///< Tasks with no child tasks, in post-order
+	size_t           nready; ///< Number of ready tasks
+};
+
+/**
+ * A worker's queue of tasks.
+ */
+struct par_deque {
+	pthread_mutex_t lock;   ///< Guards top and bottom
+	size_t         *items;  ///< Task indices
+	size_t          top;    ///< Index of the next task to steal
+	size_t          bottom; ///< Index just past the owner's next task
+};
+
+struct exp_par_pool {
+	pthread_mutex_t      lock;     ///< Guards the fields below deques
+	pthread_cond_t       work;     ///< Signalled when a run starts or the pool is freed
+	pthread_cond_t       done;     ///< Signalled when a run's last task is done or its last thread leaves
+	pthread_t           *threads;  ///< Pool threads. Worker 0 is the calling thread and has no entry.
+	unsigned             nworkers; ///< Number of workers, including the calling thread
+	struct par_deque    *deques;   ///< One deque per worker
+	size_t               nitems;   ///< Number of tasks each deque can hold
+	struct exp_par_plan *plan;     ///< The plan being run or NULL
+	unsigned long        run;      ///< Number of runs started
+	size_t               remaining; ///< Tasks of the current run not yet done
+	unsigned             busy;     ///< Pool threads working on the current run
+	int                  quit;     ///< Set when the pool is being freed
+};
+
+/**
+ * A worker thread's start arguments.
+ */
+struct par_worker {
+	struct exp_par_pool *pool; ///< The pool
+	unsigned             id;   ///< The worker's deque
+};
+
+/*---------------------------------------------*
+ *     plans                                   *
+ *---------------------------------------------*/
+
+/**
+ * A subtree being planned.
+ */
+struct par_size {
+	size_t size; ///< Number of nodes
+	size_t task; ///< The subtree's top task, or PAR_NONE if it is small
+};
+
+/** New parallel evaluation plan.
+ * Sizes every subtree of exp once and arranges the big ones into tasks.
+ * The plan takes a reference to exp, which must not be changed while the plan exists.
+ * @param exp The expression to plan
+ * @param threshold The smallest subtree, in nodes, to give its own task, or 0 for @ref EXP_PAR_THRESHOLD.
+ * @return The new plan. Free with @ref exp_par_plan_free.
+ */
+struct exp_par_plan *
+exp_par_plan_new (expression_t exp,
+                  size_t threshold) {
+	struct exp_par_plan *plan;
+	struct exp_walk w;
+	struct par_size *stack = NULL;
+	size_t depth = 0, stack_size = 0;
+	size_t tasks_size = 0, links_size = 0, nlinks = 0;
+	size_t i;
+	expression_t node;
+	enum exp_walk_event event;
+
+	assert(exp);
+	if (threshold == 0) threshold = EXP_PAR_THRESHOLD;
+
+	plan = (struct exp_par_plan *) malloc(sizeof(struct exp_par_plan));
+	assert(plan); // throw error - exp_par_plan_new: malloc could not do allocation
+	plan->exp    = expression_ref(exp);
+	plan->tasks  = NULL;
+	plan->ntasks = 0;
+	plan->links  = NULL;
+
+	/* Size subtrees in post-order */
+	exp_walk_init(&w, exp);
+	while (exp_walk_next(&w, &node, &event)) {
+		struct par_size s;
+
+		if (event == EXP_WALK_ENTER) {
+			// a symbol or a select is evaluated as a leaf
+			if ((node->type == EXP_SYMBOLIC) || EXP_IS_SELECT(node)) exp_walk_skip(&w);
+			continue;
+		}
+		if (event != EXP_WALK_LEAVE) continue;
+
+		s.size = 1;
+		s.task = PAR_NONE;
+		if ((node->type == EXP_TREE) && !EXP_IS_SELECT(node)) {
+			struct par_size l, r;
+			int big_l, big_r;
+
+			r = stack[--depth];
+			l = stack[--depth];
+			s.size += l.size + r.size;
+			big_l = (l.task != PAR_NONE);
+			big_r = (r.task != PAR_NONE);
+
+			if (big_l != big_r) {
+				// one big child -- climb its chain
+				struct par_task *t = &plan->tasks[big_l ? l.task : r.task];
+				if (nlinks == links_size) {
+					links_size = links_size ? (links_size * 2) : 16;
+					plan->links = (struct par_link *) realloc(plan->links, links_size * sizeof(struct par_link));
+					assert(plan->links); // throw error - exp_par_plan_new: realloc could not do allocation
+				}
+				// a chain's links are added one after another, since its small siblings add none
+				assert(t->link + t->nlinks == nlinks);
+				plan->links[nlinks].exp      = node;
+				plan->links[nlinks].big_left = big_l;
+				nlinks++;
+				t->nlinks++;
+				s.task = big_l ? l.task : r.task;
+			}
+			else if (s.size >= threshold) {
+				// a fork
+				struct par_task *t;
+				if (plan->ntasks == tasks_size) {
+					tasks_size = tasks_size ? (tasks_size * 2) : 16;
+					plan->tasks = (struct par_task *) realloc(plan->tasks, tasks_size * sizeof(struct par_task));
+					assert(plan->tasks); // throw error - exp_par_plan_new: realloc could not do allocation
+				}
+				s.task = plan->ntasks++;
+				t = &plan->tasks[s.task];
+				t->fork   = node;
+				t->left   = l.task;
+				t->right  = r.task;
+				t->parent = PAR_NONE;
+				t->link   = nlinks;
+				t->nlinks = 0;
+				if (big_l) {
+					plan->tasks[l.task].parent = s.task;
+					plan->tasks[r.task].parent = s.task;
+				}
+			}
+		}
+
+		if (depth == stack_size) {
+			stack_size = stack_size ? (stack_size * 2) : EXP_WALK_LOCAL;
+			stack = (struct par_size *) realloc(stack, stack_size * sizeof(struct par_size));
+			assert(stack); // throw error - exp_par_plan_new: realloc could not do allocation
+		}
+		stack[depth++] = s;
+	}
+	exp_walk_free(&w);
+
+	assert(depth == 1);
+	plan->root = stack[0].task;
+	free(stack);
+
+	/* Tasks that can start right away */
+	plan->ready = (size_t *) malloc((plan->ntasks ? plan->ntasks : 1) * sizeof(size_t));
+	assert(plan->ready); // throw error - exp_par_plan_new: malloc could not do allocation
+	plan->nready = 0;
+	for (i = 0; i < plan->ntasks; i++) {
+		if (plan->tasks[i].left == PAR_NONE) plan->ready[plan->nready++] = i;
+	}
+
+	return plan;
+}
+
+/** Free a plan and release its reference to the expression.
+ * @param plan The plan to free.
+ */
+void
+exp_par_plan_free (struct exp_par_plan *plan) {
+	if (!plan) return;
+	expression_free(plan->exp);
+	free(plan->tasks);
+	free(plan->links);
+	free(plan->ready);
+	free(plan);
+}
+
+/** Number of tasks a plan splits its expression into.
+ * Zero means the expression is too small to split and is evaluated sequentially.
+ */
+size_t
+exp_par_plan_tasks (struct exp_par_plan const *plan) {
+	assert(plan);
+	return plan->ntasks;
+}
+
+/*---------------------------------------------*
+ *     tasks                                   *
+ *---------------------------------------------*/
+
+/** Get the value of a fork's child, from its task or by evaluating it here.
+ * @return EXP_OK or the error code
+ */
+static int
+par_child (struct exp_par_plan *plan,
+           size_t task,
+           expression_t exp,
+           value_t *val,
+           struct exp_error *err) {
+	if (task == PAR_NONE) {
+		return expression_evaluate_r(exp, val, err);
+	}
+	*val = plan->tasks[task].val;
+	if (plan->tasks[task].ret != EXP_OK) *err = plan->tasks[task].err;
+	return plan->tasks[task].ret;
+}
+
+/* True if op is && or || and left_val alone decides it, so an error on its right is dropped */
+static int
+par_decided (char op, value_t left_val) {
+	int truth;
+
+	if ((op != '&') && (op != '|')) return 0;
+	truth = (left_val.type == VAL_DOUBLE) ? (left_val.data.dbl != 0.0) : (left_val.data.lint != 0);
+	return truth == (op == '|');
+}
+
+/** Run one task whose child tasks are done.
+ * Errors are picked exactly as the sequential evaluator picks them, left before right,
+ * and not at all on the right of a && or || whose left side decides it.
+ */
+static void
+par_task_run (struct exp_par_plan *plan, size_t index) {
+	struct par_task *t = &plan->tasks[index];
+	expression_t fork = t->fork;
+	value_t l, r;
+	size_t i;
+
+	exp_error_clear(&t->err);
+
+	/* The fork */
+	if ((t->ret = par_child(plan, t->left, fork->data.tree.left, &t->val, &t->err)) == EXP_OK) {
+		l = t->val;
+		if (par_decided(fork->data.tree.op, l)) {
+			t->val = value_new_lint(fork->data.tree.op == '|');
+		} else if ((t->ret = par_child(plan, t->right, fork->data.tree.right, &r, &t->err)) == EXP_OK) {
+			t->ret = expression_operate_r(fork->data.tree.op, l, r, &t->val, &t->err);
+		} else {
+			t->val = r;
+		}
+	}
+
+	/* Up the chain */
+	for (i = 0; i < t->nlinks; i++) {
+		struct par_link const *link = &plan->links[t->link + i];
+		expression_t exp = link->exp;
+		char op = exp->data.tree.op;
+		struct exp_error small_err;
+		value_t small;
+
+		if (link->big_left) {
+			if (t->ret != EXP_OK) continue; // the left error wins
+			if (par_decided(op, t->val)) {
+				t->val = value_new_lint(op == '|');
+				continue;
+			}
+			if ((t->ret = expression_evaluate_r(exp->data.tree.right, &small, &t->err)) != EXP_OK) {
+				t->val = small;
+				continue;
+			}
+			t->ret = expression_operate_r(op, t->val, small, &t->val, &t->err);
+		} else {
+			int ret = expression_evaluate_r(exp->data.tree.left, &small, &small_err);
+			if (ret != EXP_OK) {
+				// the left side is met first
+				t->ret = ret;
+				t->val = small;
+				t->err = small_err;
+				continue;
+			}
+			if (par_decided(op, small)) {
+				t->ret = EXP_OK;
+				t->val = value_new_lint(op == '|');
+				exp_error_clear(&t->err);
+				continue;
+			}
+			if (t->ret != EXP_OK) continue;
+			t->ret = expression_operate_r(op, small, t->val, &t->val, &t->err);
+		}
+	}
+}
+
+/*---------------------------------------------*
+ *     pool                                    *
+ *---------------------------------------------*/
+
+/** Take a task, first from the bottom of the worker's own deque and then from the top of another's.
+ * @return The task, or PAR_NONE if every deque is empty.
+ */
+static size_t
+par_take (struct exp_par_pool *pool, unsigned id) {
+	size_t task = PAR_NONE;
+	unsigned k;
+
+	for (k = 0; (k < pool->nworkers) && (task == PAR_NONE); k++) {
+		struct par_deque *d = &pool->deques[(id + k) % pool->nworkers];
+
+		pthread_mutex_lock(&d->lock);
+		if (d->top < d->bottom) {
+			task = (k == 0) ? d->items[--d->bottom] : d->items[d->top++];
+		}
+		pthread_mutex_unlock(&d->lock);
+	}
+	return task;
+}
+
+/** Work on a run until there is nothing left to take.
+ * Finishing a task's last child task goes straight on to that task.
+ */
+static void
+par_work (struct exp_par_pool *pool,
+          struct exp_par_plan *plan,
+          unsigned id) {
+	size_t task;
+
+	while ((task = par_take(pool, id)) != PAR_NONE) {
+		for (;;) {
+			size_t parent;
+			int go_on = 0;
+
+			par_task_run(plan, task);
+
+			parent = plan->tasks[task].parent;
+			pthread_mutex_lock(&pool->lock);
+			if ((parent != PAR_NONE) && (--plan->tasks[parent].pending == 0)) go_on = 1;
+			if (--pool->remaining == 0) pthread_cond_broadcast(&pool->done);
+			pthread_mutex_unlock(&pool->lock);
+
+			if (!go_on) break;
+			task = parent;
+		}
+	}
+}
+
+/* Pool thread body -- join each run as it starts */
+static void *
+par_worker_main (void *arg) {
+	struct par_worker *worker = (struct par_worker *) arg;
+	struct exp_par_pool *pool = worker->pool;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		struct exp_par_plan *plan;
+
+		while (!pool->quit && (pool->run == seen)) pthread_cond_wait(&pool->work, &pool->lock);
+		if (pool->quit) break;
+		seen = pool->run;
+		if (!(plan = pool->plan)) continue; // that run is already over
+
+		pool->busy++;
+		pthread_mutex_unlock(&pool->lock);
+		par_work(pool, plan, worker->id);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->busy == 0) pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	free(worker);
+	return NULL;
+}
+
+/** New pool of evaluation threads.
+ * The thread that runs an evaluation also works on it, so nthreads - 1 threads are started.
+ * If a thread cannot be started the pool carries on with fewer.
+ * @param nthreads Number of workers, or 0 to use one per online CPU.
+ * @return The new pool. Free with @ref exp_par_pool_free.
+ */
+struct exp_par_pool *
+exp_par_pool_new (unsigned nthreads) {
+	struct exp_par_pool *pool;
+	unsigned i;
+
+	if (nthreads == 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = (ncpu > 0) ? (unsigned) ncpu : 1;
+	}
+
+	pool = (struct exp_par_pool *) malloc(sizeof(struct exp_par_pool));
+	assert(pool); // throw error - exp_par_pool_new: malloc could not do allocation
+	pool->threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+	pool->deques  = (struct par_deque *) malloc(nthreads * sizeof(struct par_deque));
+	assert(pool->threads && pool->deques); // throw error - exp_par_pool_new: malloc could not do allocation
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->nitems    = 0;
+	pool->plan      = NULL;
+	pool->run       = 0;
+	pool->remaining = 0;
+	pool->busy      = 0;
+	pool->quit      = 0;
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+		pool->deques[i].items  = NULL;
+		pool->deques[i].top    = 0;
+		pool->deques[i].bottom = 0;
+	}
+
+	/* Start threads -- worker 0 is the caller */
+	pool->nworkers = 1;
+	for (i = 1; i < nthreads; i++) {
+		struct par_worker *worker = (struct par_worker *) malloc(sizeof(struct par_worker));
+		assert(worker); // throw error - exp_par_pool_new: malloc could not do allocation
+		worker->pool = pool;
+		worker->id   = pool->nworkers;
+		if (pthread_create(&pool->threads[pool->nworkers], NULL, par_worker_main, worker) != 0) {
+			free(worker);
+			break;
+		}
+		pool->nworkers++;
+	}
+
+	return pool;
+}
+
+/** Stop a pool's threads and free it.
+ * Must not be called during an evaluation on the pool.
+ * @param pool The pool to free.
+ */
+void
+exp_par_pool_free (struct exp_par_pool *pool) {
+	unsigned i;
+
+	if (!pool) return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 1; i < pool->nworkers; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	for (i = 0; i < pool->nworkers; i++) {
+		pthread_mutex_destroy(&pool->deques[i].lock);
+		free(pool->deques[i].items);
+	}
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->deques);
+	free(pool->threads);
+	free(pool);
+}
+
+/** Number of workers in a pool, including the calling thread.
+ */
+unsigned
+exp_par_pool_threads (struct exp_par_pool const *pool) {
+	assert(pool);
+	return pool->nworkers;
+}
+
+/** Evaluate a planned expression in parallel, reporting errors instead of exiting.
+ * Gives the same result and error as @ref expression_evaluate_r on the plan's expression.
+ * One pool runs one evaluation at a time, and a plan may only be in one evaluation at a time.
+ * @param pool The threads to use
+ * @param plan The plan of the expression to evaluate
+ * @param[out] result Set to the value of the expression
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+expression_evaluate_parallel_r (struct exp_par_pool *pool,
+                                struct exp_par_plan *plan,
+                                value_t *result,
+                                struct exp_error *err) {
+	struct par_task *root;
+	size_t i, start;
+	unsigned w;
+
+	assert(pool);
+	assert(plan);
+	assert(result);
+
+	if (plan->root == PAR_NONE) {
+		return expression_evaluate_r(plan->exp, result, err);
+	}
+
+	/* Reset the tasks and deal the ready ones out in blocks */
+	for (i = 0; i < plan->ntasks; i++) {
+		plan->tasks[i].pending = (plan->tasks[i].left != PAR_NONE) ? 2 : 0;
+	}
+	if (pool->nitems < plan->nready) {
+		for (w = 0; w < pool->nworkers; w++) {
+			pool->deques[w].items = (size_t *) realloc(pool->deques[w].items, plan->nready * sizeof(size_t));
+			assert(pool->deques[w].items); // throw error - expression_evaluate_parallel_r: realloc could not do allocation
+		}
+		pool->nitems = plan->nready;
+	}
+	for (w = 0, start = 0; w < pool->nworkers; w++) {
+		struct par_deque *d = &pool->deques[w];
+		size_t end = (plan->nready * (w + 1)) / pool->nworkers;
+
+		// the owner takes from the bottom, so the block goes in backwards to start on its leftmost task
+		d->top    = 0;
+		d->bottom = end - start;
+		for (i = 0; i < d->bottom; i++) d->items[i] = plan->ready[end - 1 - i];
+		start = end;
+	}
+
+	/* Start the run and join it */
+	pthread_mutex_lock(&pool->lock);
+	pool->plan      = plan;
+	pool->remaining = plan->ntasks;
+	pool->run++;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	par_work(pool, plan, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while ((pool->remaining > 0) || (pool->busy > 0)) pthread_cond_wait(&pool->done, &pool->lock);
+	pool->plan = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	root = &plan->tasks[plan->root];
+	*result = root->val;
+	exp_error_clear(err);
+	if (root->ret != EXP_OK) {
+		return exp_error_set(err, root->err.code, root->err.index, "%s", root->err.msg);
+	}
+	return EXP_OK;
+}
+
+#ifdef PARALLEL_TEST_MAIN
+/*
+ * Checks that parallel evaluation gives the same result and error as
+ * expression_evaluate_r, over several pool sizes and task thresholds,
+ * on long sums and on balanced trees that split into many tasks.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DPARALLEL_TEST_MAIN -o parallel parallel.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c funcs.c arena.c -pthread -lm
+ */
+#include <stdio.h>
+#include <string.h> // strcmp(), strlen(), memcpy()
+#include "workspace.h"
+
+/**
+ * Long sums of one term repeated, with one other term part way through.
+ */
+static struct test_par {
+	char const *term;   ///< The repeated term
+	char const *middle; ///< The other term
+	size_t      count;  ///< Number of terms
+} test_pars[] = {
+	{ "(3*4-5)", "1",             2000 },
+	{ "(3*4-5)", "1/0",           2000 },
+	{ "(3*4-5)", "x",             2000 },
+	{ "(7/2.0)", "(1 ? 2 : 1/0)", 1000 },
+	{ "(2-9)",   "(0 ? 1/0 : 3)", 1000 },
+	{ "(1 < 2)", "(0 && 1/0)",    1000 },
+	{ "(1/0)",   "(1.5/0)",        500 }, // errors all through, the first must win
+	{ "(1 ? 2 : 3)", "4",            3 },
+};
+#define TEST_PAR_COUNT (sizeof(test_pars) / sizeof(test_pars[0]))
+
+/**
+ * Balanced trees of one term repeated, with one other term part way through.
+ * Unlike a long sum, a balanced tree splits into many forks, each with both children big.
+ */
+static struct test_bal {
+	char const *term;   ///< The repeated term
+	char const *middle; ///< The other term
+	int         depth;  ///< Levels of operations, for 2^depth terms
+} test_bals[] = {
+	{ "(3*4-5)", "1",          10 },
+	{ "(3*4-5)", "1/0",        10 },
+	{ "(7/2.0)", "(0 && 1/0)",  8 },
+};
+#define TEST_BAL_COUNT (sizeof(test_bals) / sizeof(test_bals[0]))
+
+/// Pool sizes to try
+static unsigned const test_threads[] = { 1, 2, 4 };
+/// Thresholds to try
+static size_t const test_thresholds[] = { 0, 2, 16, 100 };
+
+/* Build term+term+...+middle+...+term */
+static char *
+test_sum (struct test_par const *t) {
+	size_t tlen = strlen(t->term), mlen = strlen(t->middle);
+	char *str = (char *) malloc((t->count * (tlen + mlen + 1)) + 1);
+	char *p = str;
+	size_t i;
+
+	assert(str);
+	for (i = 0; i < t->count; i++) {
+		if (i) *p++ = '+';
+		if (i == (t->count * 2) / 3) {
+			memcpy(p, t->middle, mlen);
+			p += mlen;
+		} else {
+			memcpy(p, t->term, tlen);
+			p += tlen;
+		}
+	}
+	*p = '\0';
+	return str;
+}
+
+/* Write a balanced tree of depth levels, alternating + and -, at p. Returns the end. */
+static char *
+test_tree (char *p, struct test_bal const *t, int depth, size_t *term) {
+	char const *str;
+
+	if (depth == 0) {
+		str = (*term == ((size_t) 2 << t->depth) / 3) ? t->middle : t->term;
+		(*term)++;
+		memcpy(p, str, strlen(str));
+		return p + strlen(str);
+	}
+	*p++ = '(';
+	p = test_tree(p, t, depth - 1, term);
+	*p++ = (depth % 2) ? '+' : '-';
+	p = test_tree(p, t, depth - 1, term);
+	*p++ = ')';
+	return p;
+}
+
+/* A balanced tree must split into more tasks than there are threads, and still match
+ * expression_evaluate_r. Returns the number of failures. */
+static int
+test_balanced (struct exp_par_pool *pool, struct test_bal const *t, int *cases) {
+	size_t len = strlen(t->term) > strlen(t->middle) ? strlen(t->term) : strlen(t->middle);
+	char *str = (char *) malloc(((size_t) 1 << t->depth) * (len + 3) + 1);
+	struct exp_par_plan *plan;
+	struct exp_error want_err, err;
+	value_t want, result;
+	expression_t exp;
+	size_t th, tasks, term = 0;
+	int want_ret, ret, bad = 0;
+
+	assert(str);
+	*test_tree(str, t, t->depth, &term) = '\0';
+	string_to_expression_r(strlen(str), str, &exp, &err);
+	want_ret = expression_evaluate_r(exp, &want, &want_err);
+
+	for (th = 0; th < sizeof(test_thresholds) / sizeof(test_thresholds[0]); th++) {
+		// threshold 0 is the default, which is too big to split these
+		if (test_thresholds[th] == 0) continue;
+		plan = exp_par_plan_new(exp, test_thresholds[th]);
+		tasks = exp_par_plan_tasks(plan);
+		ret = expression_evaluate_parallel_r(pool, plan, &result, &err);
+		(*cases)++;
+		if ((ret != want_ret) || !value_equal(result, want)
+		    || (err.code != want_err.code) || strcmp(err.msg, want_err.msg)) {
+			printf("FAIL %u threads, threshold %lu, %lu tasks, balanced %s with %s: returned %d \"%s\", want %d \"%s\"\n",
+			       exp_par_pool_threads(pool), (unsigned long) test_thresholds[th], (unsigned long) tasks,
+			       t->term, t->middle, ret, err.msg, want_ret, want_err.msg);
+			bad++;
+		}
+		if (tasks <= exp_par_pool_threads(pool)) {
+			printf("FAIL %u threads, threshold %lu, balanced %s: only %lu tasks\n",
+			       exp_par_pool_threads(pool), (unsigned long) test_thresholds[th], t->term, (unsigned long) tasks);
+			bad++;
+		}
+		exp_par_plan_free(plan);
+	}
+
+	expression_free(exp);
+	free(str);
+	return bad;
+}
+
+int
+main (void) {
+	struct exp_par_pool *pool;
+	struct exp_par_plan *plan;
+	struct exp_error want_err, err;
+	value_t want, result;
+	expression_t exp;
+	size_t i, th, tasks;
+	unsigned tp;
+	int want_ret, ret, run;
+	int bad = 0, cases = 0;
+	char *str;
+
+	workspace_init();
+	for (tp = 0; tp < sizeof(test_threads) / sizeof(test_threads[0]); tp++) {
+		pool = exp_par_pool_new(test_threads[tp]);
+		for (i = 0; i < TEST_PAR_COUNT; i++) {
+			str = test_sum(&test_pars[i]);
+			string_to_expression_r(strlen(str), str, &exp, &err);
+			want_ret = expression_evaluate_r(exp, &want, &want_err);
+
+			for (th = 0; th < sizeof(test_thresholds) / sizeof(test_thresholds[0]); th++) {
+				plan = exp_par_plan_new(exp, test_thresholds[th]);
+				tasks = exp_par_plan_tasks(plan);
+				// a plan can be run again
+				for (run = 0; run < 2; run++) {
+					ret = expression_evaluate_parallel_r(pool, plan, &result, &err);
+					cases++;
+					if ((ret != want_ret) || !value_equal(result, want)
+					    || (err.code != want_err.code) || strcmp(err.msg, want_err.msg)) {
+						printf("FAIL %u threads, threshold %lu, %lu tasks, %s x %lu with %s: returned %d \"%s\", want %d \"%s\"\n",
+						       exp_par_pool_threads(pool), (unsigned long) test_thresholds[th], (unsigned long) tasks,
+						       test_pars[i].term, (unsigned long) test_pars[i].count, test_pars[i].middle,
+						       ret, err.msg, want_ret, want_err.msg);
+						bad++;
+					}
+				}
+				if ((test_thresholds[th] == 2) && (test_pars[i].count > 100) && (tasks < 2)) {
+					printf("FAIL threshold 2, %s x %lu: only %lu tasks\n", test_pars[i].term, (unsigned long) test_pars[i].count, (unsigned long) tasks);
+					bad++;
+				}
+				exp_par_plan_free(plan);
+			}
+			expression_free(exp);
+			free(str);
+		}
+		for (i = 0; i < TEST_BAL_COUNT; i++) {
+			bad += test_balanced(pool, &test_bals[i], &cases);
+		}
+		exp_par_pool_free(pool);
+	}
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef PARALLEL_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
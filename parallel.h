@@ -0,0 +1,58 @@
+/**
+ * @file parallel.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Parallel evaluation of large expression trees on a work-stealing thread pool.
+ *
+ * A plan is made once per expression. It caches the sizes of the expression's
+ * subtrees as a graph of tasks, each one a subtree too large to leave to one thread.
+ * Subtrees smaller than the plan's threshold are evaluated sequentially inside a task,
+ * and so are selects, c ? a : b, whatever their size.
+ */
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "expression_lite.h" // just need pointer expression_t
+
+/// Default smallest subtree, in nodes, worth giving its own task
+#define EXP_PAR_THRESHOLD 4096
+
+/// A pool of evaluation threads. Its fields are private to parallel.c.
+struct exp_par_pool;
+
+/// A parallel evaluation plan for one expression. Its fields are private to parallel.c.
+struct exp_par_plan;
+
+struct exp_par_pool *
+exp_par_pool_new (unsigned nthreads);
+
+void
+exp_par_pool_free (struct exp_par_pool *pool);
+
+unsigned
+exp_par_pool_threads (struct exp_par_pool const *pool);
+
+struct exp_par_plan *
+exp_par_plan_new (expression_t exp,
+                  size_t threshold);
+
+void
+exp_par_plan_free (struct exp_par_plan *plan);
+
+size_t
+exp_par_plan_tasks (struct exp_par_plan const *plan);
+
+int
+expression_evaluate_parallel_r (struct exp_par_pool *pool,
+                                struct exp_par_plan *plan,
+                                value_t *result,
+                                struct exp_error *err);
+
+#endif /* _PARALLEL_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
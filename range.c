@@ -0,0 +1,584 @@
+/**
+ * @file range.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Interval analysis of compiled expressions.
+ *
+ * The analysis runs the bytecode once on a stack of intervals instead of values.
+ * An operation is proven safe when no pair of values from its operands' intervals
+ * can overflow or divide by zero. Since every operation is monotonic in each operand
+ * over an interval that excludes zero, only the intervals' corners need trying.
+ * The result of a checked operation that succeeds can be any integer, unless it is a
+ * division, so the analysis carries on from the widest interval the check lets through.
+ * Comparisons and logical operations never fail and give 0 or 1, and a select can give
+ * anything either of its arms can.
+ */
+#include <stdlib.h> // malloc(), calloc(), free()
+#include <string.h> // memset()
+#include "errors.h"
+#include "types.h"
+#include "expression.h"
+#include "bytecode.h"
+#include "range.h"
+
+/// Every integer
+static struct exp_range const range_full = { SYS_INT_LONG_T_MIN, SYS_INT_LONG_T_MAX };
+
+/// A truth value
+static struct exp_range const range_truth = { 0, 1 };
+
+/// Offset from an operation to its _K form
+#define RANGE_K_OFFSET (BC_ADD_K - BC_ADD)
+
+/// Stack entries kept on the C stack by range_run before it allocates
+#define RANGE_STACK_LOCAL 64
+
+/*---------------------------------------------*
+ *     checked arithmetic                      *
+ *---------------------------------------------*/
+
+/* a + b, or non-zero if it overflows */
+static int
+range_add (sys_int_long a, sys_int_long b, sys_int_long *r) {
+	if (((b > 0) && (a > SYS_INT_LONG_T_MAX - b)) || ((b < 0) && (a < SYS_INT_LONG_T_MIN - b))) return 1;
+	*r = a + b;
+	return 0;
+}
+
+/* a - b, or non-zero if it overflows */
+static int
+range_sub (sys_int_long a, sys_int_long b, sys_int_long *r) {
+	if (((b < 0) && (a > SYS_INT_LONG_T_MAX + b)) || ((b > 0) && (a < SYS_INT_LONG_T_MIN + b))) return 1;
+	*r = a - b;
+	return 0;
+}
+
+/* a * b, or non-zero if it overflows */
+static int
+range_mul (sys_int_long a, sys_int_long b, sys_int_long *r) {
+	if (a > 0) {
+		if ((b > 0) ? (a > SYS_INT_LONG_T_MAX / b) : (b < SYS_INT_LONG_T_MIN / a)) return 1;
+	} else if (a < 0) {
+		if ((b > 0) ? (a < SYS_INT_LONG_T_MIN / b) : ((b != 0) && (a < SYS_INT_LONG_T_MAX / b))) return 1;
+	}
+	*r = a * b;
+	return 0;
+}
+
+/* a / b, or non-zero if b is zero or it overflows */
+static int
+range_div (sys_int_long a, sys_int_long b, sys_int_long *r) {
+	if ((b == 0) || ((b == -1) && (a == SYS_INT_LONG_T_MIN))) return 1;
+	*r = a / b;
+	return 0;
+}
+
+/* Apply a checked operation */
+static int
+range_apply (enum bc_opcode op, sys_int_long a, sys_int_long b, sys_int_long *r) {
+	switch (op) {
+	case BC_ADD: return range_add(a, b, r);
+	case BC_SUB: return range_sub(a, b, r);
+	case BC_MUL: return range_mul(a, b, r);
+	case BC_DIV: return range_div(a, b, r);
+	default:
+		assert(0); // throw error - range_apply: not an operation
+		return 1;
+	}
+}
+
+/*---------------------------------------------*
+ *     intervals                               *
+ *---------------------------------------------*/
+
+/** Widen the interval [*lo, *hi] by the corners of a and [blo, bhi] under op.
+ * @param first Non-zero if the interval is still empty
+ * @return Non-zero if some corner fails
+ */
+static int
+range_corners (enum bc_opcode op,
+               struct exp_range a,
+               sys_int_long blo,
+               sys_int_long bhi,
+               struct exp_range *r,
+               int first) {
+	sys_int_long as[2], bs[2], v;
+	int i, j;
+
+	as[0] = a.lo; as[1] = a.hi;
+	bs[0] = blo;  bs[1] = bhi;
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < 2; j++) {
+			if (range_apply(op, as[i], bs[j], &v)) return 1;
+			if (first || (v < r->lo)) r->lo = v;
+			if (first || (v > r->hi)) r->hi = v;
+			first = 0;
+		}
+	}
+	return 0;
+}
+
+/** Find the interval of an operation's result.
+ * @param[out] r Set to the interval of every result the operation can give without error.
+ * @return Non-zero if the operation is proven never to fail
+ */
+static int
+range_operate (enum bc_opcode op,
+               struct exp_range a,
+               struct exp_range b,
+               struct exp_range *r) {
+	int first = 1;
+
+	if ((op != BC_DIV) || (b.lo > 0) || (b.hi < 0)) {
+		if (range_corners(op, a, b.lo, b.hi, r, 1) == 0) return 1;
+		if (op != BC_DIV) {
+			*r = range_full;
+			return 0;
+		}
+	}
+
+	/* A division that might fail -- bound what gets through, one side of zero at a time */
+	if (b.lo < 0) {
+		if (range_corners(op, a, b.lo, (b.hi < 0) ? b.hi : -1, r, first)) {
+			*r = range_full;
+			return 0;
+		}
+		first = 0;
+	}
+	if (b.hi > 0) {
+		if (range_corners(op, a, (b.lo > 0) ? b.lo : 1, b.hi, r, first)) {
+			*r = range_full;
+			return 0;
+		}
+		first = 0;
+	}
+	if (first) *r = range_full; // always divides by zero
+	return 0;
+}
+
+/*---------------------------------------------*
+ *     programs                                *
+ *---------------------------------------------*/
+
+/** Compile an expression and prove which of its operations are safe.
+ * @param exp The expression to compile
+ * @param nsyms Number of symbol names in syms
+ * @param syms Symbol names. A symbol is loaded from the variable with the same index.
+ * @param ranges Declared range of each variable, or NULL if they can be any integer.
+ * 		Values given to @ref range_run must stay inside them.
+ * @param[out] rprog Set to the new program, or NULL on error. Free with @ref range_free.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+range_compile (expression_t exp,
+               size_t nsyms,
+               char const *const *syms,
+               struct exp_range const *ranges,
+               struct range_program **rprog,
+               struct exp_error *err) {
+	struct bc_program *prog;
+	struct range_program *rp;
+	struct exp_range *stack, *sp;
+	size_t i;
+	int ret;
+
+	assert(rprog);
+
+	*rprog = NULL;
+	if ((ret = bytecode_compile(exp, nsyms, syms, &prog, err)) != EXP_OK) {
+		return ret;
+	}
+	// a long int result may still come from comparing doubles
+	if ((prog->type != VAL_LINT) || (prog->nconsts != 0)) {
+		bytecode_free(prog);
+		return exp_error_set(err, EXP_EEVAL, 0, "Compile Error - Only long int expressions can be range checked");
+	}
+
+	rp = (struct range_program *) malloc(sizeof(struct range_program));
+	assert(rp); // throw error - range_compile: malloc could not do allocation
+	rp->prog    = prog;
+	rp->checked = (unsigned char *) malloc(prog->len);
+	rp->vars    = (struct exp_range *) malloc((nsyms ? nsyms : 1) * sizeof(struct exp_range));
+	stack       = (struct exp_range *) malloc((prog->depth ? prog->depth : 1) * sizeof(struct exp_range));
+	assert(rp->checked && rp->vars && stack); // throw error - range_compile: malloc could not do allocation
+	rp->ops      = 0;
+	rp->unproven = 0;
+
+	for (i = 0; i < nsyms; i++) {
+		rp->vars[i] = ranges ? ranges[i] : range_full;
+		assert(rp->vars[i].lo <= rp->vars[i].hi); // throw error - range_compile: empty variable range
+	}
+
+	/* Run the program on intervals */
+	sp = stack;
+	for (i = 0; i < prog->len; i++) {
+		struct bc_insn const *insn = &prog->code[i];
+		struct exp_range b;
+		enum bc_opcode op = insn->op;
+
+		rp->checked[i] = 0;
+		switch (op) {
+		case BC_CONST:
+			sp->lo = sp->hi = insn->arg;
+			sp++;
+			continue;
+		case BC_LOAD:
+			*sp++ = rp->vars[insn->arg];
+			continue;
+		case BC_RET:
+			rp->range = *--sp;
+			continue;
+		case BC_ADD_K: case BC_SUB_K: case BC_MUL_K: case BC_DIV_K:
+			op = (enum bc_opcode) (op - RANGE_K_OFFSET);
+			b.lo = b.hi = insn->arg;
+			break;
+		case BC_LT: case BC_GT: case BC_LE: case BC_GE: case BC_EQ: case BC_NE:
+		case BC_AND: case BC_OR:
+			sp--;
+			sp[-1] = range_truth;
+			rp->ops++;
+			continue;
+		case BC_SELECT:
+			// cond, then, else
+			sp -= 2;
+			sp[-1].lo = (sp[0].lo < sp[1].lo) ? sp[0].lo : sp[1].lo;
+			sp[-1].hi = (sp[0].hi > sp[1].hi) ? sp[0].hi : sp[1].hi;
+			rp->ops++;
+			continue;
+		default:
+			b = *--sp;
+			break;
+		}
+		rp->ops++;
+		if (!range_operate(op, sp[-1], b, &sp[-1])) {
+			rp->checked[i] = 1;
+			rp->unproven++;
+		}
+	}
+
+	free(stack);
+	*rprog = rp;
+	return EXP_OK;
+}
+
+/** Free a range checked program.
+ */
+void
+range_free (struct range_program *rprog) {
+	if (!rprog) return;
+	bytecode_free(rprog->prog);
+	free(rprog->checked);
+	free(rprog->vars);
+	free(rprog);
+}
+
+/// Faults an operation can have in @ref range_run, 0 for none
+#define RANGE_FAULT_ZERO     1 ///< Division by zero
+#define RANGE_FAULT_DIV      2 ///< LONG_MIN / -1
+#define RANGE_FAULT_OVERFLOW 3 ///< Overflow
+
+/* Report the fault of the result */
+static int
+range_fault (unsigned char fault, value_t *result, struct exp_error *err) {
+	switch (fault) {
+	case RANGE_FAULT_ZERO:
+		*result = value_new_type(VAL_ERROR);
+		return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Division by zero");
+	case RANGE_FAULT_DIV:
+		*result = value_new_type(VAL_INF);
+		return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Division overflow");
+	default:
+		*result = value_new_type(VAL_INF);
+		return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Integer overflow");
+	}
+}
+
+/** Run a range checked program, reporting errors instead of exiting.
+ * Operations proven safe run unchecked. The rest report overflow and division by zero.
+ * A program with every operation proven runs as plain bytecode,
+ * and may equally be given to @ref batch_run or compiled by @ref jit_compile.
+ *
+ * Both arms of a select are run, so a failed operation does not stop the run. Its
+ * fault is kept beside its stack entry and passed up like @ref expression_evaluate_r
+ * passes its errors, and only reported if it reaches the result. The value left by
+ * a failed operation is outside the proven ranges, so from the first fault on every
+ * operation is checked.
+ * @param rprog The program to run
+ * @param vars Variable values, indexed like the program's syms. They are checked against the declared ranges.
+ * @param[out] result Set to the result. On error, a VAL_ERROR or VAL_INF value.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+range_run (struct range_program const *rprog,
+           sys_int_long const *vars,
+           value_t *result,
+           struct exp_error *err) {
+	struct bc_program const *prog;
+	struct bc_insn const *ip;
+	sys_int_long  local[RANGE_STACK_LOCAL];
+	sys_int_long *stack = local;
+	sys_int_long *sp;
+	sys_int_long  l, r;
+	unsigned char local_faults[RANGE_STACK_LOCAL];
+	unsigned char *faults = NULL; // fault of each stack entry, set at the first fault
+	unsigned char rf, fault;
+	size_t i, top;
+	int ret = EXP_OK;
+
+	assert(rprog);
+	assert(result);
+
+	prog = rprog->prog;
+	assert(vars || (prog->nvars == 0));
+
+	exp_error_clear(err);
+	for (i = 0; i < prog->nvars; i++) {
+		if ((vars[i] < rprog->vars[i].lo) || (vars[i] > rprog->vars[i].hi)) {
+			*result = value_new_type(VAL_ERROR);
+			return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Variable %lu is out of its declared range", (unsigned long) i);
+		}
+	}
+
+	/* Nothing to check */
+	if (rprog->unproven == 0) {
+		*result = bytecode_run(prog, vars);
+		return EXP_OK;
+	}
+
+	if (prog->depth > RANGE_STACK_LOCAL) {
+		stack = (sys_int_long *) malloc(prog->depth * sizeof(sys_int_long));
+		assert(stack); // throw error - range_run: malloc could not do allocation
+	}
+	sp = stack;
+
+	for (i = 0, ip = prog->code; ; i++, ip++) {
+		enum bc_opcode op = ip->op;
+
+		rf = 0;
+		switch (op) {
+		case BC_CONST:
+		case BC_LOAD:
+			if (faults) faults[sp - stack] = 0;
+			*sp++ = (op == BC_CONST) ? ip->arg : vars[ip->arg];
+			continue;
+		case BC_RET:
+			top = (size_t) (--sp - stack);
+			if (faults && faults[top]) {
+				ret = range_fault(faults[top], result, err);
+			} else {
+				*result = value_new_lint(*sp);
+			}
+			goto done;
+		case BC_SELECT:
+			// cond, then, else -- then is one past cond and else two
+			sp -= 2;
+			top = (size_t) (sp - 1 - stack);
+			if (faults && !faults[top]) faults[top] = faults[top + 1 + (sp[-1] == 0)];
+			sp[-1] = sp[sp[-1] == 0];
+			continue;
+		case BC_ADD_K: case BC_SUB_K: case BC_MUL_K: case BC_DIV_K:
+			op = (enum bc_opcode) (op - RANGE_K_OFFSET);
+			r = ip->arg;
+			break;
+		default:
+			r = *--sp;
+			if (faults) rf = faults[sp - stack];
+			break;
+		}
+		l = sp[-1];
+		top = (size_t) (sp - 1 - stack);
+
+		/* Fast path, also taken by comparisons and logical operations, which cannot fail */
+		if ((!rprog->checked[i] && !faults) || (op > BC_DIV)) {
+			switch (op) {
+			case BC_ADD: sp[-1] = l + r; break;
+			case BC_SUB: sp[-1] = l - r; break;
+			case BC_MUL: sp[-1] = l * r; break;
+			case BC_DIV: sp[-1] = l / r; break;
+			case BC_LT:  sp[-1] = (l <  r); break;
+			case BC_GT:  sp[-1] = (l >  r); break;
+			case BC_LE:  sp[-1] = (l <= r); break;
+			case BC_GE:  sp[-1] = (l >= r); break;
+			case BC_EQ:  sp[-1] = (l == r); break;
+			case BC_NE:  sp[-1] = (l != r); break;
+			case BC_AND: sp[-1] = (l != 0) & (r != 0); break;
+			case BC_OR:  sp[-1] = (l != 0) | (r != 0); break;
+			default:
+				assert(0); // throw error - range_run: invalid opcode
+				break;
+			}
+			if (!faults) continue;
+			fault = 0;
+		}
+
+		/* Checked */
+		else {
+			fault = 0;
+			if (range_apply(op, l, r, &sp[-1])) {
+				fault = (op != BC_DIV) ? RANGE_FAULT_OVERFLOW : (r == 0) ? RANGE_FAULT_ZERO : RANGE_FAULT_DIV;
+				sp[-1] = 0;
+				if (!faults) {
+					faults = (prog->depth > RANGE_STACK_LOCAL) ? (unsigned char *) calloc(prog->depth, 1) : local_faults;
+					assert(faults); // throw error - range_run: calloc could not do allocation
+					if (faults == local_faults) memset(local_faults, 0, sizeof(local_faults));
+				}
+			}
+			if (!faults) continue;
+		}
+
+		/* Pass faults up. && and || drop a fault on their right when their left decides them. */
+		if (!faults[top] && !(((op == BC_AND) || (op == BC_OR)) && ((l != 0) == (op == BC_OR)))) {
+			faults[top] = rf ? rf : fault;
+		}
+	}
+
+done:
+	if (stack != local) free(stack);
+	if (faults != local_faults) free(faults);
+	return ret;
+}
+
+#ifdef RANGE_TEST_MAIN
+/*
+ * Checks which operations are proven safe, the ranges found, and that
+ * range_run gives the tree evaluator's result on both the fast and the checked path.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DRANGE_TEST_MAIN -o range range.c bytecode.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c funcs.c arena.c -lm
+ */
+#include <stdio.h>
+#include <string.h> // strcmp(), strlen(), strstr()
+
+/**
+ * Expressions of x and y with declared ranges, and what the analysis should find.
+ */
+static struct test_range {
+	char const      *str;      ///< The expression, using only x and y
+	struct exp_range x, y;     ///< Declared ranges
+	size_t           ops;      ///< Operations in the program
+	size_t           unproven; ///< Operations left checked
+	struct exp_range result;   ///< Range of the result
+} test_ranges[] = {
+	{ "x+y",                       {0, 100},      {0, 100},      1, 0, {0, 200} },
+	{ "x*y-3",                     {-1000, 1000}, {-1000, 1000}, 2, 0, {-1000003, 999997} },
+	{ "x/y",                       {0, 100},      {1, 10},       1, 0, {0, 100} },
+	{ "x/y",                       {0, 100},      {-1, 1},       1, 1, {-100, 100} }, // a checked division cannot grow
+	{ "x < y ? x : y*2",           {0, 10},       {0, 10},       3, 0, {0, 20} },
+	{ "(x == y) + (x && y)",       {-5, 5},       {-5, 5},       3, 0, {0, 2} },
+	{ "x*1000000*1000000*1000000", {0, 10},       {0, 0},        3, 1, {SYS_INT_LONG_T_MIN, SYS_INT_LONG_T_MAX} },
+	{ "y == 0 ? 0 : x/y",          {0, 100},      {0, 5},        3, 1, {0, 100} },
+};
+#define TEST_RANGE_COUNT (sizeof(test_ranges) / sizeof(test_ranges[0]))
+
+/* Write str with x and y replaced by their values */
+static void
+test_substitute (char *dst, char const *str, sys_int_long x, sys_int_long y) {
+	for (; *str; str++) {
+		if ((*str == 'x') || (*str == 'y')) {
+			sys_int_long v = (*str == 'x') ? x : y;
+			// no unary minus
+			dst += (v < 0) ? sprintf(dst, "(0-%ld)", -(long) v) : sprintf(dst, "%ld", (long) v);
+		} else {
+			*dst++ = *str;
+		}
+	}
+	*dst = '\0';
+}
+
+int
+main (void) {
+	static char const *const syms[] = { "x", "y" };
+	struct range_program *rprog;
+	struct exp_error err, want_err;
+	expression_t exp;
+	value_t result, want;
+	sys_int_long vars[2];
+	char str[128];
+	size_t i, xi, yi;
+	int bad = 0, cases = 0, ret, want_ret;
+
+	for (i = 0; i < TEST_RANGE_COUNT; i++) {
+		struct test_range const *t = &test_ranges[i];
+		struct exp_range ranges[2];
+		sys_int_long xs[3], ys[3];
+
+		ranges[0] = t->x;
+		ranges[1] = t->y;
+		string_to_expression_r(strlen(t->str), (char *) t->str, &exp, &err);
+		cases++;
+		if (range_compile(exp, 2, syms, ranges, &rprog, &err) != EXP_OK) {
+			printf("FAIL \"%s\": %s\n", t->str, err.msg);
+			bad++;
+			expression_free(exp);
+			continue;
+		}
+		expression_free(exp);
+		if ((rprog->ops != t->ops) || (rprog->unproven != t->unproven)
+		    || (rprog->range.lo != t->result.lo) || (rprog->range.hi != t->result.hi)) {
+			printf("FAIL \"%s\": %lu ops %lu unproven [%ld, %ld], want %lu %lu [%ld, %ld]\n", t->str,
+			       (unsigned long) rprog->ops, (unsigned long) rprog->unproven, (long) rprog->range.lo, (long) rprog->range.hi,
+			       (unsigned long) t->ops, (unsigned long) t->unproven, (long) t->result.lo, (long) t->result.hi);
+			bad++;
+		}
+
+		/* Corners and middle of the declared ranges */
+		xs[0] = t->x.lo; xs[1] = t->x.lo + (t->x.hi - t->x.lo) / 2; xs[2] = t->x.hi;
+		ys[0] = t->y.lo; ys[1] = t->y.lo + (t->y.hi - t->y.lo) / 2; ys[2] = t->y.hi;
+		for (xi = 0; xi < 3; xi++) {
+			for (yi = 0; yi < 3; yi++) {
+				vars[0] = xs[xi];
+				vars[1] = ys[yi];
+				ret = range_run(rprog, vars, &result, &err);
+				cases++;
+				if ((ret != EXP_OK) && strstr(err.msg, "overflow")) {
+					// the tree evaluator does not check for overflow
+					if ((t->unproven == 0) || (result.type != VAL_INF)) {
+						printf("FAIL \"%s\" x=%ld y=%ld: %s\n", t->str, (long) vars[0], (long) vars[1], err.msg);
+						bad++;
+					}
+					continue;
+				}
+				test_substitute(str, t->str, vars[0], vars[1]);
+				string_to_expression_r(strlen(str), str, &exp, &want_err);
+				want_ret = expression_evaluate_r(exp, &want, &want_err);
+				expression_free(exp);
+				if ((ret != want_ret) || !value_equal(result, want) || ((ret != EXP_OK) && strcmp(err.msg, want_err.msg))) {
+					printf("FAIL \"%s\" x=%ld y=%ld: returned %d value %ld, want %d value %ld\n", t->str,
+					       (long) vars[0], (long) vars[1], ret, (long) result.data.lint, want_ret, (long) want.data.lint);
+					bad++;
+				}
+			}
+		}
+
+		/* Values outside the declared ranges are turned away */
+		vars[0] = t->x.hi + 1;
+		vars[1] = t->y.lo;
+		cases++;
+		if (range_run(rprog, vars, &result, &err) == EXP_OK) {
+			printf("FAIL \"%s\": x=%ld outside [%ld, %ld] was run\n", t->str, (long) vars[0], (long) t->x.lo, (long) t->x.hi);
+			bad++;
+		}
+		range_free(rprog);
+	}
+
+	/* Only long int expressions */
+	string_to_expression_r(5, "x+1.5", &exp, &err);
+	cases++;
+	if (range_compile(exp, 2, syms, NULL, &rprog, &err) == EXP_OK) {
+		printf("FAIL \"x+1.5\": was compiled\n");
+		range_free(rprog);
+		bad++;
+	}
+	expression_free(exp);
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef RANGE_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
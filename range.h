@@ -0,0 +1,67 @@
+/**
+ * @file range.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Interval analysis of compiled expressions.
+ *
+ * Every operation is given the range of values its operands can take, from the
+ * program's constants and the declared ranges of its variables. Operations that can
+ * be shown never to overflow or divide by zero run unchecked. Only the rest pay for checks.
+ *
+ * The proofs are only used by @ref range_run. The tree evaluators do not keep them per node:
+ * they never check + - * for overflow, so there is nothing to drop there, and their only
+ * check is the divisor test of '/', which is one compare next to the cost of walking the node.
+ * A proof also needs declared variable ranges, which trees do not have, and would go stale
+ * when @ref expression_simplify rewrites a node in place.
+ */
+#ifndef _RANGE_H_
+#define _RANGE_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "bytecode.h"
+#include "expression_lite.h" // just need pointer expression_t
+
+/**
+ * A closed interval of integers.
+ */
+struct exp_range {
+	sys_int_long lo; ///< Smallest value
+	sys_int_long hi; ///< Largest value
+};
+
+/**
+ * A compiled expression with the operations that need checks marked.
+ */
+struct range_program {
+	struct bc_program *prog;     ///< The compiled expression
+	unsigned char     *checked;  ///< Per instruction, non-zero where the operation is not proven safe
+	struct exp_range  *vars;     ///< Declared range of each variable
+	struct exp_range   range;    ///< Range of the result
+	size_t             ops;      ///< Number of operations
+	size_t             unproven; ///< Number of operations that need checks
+};
+
+int
+range_compile (expression_t exp,
+               size_t nsyms,
+               char const *const *syms,
+               struct exp_range const *ranges,
+               struct range_program **rprog,
+               struct exp_error *err);
+
+void
+range_free (struct range_program *rprog);
+
+int
+range_run (struct range_program const *rprog,
+           sys_int_long const *vars,
+           value_t *result,
+           struct exp_error *err);
+
+#endif /* _RANGE_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
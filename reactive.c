@@ -0,0 +1,576 @@
+/**
+ * @file reactive.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Keeps many expressions up to date as workspace variables change, spreadsheet style.
+ *
+ * Each expression is copied into an array of nodes in post-order, with the root last.
+ * Nodes keep their cached value, a dirty flag and their parent's index.
+ * A dirty node's ancestors are always dirty too, so marking can stop at the first
+ * node that already is, and recomputing only has to descend into dirty children.
+ *
+ * Each variable name keeps the list of symbol nodes that read it. The set watches
+ * the workspace, and a change to a name marks just those nodes and their ancestors.
+ * The cost of a change depends on the number of dependent nodes, not on the number
+ * of expressions.
+ */
+#include <stdlib.h> // malloc(), realloc(), calloc(), free()
+#include <string.h> // strcmp(), strncpy()
+#include "errors.h"
+#include "types.h"
+#include "symbolic.h"
+#include "workspace.h"
+#include "expression.h"
+#include "traverse.h"
+#include "reactive.h"
+
+/// No node, used as the root's parent
+#define REACTIVE_NONE ((size_t) -1)
+
+/**
+ * A node of a live expression.
+ */
+struct reactive_node {
+	value_t       val;    ///< Cached value, valid when not dirty
+	size_t        parent; ///< Index of the parent node or REACTIVE_NONE
+	size_t        left;   ///< Index of the left child, or the variable index for a symbol
+	size_t        right;  ///< Index of the right child
+	char          op;     ///< Operation of a tree node
+	unsigned char type;   ///< The node's @ref expression_type
+	unsigned char dirty;  ///< Non-zero if val must be recomputed
+};
+
+/**
+ * A live expression.
+ */
+struct reactive_formula {
+	struct reactive_node *nodes; ///< Nodes in post-order, root last
+	size_t                count; ///< Number of nodes
+};
+
+/**
+ * A node that reads a variable.
+ */
+struct reactive_dep {
+	size_t formula; ///< Index of the expression
+	size_t node;    ///< Index of the symbol node in it
+};
+
+/**
+ * A variable name used by the live expressions.
+ */
+struct reactive_var {
+	char                 name[SYMBOLIC_NAME_SIZE]; ///< The name
+	struct reactive_dep *deps;       ///< Nodes that read it
+	size_t               ndeps;      ///< Number of deps
+	size_t               size;       ///< Number of deps that fit
+	value_t const       *data;       ///< Workspace value, valid at generation
+	unsigned long        generation; ///< Workspace generation data was looked up at or 0
+};
+
+struct exp_reactive {
+	struct reactive_formula *formulas;  ///< Live expressions, indexed by id
+	size_t                   nformulas; ///< Number of formulas
+	size_t                   fsize;     ///< Number of formulas that fit
+	struct reactive_var     *vars;      ///< Variables
+	size_t                   nvars;     ///< Number of vars
+	size_t                   vsize;     ///< Number of vars that fit
+	size_t                  *slots;     ///< Hash of names to var index + 1, or 0 if empty
+	size_t                   nslots;    ///< Number of slots, a power of two
+	size_t                  *stack;     ///< Scratch stack of node indices
+	size_t                   ssize;     ///< Number of indices that fit in stack
+	unsigned long            recomputed; ///< Node values computed so far
+};
+
+/* Grow an array to hold at least need elements */
+static void *
+grow (void *array, size_t *size, size_t need, size_t elem) {
+	if (need <= *size) return array;
+	while (*size < need) *size = *size ? (*size * 2) : 16;
+	array = realloc(array, *size * elem);
+	assert(array); // throw error - grow: realloc could not do allocation
+	return array;
+}
+
+static size_t
+name_hash (char const *name) {
+	size_t h = (size_t) 2166136261UL;
+	while (*name) {
+		h ^= (unsigned char) *name++;
+		h *= (size_t) 16777619UL;
+	}
+	return h;
+}
+
+/** Find a variable by name.
+ * @param add Non-zero to add the variable if it is not there yet.
+ * @return The variable index or REACTIVE_NONE.
+ */
+static size_t
+var_find (struct exp_reactive *r, char const *name, int add) {
+	size_t i, v;
+
+	for (i = name_hash(name) & (r->nslots - 1); r->slots[i]; i = (i + 1) & (r->nslots - 1)) {
+		if (strcmp(r->vars[r->slots[i] - 1].name, name) == 0) return r->slots[i] - 1;
+	}
+	if (!add) return REACTIVE_NONE;
+
+	v = r->nvars++;
+	r->vars = (struct reactive_var *) grow(r->vars, &r->vsize, r->nvars, sizeof(struct reactive_var));
+	strncpy(r->vars[v].name, name, SYMBOLIC_NAME_SIZE);
+	r->vars[v].deps       = NULL;
+	r->vars[v].ndeps      = 0;
+	r->vars[v].size       = 0;
+	r->vars[v].data       = NULL;
+	r->vars[v].generation = 0;
+	r->slots[i] = v + 1;
+
+	/* Keep the hash at most half full */
+	if (2 * r->nvars > r->nslots) {
+		size_t nslots = r->nslots * 2;
+		size_t *slots = (size_t *) calloc(nslots, sizeof(size_t));
+		assert(slots); // throw error - var_find: calloc could not do allocation
+		for (i = 0; i < r->nvars; i++) {
+			size_t j = name_hash(r->vars[i].name) & (nslots - 1);
+			while (slots[j]) j = (j + 1) & (nslots - 1);
+			slots[j] = i + 1;
+		}
+		free(r->slots);
+		r->slots  = slots;
+		r->nslots = nslots;
+	}
+	return v;
+}
+
+/* Mark a node and its ancestors dirty */
+static void
+mark_dirty (struct reactive_formula *f, size_t node) {
+	while ((node != REACTIVE_NONE) && !f->nodes[node].dirty) {
+		f->nodes[node].dirty = 1;
+		node = f->nodes[node].parent;
+	}
+}
+
+/* Workspace watcher */
+static void
+reactive_changed (char const *name, void *ctx) {
+	struct exp_reactive *r = (struct exp_reactive *) ctx;
+	size_t v, i;
+
+	if (name == NULL) {
+		// everything may have changed
+		for (i = 0; i < r->nformulas; i++) {
+			size_t n;
+			for (n = 0; n < r->formulas[i].count; n++) r->formulas[i].nodes[n].dirty = 1;
+		}
+		return;
+	}
+
+	if ((v = var_find(r, name, 0)) == REACTIVE_NONE) return;
+	for (i = 0; i < r->vars[v].ndeps; i++) {
+		struct reactive_dep *d = &r->vars[v].deps[i];
+		mark_dirty(&r->formulas[d->formula], d->node);
+	}
+}
+
+/** Create an empty set of live expressions.
+ * The set watches the workspace until it is freed.
+ * @return The new set, or NULL if the workspace already has WORKSPACE_WATCHERS watchers.
+ */
+struct exp_reactive *
+exp_reactive_new (void) {
+	struct exp_reactive *r = (struct exp_reactive *) calloc(1, sizeof(struct exp_reactive));
+	assert(r); // throw error - exp_reactive_new: calloc could not do allocation
+
+	r->nslots = 16;
+	r->slots  = (size_t *) calloc(r->nslots, sizeof(size_t));
+	assert(r->slots); // throw error - exp_reactive_new: calloc could not do allocation
+
+	if (workspace_watch(reactive_changed, r) != WORKSPACE_OK) {
+		free(r->slots);
+		free(r);
+		return NULL;
+	}
+	return r;
+}
+
+/** Free a set of live expressions.
+ */
+void
+exp_reactive_free (struct exp_reactive *r) {
+	size_t i;
+	if (r == NULL) return;
+	workspace_unwatch(reactive_changed, r);
+	for (i = 0; i < r->nformulas; i++) free(r->formulas[i].nodes);
+	for (i = 0; i < r->nvars; i++) free(r->vars[i].deps);
+	free(r->formulas);
+	free(r->vars);
+	free(r->slots);
+	free(r->stack);
+	free(r);
+}
+
+/** Add an expression to the set.
+ * The expression is copied, so the caller keeps it.
+ * @param exp The expression. Symbols must not have parameters.
+ * @param[out] id Set to the id to read the expression's value with.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+exp_reactive_add (struct exp_reactive *r,
+                  expression_t exp,
+                  size_t *id,
+                  struct exp_error *err) {
+	struct reactive_formula *f;
+	struct reactive_node *nodes;
+	struct exp_walk w;
+	expression_t node;
+	size_t count = 0, depth = 0, n;
+
+	assert(r);
+	assert(exp);
+	assert(id);
+	exp_error_clear(err);
+
+	/* Size up and check */
+	exp_walk_init(&w, exp);
+	while ((node = exp_walk_next_post(&w)) != NULL) {
+		if ((node->type == EXP_SYMBOLIC) && node->data.sym.p) {
+			exp_walk_free(&w);
+			return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - Symbol parameters are not supported in \"%s\"", node->data.sym.name);
+		}
+		count++;
+	}
+	exp_walk_free(&w);
+
+	nodes = (struct reactive_node *) malloc(count * sizeof(struct reactive_node));
+	assert(nodes); // throw error - exp_reactive_add: malloc could not do allocation
+	r->stack = (size_t *) grow(r->stack, &r->ssize, count, sizeof(size_t));
+	r->formulas = (struct reactive_formula *) grow(r->formulas, &r->fsize, r->nformulas + 1, sizeof(struct reactive_formula));
+	*id = r->nformulas;
+
+	/* Copy in post-order. Finished subtrees wait on the stack for their parent. */
+	n = 0;
+	exp_walk_init(&w, exp);
+	while ((node = exp_walk_next_post(&w)) != NULL) {
+		struct reactive_node *rn = &nodes[n];
+		rn->type   = (unsigned char) node->type;
+		rn->dirty  = 1;
+		rn->parent = REACTIVE_NONE;
+		rn->op     = 0;
+		rn->left   = rn->right = REACTIVE_NONE;
+		rn->val    = value_new_type(VAL_UNDEF);
+
+		if (node->type == EXP_VALUE) {
+			rn->val = node->data.val;
+		} else if (node->type == EXP_SYMBOLIC) {
+			struct reactive_var *var;
+			rn->left = var_find(r, node->data.sym.name, 1);
+			var = &r->vars[rn->left];
+			var->deps = (struct reactive_dep *) grow(var->deps, &var->size, var->ndeps + 1, sizeof(struct reactive_dep));
+			var->deps[var->ndeps].formula = *id;
+			var->deps[var->ndeps].node    = n;
+			var->ndeps++;
+		} else {
+			rn->op    = node->data.tree.op;
+			rn->right = r->stack[--depth];
+			rn->left  = r->stack[--depth];
+			nodes[rn->left].parent  = n;
+			nodes[rn->right].parent = n;
+		}
+		r->stack[depth++] = n++;
+	}
+	exp_walk_free(&w);
+	assert(depth == 1);
+
+	f = &r->formulas[r->nformulas++];
+	f->nodes = nodes;
+	f->count = count;
+	return EXP_OK;
+}
+
+/* True if rn is a select, a '?' node whose right child is the ':' node of its arms */
+static int
+is_select (struct reactive_formula const *f, struct reactive_node const *rn) {
+	return (rn->type == EXP_TREE) && (rn->op == '?')
+	    && (f->nodes[rn->right].type == EXP_TREE) && (f->nodes[rn->right].op == ':');
+}
+
+/* Compute a node whose children are up to date.
+ * Errors become VAL_ERROR, VAL_INF or VAL_UNDEF values that pass up like with
+ * @ref exp_held_operate. A select picks from its arms, so an error in the arm it
+ * does not take is dropped. Its ':' node has no value of its own. */
+static void
+compute_node (struct exp_reactive *r, struct reactive_formula *f, struct reactive_node *rn) {
+	if (rn->type == EXP_SYMBOLIC) {
+		struct reactive_var *var = &r->vars[rn->left];
+		if (var->generation != workspace_generation()) {
+			void *data = workspace_get(var->name);
+			var->data = ((data == WORKSPACE_NOTSET) || (data == NULL)) ? NULL : (value_t const *) data;
+			var->generation = workspace_generation();
+		}
+		rn->val = var->data ? *var->data : value_new_type(VAL_UNDEF);
+	} else if (rn->type == EXP_TREE) {
+		value_t left_val  = f->nodes[rn->left].val;
+		value_t right_val = f->nodes[rn->right].val;
+		if ((rn->parent != REACTIVE_NONE) && is_select(f, &f->nodes[rn->parent])
+		    && (&f->nodes[f->nodes[rn->parent].right] == rn)) {
+			rn->val = value_new_type(VAL_UNDEF); // the arms, read directly by the select
+		} else if (is_select(f, rn)) {
+			struct reactive_node const *arms = &f->nodes[rn->right];
+			rn->val = expression_select(left_val, f->nodes[arms->left].val, f->nodes[arms->right].val);
+		} else {
+			rn->val = exp_held_operate(NULL, rn->op, left_val, right_val);
+		}
+	}
+	rn->dirty = 0;
+	r->recomputed++;
+}
+
+/** Report the error behind a root value that is not a number.
+ * Follows the error down from the root, the way it came up: through a select's
+ * condition or taken arm, and otherwise through the first child that is not a number,
+ * to the node where the error started.
+ * @return The error code
+ */
+static int
+formula_error (struct exp_reactive *r, struct reactive_formula *f, struct exp_error *err) {
+	struct reactive_node *rn = &f->nodes[f->count - 1];
+
+	while (rn->type == EXP_TREE) {
+		struct reactive_node *left  = &f->nodes[rn->left];
+		struct reactive_node *right = &f->nodes[rn->right];
+		if (is_select(f, rn) && VAL_IS_NUMBER(left->val)) {
+			int truth = (left->val.type == VAL_DOUBLE) ? (left->val.data.dbl != 0.0) : (left->val.data.lint != 0);
+			rn = &f->nodes[truth ? right->left : right->right];
+		} else if (!VAL_IS_NUMBER(left->val)) {
+			rn = left;
+		} else if (!VAL_IS_NUMBER(right->val)) {
+			rn = right;
+		} else {
+			value_t val;
+			return expression_operate_r(rn->op, left->val, right->val, &val, err);
+		}
+	}
+	if (rn->type == EXP_SYMBOLIC) {
+		struct reactive_var *var = &r->vars[rn->left];
+		if (var->data == NULL) {
+			return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - \"%s\" is not set", var->name);
+		}
+		return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Symbol \"%s\" is not a number", var->name);
+	}
+	return exp_error_set(err, EXP_EEVAL, 0, "Evaluation Error - Value is not a number");
+}
+
+/** Read the current value of an expression in the set.
+ * Only nodes affected by workspace changes since the last read are recomputed.
+ * @param id The id from @ref exp_reactive_add.
+ * @param[out] result Set to the value.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+exp_reactive_get (struct exp_reactive *r,
+                  size_t id,
+                  value_t *result,
+                  struct exp_error *err) {
+	struct reactive_formula *f;
+	size_t depth = 0;
+
+	assert(r);
+	assert(id < r->nformulas);
+	assert(result);
+	exp_error_clear(err);
+
+	f = &r->formulas[id];
+	if (f->nodes[f->count - 1].dirty) {
+		/* Depth first through dirty nodes only */
+		r->stack[depth++] = f->count - 1;
+		while (depth) {
+			struct reactive_node *rn = &f->nodes[r->stack[depth - 1]];
+			if (rn->type == EXP_TREE) {
+				if (f->nodes[rn->left].dirty) {
+					r->stack[depth++] = rn->left;
+					continue;
+				}
+				if (f->nodes[rn->right].dirty) {
+					r->stack[depth++] = rn->right;
+					continue;
+				}
+			}
+			compute_node(r, f, rn);
+			depth--;
+		}
+	}
+
+	*result = f->nodes[f->count - 1].val;
+	if (!VAL_IS_NUMBER(*result)) {
+		return formula_error(r, f, err);
+	}
+	return EXP_OK;
+}
+
+/** Get counters for a set of live expressions.
+ */
+void
+exp_reactive_stats (struct exp_reactive const *r,
+                    struct exp_reactive_stats *stats) {
+	assert(r);
+	assert(stats);
+	stats->formulas   = r->nformulas;
+	stats->variables  = r->nvars;
+	stats->recomputed = r->recomputed;
+}
+
+#ifdef REACTIVE_TEST_MAIN
+/*
+ * Checks that workspace changes dirty only the nodes that depend on them,
+ * and that reads give the new values.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DREACTIVE_TEST_MAIN -o reactive reactive.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c funcs.c arena.c -lm
+ */
+#include <stdio.h>
+#include <string.h> // strlen()
+
+/// The live expressions
+static char const *const test_formulas[] = {
+	"a+b",
+	"a*2+c",
+	"b-1",
+	"c == 0 ? 0 : 10/c",
+};
+#define TEST_FORMULAS (sizeof(test_formulas) / sizeof(test_formulas[0]))
+
+static int cases, bad;
+
+/* Read every formula, checking each result and how many nodes were recomputed */
+static void
+test_read (struct exp_reactive *r, char const *what, int const want_ret[], sys_int_long const want[], unsigned long const want_recomputed[]) {
+	struct exp_reactive_stats stats;
+	struct exp_error err;
+	unsigned long before;
+	value_t result;
+	size_t id;
+	int ret;
+
+	for (id = 0; id < TEST_FORMULAS; id++) {
+		exp_reactive_stats(r, &stats);
+		before = stats.recomputed;
+		ret = exp_reactive_get(r, id, &result, &err);
+		exp_reactive_stats(r, &stats);
+		cases++;
+		if (ret != want_ret[id]) {
+			printf("FAIL %s, \"%s\": returned %d, want %d (%s)\n", what, test_formulas[id], ret, want_ret[id], err.msg);
+			bad++;
+		} else if ((ret == EXP_OK) && ((result.type != VAL_LINT) || (result.data.lint != want[id]))) {
+			printf("FAIL %s, \"%s\": got %ld, want %ld\n", what, test_formulas[id], (long) result.data.lint, (long) want[id]);
+			bad++;
+		} else if (stats.recomputed - before != want_recomputed[id]) {
+			printf("FAIL %s, \"%s\": recomputed %lu nodes, want %lu\n", what, test_formulas[id], stats.recomputed - before, want_recomputed[id]);
+			bad++;
+		}
+	}
+}
+
+int
+main (void) {
+	value_t a = value_new_lint(1), b = value_new_lint(2), c = value_new_lint(5);
+	value_t a2 = value_new_lint(10), z = value_new_lint(7);
+	struct exp_reactive *r;
+	struct exp_reactive_stats stats;
+	struct exp_error err;
+	expression_t exp;
+	size_t id, i;
+
+	workspace_init();
+	workspace_set("a", &a);
+	workspace_set("b", &b);
+	workspace_set("c", &c);
+
+	r = exp_reactive_new();
+	for (i = 0; i < TEST_FORMULAS; i++) {
+		string_to_expression_r(strlen(test_formulas[i]), (char *) test_formulas[i], &exp, &err);
+		exp_reactive_add(r, exp, &id, &err);
+		expression_free(exp);
+		assert(id == i);
+	}
+
+	/* Symbol parameters are turned away */
+	string_to_expression_r(4, "f(1)", &exp, &err);
+	cases++;
+	if (exp_reactive_add(r, exp, &id, &err) != EXP_ESYMBOL) {
+		printf("FAIL f(1): was added\n");
+		bad++;
+	}
+	expression_free(exp);
+
+	{
+		int const ret[]            = { EXP_OK, EXP_OK, EXP_OK, EXP_OK };
+		sys_int_long const want[]  = { 3, 7, 1, 2 };
+		unsigned long const all[]  = { 3, 5, 3, 9 };
+		unsigned long const none[] = { 0, 0, 0, 0 };
+		test_read(r, "first read", ret, want, all);
+		test_read(r, "second read", ret, want, none);
+	}
+	{
+		// a symbol and the nodes above it
+		int const ret[]            = { EXP_OK, EXP_OK, EXP_OK, EXP_OK };
+		sys_int_long const want[]  = { 12, 25, 1, 2 };
+		unsigned long const some[] = { 2, 3, 0, 0 };
+		unsigned long const none[] = { 0, 0, 0, 0 };
+		workspace_set("a", &a2);
+		test_read(r, "a set", ret, want, some);
+		workspace_set("z", &z);
+		test_read(r, "z set", ret, want, none);
+	}
+	{
+		// both of the select's reads of c, with the error in the untaken arm dropped
+		int const ret[]            = { EXP_OK, EXP_OK, EXP_OK, EXP_OK };
+		sys_int_long const zero[]  = { 12, 20, 1, 0 };
+		sys_int_long const two[]   = { 12, 22, 1, 5 };
+		unsigned long const some[] = { 0, 2, 0, 6 };
+		unsigned long const none[] = { 0, 0, 0, 0 };
+		c.data.lint = 0;
+		workspace_set("c", &c);
+		test_read(r, "c zero", ret, zero, some);
+		c.data.lint = 2;
+		test_read(r, "c changed in place", ret, zero, none);
+		workspace_set("c", &c);
+		test_read(r, "c set again", ret, two, some);
+	}
+	{
+		int const ret[]            = { EXP_ESYMBOL, EXP_OK, EXP_ESYMBOL, EXP_OK };
+		sys_int_long const want[]  = { 0, 22, 0, 5 };
+		unsigned long const some[] = { 2, 0, 2, 0 };
+		workspace_unset("b");
+		test_read(r, "b unset", ret, want, some);
+	}
+	{
+		int const ret[]            = { EXP_ESYMBOL, EXP_ESYMBOL, EXP_ESYMBOL, EXP_ESYMBOL };
+		sys_int_long const want[]  = { 0, 0, 0, 0 };
+		unsigned long const all[]  = { 3, 5, 3, 9 };
+		// every node, since any name may have changed
+		workspace_init();
+		test_read(r, "workspace cleared", ret, want, all);
+	}
+
+	exp_reactive_stats(r, &stats);
+	cases++;
+	if ((stats.formulas != TEST_FORMULAS) || (stats.variables != 3)) {
+		printf("FAIL stats: %lu formulas and %lu variables, want %lu and 3\n",
+		       (unsigned long) stats.formulas, (unsigned long) stats.variables, (unsigned long) TEST_FORMULAS);
+		bad++;
+	}
+	exp_reactive_free(r);
+
+	printf("%d cases, %d failures\n", cases, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef REACTIVE_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,60 @@
+/**
+ * @file reactive.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Keeps many expressions up to date as workspace variables change, spreadsheet style.
+ * Every node's value is cached. Setting a variable marks only the nodes that depend
+ * on it as dirty, and reading an expression recomputes only its dirty nodes.
+ *
+ * Variables are read from the workspace, whose entries must hold a pointer to a @ref value_t.
+ * Changing a value in place is not seen until the entry is set again with @ref workspace_set.
+ */
+#ifndef _REACTIVE_H_
+#define _REACTIVE_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "expression_lite.h" // just need pointer expression_t
+
+/**
+ * A set of live expressions.
+ */
+struct exp_reactive;
+
+/**
+ * Counters for a set of live expressions.
+ */
+struct exp_reactive_stats {
+	size_t        formulas;   ///< Number of expressions added
+	size_t        variables;  ///< Number of distinct variable names used
+	unsigned long recomputed; ///< Number of node values computed so far
+};
+
+struct exp_reactive *
+exp_reactive_new (void);
+
+void
+exp_reactive_free (struct exp_reactive *r);
+
+int
+exp_reactive_add (struct exp_reactive *r,
+                  expression_t exp,
+                  size_t *id,
+                  struct exp_error *err);
+
+int
+exp_reactive_get (struct exp_reactive *r,
+                  size_t id,
+                  value_t *result,
+                  struct exp_error *err);
+
+void
+exp_reactive_stats (struct exp_reactive const *r,
+                    struct exp_reactive_stats *stats);
+
+#endif /* _REACTIVE_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,590 @@
+/**
+ * @file reparse.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Incremental reparsing of edited expression strings.
+ */
+#include <stdlib.h> // realloc(), free()
+#include <string.h> // memmove(), memcpy()
+#include "errors.h"
+#include "types.h"
+#include "scan.h"
+#include "token.h"
+#include "expression.h"
+#include "reparse.h"
+
+/// Number of spans to allocate the first time a span array grows
+#define EXP_SPANS_INIT_SIZE 8
+
+/** Empty a span array, keeping its memory, to record the groups of a parse.
+ * @param mark Index the first group's gap is counted from.
+ */
+static void
+exp_spans_clear (struct exp_spans *spans, pindex_t mark) {
+	spans->count = 0;
+	spans->first = EXP_SPAN_NONE;
+	spans->free  = EXP_SPAN_NONE;
+	spans->mark  = mark;
+	spans->last  = EXP_SPAN_NONE;
+}
+
+/** Initialize an empty span array.
+ * @param spans The spans to initialize.
+ */
+void
+exp_spans_init (struct exp_spans *spans) {
+	assert(spans);
+	spans->spans = NULL;
+	spans->size  = 0;
+	exp_spans_clear(spans, 0);
+}
+
+/** Free a span array.
+ * The array is left empty and may be reused.
+ * @param spans The spans to free.
+ */
+void
+exp_spans_free (struct exp_spans *spans) {
+	assert(spans);
+	free(spans->spans);
+	exp_spans_init(spans);
+}
+
+/** Make room for count spans.
+ */
+static void
+exp_spans_reserve (struct exp_spans *spans, size_t count) {
+	size_t size = spans->size ? spans->size : EXP_SPANS_INIT_SIZE;
+
+	if (count <= spans->size) return;
+	while (size < count) size *= 2;
+	spans->spans = (struct exp_span *) realloc(spans->spans, size * sizeof(struct exp_span));
+	assert(spans->spans); // throw error - exp_spans_reserve: realloc could not do allocation
+	spans->size = size;
+}
+
+/** Take an unused span, a freed one if there is one.
+ * @return Index of the span. Its fields are not set.
+ */
+static size_t
+exp_spans_take (struct exp_spans *spans) {
+	size_t i = spans->free;
+
+	if (i != EXP_SPAN_NONE) {
+		spans->free = spans->spans[i].next;
+		return i;
+	}
+	exp_spans_reserve(spans, spans->count + 1);
+	return spans->count++;
+}
+
+/** Free every group nested in a group, leaving it with none.
+ * Walks down to each group with nothing nested left and frees it, so no stack is needed.
+ */
+static void
+exp_spans_release (struct exp_spans *spans, size_t group) {
+	size_t i = spans->spans[group].child;
+
+	spans->spans[group].child = EXP_SPAN_NONE;
+	while (i != EXP_SPAN_NONE) {
+		struct exp_span *span = &spans->spans[i];
+		size_t up = span->parent;
+		size_t next = span->next;
+
+		if (span->child != EXP_SPAN_NONE) {
+			// free the nested groups first, then come back for this one
+			i = span->child;
+			span->child = EXP_SPAN_NONE;
+			continue;
+		}
+		span->next  = spans->free;
+		spans->free = i;
+		i = (next != EXP_SPAN_NONE) ? next : ((up != group) ? up : EXP_SPAN_NONE);
+	}
+}
+
+/** Add a group whose open paren was just found.
+ * The parser calls @ref exp_spans_close once the group is done.
+ * @param spans The spans to add to.
+ * @param open Index of the group's '('
+ * @param parent Index of the enclosing group's span or EXP_SPAN_NONE.
+ * @return Index of the new span.
+ */
+size_t
+exp_spans_open (struct exp_spans *spans,
+                pindex_t open,
+                size_t parent) {
+	struct exp_span *span;
+	size_t i;
+
+	assert(spans);
+	assert(open >= spans->mark);
+	i = exp_spans_take(spans);
+
+	// the last paren was the ')' of the group before this one, or the '(' of its parent
+	if (spans->last != EXP_SPAN_NONE) spans->spans[spans->last].next = i;
+	else if (parent != EXP_SPAN_NONE) spans->spans[parent].child = i;
+	else spans->first = i;
+
+	span = &spans->spans[i];
+	span->gap    = open - spans->mark;
+	span->len    = open; // until the group closes
+	span->parent = parent;
+	span->child  = EXP_SPAN_NONE;
+	span->next   = EXP_SPAN_NONE;
+	span->exp    = NULL;
+
+	spans->mark = open;
+	spans->last = EXP_SPAN_NONE;
+	return i;
+}
+
+/** Finish a group whose close paren was just found.
+ * @param spans The spans the group was added to.
+ * @param group Index of the group's span, from @ref exp_spans_open.
+ * @param close Index of the group's ')'
+ * @param exp The node the inside of the group became
+ */
+void
+exp_spans_close (struct exp_spans *spans,
+                 size_t group,
+                 pindex_t close,
+                 expression_t exp) {
+	struct exp_span *span;
+
+	assert(spans);
+	assert(group < spans->count);
+	span = &spans->spans[group];
+	assert(close > span->len);
+	span->len = close - span->len;
+	span->exp = exp;
+
+	spans->mark = close;
+	spans->last = group;
+}
+
+/** Convert String to an Expression, recording its parenthesized groups.
+ * Same as @ref string_to_expression_r, but also fills in spans for later use by @ref expression_reparse_r.
+ * @param str_len Length of given string
+ * @param str String to parse
+ * @param[out] exp Set to the expression_t representation of the string, or NULL on error
+ * @param[out] spans Set to the groups of the string. Must have been initialized. Emptied on error.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ */
+int
+string_to_expression_spans_r (size_t str_len,
+                              char const *str,
+                              expression_t *exp,
+                              struct exp_spans *spans,
+                              struct exp_error *err) {
+	struct token_list list;
+	int ret;
+
+	assert(spans);
+	exp_spans_clear(spans, 0);
+
+	token_list_init(&list);
+	string_to_tokens(str_len, str, &list);
+	ret = tokens_to_expression_spans_r(str, &list, 0, exp, spans, err);
+	token_list_free(&list);
+
+	if (ret != EXP_OK) exp_spans_clear(spans, 0);
+	return ret;
+}
+
+/** Find the innermost group that holds a range of the string.
+ * The range must be inside the parens, not on them.
+ * Walks down from the groups not inside another, adding up gaps to place each group
+ * it passes, until no group at that depth holds the range.
+ * @param[out] open Set to the index of the group's '('
+ * @param[out] close Set to the index of the group's ')'
+ * @return Index of the group's span or EXP_SPAN_NONE.
+ */
+static size_t
+exp_spans_find (struct exp_spans const *spans, pindex_t start, pindex_t end, pindex_t *open, pindex_t *close) {
+	size_t g = EXP_SPAN_NONE;
+	size_t i = spans->first;
+	pindex_t mark = 0;
+
+	while (i != EXP_SPAN_NONE) {
+		struct exp_span const *span = &spans->spans[i];
+		pindex_t o = mark + span->gap;
+		pindex_t c = o + span->len;
+
+		if (o >= start) break; // this and later groups open too late
+		if (c < end) {
+			// ends before the range does, try the next group
+			mark = c;
+			i = span->next;
+			continue;
+		}
+		g = i;
+		*open  = o;
+		*close = c;
+		mark = o;
+		i = span->child;
+	}
+	return g;
+}
+
+/** Reparse a whole string, replacing exp and spans only on success.
+ */
+static int
+reparse_full (expression_t *exp,
+              struct exp_spans *spans,
+              size_t new_len,
+              char const *new_str,
+              struct exp_error *err) {
+	struct exp_spans fresh;
+	expression_t fresh_exp;
+	int ret;
+
+	exp_spans_init(&fresh);
+	if ((ret = string_to_expression_spans_r(new_len, new_str, &fresh_exp, &fresh, err)) != EXP_OK) {
+		exp_spans_free(&fresh);
+		return ret;
+	}
+
+	if (*exp) expression_free(*exp);
+	*exp = fresh_exp;
+	exp_spans_free(spans);
+	*spans = fresh;
+	return EXP_OK;
+}
+
+/** Reparse an Expression after an edit to its string.
+ * Finds the innermost parenthesized group that holds the edited range and
+ * reparses just the new text inside that group. The result replaces the group's
+ * node in place, so every node outside the group, and the root pointer, are kept.
+ * The spans are updated to match the new string.
+ *
+ * If no group holds the edit, or the group's new text does not parse on its own,
+ * the whole new string is parsed instead. New text with an invalid char or parens that
+ * do not balance is caught by @ref scan_structure before it is tokenized. If that fails too, exp and spans are left
+ * as they were and the error is returned.
+ *
+ * @param[in,out] exp The expression parsed from old_str. Set to the expression for new_str.
+ * @param[in,out] spans The spans recorded for old_str. Updated for new_str.
+ * @param old_len Length of the old string
+ * @param old_str The old string
+ * @param new_len Length of the new string
+ * @param new_str The new string
+ * @param edit_start Index of the first changed char. The same in both strings.
+ * @param edit_old_len Number of chars that were replaced in the old string
+ * @param edit_new_len Number of chars that replaced them in the new string
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ * @warning exp must have come from @ref string_to_expression_spans_r or an earlier reparse.
+ */
+int
+expression_reparse_r (expression_t *exp,
+                      struct exp_spans *spans,
+                      size_t old_len,
+                      char const *old_str,
+                      size_t new_len,
+                      char const *new_str,
+                      pindex_t edit_start,
+                      pcount_t edit_old_len,
+                      pcount_t edit_new_len,
+                      struct exp_error *err) {
+	struct token_list list;
+	struct exp_spans inner;
+	struct scan_result scan;
+	expression_t node, fresh;
+	struct expression swap;
+	pindex_t open, close;
+	pindex_t cstart, cend; // inside of the group in new_str
+	size_t g, i, ancestor;
+	size_t *slots;
+	long delta;
+
+	assert(exp && *exp);
+	assert(spans);
+	assert(old_str && new_str);
+	assert(edit_start + edit_old_len <= old_len);
+	assert(edit_start + edit_new_len <= new_len);
+	assert(old_len - edit_old_len == new_len - edit_new_len);
+	(void) old_str;
+
+	delta = (long) edit_new_len - (long) edit_old_len;
+
+	/* Find the group to reparse */
+	g = exp_spans_find(spans, edit_start, edit_start + edit_old_len, &open, &close);
+	if (g == EXP_SPAN_NONE) {
+		return reparse_full(exp, spans, new_len, new_str, err);
+	}
+	cstart = open + 1;
+	cend   = (pindex_t) ((long) close + delta);
+	assert(new_str[cstart - 1] == '(');
+	assert(new_str[cend] == ')');
+
+	/* Text with an invalid char or unbalanced parens cannot parse as the group on its own.
+	 * An edit that unbalances them moves the group's close paren, which only a full parse can place. */
+	scan_structure(cend - cstart, &new_str[cstart], &scan);
+	if ((scan.invalid != PINDEX_BAD) || (scan.unmatched != PINDEX_BAD) || (scan.depth != 0)) {
+		return reparse_full(exp, spans, new_len, new_str, err);
+	}
+
+	/* Parse the inside of the group on its own, placing its groups from the group's '(' */
+	exp_spans_init(&inner);
+	exp_spans_clear(&inner, open);
+	token_list_init(&list);
+	string_to_tokens(cend - cstart, &new_str[cstart], &list);
+	if (tokens_to_expression_spans_r(&new_str[cstart], &list, cstart, &fresh, &inner, NULL) != EXP_OK) {
+		// let a full parse find the real problem, or handle edits that move parens around
+		token_list_free(&list);
+		exp_spans_free(&inner);
+		return reparse_full(exp, spans, new_len, new_str, err);
+	}
+	token_list_free(&list);
+	exp_error_clear(err);
+
+	/* Replace the group's nested groups, reusing the spans of the old ones */
+	node = spans->spans[g].exp;
+	exp_spans_release(spans, g);
+	slots = (size_t *) malloc((inner.count + 1) * sizeof(size_t));
+	assert(slots); // throw error - expression_reparse_r: malloc could not do allocation
+	for (i = 0; i < inner.count; i++) {
+		slots[i] = exp_spans_take(spans);
+	}
+	#define REPARSE_SLOT(j) (((j) == EXP_SPAN_NONE) ? EXP_SPAN_NONE : slots[j])
+	for (i = 0; i < inner.count; i++) {
+		struct exp_span *span = &spans->spans[slots[i]];
+		*span = inner.spans[i];
+		span->parent = (span->parent == EXP_SPAN_NONE) ? g : slots[span->parent];
+		span->child  = REPARSE_SLOT(span->child);
+		span->next   = REPARSE_SLOT(span->next);
+		// the group's top node is about to move into the old node
+		if (span->exp == fresh) span->exp = node;
+	}
+	spans->spans[g].child = REPARSE_SLOT(inner.first);
+	#undef REPARSE_SLOT
+	free(slots);
+	exp_spans_free(&inner);
+
+	/* Swap the new contents into the group's node, then free the old contents.
+	 * Each node keeps its own owners. */
+	swap  = *node;
+	*node = *fresh;
+	*fresh = swap;
+	node->refs  = swap.refs;
+	fresh->refs = 1;
+	expression_free(fresh);
+
+	/* The group and every group around it are delta chars longer.
+	 * Every other group is placed from a paren that did not move, so it is left alone. */
+	for (ancestor = g; ancestor != EXP_SPAN_NONE; ancestor = spans->spans[ancestor].parent) {
+		spans->spans[ancestor].len = (pcount_t) ((long) spans->spans[ancestor].len + delta);
+	}
+
+	return EXP_OK;
+}
+
+#ifdef REPARSE_TEST_MAIN
+/*
+ * Checks that reparsing an edit gives the same tree and groups as parsing the new string,
+ * and that edits inside a group keep the nodes around it.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DREPARSE_TEST_MAIN -o reparse reparse.c expression.c token.c symbolic.c scan.c types.c traverse.c workspace.c errors.c arena.c simplify.c
+ */
+#include <stdio.h>
+#include <string.h>
+#include "simplify.h" // expression_equal()
+
+/**
+ * An edit of a string.
+ */
+struct test_edit {
+	char const *old;      ///< String before the edit
+	pindex_t    start;    ///< Index of the first replaced char
+	pcount_t    old_len;  ///< Number of chars replaced
+	char const *text;     ///< Text put in their place
+	int         in_place; ///< Non-zero if only the group around the edit must be reparsed
+};
+
+static struct test_edit const test_edits[] = {
+	{"(x+y)*2",        2, 1, "-",     1},
+	{"((a+b)*c)+d",    4, 1, "bb",    1},
+	{"((a+b)*c)+d",    7, 1, "(c+1)", 1},
+	{"f(x, (y+1))",    8, 1, "2.5",   1},
+	{"(x < 1) ? 2 : 3", 3, 1, ">=",   1},
+	{"(a)+((b)+(c))+(d)", 6, 1, "b*(e)", 1}, // groups after the edit stay where they were
+	{"((a+(b))*c)+(d)", 3, 4, "",     1}, // a nested group is dropped
+	{"(x+y)*2",        2, 1, ")+(",   0}, // the group's close paren moves
+	{"((x)+y)",        2, 1, "x)+(1", 0}, // the inner group's text is unbalanced
+	{"x+y",            0, 1, "z",     0}, // no group around the edit
+	{"(x+y)*2",        0, 7, "1",     0}, // the group itself is replaced
+};
+
+#define TEST_COUNT (sizeof(test_edits) / sizeof(test_edits[0]))
+
+/* Compare the groups chained from a and b, and the groups nested in them */
+static int
+test_groups_equal (struct exp_spans const *a, size_t ia, struct exp_spans const *b, size_t ib) {
+	while ((ia != EXP_SPAN_NONE) && (ib != EXP_SPAN_NONE)) {
+		struct exp_span const *sa = &a->spans[ia];
+		struct exp_span const *sb = &b->spans[ib];
+
+		if ((sa->gap != sb->gap) || (sa->len != sb->len)) return 0;
+		if (!expression_equal(sa->exp, sb->exp)) return 0;
+		if (!test_groups_equal(a, sa->child, b, sb->child)) return 0;
+		ia = sa->next;
+		ib = sb->next;
+	}
+	return (ia == EXP_SPAN_NONE) && (ib == EXP_SPAN_NONE);
+}
+
+/* Compare the groups of a reparse with those of a full parse */
+static int
+test_spans_equal (struct exp_spans const *a, struct exp_spans const *b) {
+	return test_groups_equal(a, a->first, b, b->first);
+}
+
+/* Apply one edit, returning the number of failures */
+static int
+test_edit (struct test_edit const *t) {
+	char new_str[64];
+	struct exp_spans spans, want_spans;
+	struct exp_error err;
+	expression_t exp, root, want;
+	size_t old_len = strlen(t->old), new_len;
+	int bad = 0;
+
+	new_len = old_len - t->old_len + strlen(t->text);
+	assert(new_len < sizeof(new_str));
+	memcpy(new_str, t->old, t->start);
+	memcpy(&new_str[t->start], t->text, strlen(t->text));
+	memcpy(&new_str[t->start + strlen(t->text)], &t->old[t->start + t->old_len], old_len - t->start - t->old_len);
+	new_str[new_len] = '\0';
+
+	exp_spans_init(&spans);
+	exp_spans_init(&want_spans);
+	string_to_expression_spans_r(old_len, t->old, &exp, &spans, &err);
+	string_to_expression_spans_r(new_len, new_str, &want, &want_spans, &err);
+	root = exp;
+
+	if (expression_reparse_r(&exp, &spans, old_len, t->old, new_len, new_str, t->start, t->old_len, strlen(t->text), &err) != EXP_OK) {
+		printf("FAIL \"%s\": %s\n", new_str, err.msg);
+		bad++;
+	} else {
+		if (!expression_equal(exp, want)) {
+			printf("FAIL \"%s\": tree differs from a full parse\n", new_str);
+			bad++;
+		}
+		if (!test_spans_equal(&spans, &want_spans)) {
+			printf("FAIL \"%s\": groups differ from a full parse\n", new_str);
+			bad++;
+		}
+		if ((exp == root) != t->in_place) {
+			printf("FAIL \"%s\": %s\n", new_str, t->in_place ? "root was replaced" : "root was kept");
+			bad++;
+		}
+	}
+
+	expression_free(exp);
+	expression_free(want);
+	exp_spans_free(&spans);
+	exp_spans_free(&want_spans);
+	return bad;
+}
+
+/* An edit to bad syntax fails and leaves the expression as it was */
+static int
+test_bad_edit (void) {
+	char const *old_str = "(x+y)*2";
+	char const *new_str = "(x+y#)*2";
+	struct exp_spans spans;
+	struct exp_error err;
+	expression_t exp, root;
+	int bad = 0;
+
+	exp_spans_init(&spans);
+	string_to_expression_spans_r(strlen(old_str), old_str, &exp, &spans, &err);
+	root = exp;
+	if (expression_reparse_r(&exp, &spans, strlen(old_str), old_str, strlen(new_str), new_str, 4, 0, 1, &err) == EXP_OK) {
+		printf("FAIL \"%s\" parsed\n", new_str);
+		bad++;
+	}
+	if ((exp != root) || (spans.count != 1) || (spans.spans[spans.first].len != 4)) {
+		printf("FAIL \"%s\" changed the expression\n", new_str);
+		bad++;
+	}
+	expression_free(exp);
+	exp_spans_free(&spans);
+	return bad;
+}
+
+/* A run of edits to one expression, so later edits reuse the spans of groups dropped by earlier ones */
+static int
+test_edit_run (void) {
+	static struct { char const *old; char const *text; } const edits[] = {
+		{"b", "b+(e)"}, {"d", "(f*(g))"}, {"+(e)", ""}, {"f*(g)", "1"}, {"a", "(h)+(i)"}, {"1", "j*(k)"},
+	};
+	char buf[2][64] = {"(a+(b))*(c+(d))", ""};
+	char *old_str = buf[0], *new_str = buf[1], *tmp;
+	struct exp_spans spans, want_spans;
+	struct exp_error err;
+	expression_t exp, root, want;
+	size_t i;
+	int bad = 0;
+
+	exp_spans_init(&spans);
+	exp_spans_init(&want_spans);
+	string_to_expression_spans_r(strlen(old_str), old_str, &exp, &spans, &err);
+	root = exp;
+	for (i = 0; i < sizeof(edits) / sizeof(edits[0]); i++) {
+		size_t at = (size_t) (strstr(old_str, edits[i].old) - old_str);
+		size_t old_len = strlen(edits[i].old);
+		size_t len = strlen(edits[i].text);
+
+		sprintf(new_str, "%.*s%s%s", (int) at, old_str, edits[i].text, &old_str[at + old_len]);
+		if ((expression_reparse_r(&exp, &spans, strlen(old_str), old_str, strlen(new_str), new_str, at, old_len, len, &err) != EXP_OK)
+		    || (string_to_expression_spans_r(strlen(new_str), new_str, &want, &want_spans, &err) != EXP_OK)) {
+			printf("FAIL \"%s\": %s\n", new_str, err.msg);
+			bad++;
+			break;
+		}
+		if ((exp != root) || !expression_equal(exp, want) || !test_spans_equal(&spans, &want_spans)) {
+			printf("FAIL \"%s\": differs from a full parse or was not reparsed in place\n", new_str);
+			bad++;
+		}
+		expression_free(want);
+		tmp = old_str;
+		old_str = new_str;
+		new_str = tmp;
+	}
+	// the run ends with the most groups it has had, so with dropped spans taken again there are no spare ones
+	if (spans.count != want_spans.count) {
+		printf("FAIL dropped groups' spans were not reused: %lu spans for %lu groups\n",
+		       (unsigned long) spans.count, (unsigned long) want_spans.count);
+		bad++;
+	}
+
+	expression_free(exp);
+	exp_spans_free(&spans);
+	exp_spans_free(&want_spans);
+	return bad;
+}
+
+int
+main (void) {
+	size_t i;
+	int bad = 0;
+
+	for (i = 0; i < TEST_COUNT; i++) {
+		bad += test_edit(&test_edits[i]);
+	}
+	bad += test_bad_edit();
+	bad += test_edit_run();
+
+	printf("%lu edits, %d failures\n", (unsigned long) TEST_COUNT + 2, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef REPARSE_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
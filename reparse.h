@@ -0,0 +1,97 @@
+/**
+ * @file reparse.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Incremental reparsing of edited expression strings.
+ *
+ * Parsing with @ref string_to_expression_spans_r also records where each
+ * parenthesized group is in the string and which node it became. After an edit,
+ * @ref expression_reparse_r only reparses the innermost group that holds the edit
+ * and swaps the result into the old tree, keeping every node outside that group.
+ *
+ * Each group's place is kept relative to the paren before it, so the edit only
+ * changes the lengths of the groups around it. The groups before and after it,
+ * and those nested in other groups, are not touched.
+ */
+#ifndef _REPARSE_H_
+#define _REPARSE_H_
+
+#include <stddef.h> /* size_t */
+#include "errors.h"
+#include "types.h"
+#include "expression_lite.h" // just need pointer expression_t
+
+/// Special parent index of a group that is not inside another group.
+#define EXP_SPAN_NONE SIZE_T_MAX
+
+/**
+ * A parenthesized group, either a sub-expression or a symbol parameter.
+ * Groups with the same parent are chained in string order.
+ */
+struct exp_span {
+	pcount_t     gap;    ///< Chars to the group's '(' from the ')' of the group before it with the same parent,
+	                     ///< or else from its parent's '('. From the start of the string if neither exists.
+	pcount_t     len;    ///< Chars from the group's '(' to its ')'
+	size_t       parent; ///< Index of the enclosing group's span or EXP_SPAN_NONE
+	size_t       child;  ///< Index of the first group nested in this one or EXP_SPAN_NONE
+	size_t       next;   ///< Index of the next group with the same parent or EXP_SPAN_NONE
+	expression_t exp;    ///< The node the inside of the group became
+};
+
+/**
+ * Every parenthesized group of an expression string.
+ * A fresh parse puts the groups in open paren order, but after an edit the spans
+ * of the reparsed group's nested groups may be anywhere in the array.
+ */
+struct exp_spans {
+	struct exp_span *spans; ///< Group array
+	size_t           count; ///< Number of spans used, including freed ones
+	size_t           size;  ///< Number of allocated spans
+	size_t           first; ///< Index of the first group not inside another, or EXP_SPAN_NONE
+	size_t           free;  ///< Index of the first freed span, chained by next, or EXP_SPAN_NONE
+
+	pindex_t         mark;  ///< Index of the last paren recorded while parsing. Private.
+	size_t           last;  ///< Group whose ')' was the last paren recorded, or EXP_SPAN_NONE. Private.
+};
+
+void
+exp_spans_init (struct exp_spans *spans);
+
+void
+exp_spans_free (struct exp_spans *spans);
+
+size_t
+exp_spans_open (struct exp_spans *spans,
+                pindex_t open,
+                size_t parent);
+
+void
+exp_spans_close (struct exp_spans *spans,
+                 size_t group,
+                 pindex_t close,
+                 expression_t exp);
+
+int
+string_to_expression_spans_r (size_t str_len,
+                              char const *str,
+                              expression_t *exp,
+                              struct exp_spans *spans,
+                              struct exp_error *err);
+
+int
+expression_reparse_r (expression_t *exp,
+                      struct exp_spans *spans,
+                      size_t old_len,
+                      char const *old_str,
+                      size_t new_len,
+                      char const *new_str,
+                      pindex_t edit_start,
+                      pcount_t edit_old_len,
+                      pcount_t edit_new_len,
+                      struct exp_error *err);
+
+#endif /* _REPARSE_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,462 @@
+/**
+ * @file scan.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Structural scanning of expression strings.
+ *
+ * The string is processed in blocks of @ref SCAN_BLOCK chars. A block kernel turns
+ * each block into bit masks, one bit per char, for open parens, close parens,
+ * operation chars, alnum chars, and invalid chars. Blocks with no parens or
+ * operations are skipped in one step; otherwise only the set bits are visited.
+ *
+ * Kernels:
+ * - AVX2, one 32 char compare per class. Picked at runtime when the CPU has it.
+ * - SSE2, two 16 char compares per class. Always present on x86-64.
+ * - Scalar, one char at a time. Used everywhere else.
+ *
+ * Define SCAN_FORCE_SCALAR to always use the scalar kernel.
+ */
+#include <string.h> // memcpy(), memset()
+#include "errors.h"
+#include "types.h"
+#include "scan.h"
+
+#if !defined(SCAN_FORCE_SCALAR) && defined(__SSE2__)
+	#define SCAN_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+#if !defined(SCAN_FORCE_SCALAR) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define SCAN_HAVE_AVX2
+	#include <immintrin.h>
+#endif
+
+/// Number of chars classified per step. Each mask has one bit per char.
+#define SCAN_BLOCK 32
+
+/// Bit mask type. Must hold at least SCAN_BLOCK bits.
+typedef unsigned long scan_mask_t;
+
+/// Mask with the low n bits set (n <= SCAN_BLOCK)
+#define SCAN_LOW_BITS(n) ( ((n) >= SCAN_BLOCK) ? (scan_mask_t) 0xFFFFFFFFUL : ((((scan_mask_t) 1) << (n)) - 1) )
+
+#if defined(__GNUC__)
+	#define SCAN_CTZ(m) ((unsigned) __builtin_ctzl(m))
+#else
+static unsigned
+scan_ctz (scan_mask_t m) {
+	unsigned n = 0;
+	while (!(m & 1)) {
+		m >>= 1;
+		n++;
+	}
+	return n;
+}
+	#define SCAN_CTZ(m) scan_ctz(m)
+#endif
+
+/**
+ * Class masks for one block.
+ */
+struct scan_masks {
+	scan_mask_t open;    ///< '('
+	scan_mask_t close;   ///< ')'
+	scan_mask_t op;      ///< operation chars, "+-*/<>=!&|,?:"
+	scan_mask_t alnum;   ///< digits and letters, including the 'e' of an exponent
+	scan_mask_t invalid; ///< anything not allowed in an expression. '.', ' ' and '\t' are allowed but in no class.
+};
+
+/// Classify the SCAN_BLOCK chars starting at block
+typedef void (*scan_block_fn)(char const *block, struct scan_masks *m);
+
+
+/*---------------------------------------------*
+ *               block kernels                 *
+ *---------------------------------------------*/
+
+#if !defined(SCAN_HAVE_SSE2) || defined(SCAN_TEST_MAIN)
+static void
+scan_block_scalar (char const *block, struct scan_masks *m) {
+	unsigned i;
+
+	m->open = m->close = m->op = m->alnum = m->invalid = 0;
+	for (i = 0; i < SCAN_BLOCK; i++) {
+		unsigned char c = (unsigned char) block[i];
+		scan_mask_t bit = ((scan_mask_t) 1) << i;
+
+		switch (c) {
+		case '(':
+			m->open |= bit;
+			break;
+		case ')':
+			m->close |= bit;
+			break;
+		case '+':
+		case '-':
+		case '*':
+		case '/':
+		case '<':
+		case '>':
+		case '=':
+		case '!':
+		case '&':
+		case '|':
+		case ',':
+		case '?':
+		case ':':
+			m->op |= bit;
+			break;
+		case '.':
+		case ' ':
+		case '\t':
+			break;
+		default:
+			if (IS_DIGIT(c) || ((c < 0x80) && IS_ALPHA(c))) m->alnum |= bit;
+			else m->invalid |= bit;
+			break;
+		}
+	}
+}
+#endif
+
+#ifdef SCAN_HAVE_SSE2
+/* Set lanes equal to ch */
+#define SSE2_EQ(x, ch) _mm_cmpeq_epi8((x), _mm_set1_epi8(ch))
+
+/* Set lanes where lo <= x <= hi, treating bytes as unsigned */
+#define SSE2_IN_RANGE(x, lo, hi) \
+	_mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8((x), _mm_set1_epi8((char)(lo))), _mm_set1_epi8((char)((hi) - (lo)))), \
+	               _mm_sub_epi8((x), _mm_set1_epi8((char)(lo))))
+
+/* Classify 16 chars into 16 bit masks */
+static void
+scan_half_sse2 (char const *half, scan_mask_t *open, scan_mask_t *close, scan_mask_t *op, scan_mask_t *alnum, scan_mask_t *invalid) {
+	__m128i x     = _mm_loadu_si128((__m128i const *) half);
+	__m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+	__m128i o     = SSE2_EQ(x, '(');
+	__m128i c     = SSE2_EQ(x, ')');
+	// '*' '+' ',' '-' and '/' fall in '*'..'/', which only adds '.', so it is taken back out
+	__m128i ops   = _mm_andnot_si128(SSE2_EQ(x, '.'), SSE2_IN_RANGE(x, '*', '/'));
+	__m128i an    = _mm_or_si128(SSE2_IN_RANGE(x, '0', '9'), SSE2_IN_RANGE(lower, 'a', 'z'));
+	__m128i plain = _mm_or_si128(_mm_or_si128(SSE2_EQ(x, ' '), SSE2_EQ(x, '\t')), SSE2_EQ(x, '.')); // allowed, but in no class
+	__m128i valid;
+
+	// '<' '=' and '>' are a range too
+	ops   = _mm_or_si128(ops, _mm_or_si128(SSE2_IN_RANGE(x, '<', '>'), _mm_or_si128(SSE2_EQ(x, '!'), SSE2_EQ(x, '&'))));
+	ops   = _mm_or_si128(ops, _mm_or_si128(SSE2_EQ(x, '|'), _mm_or_si128(SSE2_EQ(x, '?'), SSE2_EQ(x, ':'))));
+	valid = _mm_or_si128(_mm_or_si128(o, c), _mm_or_si128(_mm_or_si128(ops, an), plain));
+
+	*open    = (scan_mask_t) _mm_movemask_epi8(o);
+	*close   = (scan_mask_t) _mm_movemask_epi8(c);
+	*op      = (scan_mask_t) _mm_movemask_epi8(ops);
+	*alnum   = (scan_mask_t) _mm_movemask_epi8(an);
+	*invalid = (scan_mask_t) (~_mm_movemask_epi8(valid) & 0xFFFF);
+}
+
+static void
+scan_block_sse2 (char const *block, struct scan_masks *m) {
+	scan_mask_t o, c, op, an, inv;
+
+	scan_half_sse2(block, &m->open, &m->close, &m->op, &m->alnum, &m->invalid);
+	scan_half_sse2(block + 16, &o, &c, &op, &an, &inv);
+	m->open    |= o   << 16;
+	m->close   |= c   << 16;
+	m->op      |= op  << 16;
+	m->alnum   |= an  << 16;
+	m->invalid |= inv << 16;
+}
+#endif /* SCAN_HAVE_SSE2 */
+
+#ifdef SCAN_HAVE_AVX2
+/* Set lanes equal to ch */
+#define AVX2_EQ(x, ch) _mm256_cmpeq_epi8((x), _mm256_set1_epi8(ch))
+
+/* Set lanes where lo <= x <= hi, treating bytes as unsigned */
+#define AVX2_IN_RANGE(x, lo, hi) \
+	_mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_sub_epi8((x), _mm256_set1_epi8((char)(lo))), _mm256_set1_epi8((char)((hi) - (lo)))), \
+	                  _mm256_sub_epi8((x), _mm256_set1_epi8((char)(lo))))
+
+__attribute__((target("avx2")))
+static void
+scan_block_avx2 (char const *block, struct scan_masks *m) {
+	__m256i x     = _mm256_loadu_si256((__m256i const *) block);
+	__m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+	__m256i o     = AVX2_EQ(x, '(');
+	__m256i c     = AVX2_EQ(x, ')');
+	// same ranges as the SSE2 kernel
+	__m256i ops   = _mm256_andnot_si256(AVX2_EQ(x, '.'), AVX2_IN_RANGE(x, '*', '/'));
+	__m256i an    = _mm256_or_si256(AVX2_IN_RANGE(x, '0', '9'), AVX2_IN_RANGE(lower, 'a', 'z'));
+	__m256i plain = _mm256_or_si256(_mm256_or_si256(AVX2_EQ(x, ' '), AVX2_EQ(x, '\t')), AVX2_EQ(x, '.')); // allowed, but in no class
+	__m256i valid;
+
+	ops   = _mm256_or_si256(ops, _mm256_or_si256(AVX2_IN_RANGE(x, '<', '>'), _mm256_or_si256(AVX2_EQ(x, '!'), AVX2_EQ(x, '&'))));
+	ops   = _mm256_or_si256(ops, _mm256_or_si256(AVX2_EQ(x, '|'), _mm256_or_si256(AVX2_EQ(x, '?'), AVX2_EQ(x, ':'))));
+	valid = _mm256_or_si256(_mm256_or_si256(o, c), _mm256_or_si256(_mm256_or_si256(ops, an), plain));
+
+	m->open    = (scan_mask_t) (unsigned) _mm256_movemask_epi8(o);
+	m->close   = (scan_mask_t) (unsigned) _mm256_movemask_epi8(c);
+	m->op      = (scan_mask_t) (unsigned) _mm256_movemask_epi8(ops);
+	m->alnum   = (scan_mask_t) (unsigned) _mm256_movemask_epi8(an);
+	m->invalid = (scan_mask_t) (unsigned) ~_mm256_movemask_epi8(valid);
+}
+#endif /* SCAN_HAVE_AVX2 */
+
+/** Pick the best block kernel for this CPU.
+ * No state is kept, so this is safe to call from any thread.
+ */
+static scan_block_fn
+scan_kernel (void) {
+#ifdef SCAN_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2")) return scan_block_avx2;
+#endif
+#ifdef SCAN_HAVE_SSE2
+	return scan_block_sse2;
+#else
+	return scan_block_scalar;
+#endif
+}
+
+/** Name of the block kernel that will be used.
+ * @return "avx2", "sse2", or "scalar"
+ */
+char const *
+scan_kernel_name (void) {
+	scan_block_fn fn = scan_kernel();
+#ifdef SCAN_HAVE_AVX2
+	if (fn == scan_block_avx2) return "avx2";
+#endif
+#ifdef SCAN_HAVE_SSE2
+	if (fn == scan_block_sse2) return "sse2";
+#endif
+	return "scalar";
+}
+
+/** Classify the block of chars starting at index.
+ * A short final block is padded with spaces, which belong to no class.
+ * @return The number of real chars in the block.
+ */
+static size_t
+scan_block (scan_block_fn fn, size_t str_len, char const *str, pindex_t index, struct scan_masks *m) {
+	char pad[SCAN_BLOCK];
+	size_t n = str_len - index;
+
+	if (n >= SCAN_BLOCK) {
+		fn(&str[index], m);
+		return SCAN_BLOCK;
+	}
+	memset(pad, ' ', SCAN_BLOCK);
+	memcpy(pad, &str[index], n);
+	fn(pad, m);
+	return n;
+}
+
+
+/*---------------------------------------------*
+ *               scanners                      *
+ *---------------------------------------------*/
+
+/* Scan the structure of an expression string with a given kernel */
+static void
+scan_structure_fn (scan_block_fn fn,
+                   size_t str_len,
+                   char const *str,
+                   struct scan_result *res) {
+	pcount_t depth = 0;
+	pindex_t index;
+
+	assert(str || (str_len == 0));
+	assert(res);
+
+	res->invalid   = PINDEX_BAD;
+	res->unmatched = PINDEX_BAD;
+	res->op        = PINDEX_BAD;
+	res->op_depth  = 0;
+
+	for (index = 0; index < str_len; index += SCAN_BLOCK) {
+		struct scan_masks m;
+		scan_mask_t events;
+		pindex_t stop = PINDEX_BAD;
+
+		scan_block(fn, str_len, str, index, &m);
+
+		// only look at chars up to the first invalid one
+		if (m.invalid) {
+			stop = index + SCAN_CTZ(m.invalid);
+			events = (m.open | m.close | m.op) & SCAN_LOW_BITS(SCAN_CTZ(m.invalid));
+		} else {
+			events = m.open | m.close | m.op;
+		}
+
+		// visit parens and operations in order
+		while (events) {
+			unsigned bit = SCAN_CTZ(events);
+			scan_mask_t b = ((scan_mask_t) 1) << bit;
+			events &= events - 1;
+
+			if (m.open & b) {
+				depth++;
+			}
+			else if (m.close & b) {
+				if (depth == 0) {
+					res->unmatched = index + bit;
+					res->depth = 0;
+					return;
+				}
+				depth--;
+			}
+			else if ((res->op == PINDEX_BAD) || (depth < res->op_depth)) {
+				res->op = index + bit;
+				res->op_depth = depth;
+			}
+		}
+
+		if (stop != PINDEX_BAD) {
+			res->invalid = stop;
+			break;
+		}
+	}
+
+	res->depth = depth;
+}
+
+/** Scan the structure of an expression string.
+ * Scanning stops at the first invalid char or unmatched close paren.
+ * @param str_len Length of given string
+ * @param str String to scan
+ * @param[out] res Set to what was found.
+ */
+void
+scan_structure (size_t str_len,
+                char const *str,
+                struct scan_result *res) {
+	scan_structure_fn(scan_kernel(), str_len, str, res);
+}
+
+/** Find the end of a run of alnum chars.
+ * @param str_len Overall string length.
+ * @param str String to search in.
+ * @param start Index to start at.
+ * @return The index of the first non-alnum char at or after start, or str_len.
+ */
+pindex_t
+scan_alnum_end (size_t str_len,
+                char const *str,
+                pindex_t start) {
+	scan_block_fn fn = scan_kernel();
+	pindex_t index;
+
+	assert(str || (str_len == 0));
+
+	for (index = start; index < str_len; index += SCAN_BLOCK) {
+		struct scan_masks m;
+		size_t n = scan_block(fn, str_len, str, index, &m);
+		scan_mask_t other = ~m.alnum & SCAN_LOW_BITS(n);
+
+		if (other) return index + SCAN_CTZ(other);
+	}
+	return str_len;
+}
+
+#ifdef SCAN_TEST_MAIN
+/*
+ * Checks every kernel against the scalar kernel and times scan_structure with each.
+ *
+ * make tests
+ * or
+ * gcc -O2 -DDEBUG -DSCAN_TEST_MAIN -o scan scan.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TEST_LEN (1 << 24)
+
+static char const test_chars[] = "0123456789abcexyzEXYZ()()+-*/<>=!&|,?:.   \t";
+
+/// Expressions that use every kind of char, with the operation scan_structure should find
+static struct {
+	char const *str;
+	pindex_t    op;
+	pcount_t    op_depth;
+} const test_exprs[] = {
+	{"1.5*x",                                        3, 0},
+	{"a<b",                                          1, 0},
+	{"max(a,b)",                                     5, 1},
+	{"c?a:b",                                        1, 0},
+	{"(1.5e+3 >= x) && !(y <= 2 || z == 3.25E-1)",  14, 0},
+	{"min(a, b, c) != max(1.0, (2 > 3) ? 4 : 5.e1)", 13, 0},
+};
+
+static void
+test_kernel (char const *name, scan_block_fn fn, char const *str) {
+	struct scan_result want, got;
+	struct scan_masks a, b;
+	clock_t start;
+	size_t i;
+	int rep;
+
+	// masks must match the scalar kernel everywhere
+	for (i = 0; i + SCAN_BLOCK <= 4096; i++) {
+		scan_block_scalar(&str[i], &a);
+		fn(&str[i], &b);
+		assert((a.open == b.open) && (a.close == b.close) && (a.op == b.op));
+		assert((a.alnum == b.alnum) && (a.invalid == b.invalid));
+	}
+
+	// every char of real expressions is valid
+	for (i = 0; i < sizeof(test_exprs) / sizeof(test_exprs[0]); i++) {
+		scan_structure_fn(fn, strlen(test_exprs[i].str), test_exprs[i].str, &got);
+		assert((got.invalid == PINDEX_BAD) && (got.unmatched == PINDEX_BAD) && (got.depth == 0));
+		assert((got.op == test_exprs[i].op) && (got.op_depth == test_exprs[i].op_depth));
+	}
+
+	// whole scans must match the scalar kernel
+	for (i = 1; i < 2048; i += 7) {
+		scan_structure_fn(scan_block_scalar, i, str, &want);
+		scan_structure_fn(fn, i, str, &got);
+		assert((want.invalid == got.invalid) && (want.unmatched == got.unmatched));
+		assert((want.op == got.op) && (want.op_depth == got.op_depth) && (want.depth == got.depth));
+	}
+
+	start = clock();
+	for (rep = 0; rep < 8; rep++) {
+		// past the checked region, which has invalid chars
+		scan_structure_fn(fn, TEST_LEN - 4096, &str[4096], &got);
+		assert(got.invalid == PINDEX_BAD);
+	}
+	printf("%-6s %8.1f MB/s\n", name, (8.0 * (TEST_LEN - 4096) / (1 << 20)) / ((double) (clock() - start) / CLOCKS_PER_SEC));
+}
+
+int main() {
+	char *str = malloc(TEST_LEN);
+	size_t i;
+
+	assert(str);
+	srand(1);
+	for (i = 0; i < TEST_LEN; i++) {
+		str[i] = test_chars[rand() % (sizeof(test_chars) - 1)];
+	}
+	for (i = 0; i < 4096; i += 97) {
+		str[i] = '#'; // some invalid chars for the checks
+	}
+
+	/* no close parens in the timing region so it does not stop early */
+	for (i = 4096; i < TEST_LEN; i++) {
+		if (str[i] == ')') str[i] = 'a';
+	}
+
+	printf("selected kernel: %s\n", scan_kernel_name());
+	test_kernel("scalar", scan_block_scalar, str);
+#ifdef SCAN_HAVE_SSE2
+	test_kernel("sse2", scan_block_sse2, str);
+#endif
+#ifdef SCAN_HAVE_AVX2
+	if (__builtin_cpu_supports("avx2")) test_kernel("avx2", scan_block_avx2, str);
+#endif
+	free(str);
+	return 0;
+}
+#endif // #ifdef SCAN_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,44 @@
+/**
+ * @file scan.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Structural scanning of expression strings.
+ * Classifies 32 chars per step to track paren depth, find operations and
+ * the ends of symbol names, and reject chars that cannot appear in an expression.
+ * Uses AVX2 or SSE2 when available, with a portable scalar fallback.
+ */
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stddef.h> /* size_t */
+#include "types.h"
+
+/**
+ * Structure of an expression string found by @ref scan_structure.
+ */
+struct scan_result {
+	pindex_t invalid;   ///< Index of the first char that cannot be in an expression or PINDEX_BAD
+	pindex_t unmatched; ///< Index of the first close paren without an open paren or PINDEX_BAD
+	pindex_t op;        ///< Index of the leftmost operation char at the lowest paren depth or PINDEX_BAD. May be a ',' or an exponent's sign.
+	pcount_t op_depth;  ///< Paren depth of op
+	pcount_t depth;     ///< Number of open parens left unclosed at the end of the string
+};
+
+void
+scan_structure (size_t str_len,
+                char const *str,
+                struct scan_result *res);
+
+pindex_t
+scan_alnum_end (size_t str_len,
+                char const *str,
+                pindex_t start);
+
+char const *
+scan_kernel_name (void);
+
+#endif /* _SCAN_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,488 @@
+/**
+ * @file simplify.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Constant folding and algebraic simplification of expression trees.
+ *
+ * Every rewrite keeps the value @ref expression_evaluate would give, including
+ * truncating division and wrap around on overflow. Nothing that is an error when
+ * evaluated by @ref expression_evaluate_r is folded away or folded in, so division
+ * by zero and LONG_MIN / -1 are left in the tree, and a subtree containing a division
+ * is never dropped, except from a select's untaken arm, where errors are dropped too.
+ *
+ * Double constants are folded with the same double arithmetic the evaluators use.
+ * Double arithmetic is not associative and x + 0 is not x when x is -0.0, so the
+ * rewrites that rely on those only touch subtrees of long ints.
+ *
+ * Nodes with more than one owner are left untouched, since other owners see them too.
+ * Arena nodes count as having one owner, so they are rewritten in place like any other.
+ */
+#include <stdlib.h> // realloc(), free()
+#include <string.h> // strcmp()
+#include <limits.h> // LONG_MIN
+#include "errors.h"
+#include "types.h"
+#include "expression.h"
+#include "arena.h"
+#include "traverse.h"
+#include "simplify.h"
+
+/* True if exp has other owners, who would see it rewritten.
+ * An arena node's refs is EXP_ARENA_REFS, but it only hangs from its parent. */
+static int
+is_shared (expression_t exp) {
+	return (exp->refs > 1) && (exp->refs != EXP_ARENA_REFS);
+}
+
+/* Release an unshared node whose children are already accounted for.
+ * An arena node is left to its arena. */
+static void
+drop_node (expression_t exp) {
+	if (exp->refs != EXP_ARENA_REFS) free(exp);
+}
+
+/* True if exp is a long int constant, storing it in val */
+static int
+is_lint (expression_t exp, sys_int_long *val) {
+	if ((exp->type == EXP_VALUE) && (exp->data.val.type == VAL_LINT)) {
+		if (val) *val = exp->data.val.data.lint;
+		return 1;
+	}
+	return 0;
+}
+
+/* True if exp is a long int or double constant */
+static int
+is_number (expression_t exp) {
+	return (exp->type == EXP_VALUE) && VAL_IS_NUMBER(exp->data.val);
+}
+
+/* True if exp is made of long ints only */
+static int
+is_int (expression_t exp) {
+	return expression_infer(exp) == EXP_NUM_INT;
+}
+
+/* True if evaluating exp can never fail and gives a long int, so it may be dropped from the tree */
+static int
+is_total (expression_t exp) {
+	struct exp_walk w;
+	enum exp_walk_event event;
+	expression_t node;
+	int total = 1;
+
+	exp_walk_init(&w, exp);
+	while (total && exp_walk_next(&w, &node, &event)) {
+		if (event != EXP_WALK_ENTER) continue;
+		switch (node->type) {
+		case EXP_VALUE:
+			total = (node->data.val.type == VAL_LINT);
+			break;
+		case EXP_SYMBOLIC:
+			// a symbol may have no value, which is an error
+			total = 0;
+			break;
+		case EXP_TREE:
+			total = (node->data.tree.op != '/');
+			break;
+		default:
+			total = 0;
+			break;
+		}
+	}
+	exp_walk_free(&w);
+	return total;
+}
+
+/** Apply a binary operation to two constants.
+ * Overflow wraps, as it does when the tree is evaluated.
+ * @return Non-zero on success, zero if the operation must be left to run time.
+ */
+static int
+fold (char op, sys_int_long l, sys_int_long r, sys_int_long *result) {
+	unsigned long ul = (unsigned long) l, ur = (unsigned long) r;
+	switch (op) {
+	case '+': *result = (sys_int_long) (ul + ur); return 1;
+	case '-': *result = (sys_int_long) (ul - ur); return 1;
+	case '*': *result = (sys_int_long) (ul * ur); return 1;
+	case '/':
+		if ((r == 0) || ((l == LONG_MIN) && (r == -1))) return 0;
+		*result = l / r;
+		return 1;
+	case '<': *result = (l < r);  return 1;
+	case '>': *result = (l > r);  return 1;
+	case 'L': *result = (l <= r); return 1;
+	case 'G': *result = (l >= r); return 1;
+	case '=': *result = (l == r); return 1;
+	case '!': *result = (l != r); return 1;
+	case '&': *result = (l != 0) && (r != 0); return 1;
+	case '|': *result = (l != 0) || (r != 0); return 1;
+	default:
+		return 0;
+	}
+}
+
+/* Push a pair of nodes still to be compared */
+static void
+equal_push (expression_t **pending, size_t *depth, size_t *size, expression_t a, expression_t b) {
+	if (*depth + 2 > *size) {
+		*size = *size ? (*size * 2) : EXP_WALK_LOCAL;
+		*pending = (expression_t *) realloc(*pending, *size * sizeof(expression_t));
+		assert(*pending); // throw error - equal_push: realloc could not do allocation
+	}
+	(*pending)[(*depth)++] = a;
+	(*pending)[(*depth)++] = b;
+}
+
+/** Compare two expressions for structural equality.
+ * The pairs of nodes still to compare are kept on a heap stack, so deep trees are fine.
+ * @return Non-zero if a and b have the same shape, operations, values and symbols.
+ */
+int
+expression_equal (expression_t a,
+                  expression_t b) {
+	expression_t *pending = NULL;
+	size_t depth = 0, size = 0;
+	int equal = 1;
+
+	equal_push(&pending, &depth, &size, a, b);
+	while (equal && depth) {
+		b = pending[--depth];
+		a = pending[--depth];
+		if (a == b) continue;
+		if (a->type != b->type) {
+			equal = 0;
+			continue;
+		}
+		switch (a->type) {
+		case EXP_VALUE:
+			equal = value_equal(a->data.val, b->data.val);
+			break;
+		case EXP_SYMBOLIC:
+			if (strcmp(a->data.sym.name, b->data.sym.name) != 0) {
+				equal = 0;
+			} else if ((a->data.sym.p == NULL) || (b->data.sym.p == NULL)) {
+				equal = (a->data.sym.p == b->data.sym.p);
+			} else {
+				equal_push(&pending, &depth, &size, a->data.sym.p, b->data.sym.p);
+			}
+			break;
+		case EXP_TREE:
+			if (a->data.tree.op != b->data.tree.op) {
+				equal = 0;
+			} else {
+				// right first, so the left sides are compared first
+				equal_push(&pending, &depth, &size, a->data.tree.right, b->data.tree.right);
+				equal_push(&pending, &depth, &size, a->data.tree.left, b->data.tree.left);
+			}
+			break;
+		default:
+			equal = 0;
+			break;
+		}
+	}
+
+	free(pending);
+	return equal;
+}
+
+/* Turn the unshared tree node exp into the constant val, freeing its children */
+static expression_t
+make_value (expression_t exp, value_t val) {
+	expression_free(exp->data.tree.left);
+	expression_free(exp->data.tree.right);
+	exp->type = EXP_VALUE;
+	exp->data.val = val;
+	return exp;
+}
+
+/* Turn the unshared tree node exp into the long int constant val, freeing its children */
+static expression_t
+make_lint (expression_t exp, sys_int_long val) {
+	return make_value(exp, value_new_lint(val));
+}
+
+/* Replace the unshared tree node exp by one of its children, freeing the rest */
+static expression_t
+keep_child (expression_t exp, expression_t keep) {
+	expression_t drop = (keep == exp->data.tree.left) ? exp->data.tree.right : exp->data.tree.left;
+	expression_free(drop);
+	drop_node(exp); // children are already accounted for
+	return keep;
+}
+
+/** Simplify a tree node whose children are already simplified.
+ * @return The simplified node, which may be a different node than exp.
+ */
+static expression_t
+simplify_node (expression_t exp) {
+	expression_t left  = exp->data.tree.left;
+	expression_t right = exp->data.tree.right;
+	char op = exp->data.tree.op;
+	sys_int_long l, r, v;
+
+	/* Selects on a constant condition */
+	if (EXP_IS_SELECT(exp) && is_number(left) && !is_shared(right)) {
+		int truth = expression_select(left->data.val, value_new_lint(1), value_new_lint(0)).data.lint;
+		expression_t taken   = truth ? right->data.tree.left : right->data.tree.right;
+		expression_t dropped = truth ? right->data.tree.right : right->data.tree.left;
+
+		if (is_number(taken) && is_number(dropped)) {
+			return make_value(exp, expression_select(left->data.val, right->data.tree.left->data.val, right->data.tree.right->data.val));
+		}
+		// an error in the dropped arm never reaches the result, but a double there would make it a double
+		if (is_int(dropped) && is_int(taken)) {
+			expression_free(left);
+			expression_free(dropped);
+			drop_node(right); // taken is already accounted for
+			drop_node(exp);
+			return taken;
+		}
+		return exp;
+	}
+
+	/* Constant folding */
+	if (is_lint(left, &l) && is_lint(right, &r)) {
+		if (fold(op, l, r, &v)) return make_lint(exp, v);
+		return exp;
+	}
+	if (is_number(left) && is_number(right)) {
+		value_t val;
+		// an error such as division by zero is left to run time, where it can be reported
+		val = expression_operate(op, left->data.val, right->data.val);
+		if (!VAL_IS_NUMBER(val)) return exp;
+		return make_value(exp, val);
+	}
+
+	/* Identities */
+	if (is_lint(right, &r)) {
+		if ((r == 0) && (op == '-')) return keep_child(exp, left);
+		if ((r == 0) && (op == '+') && is_int(left)) return keep_child(exp, left);
+		if ((r == 1) && ((op == '*') || (op == '/'))) return keep_child(exp, left);
+		if ((r == 0) && (op == '*') && is_total(left)) return make_lint(exp, 0);
+	}
+	if (is_lint(left, &l)) {
+		if ((l == 0) && (op == '+') && is_int(right)) return keep_child(exp, right);
+		if ((l == 1) && (op == '*')) return keep_child(exp, right);
+		if ((l == 0) && (op == '*') && is_total(right)) return make_lint(exp, 0);
+	}
+	if ((op == '-') && is_total(left) && expression_equal(left, right)) {
+		return make_lint(exp, 0);
+	}
+
+	/* Merge constant chains, (x op1 c1) op2 c2 -> x op3 c3.
+	 * Wrap around arithmetic is associative, so this is exact for long int x. */
+	if (is_lint(right, &r) && (left->type == EXP_TREE) && is_lint(left->data.tree.right, &l)
+	    && !is_shared(left) && !is_shared(left->data.tree.right) && is_int(left->data.tree.left)) {
+		char lop = left->data.tree.op;
+		expression_t c = left->data.tree.right;
+
+		if (((op == '+') || (op == '-')) && ((lop == '+') || (lop == '-'))) {
+			// x + (+-c1 +- c2)
+			unsigned long sum = (lop == '+') ? (unsigned long) l : -(unsigned long) l;
+			sum = (op == '+') ? (sum + (unsigned long) r) : (sum - (unsigned long) r);
+			v = (sys_int_long) sum;
+			// keep the constant positive so the expression prints as it parses
+			if ((v < 0) && (v != LONG_MIN)) {
+				left->data.tree.op = '-';
+				c->data.val.data.lint = -v;
+			} else {
+				left->data.tree.op = '+';
+				c->data.val.data.lint = v;
+			}
+		} else if ((op == '*') && (lop == '*')) {
+			c->data.val.data.lint = (sys_int_long) ((unsigned long) l * (unsigned long) r);
+		} else {
+			return exp;
+		}
+
+		expression_free(right);
+		drop_node(exp);
+		// the merged constant may now be an identity
+		return simplify_node(left);
+	}
+
+	return exp;
+}
+
+/** Simplify an expression.
+ * - Constant subtrees become a single value.
+ * - x-0, x*1, 1*x and x/1 become x, as do x+0 and 0+x when x is a long int.
+ * - x*0, 0*x and x-x become 0 when x is a long int with no division or symbol.
+ * - (x+c1)+c2, (x-c1)+c2 and similar chains become a single operation on x,
+ *   as do (x*c1)*c2 chains.
+ * - A select on a constant condition becomes its taken arm, when both arms are long ints.
+ *
+ * The expression is rewritten in place. Nodes that are no longer needed are freed.
+ * @param exp The expression to simplify. It belongs to the result afterwards.
+ * @return The simplified expression, which may be a different node than exp.
+ */
+expression_t
+expression_simplify (expression_t exp) {
+	struct exp_walk w;
+	enum exp_walk_event event;
+	expression_t node, parent;
+	expression_t *slot; // where node hangs from its parent
+
+	assert(exp);
+
+	/* Post-order, so each node is simplified after its children.
+	 * A simplified node is swapped into its parent before the walk reads the parent's next child. */
+	exp_walk_init(&w, exp);
+	while (exp_walk_next(&w, &node, &event)) {
+		if (event == EXP_WALK_ENTER) {
+			// other owners see shared nodes too, so they and their children are left alone
+			if (is_shared(node)) exp_walk_skip(&w);
+			continue;
+		}
+		if ((event != EXP_WALK_LEAVE) || (node->type != EXP_TREE) || is_shared(node)) continue;
+
+		parent = w.depth ? w.stack[w.depth - 1].exp : NULL;
+		if (!parent) {
+			slot = &exp;
+		} else if (parent->type == EXP_SYMBOLIC) {
+			slot = &parent->data.sym.p;
+		} else if (parent->data.tree.left == node) {
+			slot = &parent->data.tree.left;
+		} else {
+			slot = &parent->data.tree.right;
+		}
+		*slot = simplify_node(node);
+	}
+	exp_walk_free(&w);
+
+	return exp;
+}
+
+#ifdef SIMPLIFY_TEST_MAIN
+/*
+ * Checks each rewrite, that shared nodes are left alone and arena nodes are not,
+ * and that a chain of a million terms is simplified without running out of stack.
+ *
+ * make tests
+ * or
+ * gcc -g -DDEBUG -DSIMPLIFY_TEST_MAIN -o simplify simplify.c expression.c token.c symbolic.c reparse.c scan.c types.c traverse.c workspace.c errors.c arena.c
+ */
+#include <stdio.h>
+#include "symbolic.h"
+
+/**
+ * An expression and what it simplifies to, as printed by @ref expression_to_string.
+ */
+struct test_case {
+	char const *str;  ///< Expression to simplify
+	char const *want; ///< Simplified expression
+};
+
+static struct test_case const test_cases[] = {
+	{"1+2*3",                   "7"},
+	{"x+0",                     "x"},
+	{"0+x",                     "x"},
+	{"x*1",                     "x"},
+	{"1*x",                     "x"},
+	{"x/1",                     "x"},
+	{"x-0",                     "x"},
+	{"x*0",                     "(x * 0)"}, // x may have no value, so never dropped
+	{"0*x",                     "(0 * x)"},
+	{"x-x",                     "(x - x)"},
+	{"y-y",                     "(y - y)"},
+	{"x/0-x/0",                 "((x / 0) - (x / 0))"}, // traps, so never dropped
+	{"(x/0)*0",                 "((x / 0) * 0)"},
+	{"(x+1)+2",                 "(x + 3)"},
+	{"(x-1)+2",                 "(x + 1)"},
+	{"(x-5)-2",                 "(x - 7)"},
+	{"(x*3)*4",                 "(x * 12)"},
+	{"((x+1)+2)+3",             "(x + 6)"},
+	{"(x+1)-1",                 "x"},
+	{"(x+2)+(0-5)",             "(x - 3)"},
+	{"1 ? x : 2",               "x"},
+	{"0 ? x : 2",               "2"},
+	{"1 ? x : 1.5",             "(1 ? x : 1.5)"}, // the dropped double would make the result a double
+	{"1 ? 2 : 3/0",             "2"},
+	{"x ? 1 : 2",               "(x ? 1 : 2)"},
+	{"1.5+2",                   "3.5"},
+	{"1.0/0",                   "(1.0 / 0)"},
+	{"x+0.0",                   "(x + 0.0)"},
+	{"f(1+2, x*1)",             "f(3, x)"},
+	{"(x+1)*(x+1)-(x+1)*(x+1)", "(((x + 1) * (x + 1)) - ((x + 1) * (x + 1)))"},
+	{"3 == 3",                  "1"},
+	{"2 < 1 || 0",              "0"},
+	{"g(h(1+1))+0",             "(g(h(2)) + 0)"}, // calls may give doubles
+};
+
+#define TEST_COUNT (sizeof(test_cases) / sizeof(test_cases[0]))
+
+/// Terms in the long chain
+#define TEST_CHAIN 1000000
+
+/* Check the string of exp, returning the number of failures */
+static int
+test_check (char const *what, expression_t exp, char const *want) {
+	exp_buf buf;
+
+	expression_to_string(buf, exp);
+	if (strcmp(buf, want) != 0) {
+		printf("FAIL %s: got \"%s\", want \"%s\"\n", what, buf, want);
+		return 1;
+	}
+	return 0;
+}
+
+int
+main (void) {
+	struct exp_arena *arena = exp_arena_new(0);
+	struct exp_error err;
+	expression_t exp, other, shared;
+	size_t i;
+	int bad = 0;
+
+	for (i = 0; i < TEST_COUNT; i++) {
+		if (string_to_expression_r(strlen(test_cases[i].str), test_cases[i].str, &exp, &err) != EXP_OK) {
+			printf("FAIL parse \"%s\": %s\n", test_cases[i].str, err.msg);
+			bad++;
+			continue;
+		}
+		exp = expression_simplify(exp);
+		bad += test_check(test_cases[i].str, exp, test_cases[i].want);
+		expression_free(exp);
+	}
+
+	/* A shared subtree is left as it is, since its other owner sees it too */
+	string_to_expression_r(5, "(1+2)", &shared, &err);
+	other = expression_new_tree('*', expression_new_sym(sym_new_name("x")), shared);
+	expression_ref(shared);
+	exp = expression_simplify(expression_new_tree('+', expression_new_sym(sym_new_name("y")), shared));
+	bad += test_check("shared", exp, "(y + (1 + 2))");
+	bad += test_check("other owner", other, "(x * (1 + 2))");
+	expression_free(exp);
+	expression_free(other);
+
+	/* Arena nodes all have EXP_ARENA_REFS, but are rewritten in place */
+	string_to_expression_arena_r(9, "(x+1)+2*3", arena, &exp, &err);
+	bad += test_check("arena", expression_simplify(exp), "(x + 7)");
+	exp_arena_free(arena);
+
+	/* 1+1+...+1, leaning left, folds to one value */
+	exp   = expression_new_value(value_new_lint(1));
+	other = expression_new_value(value_new_lint(1));
+	for (i = 1; i < TEST_CHAIN; i++) {
+		exp   = expression_new_tree('+', exp, expression_new_value(value_new_lint(1)));
+		other = expression_new_tree('+', other, expression_new_value(value_new_lint(1)));
+	}
+	if (!expression_equal(exp, other)) {
+		printf("FAIL chain: equal chains compare unequal\n");
+		bad++;
+	}
+	expression_free(other);
+	exp = expression_simplify(exp);
+	bad += test_check("chain", exp, "1000000");
+	expression_free(exp);
+
+	printf("%lu cases, %d failures\n", (unsigned long) TEST_COUNT + 4, bad);
+	return bad ? 1 : 0;
+}
+#endif // #ifdef SIMPLIFY_TEST_MAIN
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,23 @@
+/**
+ * @file simplify.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Constant folding and algebraic simplification of expression trees.
+ */
+#ifndef _SIMPLIFY_H_
+#define _SIMPLIFY_H_
+
+#include "expression_lite.h" // just need pointer expression_t
+
+expression_t
+expression_simplify (expression_t exp);
+
+int
+expression_equal (expression_t a,
+                  expression_t b);
+
+#endif /* _SIMPLIFY_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
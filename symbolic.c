@@ -9,6 +9,8 @@
 #include "types.h"
 #include "errors.h"
 #include "symbolic.h"
+#include "token.h"
+#include "expression.h"
 
 /*---------------------------------------------*
  *               symbolic                      *
@@ -28,72 +30,73 @@ sym_new_name(char *name) {
 
 	///@todo Should probably check that the name contains valid chars (printable)
 	strncpy(sym.name, name, SYMBOLIC_NAME_SIZE);
+	sym.p = NULL;
 	return sym;
 }
 
-/** Create symbol from a string.
- * @param src_str_len The length of the actual buffer (not the number size).
+/** Create symbol from a string, reporting errors instead of exiting.
+ * @param src_str_len The length of the actual buffer (not the symbol size).
  * @param src_str The source string.
- * @return The symbol in the source string.
- * @note Must have first char be digit
- * @note Currently we only do Long Ints
+ * @param[out] sym Set to the symbol in the source string.
+ * @param[out] err Filled in with the error details, or cleared on success. May be NULL.
+ * @return EXP_OK or the error code
+ * @note Must have first char be alpha
  */
-sym_t
-string_to_sym (size_t src_str_len, char const *src_str) {
-	sym_t    sym;
-	pindex_t index = 0;
-    pindex_t index_tmp;           ///< Used to explore the presence of a symbol parameter
-
-    // default values
-    sym.name[0] = '\0';
-    sym.p = NULL;
-
-    // navigate over possible whitespace to next real character -- using a main index
-    for (; (index < src_str_len) && IS_WHITESPACE(src_str[index]); index++)
-    	;
-
-    // find end of symbol name -- using index_tmp
-    for (index_tmp = index; (index_tmp < src_str_len) && IS_ALNUM(src_str[index_tmp]); index_tmp++)
-    	;
-    // index_tmp should now be placed one past the symbol name
-
-    // check if the name will fit in the sym_t name
-    if ((index_tmp - index) >= SYMBOLIC_NAME_SIZE) {
-    	rerror("Symbol Error - Symbol name is too large");
-    }
-    // store the name
-    memcpy(sym.name, &src_str[index], (size_t)(index_tmp - index));
-    sym.name[(index_tmp - index)] = '\0';
-
-    // update index from the explorer temp index
-    index = index_tmp;
-
-    // navigate over possible whitespace to next real character -- using a index
-    for (; (index < src_str_len) && IS_WHITESPACE(src_str[index]); index++)
-    	;
-    // index should now be placed one past the symbol name or white space after symbol name
-
-    // check for presence of '(' signifying the start of a symbol parameter
-    if ( (index < src_str_len) && (src_str[index] == '(') ) {
-    	size_t end;
-
-//        pferror("string_to_expression","Symbol functions not currently supported");
+int
+string_to_sym_r (size_t src_str_len,
+                 char const *src_str,
+                 sym_t *sym,
+                 struct exp_error *err) {
+	struct token_list list;
+	expression_t exp;
+	int ret;
+
+	assert(sym);
+	sym->name[0] = '\0';
+	sym->p = NULL;
+
+	// let the lexer classify the chars and the parser handle any parameter
+	token_list_init(&list);
+	string_to_tokens(src_str_len, src_str, &list);
+	if (list.tokens[0].kind != TOK_SYMBOL) {
+		exp_error_clear(err);
+		ret = exp_error_set(err, EXP_ESYMBOL, list.tokens[0].offset, "Symbol Error - Symbol name must start with an alpha char");
+		token_list_free(&list);
+		return ret;
+	}
+	ret = tokens_to_expression_r(src_str, &list, &exp, err);
+	token_list_free(&list);
+	if (ret != EXP_OK) return ret;
 
-    	// find end of parameter string
-    	end = find_matching(src_str_len, src_str, index);
+	if (exp->type != EXP_SYMBOLIC) {
+		expression_free(exp);
+		return exp_error_set(err, EXP_ESYMBOL, 0, "Symbol Error - Expected a lone symbol");
+	}
 
-    	// check if the parameter string is not valid
-    	if (end == PINDEX_BAD) {
-    		rerror("Syntax Error - Unmatched parenthesis around symbol parameter");
-    	}
+	// take the symbol out of the expression shell
+	*sym = exp->data.sym;
+	exp->type = EXP_VALUE;
+	expression_free(exp);
 
-    	// parameter must be valid
+	return EXP_OK;
+}
 
-    	// store the parameter expression
-    	sym.p = string_to_expression((end+1) - index, &src_str[(end+1) - index]);
-    }
+/** Create symbol from a string.
+ * Same as @ref string_to_sym_r, but exits with a runtime error on bad syntax.
+ * @param src_str_len The length of the actual buffer (not the symbol size).
+ * @param src_str The source string.
+ * @return The symbol in the source string.
+ * @note Must have first char be alpha
+ */
+sym_t
+string_to_sym (size_t src_str_len, char const *src_str) {
+	sym_t sym;
+	struct exp_error err;
 
-    return sym;
+	if (string_to_sym_r(src_str_len, src_str, &sym, &err) != EXP_OK) {
+		rerror("%s", err.msg);
+	}
+	return sym;
 }
 
 /** Generate a string from a sym_t.
@@ -15,6 +15,7 @@
 #define _SYMBOLIC_H_
 
 #include <stddef.h> /* size_t */
+#include "errors.h"
 #include "expression_lite.h" // just need pointer expression_t
 
 #define SYMBOLIC_NAME_SIZE 10
@@ -37,6 +38,12 @@ sym_new_name(char *name);
 sym_t
 string_to_sym (size_t src_str_len, char const *src_str);
 
+int
+string_to_sym_r (size_t src_str_len,
+                 char const *src_str,
+                 sym_t *sym,
+                 struct exp_error *err);
+
 void
 sym_to_string(char *dst_str, sym_t src_sym);
 
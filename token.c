@@ -0,0 +1,285 @@
+/**
+ * @file token.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * The expression lexer.
+ */
+#include <stdlib.h> // realloc(), free(), malloc(), strtod()
+#include <string.h> // memcpy()
+#include "errors.h"
+#include "types.h"
+#include "scan.h"
+#include "token.h"
+
+/// Number of tokens to allocate the first time a list grows
+#define TOKEN_LIST_INIT_SIZE 16
+
+/** Initialize an empty token list.
+ * @param list The list to initialize.
+ */
+void
+token_list_init (struct token_list *list) {
+	assert(list);
+	list->tokens = NULL;
+	list->count  = 0;
+	list->size   = 0;
+}
+
+/** Free the tokens held by a list.
+ * The list is left empty and may be reused.
+ * @param list The list to free.
+ */
+void
+token_list_free (struct token_list *list) {
+	assert(list);
+	free(list->tokens);
+	token_list_init(list);
+}
+
+/** Append a new token to a list.
+ * @return The new token.
+ */
+static struct token *
+token_list_push (struct token_list *list,
+                 enum token_kind kind,
+                 pindex_t offset,
+                 pcount_t length) {
+	struct token *tok;
+
+	if (list->count == list->size) {
+		size_t size = list->size ? (list->size * 2) : TOKEN_LIST_INIT_SIZE;
+		list->tokens = (struct token *) realloc(list->tokens, size * sizeof(struct token));
+		assert(list->tokens); // throw error - token_list_push: realloc could not do allocation
+		list->size = size;
+	}
+
+	tok = &list->tokens[list->count++];
+	tok->kind   = kind;
+	tok->op     = '\0';
+	tok->offset = offset;
+	tok->length = length;
+	tok->val    = value_new_lint(0);
+	return tok;
+}
+
+/// Longest decimal number, in chars, that is converted without allocating
+#define TOKEN_NUMBER_LOCAL 64
+
+/** Scan a number.
+ * A whole number is digits only. A decimal number has a fraction, '.' followed by digits,
+ * an exponent, 'e' or 'E' followed by an optionally signed run of digits, or both.
+ * @param index Index of the number's first digit
+ * @param[out] val Set to the number's value, or a VAL_ERROR value for a whole number above SYS_INT_LONG_T_MAX
+ * @return Index just past the number
+ */
+static pindex_t
+token_number (size_t str_len,
+              char const *str,
+              pindex_t index,
+              value_t *val) {
+	pindex_t start = index;
+	pindex_t exp;
+	unsigned long lint = 0;
+	int decimal = 0, big = 0;
+
+	for (; (index < str_len) && IS_DIGIT(str[index]); index++) {
+		unsigned long digit = (unsigned long)(str[index] - '0');
+		// stop adding up once it is too large, rather than wrap
+		if (lint > ((unsigned long) SYS_INT_LONG_T_MAX - digit) / 10) big = 1;
+		if (!big) lint = (lint * 10) + digit;
+	}
+	if ((index + 1 < str_len) && (str[index] == '.') && IS_DIGIT(str[index + 1])) {
+		for (index++; (index < str_len) && IS_DIGIT(str[index]); index++)
+			;
+		decimal = 1;
+	}
+	if ((index < str_len) && ((str[index] == 'e') || (str[index] == 'E'))) {
+		exp = index + 1;
+		if ((exp < str_len) && ((str[exp] == '+') || (str[exp] == '-'))) exp++;
+		if ((exp < str_len) && IS_DIGIT(str[exp])) {
+			for (index = exp; (index < str_len) && IS_DIGIT(str[index]); index++)
+				;
+			decimal = 1;
+		}
+	}
+
+	if (!decimal) {
+		*val = big ? value_new_type(VAL_ERROR) : value_new_lint((sys_int_long) lint);
+	} else {
+		// strtod needs a terminated copy
+		char local[TOKEN_NUMBER_LOCAL];
+		char *buf = local;
+		size_t len = index - start;
+
+		if (len >= TOKEN_NUMBER_LOCAL) {
+			buf = (char *) malloc(len + 1);
+			assert(buf); // throw error - token_number: malloc could not do allocation
+		}
+		memcpy(buf, &str[start], len);
+		buf[len] = '\0';
+		*val = value_new_double(strtod(buf, NULL));
+		if (buf != local) free(buf);
+	}
+	return index;
+}
+
+/** Scan a string into tokens.
+ * @param lines When set, each '\n' ends a line with a TOK_END token and '\r' is whitespace.
+ * @return The number of tokens, including the final TOK_END token.
+ */
+static size_t
+tokenize (size_t str_len,
+          char const *str,
+          struct token_list *list,
+          int lines) {
+	pindex_t index = 0;
+
+	assert(str || (str_len == 0));
+	assert(list);
+	list->count = 0;
+
+	while (index < str_len) {
+		char c = str[index];
+		pindex_t start = index;
+
+		switch (c) {
+
+		/* Parentheses */
+		case '(':
+			token_list_push(list, TOK_OPEN, index++, 1);
+			break;
+		case ')':
+			token_list_push(list, TOK_CLOSE, index++, 1);
+			break;
+
+		/* Operation chars, and the comma between symbol arguments */
+		case '+':
+		case '-':
+		case '*':
+		case '/':
+		case ',':
+			token_list_push(list, TOK_OP, index++, 1)->op = c;
+			break;
+
+		/* Comparisons, logical operations and selects -- see @ref token for their op chars */
+		case '<':
+		case '>':
+			if ((index + 1 < str_len) && (str[index + 1] == '=')) {
+				token_list_push(list, TOK_OP, index, 2)->op = (c == '<') ? 'L' : 'G';
+				index += 2;
+				break;
+			}
+			token_list_push(list, TOK_OP, index++, 1)->op = c;
+			break;
+		case '=':
+		case '!':
+			if ((index + 1 < str_len) && (str[index + 1] == '=')) {
+				token_list_push(list, TOK_OP, index, 2)->op = c;
+				index += 2;
+				break;
+			}
+			/* A lone '=' or '!' -- left for the parser to report */
+			token_list_push(list, TOK_ERROR, index++, 1);
+			break;
+		case '&':
+		case '|':
+			if ((index + 1 < str_len) && (str[index + 1] == c)) {
+				token_list_push(list, TOK_OP, index, 2)->op = c;
+				index += 2;
+				break;
+			}
+			/* A lone '&' or '|' -- left for the parser to report */
+			token_list_push(list, TOK_ERROR, index++, 1);
+			break;
+		case '?':
+		case ':':
+			token_list_push(list, TOK_OP, index++, 1)->op = c;
+			break;
+
+		/* White space chars */
+		case ' ':
+		case '\t':
+			/* Ignore - Continue Past */
+			index++;
+			break;
+
+		/* End of line chars */
+		case '\n':
+			if (lines) {
+				token_list_push(list, TOK_END, index++, 1);
+				break;
+			}
+			/* Encountered end of string char -- left for the parser to report */
+			token_list_push(list, TOK_ERROR, index++, 1);
+			break;
+		case '\r':
+			if (lines) {
+				/* Ignore - Part of a CRLF line ending */
+				index++;
+				break;
+			}
+			/* Encountered end of string char -- left for the parser to report */
+			token_list_push(list, TOK_ERROR, index++, 1);
+			break;
+
+		default:
+			// if we encounter the start of a number -- value is accumulated as we go
+			if (IS_DIGIT(c)) {
+				value_t val;
+				index = token_number(str_len, str, index, &val);
+				token_list_push(list, TOK_NUMBER, start, index - start)->val = val;
+			}
+			// if we encounter the start of a symbol name - looks for alpha char
+			else if (IS_ALPHA(c)) {
+				index = scan_alnum_end(str_len, str, index + 1);
+				token_list_push(list, TOK_SYMBOL, start, index - start);
+			}
+			else {
+				// Unknown character encountered -- left for the parser to report
+				token_list_push(list, TOK_ERROR, index++, 1);
+			}
+			break;
+
+		} // switch() end
+	}
+
+	token_list_push(list, TOK_END, str_len, 0);
+	return list->count;
+}
+
+/** Convert a String to Tokens.
+ * Scans the string once from left to right, classifying every char.
+ * Whitespace is skipped and does not produce tokens.
+ * Chars that cannot start a token become TOK_ERROR tokens, so scanning never fails.
+ * @param str_len Length of given string
+ * @param str String to scan
+ * @param list List to fill. Any previous tokens in the list are discarded.
+ * @return The number of tokens, including the final TOK_END token.
+ */
+size_t
+string_to_tokens (size_t str_len,
+                  char const *str,
+                  struct token_list *list) {
+	return tokenize(str_len, str, list, 0);
+}
+
+/** Convert a multi-line String to Tokens.
+ * Same as @ref string_to_tokens, but each line is ended by its own TOK_END token,
+ * so the tokens of each line form a token array of their own.
+ * Blank lines produce a lone TOK_END token.
+ * A '\r' is treated as whitespace, which allows CRLF line endings.
+ * @param str_len Length of given string
+ * @param str String to scan
+ * @param list List to fill. Any previous tokens in the list are discarded.
+ * @return The number of tokens, including the final TOK_END token.
+ */
+size_t
+string_to_line_tokens (size_t str_len,
+                       char const *str,
+                       struct token_list *list) {
+	return tokenize(str_len, str, list, 1);
+}
+
+/* vim: set ts=4 sw=4 expandtab: */
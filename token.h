@@ -0,0 +1,72 @@
+/**
+ * @file token.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * The expression lexer.
+ * Turns an expression string into an array of tokens that the parser consumes.
+ * Every char of the string is classified exactly once, and token arrays can be
+ * kept around to parse the same string again without rescanning it.
+ */
+#ifndef _TOKEN_H_
+#define _TOKEN_H_
+
+#include <stddef.h> /* size_t */
+#include "types.h"
+
+/**
+ * Token kind selector.
+ */
+enum token_kind {
+	TOK_END,    ///< End of the token array. Always the last token.
+	TOK_NUMBER, ///< Whole or decimal number. The value is pre-parsed into val.
+	TOK_SYMBOL, ///< Symbol name.
+	TOK_OPEN,   ///< Open paren '('
+	TOK_CLOSE,  ///< Close paren ')'
+	TOK_OP,     ///< Binary operation, the ',' between symbol arguments, or the '?' and ':' of a select. The operation char is in op.
+	TOK_ERROR   ///< A char that cannot start a token, such as '#' or an early '\0'.
+};
+
+/**
+ * A single token and where it came from in the source string.
+ * The two char operations get an op char of their own: 'L' for "<=", 'G' for ">=",
+ * '=' for "==", '!' for "!=", '&' for "&&" and '|' for "||".
+ */
+struct token {
+	enum token_kind kind;  ///< The token's kind
+	char            op;    ///< Operation char for TOK_OP
+	pindex_t        offset; ///< Index of the token's first char in the source string
+	pcount_t        length; ///< Number of source chars in the token
+	value_t         val;   ///< Value of a TOK_NUMBER, a VAL_LINT or VAL_DOUBLE, or VAL_ERROR if a whole number is too large
+};
+
+/**
+ * A growable array of tokens.
+ * The array is always terminated by a TOK_END token once filled by @ref string_to_tokens.
+ */
+struct token_list {
+	struct token *tokens; ///< Token array
+	size_t        count;  ///< Number of tokens, including the TOK_END token
+	size_t        size;   ///< Number of allocated tokens
+};
+
+void
+token_list_init (struct token_list *list);
+
+void
+token_list_free (struct token_list *list);
+
+size_t
+string_to_tokens (size_t str_len,
+                  char const *str,
+                  struct token_list *list);
+
+size_t
+string_to_line_tokens (size_t str_len,
+                       char const *str,
+                       struct token_list *list);
+
+#endif /* _TOKEN_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,184 @@
+/**
+ * @file traverse.c
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Non-recursive traversal of expression trees.
+ *
+ * Each frame on the walk's stack records how far through its node the walk is.
+ * Children are pushed only when the walk reaches them, which lets a caller skip
+ * them after entering a node.
+ */
+#include <stdlib.h> // malloc(), realloc(), free()
+#include <string.h> // memcpy()
+#include "errors.h"
+#include "types.h"
+#include "expression.h"
+#include "traverse.h"
+
+/* Frame states, in the order a node goes through them */
+#define WALK_START   0 ///< Not entered yet
+#define WALK_FIRST   1 ///< Entered, first child not started
+#define WALK_BETWEEN 2 ///< First child done
+#define WALK_SECOND  3 ///< Between visited, second child not started
+#define WALK_DONE    4 ///< Children done, leave next
+
+/** Start a walk.
+ * @param w The walk to start. Free it with @ref exp_walk_free when done.
+ * @param root The expression to walk.
+ */
+void
+exp_walk_init (struct exp_walk *w,
+               expression_t root) {
+	assert(w);
+	assert(root);
+	w->stack = w->local;
+	w->size  = EXP_WALK_LOCAL;
+	w->stack[0].exp   = root;
+	w->stack[0].state = WALK_START;
+	w->depth = 1;
+}
+
+/* Push a node that has not been entered yet */
+static void
+walk_push (struct exp_walk *w, expression_t exp) {
+	if (w->depth == w->size) {
+		size_t size = w->size * 2;
+		if (w->stack == w->local) {
+			w->stack = (struct exp_walk_frame *) malloc(size * sizeof(struct exp_walk_frame));
+			assert(w->stack); // throw error - walk_push: malloc could not do allocation
+			memcpy(w->stack, w->local, w->depth * sizeof(struct exp_walk_frame));
+		} else {
+			w->stack = (struct exp_walk_frame *) realloc(w->stack, size * sizeof(struct exp_walk_frame));
+			assert(w->stack); // throw error - walk_push: realloc could not do allocation
+		}
+		w->size = size;
+	}
+	w->stack[w->depth].exp   = exp;
+	w->stack[w->depth].state = WALK_START;
+	w->depth++;
+}
+
+/** Step a walk to the next visit.
+ * The node from a leave event may be freed before the next step,
+ * since the walk does not look at a node again once it has been left.
+ * @param[out] exp Set to the visited node.
+ * @param[out] event Set to the kind of visit.
+ * @return Non-zero if there was a visit, zero once the walk is over.
+ */
+int
+exp_walk_next (struct exp_walk *w,
+               expression_t *exp,
+               enum exp_walk_event *event) {
+	while (w->depth) {
+		struct exp_walk_frame *f = &w->stack[w->depth - 1];
+		expression_t node = f->exp;
+
+		switch (f->state) {
+		case WALK_START:
+			f->state = WALK_FIRST;
+			*exp   = node;
+			*event = EXP_WALK_ENTER;
+			return 1;
+
+		case WALK_FIRST:
+			f->state = WALK_BETWEEN;
+			if (node->type == EXP_TREE) {
+				walk_push(w, node->data.tree.left);
+			} else if ((node->type == EXP_SYMBOLIC) && node->data.sym.p) {
+				walk_push(w, node->data.sym.p);
+			} else {
+				f->state = WALK_DONE;
+			}
+			break;
+
+		case WALK_BETWEEN:
+			if (node->type == EXP_TREE) {
+				f->state = WALK_SECOND;
+				*exp   = node;
+				*event = EXP_WALK_BETWEEN;
+				return 1;
+			}
+			f->state = WALK_DONE;
+			break;
+
+		case WALK_SECOND:
+			f->state = WALK_DONE;
+			walk_push(w, node->data.tree.right);
+			break;
+
+		default: // WALK_DONE
+			w->depth--;
+			*exp   = node;
+			*event = EXP_WALK_LEAVE;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/** Skip the children of the node just entered.
+ * The next visit is the node's leave event.
+ */
+void
+exp_walk_skip (struct exp_walk *w) {
+	assert(w->depth);
+	assert(w->stack[w->depth - 1].state == WALK_FIRST); // throw error - exp_walk_skip: only valid right after enter
+	w->stack[w->depth - 1].state = WALK_DONE;
+}
+
+/** Step a walk to the next node in post-order.
+ * @return The next node after all of its children, or NULL once the walk is over.
+ */
+expression_t
+exp_walk_next_post (struct exp_walk *w) {
+	expression_t exp;
+	enum exp_walk_event event;
+
+	while (exp_walk_next(w, &exp, &event)) {
+		if (event == EXP_WALK_LEAVE) return exp;
+	}
+	return NULL;
+}
+
+/** Release the memory held by a walk.
+ */
+void
+exp_walk_free (struct exp_walk *w) {
+	if (w->stack != w->local) free(w->stack);
+	w->stack = w->local;
+	w->depth = 0;
+}
+
+/** Walk an expression, calling a visitor function for every visit.
+ * @param exp The expression to walk.
+ * @param fn The visitor. Its result can skip a node's children or stop the walk.
+ * @param ctx Passed to fn.
+ * @return Non-zero if fn stopped the walk.
+ */
+int
+expression_visit (expression_t exp,
+                  exp_visit_fn fn,
+                  void *ctx) {
+	struct exp_walk w;
+	enum exp_walk_event event;
+	expression_t node;
+	int stopped = 0;
+
+	exp_walk_init(&w, exp);
+	while (exp_walk_next(&w, &node, &event)) {
+		enum exp_visit_result r = fn(node, event, ctx);
+		if (r == EXP_VISIT_STOP) {
+			stopped = 1;
+			break;
+		}
+		if ((r == EXP_VISIT_SKIP) && (event == EXP_WALK_ENTER)) {
+			exp_walk_skip(&w);
+		}
+	}
+	exp_walk_free(&w);
+	return stopped;
+}
+
+/* vim: set ts=4 sw=4 expandtab: */
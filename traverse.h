@@ -0,0 +1,87 @@
+/**
+ * @file traverse.h
+ *
+ * @date Oct 18, 2026
+ * @author Craig Hesling
+ *
+ * Non-recursive traversal of expression trees.
+ * The walk keeps its own stack on the heap, so any depth of tree can be walked
+ * without using the C stack.
+ */
+#ifndef _TRAVERSE_H_
+#define _TRAVERSE_H_
+
+#include <stddef.h> /* size_t */
+#include "expression_lite.h" // just need pointer expression_t
+
+/// Frames kept inside struct exp_walk before the stack moves to the heap
+#define EXP_WALK_LOCAL 32
+
+/**
+ * Points at which a walk visits a node.
+ * Every node is entered and left once. Tree nodes are also visited between their two children.
+ * A symbol's parameter is its only child.
+ */
+enum exp_walk_event {
+	EXP_WALK_ENTER,   ///< Before the node's children
+	EXP_WALK_BETWEEN, ///< After a tree's left child and before its right child
+	EXP_WALK_LEAVE    ///< After the node's children
+};
+
+/**
+ * A node being walked and how far through it the walk is.
+ */
+struct exp_walk_frame {
+	expression_t exp;   ///< The node
+	unsigned     state; ///< Next step for the node
+};
+
+/**
+ * State of a walk.
+ * Holds a pointer into itself, so it must not be copied once started.
+ */
+struct exp_walk {
+	struct exp_walk_frame *stack; ///< Nodes from the root down to the current node
+	size_t                 depth; ///< Number of frames in stack
+	size_t                 size;  ///< Number of frames stack can hold
+	struct exp_walk_frame  local[EXP_WALK_LOCAL]; ///< Starting stack
+};
+
+/**
+ * What a visitor function wants the walk to do next.
+ */
+enum exp_visit_result {
+	EXP_VISIT_CONTINUE, ///< Keep going
+	EXP_VISIT_SKIP,     ///< On enter, do not walk the node's children. It is still left.
+	EXP_VISIT_STOP      ///< End the walk
+};
+
+/** Called for each visit of a node by @ref expression_visit. */
+typedef enum exp_visit_result (*exp_visit_fn)(expression_t exp, enum exp_walk_event event, void *ctx);
+
+void
+exp_walk_init (struct exp_walk *w,
+               expression_t root);
+
+int
+exp_walk_next (struct exp_walk *w,
+               expression_t *exp,
+               enum exp_walk_event *event);
+
+void
+exp_walk_skip (struct exp_walk *w);
+
+expression_t
+exp_walk_next_post (struct exp_walk *w);
+
+void
+exp_walk_free (struct exp_walk *w);
+
+int
+expression_visit (expression_t exp,
+                  exp_visit_fn fn,
+                  void *ctx);
+
+#endif /* _TRAVERSE_H_ */
+
+/* vim: set ts=4 sw=4 expandtab: */
@@ -9,7 +9,8 @@
  */
 #include <stdio.h> /* snprintf() */
 #include <stddef.h> /* size_t */
-#include <stdlib.h> /* atol() */
+#include <stdlib.h> /* atol(), strtod() */
+#include <string.h> /* strspn(), strcat(), memcmp(), memcpy() */
 #include "errors.h"
 #include "expression.h" // used in sym_t
 #include "types.h"
@@ -23,6 +24,7 @@ value_t
 value_new_type(enum value_types type) {
 	value_t val;
 	val.type = type;
+	val.data.lint = 0;
 	return val;
 }
 
@@ -35,6 +37,47 @@ value_new_lint(sys_int_long lint) {
 }
 
 
+value_t
+value_new_double(double dbl) {
+	value_t val;
+	val.type = VAL_DOUBLE;
+	val.data.dbl = dbl;
+	return val;
+}
+
+/** Compare two values for the same type and data.
+ * Doubles compare by their bits, so 0.0 and -0.0 differ and a NaN equals itself.
+ * @return Non-zero if a and b are the same value
+ */
+int
+value_equal(value_t a, value_t b) {
+	if (a.type != b.type) return 0;
+	switch (a.type) {
+	case VAL_LINT:   return a.data.lint == b.data.lint;
+	case VAL_DOUBLE: return memcmp(&a.data.dbl, &b.data.dbl, sizeof(double)) == 0;
+	default:         return 1;
+	}
+}
+
+/** The data of a value as bits, for hashing.
+ * Values that are @ref value_equal have the same bits.
+ */
+unsigned long
+value_bits(value_t val) {
+	unsigned long bits = 0;
+	switch (val.type) {
+	case VAL_LINT:
+		bits = (unsigned long) val.data.lint;
+		break;
+	case VAL_DOUBLE:
+		memcpy(&bits, &val.data.dbl, (sizeof(bits) < sizeof(double)) ? sizeof(bits) : sizeof(double));
+		break;
+	default:
+		break;
+	}
+	return bits;
+}
+
 /** Create value from a string.
  * @param src_str_len The length of the actual buffer (not the number size).
  * @param src_str The source string.
@@ -81,49 +124,22 @@ value_to_string (char *dst_str, value_t src_val) {
 		//lint_to_string(dst_str, src_val.data.lint);
 		snprintf(dst_str, SYS_INT_LONG_T_STR_SIZE + 1, "%ld", src_val.data.lint);
 		break;
+	case VAL_DOUBLE:
+		// shortest of the usual precisions that reads back the same
+		snprintf(dst_str, SYS_DOUBLE_STR_SIZE + 1, "%.15g", src_val.data.dbl);
+		if (strtod(dst_str, NULL) != src_val.data.dbl) {
+			snprintf(dst_str, SYS_DOUBLE_STR_SIZE + 1, "%.16g", src_val.data.dbl);
+		}
+		if (strtod(dst_str, NULL) != src_val.data.dbl) {
+			snprintf(dst_str, SYS_DOUBLE_STR_SIZE + 1, "%.17g", src_val.data.dbl);
+		}
+		// keep a point, so it reads back as a double
+		if (dst_str[strspn(dst_str, "-0123456789")] == '\0') strcat(dst_str, ".0");
+		break;
 	default:
 		assert(0); ///< @warning Unknown types of @ref value_t will just assert(false) here.
 		break;
 	}
 }
 
-/*---------------------------------------------*
- *                 misc                        *
- *---------------------------------------------*/
-
-/**
- * Find the index of the matching closing paren in a string.
- * @param str_len Overall string length.
- * @param str String to search in.
- * @param start Index of the open paren to match.
- * @return The index of the matching paren or PINDEX_BAD if no match was found.
- * @note Assumes start is the index of the open paren to match and then moves forward.
- */
-pindex_t
-find_matching (size_t str_len,
-               const char *str,
-               pindex_t start) {
-	pcount_t level;
-
-	// Increment the index past the initial open paren
-	if( (++start) >= str_len ) return PINDEX_BAD;
-	// Stepped up a level
-	level = 1;
-
-	// parse only for parens and stop when level returns to 0
-    for (;(start < str_len) && (level > 0);start++) {
-        assert(str[start] != '\0');
-
-        // modify level for parens
-        if (str[start] == '(') level++;
-        else if (str[start] == ')') level--;
-
-        // when level is 0, we found the matching paren
-        if (level == 0) return start;
-    }
-
-    // If we didn't find level 0 above, then we ran out of characters to scan
-    return PINDEX_BAD;
-}
-
 /* vim: set ts=4 sw=4 expandtab: */
@@ -21,8 +21,16 @@
 typedef int long sys_int_long;
 #define SYS_INT_LONG_T_MIN LONG_MIN
 #define SYS_INT_LONG_T_MAX LONG_MAX
-/// The length in chars for a long int string. 4 byte long - @f$ {\tt ceiling} \left( {\tt log10}(2^{4 \times 8 - 1}) \right) + 1@f$
-#define SYS_INT_LONG_T_STR_SIZE 11
+/** Long int l / r that never traps, for a vector of rows whose faults are found apart.
+ * A divisor of 0 is taken as 1, and SYS_INT_LONG_T_MIN / -1 wraps to SYS_INT_LONG_T_MIN.
+ * The value is only a stand-in. A division that would trap is an error, see @ref BC_DIV_FAULT.
+ * \note Evaluates l and r more than once.
+ */
+#define SYS_INT_LONG_DIV(l, r) ( (l) / ((r) + ((r) == 0) + 2 * (((r) == -1) & ((l) == SYS_INT_LONG_T_MIN))) )
+/// The length in chars for a long int string. 8 byte long - @f$ {\tt ceiling} \left( {\tt log10}(2^{8 \times 8 - 1}) \right) + 1@f$
+#define SYS_INT_LONG_T_STR_SIZE 20
+/// The length in chars for a double string. Sign, 17 significant digits, point, and a 3 digit exponent - "-1.2345678901234567e-308"
+#define SYS_DOUBLE_STR_SIZE 24
 
 #define SIZE_T_MAX ( ~( (size_t) (0) ) )
 #define PINDEX_MAX SIZE_T_MAX ///< The max value of pindex_t
@@ -47,7 +55,8 @@ enum value_types {
 	VAL_ERROR,
 	VAL_UNDEF,
 	VAL_INF,
-	VAL_LINT
+	VAL_LINT,
+	VAL_DOUBLE
 };
 
 /**
@@ -55,6 +64,7 @@ enum value_types {
  */
 union value_data {
 	sys_int_long lint;
+	double       dbl;
 };
  
 /** Represents a numeric value or an error.
@@ -67,6 +77,9 @@ struct value {
 };
 typedef struct value value_t;
 
+/// True if a value is a number rather than an error or undefined
+#define VAL_IS_NUMBER(val) ( ((val).type == VAL_LINT) || ((val).type == VAL_DOUBLE) )
+
 value_t
 value_new_type(enum value_types type);
 
@@ -74,20 +87,19 @@ value_t
 value_new_lint(sys_int_long lint);
 
 value_t
-string_to_value(size_t src_str_len, char const *src_str);
+value_new_double(double dbl);
 
-void
-value_to_string (char *dst_str, value_t src_val);
+int
+value_equal(value_t a, value_t b);
 
+unsigned long
+value_bits(value_t val);
 
-/*---------------------------------------------*
- *                 misc                        *
- *---------------------------------------------*/
+value_t
+string_to_value(size_t src_str_len, char const *src_str);
 
-pindex_t
-find_matching (size_t str_len,
-               const char *str,
-               pindex_t start);
+void
+value_to_string (char *dst_str, value_t src_val);
 
 #endif /* TYPES_H_INCLUDED */
 
@@ -28,6 +28,33 @@ static int ws_last = -1;
 #define WS_LAST_SET(x)   ws_last = ((x) > ws_last) ?(x):ws_last
 #define WS_LAST_UNSET(x) ws_last = ((x) == ws_last)?(ws_last-1):ws_last
 
+/*
+ * Generation counter
+ * Bumped on every change to the workspace, so saved entry indices and data can be
+ * checked for staleness with one compare. Starts at 1 so 0 can mean "never looked up".
+ */
+static unsigned long ws_generation = 1;
+
+/*
+ * Watchers
+ * Told about every change. They are not reset by workspace_init.
+ */
+static struct workspace_watcher {
+	workspace_watch_fn fn;
+	void *ctx;
+} WS_WATCHERS[WORKSPACE_WATCHERS];
+
+/* Tell every watcher that name changed */
+static void
+workspace_notify(char const *name) {
+	int i;
+	for (i = 0; i < WORKSPACE_WATCHERS; i++) {
+		if (WS_WATCHERS[i].fn) {
+			WS_WATCHERS[i].fn(name, WS_WATCHERS[i].ctx);
+		}
+	}
+}
+
 void
 workspace_init(void) {
 	int i;
@@ -35,6 +62,8 @@ workspace_init(void) {
 		WS_UNSET(i);
 	}
 	WS_LAST_RESET;
+	ws_generation++;
+	workspace_notify(NULL);
 }
 
 #define WS_NOTFOUND WORKSPACE_SIZE
@@ -56,7 +85,7 @@ workspace_find_name(char *name) {
 
 		// optimization - stop when the remaining are unset
 		if (windex > WS_LAST) {
-			windex = WORKSPACE_SIZE; // just get out of here (technically, windex would become WORKSPACE_SIZE+1 by the end)
+			break; // just get out of here
 		}
 
 		// name cannot match an unset workspace entry
@@ -133,6 +162,8 @@ workspace_set(char *name, void *data) {
 	strncpy(WS[windex].name, name, WORKSPACE_NAME_SIZE); // safe to copy because length was verified above
 	WS[windex].data = data;
 	WS_LAST_SET(windex);
+	ws_generation++;
+	workspace_notify(name);
 
 	return WORKSPACE_OK;
 }
@@ -144,6 +175,8 @@ workspace_unset(char *name) {
 	if(windex != WS_NOTFOUND) {
 		WS_UNSET(windex);
 		WS_LAST_UNSET(windex); // Optimization
+		ws_generation++;
+		workspace_notify(name);
 	}
 }
 
@@ -165,10 +198,86 @@ workspace_get(char *name) {
 	return WORKSPACE_NOTSET;
 }
 
+/**
+ * Find the entry index for a name.
+ * The index stays valid until @ref workspace_generation changes.
+ * @param name The name to find.
+ * @return The entry index or WORKSPACE_NOTFOUND if name is not set.
+ */
+int
+workspace_index(char *name) {
+	int windex;
+	assert(name);
+	assert(name[0] != '\0'); // name cannot be the UNSET indicator
+
+	windex = workspace_find_name(name);
+	return (windex == WS_NOTFOUND) ? WORKSPACE_NOTFOUND : windex;
+}
+
+/**
+ * Get the data of an entry by index.
+ * @param index An index from @ref workspace_index.
+ * @return The entry's data or WORKSPACE_NOTSET if the entry has been unset.
+ */
+void *
+workspace_get_index(int index) {
+	assert((0 <= index) && (index < WORKSPACE_SIZE));
+	if (WS_IS_UNSET(index)) {
+		return WORKSPACE_NOTSET;
+	}
+	return WS[index].data;
+}
+
+/**
+ * Current workspace generation.
+ * It changes whenever an entry is set or unset, or the workspace is reset.
+ * Anything looked up while it had an older value may be stale.
+ */
+unsigned long
+workspace_generation(void) {
+	return ws_generation;
+}
+
+/**
+ * Call a function after every workspace change.
+ * @param fn Called with the changed name and ctx.
+ * @param ctx Passed to fn.
+ * @return WORKSPACE_OK or WORKSPACE_FULL if there are already WORKSPACE_WATCHERS watchers.
+ */
+int
+workspace_watch(workspace_watch_fn fn, void *ctx) {
+	int i;
+	assert(fn);
+	for (i = 0; i < WORKSPACE_WATCHERS; i++) {
+		if (WS_WATCHERS[i].fn == NULL) {
+			WS_WATCHERS[i].fn  = fn;
+			WS_WATCHERS[i].ctx = ctx;
+			return WORKSPACE_OK;
+		}
+	}
+	return WORKSPACE_FULL;
+}
+
+/**
+ * Stop calling a function added with @ref workspace_watch.
+ */
+void
+workspace_unwatch(workspace_watch_fn fn, void *ctx) {
+	int i;
+	for (i = 0; i < WORKSPACE_WATCHERS; i++) {
+		if ((WS_WATCHERS[i].fn == fn) && (WS_WATCHERS[i].ctx == ctx)) {
+			WS_WATCHERS[i].fn  = NULL;
+			WS_WATCHERS[i].ctx = NULL;
+		}
+	}
+}
+
 #ifdef WORKSPACE_TEST_MAIN
 /*
  * Some simple tests for the workspace class.
  *
+ * make tests
+ * or
  * gcc -g -DDEBUG -DWORKSPACE_TEST_MAIN -o ws workspace.c
  * or
  * gcc -g -DDEBUG -DWORKSPACE_TEST_MAIN -o ws errors.c workspace.c
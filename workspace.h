@@ -13,9 +13,21 @@
 /// Indicates that a specified name has not been defined. For use in @ref workspace_get.
 #define WORKSPACE_NOTSET ((void *)(long)(-1))
 
+/// Indicates that a specified name has not been defined. For use in @ref workspace_index.
+#define WORKSPACE_NOTFOUND (-1)
+
+/// Number of functions that can watch the workspace at once
+#define WORKSPACE_WATCHERS 8
+
+/**
+ * Called after a workspace entry is set or unset.
+ * name is NULL when the whole workspace was reset by @ref workspace_init.
+ */
+typedef void (*workspace_watch_fn)(char const *name, void *ctx);
+
 /// Indicates that the @ref workspace_set operation was successful.
 #define WORKSPACE_OK   0
-/// Indicates that the @ref workspace_set operation failed because the the workspace is full.
+/// Indicates that the @ref workspace_set or @ref workspace_watch operation failed because the the workspace is full.
 #define WORKSPACE_FULL 1
 /// Indicates that the @ref workspace_set operation failed because the the name argument is invalid.
 #define WORKSPACE_NAME 2
@@ -36,6 +48,21 @@ workspace_unset(char *name);
 void *
 workspace_get(char *name);
 
+int
+workspace_index(char *name);
+
+void *
+workspace_get_index(int index);
+
+unsigned long
+workspace_generation(void);
+
+int
+workspace_watch(workspace_watch_fn fn, void *ctx);
+
+void
+workspace_unwatch(workspace_watch_fn fn, void *ctx);
+
 #endif /* _WORKSPACE_H_ */
 
 /* vim: set ts=4 sw=4 expandtab: */